@@ -34,6 +34,7 @@
 #include "CLIParser.h"
 #include "Tokenizer.h"
 #include <Logger.h>
+#include <VectorPool.h>
 #include <Globals.h>
 
 #include <GSMConfig.h>
@@ -117,6 +118,9 @@ void CommandLine::printStats(ostream& os)
 	// paging table size
 	os << "Paging table size: " << gBTS.pager().pagingEntryListSize() << endl;
 	os << "Transactions/TMSIs: " << gTransactionTable.size() << ',' << gTMSITable.size() << endl;
+	if (gRegistrar.running()) gRegistrar.dump(os);
+	gDCCHPool.dump(os);
+	if (gAccessGrant.running()) gAccessGrant.dump(os);
 	// 3122 timer current value (the number of seconds an MS should hold off the next RACH)
 	os << "T3122: " << gBTS.T3122() << " ms" << endl;
 }
@@ -144,6 +148,34 @@ int setlogfile(int argc, char** argv, ostream& os)
 }
 
 
+/** List the service threads with their roles and CPU time. */
+int threads(int argc, char** argv, ostream& os)
+{
+	if (argc!=1) return BAD_NUM_ARGS;
+	gThreadRegistry().dump(os);
+	return SUCCESS;
+}
+
+
+/** Report Vector storage pool counters. */
+int vectorPool(int argc, char** argv, ostream& os)
+{
+	if (argc!=1) return BAD_NUM_ARGS;
+	VectorPool::dump(os);
+	return SUCCESS;
+}
+
+
+/** Report the BTS clock and its timing statistics. */
+int clockStats(int argc, char** argv, ostream& os)
+{
+	if (argc!=1) return BAD_NUM_ARGS;
+	os << "frame " << gBTS.time() << endl;
+	gBTS.clock().dumpStats(os);
+	return SUCCESS;
+}
+
+
 /** Display system uptime and current GSM frame number. */
 int uptime(int argc, char** argv, ostream& os)
 {
@@ -456,15 +488,25 @@ int cellID(int argc, char** argv, ostream& os)
 int calls(int argc, char** argv, ostream& os)
 {
 	if (argc!=1) return BAD_NUM_ARGS;
-	Control::TransactionMap::const_iterator trans = gTransactionTable.begin();
-	int count = 0;
 	gTransactionTable.clearDeadEntries();
-	while (trans != gTransactionTable.end()) {
+	Control::TransactionMap table;
+	gTransactionTable.snapshot(table);
+	Control::TransactionMap::const_iterator trans = table.begin();
+	int count = 0;
+	while (trans != table.end()) {
 		os << trans->second << endl;
 		++trans;
 		count++;
 	}
 	os << endl << count << " transactions in table" << endl;
+	if (gCallReactor.running()) {
+		os << gCallReactor.calls() << " calls in reactor" << endl;
+		gCallReactor.dump(os);
+	}
+	if (gMediaRelay.running()) {
+		os << gMediaRelay.calls() << " streams in media relay" << endl;
+		gMediaRelay.dump(os);
+	}
 	return SUCCESS;
 }
 
@@ -482,8 +524,9 @@ int config(int argc, char** argv, ostream& os)
 	// one arg, pattern match and print
 	bool anything = false;
 	if (argc==2) {
-		StringMap::const_iterator p = gConfig.begin();
-		while (p != gConfig.end()) {
+		const StringMap& table = gConfig.snapshot();
+		StringMap::const_iterator p = table.begin();
+		while (p != table.end()) {
 			if (strstr(p->first.c_str(),argv[1])) {
 				os << p->first << ": " << p->second << endl;
 				anything = true;
@@ -695,7 +738,13 @@ void printChanInfo(const GSM::LogicalChannel* chan, ostream& os)
 
 int chans(int argc, char **argv, ostream& os)
 {
-	if (argc!=1) return BAD_NUM_ARGS;
+	if (argc>2) return BAD_NUM_ARGS;
+
+	if (argc==2) {
+		if (strcmp(argv[1],"alloc")!=0) return BAD_VALUE;
+		gBTS.dumpAllocators(os);
+		return SUCCESS;
+	}
 
 	os << "TN chan      transaction UPFER RSSI TXPWR TXTA DNLEV DNBER" << endl;
 	os << "TN type      id          pct    dB   dBm  sym   dBm   pct" << endl;
@@ -877,6 +926,9 @@ Parser::Parser()
 	// The constructor adds the commands.
 	addCommand("setlogfile", setlogfile, "<path> -- set the logging file to <path>.");
 	addCommand("uptime", uptime, "-- show BTS uptime and BTS frame number.");
+	addCommand("clock", clockStats, "-- show BTS frame number, clock drift and wake lateness.");
+	addCommand("threads", threads, "-- list service threads with their roles, CPU time and CPU policies.");
+	addCommand("pool", vectorPool, "-- show burst and frame storage pool counters; mallocs should stay flat under steady load.");
 	addCommand("help", showHelp, "[command] -- list available commands or gets help on a specific command.");
 	addCommand("exit", exit_function, "[wait] -- exit the application, either immediately, or waiting for existing calls to clear with a timeout in seconds");
 	addCommand("tmsis", tmsis, "[\"clear\"] or [\"dump\" filename] -- print/clear the TMSI table or dump it to a file.");
@@ -896,7 +948,7 @@ Parser::Parser()
 	addCommand("version", version,"-- print the version string");
 	addCommand("page", page, "[IMSI time] -- dump the paging table or page the given IMSI for the given period");
 	addCommand("testcall", testcall, "IMSI time -- initiate a test call to a given IMSI with a given paging time");
-	addCommand("chans", chans, "-- report PHY status for active channels");
+	addCommand("chans", chans, "[\"alloc\"] -- report PHY status for active channels, or the free lists of the channel allocators");
 	addCommand("power", power, "[minAtten maxAtten] -- report current attentuation or set min/max bounds");
         addCommand("rxgain", rxgain, "[newRxgain] -- get/set the RX gain in dB");
         addCommand("noise", noise, "-- report receive noise level in RSSI dB");
@@ -30,6 +30,14 @@
 
 using namespace std;
 
+
+ConfigurationTable::~ConfigurationTable()
+{
+	delete mTable;
+	for (RetiredList::iterator i=mRetired.begin(); i!=mRetired.end(); ++i) delete *i;
+}
+
+
 bool ConfigurationTable::readFile(const char* filename)
 {
 	ifstream configFile(filename);
@@ -37,6 +45,8 @@ bool ConfigurationTable::readFile(const char* filename)
 		cerr << "cannot open configuration file " << filename << endl;
 		return false;
 	}
+	mWriteLock.lock();
+	StringMap* newTable = new StringMap(*mTable);
 	while (configFile) {
 		string thisLine;
 		getline(configFile,thisLine);
@@ -50,32 +60,43 @@ bool ConfigurationTable::readFile(const char* filename)
 		if (thisLine[i]=='\0') continue;
 		// Catch directives
 		if (thisLine[i]=='$') {
-			processDirective(thisLine);
+			processDirective(thisLine,*newTable);
 			continue;
 		}
 		// Tokenize and put in the table.
 		string::size_type pos = thisLine.find_first_of(" ",i);
 		string key = thisLine.substr(i,pos);
 		if (pos==string::npos) {
-			mTable[key]="";
+			(*newTable)[key]="";
 			continue;
 		}
 		string value = thisLine.substr(pos+1);
-		mTable[key]=value;
+		(*newTable)[key]=value;
 	}
 	configFile.close();
+	// Find what changed, in either direction.
+	vector<string> changed;
+	for (StringMap::const_iterator n=newTable->begin(); n!=newTable->end(); ++n) {
+		StringMap::const_iterator o = mTable->find(n->first);
+		if (o==mTable->end() || o->second!=n->second) changed.push_back(n->first);
+	}
+	for (StringMap::const_iterator o=mTable->begin(); o!=mTable->end(); ++o) {
+		if (newTable->find(o->first)==newTable->end()) changed.push_back(o->first);
+	}
+	publish(newTable,changed);
+	mWriteLock.unlock();
 	return true;
 }
 
 
-void ConfigurationTable::processDirective(const string& thisLine)
+void ConfigurationTable::processDirective(const string& thisLine, const StringMap& table)
 {
 	string::size_type pos = thisLine.find_first_of(" ");
 	string key = thisLine.substr(pos+1);
 	string directive = thisLine.substr(1,pos-1);
 
 	if (directive=="static") {
-		if (!defines(key)) {
+		if (table.find(key)==table.end()) {
 			cerr << "non-existent key " << key << " cannot be static" << endl;
 			throw ConfigurationTableKeyNotFound(key);
 		}
@@ -93,27 +114,85 @@ void ConfigurationTable::processDirective(const string& thisLine)
 }
 
 
+void ConfigurationTable::publish(const StringMap* newTable, const vector<string>& changed)
+{
+	// Make sure the new map is complete before anyone can see it.
+	__sync_synchronize();
+	const StringMap* oldTable = mTable;
+	mTable = newTable;
+	mGeneration++;
+
+	// Retire the old snapshot.
+	// A reader may still be in it, so it is freed only with the table.
+	mRetired.push_back(oldTable);
+
+	// Tell the subscribers.  The lock is recursive, so they may write.
+	for (unsigned i=0; i<changed.size(); i++) {
+		for (SubscriberList::iterator s=mSubscribers.begin(); s!=mSubscribers.end(); ++s) {
+			(*s)->configurationChanged(changed[i]);
+		}
+	}
+}
+
+
+void ConfigurationTable::subscribe(ConfigurationSubscriber* subscriber)
+{
+	mWriteLock.lock();
+	mSubscribers.push_back(subscriber);
+	mWriteLock.unlock();
+}
+
+
+void ConfigurationTable::unsubscribe(ConfigurationSubscriber* subscriber)
+{
+	mWriteLock.lock();
+	mSubscribers.remove(subscriber);
+	mWriteLock.unlock();
+}
+
+
 
 bool ConfigurationTable::defines(const string& key) const
 {
-	StringMap::const_iterator where = mTable.find(key);
-	return (where!=mTable.end());
+	const StringMap* table = mTable;
+	StringMap::const_iterator where = table->find(key);
+	return (where!=table->end());
 }
 
 
 
 bool ConfigurationTable::isStatic(const string& key) const
 {
+	mWriteLock.lock();
 	StringBoolMap::const_iterator where = mStatic.find(key);
-	if (where==mStatic.end()) return false;
-	return where->second;
+	bool retVal = (where!=mStatic.end()) && where->second;
+	mWriteLock.unlock();
+	return retVal;
 }
 
 bool ConfigurationTable::isRequired(const string& key) const
 {
+	mWriteLock.lock();
 	StringBoolMap::const_iterator where = mOptional.find(key);
-	if (where==mOptional.end()) return true;
-	return !(where->second);
+	bool retVal = (where==mOptional.end()) || !(where->second);
+	mWriteLock.unlock();
+	return retVal;
+}
+
+
+void ConfigurationTable::makeStatic(const string& key)
+{
+	mWriteLock.lock();
+	mStatic[key] = true;
+	mWriteLock.unlock();
+}
+
+
+void ConfigurationTable::makeOptional(const string& key)
+{
+	mWriteLock.lock();
+	mOptional[key] = true;
+	mWriteLock.unlock();
 }
 
 
@@ -121,18 +200,17 @@ bool ConfigurationTable::isRequired(const string& key) const
 
 const char* ConfigurationTable::getStr(const string& key) const
 {
-	StringMap::const_iterator where = mTable.find(key);
-	if (where==mTable.end()) throw ConfigurationTableKeyNotFound(key);
+	const StringMap* table = mTable;
+	StringMap::const_iterator where = table->find(key);
+	if (where==table->end()) throw ConfigurationTableKeyNotFound(key);
 	return where->second.c_str();
 }
 
 
 std::vector<unsigned> ConfigurationTable::getVector(const string& key) const
 {
-	StringMap::const_iterator where = mTable.find(key);
-	if (where==mTable.end()) throw ConfigurationTableKeyNotFound(key);
 	// Make an alterable copy of the string.
-	char* line = strdup(where->second.c_str());
+	char* line = strdup(getStr(key));
 	std::vector<unsigned> retVal;
 	char *lp=line;
 	while (lp) {
@@ -146,19 +224,24 @@ std::vector<unsigned> ConfigurationTable::getVector(const string& key) const
 
 bool ConfigurationTable::unset(const string& key)
 {
-	if (isStatic(key)) return false;
-	if (isRequired(key)) return false;
-	StringMap::iterator where = mTable.find(key);
-	if (where==mTable.end()) return false;
-	mTable.erase(where);
-	return true;
+	mWriteLock.lock();
+	bool retVal = false;
+	if (!isStatic(key) && !isRequired(key) && mTable->find(key)!=mTable->end()) {
+		StringMap* newTable = new StringMap(*mTable);
+		newTable->erase(key);
+		publish(newTable,vector<string>(1,key));
+		retVal = true;
+	}
+	mWriteLock.unlock();
+	return retVal;
 }
 
 
 void ConfigurationTable::dump(ostream& os) const
 {
-	StringMap::const_iterator cfg = mTable.begin();
-	while (cfg != mTable.end()) {
+	const StringMap* table = mTable;
+	StringMap::const_iterator cfg = table->begin();
+	while (cfg != table->end()) {
 		os << cfg->first << " " << cfg->second << endl;
 		++cfg;
 	}
@@ -166,8 +249,9 @@ void ConfigurationTable::dump(ostream& os) const
 
 void ConfigurationTable::write(ostream& os) const
 {
-	StringMap::const_iterator cfg = mTable.begin();
-	while (cfg != mTable.end()) {
+	const StringMap* table = mTable;
+	StringMap::const_iterator cfg = table->begin();
+	while (cfg != table->end()) {
 		os << endl;
 		os << cfg->first << " " << cfg->second << endl;
 		if (isStatic(cfg->first)) os << "$static " << cfg->first << endl;
@@ -179,9 +263,16 @@ void ConfigurationTable::write(ostream& os) const
 
 bool ConfigurationTable::set(const string& key, const string& value)
 {
-	if (isStatic(key)) return false;
-	mTable[key]=value;
-	return true;
+	mWriteLock.lock();
+	bool retVal = false;
+	if (!isStatic(key)) {
+		StringMap* newTable = new StringMap(*mTable);
+		(*newTable)[key]=value;
+		publish(newTable,vector<string>(1,key));
+		retVal = true;
+	}
+	mWriteLock.unlock();
+	return retVal;
 }
 
 bool ConfigurationTable::set(const string& key, long value)
@@ -192,4 +283,20 @@ bool ConfigurationTable::set(const string& key, long value)
 }
 
 
+
+
+void ConfigurationHandle::refresh() const
+{
+	// Read the generation first, so a change during the parse
+	// just causes another parse next time.
+	const unsigned generation = mTable.generation();
+	const StringMap& table = mTable.snapshot();
+	StringMap::const_iterator where = table.find(mKey);
+	mDefined = (where!=table.end());
+	parse(mDefined ? where->second.c_str() : NULL);
+	__sync_synchronize();
+	mGeneration = generation+1;
+}
+
+
 // vim: ts=4 sw=4
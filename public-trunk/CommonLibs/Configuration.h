@@ -28,10 +28,13 @@
 
 #include <assert.h>
 #include <map>
+#include <list>
 #include <vector>
 #include <string>
 #include <stdlib.h>
+#include <time.h>
 #include <iostream>
+#include "Threads.h"
 
 
 /** A class for configuration file errors. */
@@ -57,20 +60,45 @@ typedef std::map<std::string,std::string> StringMap;
 typedef std::map<std::string,bool> StringBoolMap;
 
 
+/** Interface for objects that want to hear about configuration changes. */
+class ConfigurationSubscriber {
+
+	public:
+
+	virtual ~ConfigurationSubscriber() {}
+
+	/** Called after a new value of key is visible, or after key is removed. */
+	virtual void configurationChanged(const std::string& key) = 0;
+};
+
+
 /**
 	A class for reading a configuration key-value table
 	and storing it in a map.
-	This class is not thread safe.
-	The expectation is that the configuration table will be defined
-	once and then used as read-only the rest of the time.
+
+	Reads are lock-free.  The table is an immutable snapshot that writers
+	copy, modify and publish under a lock, read-copy-update style.
+	Replaced snapshots are kept until the table itself is destroyed,
+	since there is no telling when the last reader lets go of one.
+	So pointers from getStr() and snapshot() never dangle.  Writes are rare
+	operator actions, so the memory this holds stays small.
+
+	For values read on hot paths, use the typed handles below.
 */
 class ConfigurationTable {
 
 	private:
 
-	StringMap mTable;			///< The configuration table
+	typedef std::list<const StringMap*> RetiredList;
+	typedef std::list<ConfigurationSubscriber*> SubscriberList;
+
+	const StringMap* volatile mTable;	///< The current snapshot, never modified once published.
+	RetiredList mRetired;			///< Replaced snapshots, still visible to old readers.
+	SubscriberList mSubscribers;	///< Who to tell about changes.
+	mutable Mutex mWriteLock;		///< Serializes writers and protects everything but mTable.
 	StringBoolMap mStatic;		///< Flags to indicate static config values.
 	StringBoolMap mOptional;	///< Flags to indicate optional config values.
+	volatile unsigned mGeneration;	///< Bumped on every change to mTable.
 
 	// Static config values cannot be modified after initial file read.
 	// Required config values cannot be removed.
@@ -80,9 +108,18 @@ class ConfigurationTable {
 	bool readFile(const char* filename);
 
 	ConfigurationTable(const char* filename)
+		:mTable(new StringMap),mGeneration(0)
 		{ bool res = readFile(filename); assert(res); }
 
-	ConfigurationTable() {}
+	ConfigurationTable():mTable(new StringMap),mGeneration(0) {}
+
+	~ConfigurationTable();
+
+	/**
+		A counter that changes whenever the table does.
+		Callers can cache derived values and refresh them when this moves.
+	*/
+	unsigned generation() const { return mGeneration; }
 
 	/** Return true if the key is used in the table.  */
 	bool defines(const std::string& key) const;
@@ -91,13 +128,13 @@ class ConfigurationTable {
 	bool isStatic(const std::string& key) const;
 
 	/** Make a key static. */
-	void makeStatic(const std::string& key) { mStatic[key] = true; }
+	void makeStatic(const std::string& key);
 
 	/** Return true if this key is identified as required (!optional). */
 	bool isRequired(const std::string& key) const;
 
 	/** Make a key optional. */
-	void makeOptional(const std::string& key) { mOptional[key]=true; }
+	void makeOptional(const std::string& key);
 
 	/**
 		Get a string parameter from the table.
@@ -136,19 +173,154 @@ class ConfigurationTable {
 	/** Write the table to a stream, with directives. */
 	void write(std::ostream&) const;
 
-	/** Raw iterator. */
-	StringMap::const_iterator begin() const { return mTable.begin(); }
+	/**
+		A consistent view of the whole table, for iteration.
+		It stays valid for the life of the table.
+	*/
+	const StringMap& snapshot() const { return *mTable; }
 
-	/** End check. */
-	StringMap::const_iterator end() const { return mTable.end(); }
+	/**@name Change notification. */
+	//@{
+	void subscribe(ConfigurationSubscriber*);
+	void unsubscribe(ConfigurationSubscriber*);
+	//@}
 
 
 	private:
 
-	void processDirective(const std::string& line);
+	void processDirective(const std::string& line, const StringMap& table);
+
+	/**
+		Publish a new snapshot and notify subscribers.
+		Call with mWriteLock held.
+		@param newTable The new snapshot, now owned by the table.
+		@param changed The keys that differ from the old snapshot.
+	*/
+	void publish(const StringMap* newTable, const std::vector<std::string>& changed);
+
+	// The snapshots are not copyable.
+	ConfigurationTable(const ConfigurationTable&);
+	ConfigurationTable& operator=(const ConfigurationTable&);
+};
+
+
+
+/**
+	Base for typed handles on one configuration key.
+	A handle parses its value once per table change, so reading it
+	costs a couple of loads and compares.
+	Handles only hold a reference to the table, so they can be
+	static objects constructed before the table itself.
+*/
+class ConfigurationHandle {
+
+	protected:
+
+	const ConfigurationTable& mTable;
+	std::string mKey;
+	mutable volatile unsigned mGeneration;	///< table generation +1 at the last parse, 0 for never
+	mutable volatile bool mDefined;
+
+	public:
+
+	ConfigurationHandle(const ConfigurationTable& wTable, const char* wKey)
+		:mTable(wTable),mKey(wKey),mGeneration(0),mDefined(false)
+	{ }
+
+	virtual ~ConfigurationHandle() {}
+
+	const std::string& key() const { return mKey; }
+
+	/** Return true if the key is in the table. */
+	bool defined() const { check(); return mDefined; }
+
+	protected:
+
+	/** Parse again if the table has changed. */
+	void check() const
+		{ if (mGeneration!=mTable.generation()+1) refresh(); }
+
+	/** Parse the value, NULL if the key is not defined. */
+	virtual void parse(const char* value) const = 0;
+
+	private:
 
+	void refresh() const;
 };
 
+
+/** A numeric configuration value, with a default for undefined keys. */
+class ConfigurationNum : public ConfigurationHandle {
+
+	private:
+
+	long mDefault;
+	mutable volatile long mValue;
+
+	public:
+
+	ConfigurationNum(const ConfigurationTable& wTable, const char* wKey, long wDefault=0)
+		:ConfigurationHandle(wTable,wKey),mDefault(wDefault),mValue(wDefault)
+	{ }
+
+	long get() const { check(); return mValue; }
+
+	operator long() const { return get(); }
+
+	protected:
+
+	void parse(const char* value) const
+		{ mValue = value ? strtol(value,NULL,10) : mDefault; }
+};
+
+
+/**
+	A string configuration value.
+	The pointer has the same lifetime as one from ConfigurationTable::getStr.
+*/
+class ConfigurationStr : public ConfigurationHandle {
+
+	private:
+
+	const char* mDefault;
+	mutable const char* volatile mValue;
+
+	public:
+
+	ConfigurationStr(const ConfigurationTable& wTable, const char* wKey, const char* wDefault="")
+		:ConfigurationHandle(wTable,wKey),mDefault(wDefault),mValue(wDefault)
+	{ }
+
+	const char* get() const { check(); return mValue; }
+
+	operator const char*() const { return get(); }
+
+	protected:
+
+	void parse(const char* value) const
+		{ mValue = value ? value : mDefault; }
+};
+
+
+/** A flag that is set if its key is defined at all. */
+class ConfigurationFlag : public ConfigurationHandle {
+
+	public:
+
+	ConfigurationFlag(const ConfigurationTable& wTable, const char* wKey)
+		:ConfigurationHandle(wTable,wKey)
+	{ }
+
+	bool get() const { return defined(); }
+
+	operator bool() const { return defined(); }
+
+	protected:
+
+	void parse(const char*) const { }
+};
+
+
 #endif
 
 
@@ -25,11 +25,38 @@
 
 
 #include "Configuration.h"
+#include "Timeval.h"
 #include <iostream>
 
 using namespace std;
 
 
+/** Print every change. */
+class ChangePrinter : public ConfigurationSubscriber {
+	public:
+	void configurationChanged(const string& key) { cout << "changed " << key << endl; }
+};
+
+
+static ConfigurationTable* table;
+static volatile bool running = true;
+
+/** Read a handle and a raw key as fast as possible while the main thread writes. */
+void* reader(void* arg)
+{
+	ConfigurationNum key6(*table,"key6");
+	unsigned long count = 0;
+	long sum = 0;
+	while (running) {
+		sum += key6.get();
+		sum += table->defines("key3");
+		count++;
+	}
+	*(unsigned long*)arg = count;
+	return NULL;
+}
+
+
 int main(int argc, char *argv[])
 {
 
@@ -51,4 +78,36 @@ int main(int argc, char *argv[])
 	cout << "vect length " << vect.size() << ": ";
 	for (unsigned i=0; i<vect.size(); i++) cout << " " << vect[i];
 	cout << endl;
+
+	// Typed handles and change notification.
+	ConfigurationNum key2(config,"key2");
+	ConfigurationNum key6(config,"key6",-1);
+	ConfigurationFlag key4(config,"key4");
+	cout << "handles key2=" << key2.get() << " key4=" << key4.get() << " key6=" << key6.get() << endl;
+	ChangePrinter printer;
+	config.subscribe(&printer);
+	cout << "set static key2: " << config.set("key2",7) << endl;
+	config.set("key6",42);
+	cout << "handles key2=" << key2.get() << " key6=" << key6.get() << endl;
+	config.unsubscribe(&printer);
+
+	// Lock-free reads against a writer.
+	table = &config;
+	Thread threads[4];
+	unsigned long counts[4];
+	for (int i=0; i<4; i++) threads[i].start(reader,&counts[i]);
+	Timeval start;
+	for (int i=0; i<1000; i++) {
+		config.set("key6",i);
+		usleep(100);
+	}
+	running = false;
+	unsigned long total = 0;
+	for (int i=0; i<4; i++) {
+		threads[i].join();
+		total += counts[i];
+	}
+	long ms = start.elapsed();
+	cout << "4 readers, " << total << " reads during 1000 writes, " << (total/(ms?ms:1)) << " reads/ms" << endl;
+	cout << "final key6=" << key6.get() << endl;
 }
@@ -30,6 +30,7 @@
 #include "Threads.h"
 #include "LinkedLists.h"
 #include <map>
+#include <string>
 #include <vector>
 #include <queue>
 
@@ -41,6 +42,24 @@
 //@{
 
 
+/**
+	Told of each write to a queue, for readers that wait on
+	something other than the queue's own signal, like a reactor.
+*/
+class QueueListener {
+
+	public:
+
+	virtual ~QueueListener() {}
+
+	/**
+		Called after each write, with the queue lock held.
+		It must be quick and must not touch the queue.
+	*/
+	virtual void queueWritten() =0;
+};
+
+
 /** Pointer FIFO for interthread operations.  */
 template <class T> class InterthreadQueue {
 
@@ -49,10 +68,24 @@ template <class T> class InterthreadQueue {
 	PointerFIFO mQ;	
 	mutable Mutex mLock;
 	mutable Signal mWriteSignal;
+	QueueListener* mListener;	///< optional write listener, not owned
 
 
 	public:
 
+	InterthreadQueue():mListener(NULL) {}
+
+	/**
+		Set or clear the write listener.
+		Once this returns, the old listener will not be called again.
+	*/
+	void listener(QueueListener* wListener)
+	{
+		mLock.lock();
+		mListener = wListener;
+		mLock.unlock();
+	}
+
 	/** Delete contents. */
 	void clear()
 	{
@@ -126,6 +159,7 @@ template <class T> class InterthreadQueue {
 		mLock.lock();
 		mQ.put(val);
 		mWriteSignal.signal();
+		if (mListener) mListener->queueWritten();
 		mLock.unlock();
 	}
 
@@ -242,29 +276,422 @@ template <class T> class InterthreadQueueWithWait {
 
 
 
-/** Thread-safe map of pointers to class D, keyed by class K. */
-template <class K, class D > class InterthreadMap {
+/**
+	Bounded pointer FIFO for interthread operations,
+	with the interface of InterthreadQueue plus batch reads and writes.
+
+	Reads and writes are lock-free on a power-of-two ring of sequenced cells,
+	after Dmitry Vyukov's bounded multi-producer/multi-consumer queue.
+	The mutex is taken only to sleep on an empty or full ring,
+	and only when someone is actually sleeping.
+
+	The ring does not grow: write() blocks while it is full (back-pressure)
+	and writeNoBlock() refuses, and both are counted.
+*/
+template <class T> class InterthreadBoundedQueue {
+
+	protected:
+
+	/** One ring slot; mSeq says whose turn it is. */
+	struct Cell {
+		volatile size_t mSeq;
+		T* mData;
+	};
+
+	static const unsigned mLineSize = 64;	///< assumed cache line size
+
+	Cell* mRing;
+	size_t mMask;							///< ring size - 1
+	char mPad0[mLineSize];
+	volatile size_t mEnqueuePos;			///< next cell to write
+	char mPad1[mLineSize];
+	volatile size_t mDequeuePos;			///< next cell to read
+	char mPad2[mLineSize];
+
+	mutable Mutex mLock;					///< held only to sleep
+	mutable Signal mWriteSignal;			///< for readers waiting on an empty ring
+	mutable Signal mReadSignal;				///< for writers waiting on a full ring
+	volatile unsigned mReadWaiters;			///< readers asleep, changed under mLock
+	volatile unsigned mWriteWaiters;		///< writers asleep, changed under mLock
+
+	/**@name Statistics */
+	//@{
+	volatile unsigned mStalls;				///< writes that had to wait for space
+	volatile unsigned mOverflows;			///< writes refused on a full ring
+	volatile size_t mHighWater;				///< largest occupancy seen
+	//@}
+
+	/** Put a pointer in the ring, if there is room. */
+	bool tryPush(T* val)
+	{
+		size_t pos = mEnqueuePos;
+		Cell* cell;
+		while (true) {
+			cell = &mRing[pos & mMask];
+			// The compare-and-swap is a full barrier, so it orders
+			// this load before the access to mData.
+			size_t seq = cell->mSeq;
+			long dif = (long)(seq - pos);
+			if (dif==0) {
+				if (__sync_bool_compare_and_swap(&mEnqueuePos,pos,pos+1)) break;
+				pos = mEnqueuePos;
+			} else if (dif<0) return false;
+			else pos = mEnqueuePos;
+		}
+		cell->mData = val;
+		__sync_synchronize();
+		cell->mSeq = pos + 1;
+		size_t used = pos + 1 - mDequeuePos;
+		if (used<=mMask+1 && used>mHighWater) mHighWater = used;
+		return true;
+	}
+
+	/** Take a pointer from the ring, or NULL if it is empty. */
+	T* tryPop()
+	{
+		size_t pos = mDequeuePos;
+		Cell* cell;
+		while (true) {
+			cell = &mRing[pos & mMask];
+			size_t seq = cell->mSeq;
+			long dif = (long)(seq - (pos+1));
+			if (dif==0) {
+				if (__sync_bool_compare_and_swap(&mDequeuePos,pos,pos+1)) break;
+				pos = mDequeuePos;
+			} else if (dif<0) return NULL;
+			else pos = mDequeuePos;
+		}
+		T* retVal = cell->mData;
+		__sync_synchronize();
+		cell->mSeq = pos + mMask + 1;
+		return retVal;
+	}
+
+	/**
+		Wake sleepers on a signal, if there are any.
+		The barrier pairs with the one a sleeper makes after counting itself,
+		so either we see the sleeper or it sees our change to the ring.
+	*/
+	void wake(Signal& signal, volatile unsigned& waiters, bool all)
+	{
+		__sync_synchronize();
+		if (waiters==0) return;
+		mLock.lock();
+		if (all) signal.broadcast();
+		else signal.signal();
+		mLock.unlock();
+	}
+
+	/**
+		After a read, wake the writers blocked on a full ring,
+		but only once it has drained to half full, so that each
+		sleep buys the writer half a ring of work.
+	*/
+	void wakeWriters()
+	{
+		if (size() > (mMask+1)/2) return;
+		wake(mReadSignal,mWriteWaiters,true);
+	}
+
+	/** Block until val goes into the ring. */
+	void pushWait(T* val)
+	{
+		if (tryPush(val)) return;
+		// Let the readers drain before we sleep.
+		wake(mWriteSignal,mReadWaiters,true);
+		mLock.lock();
+		mStalls++;
+		mWriteWaiters++;
+		__sync_synchronize();
+		while (!tryPush(val)) mReadSignal.wait(mLock);
+		mWriteWaiters--;
+		mLock.unlock();
+	}
+
+	private:
+
+	InterthreadBoundedQueue(const InterthreadBoundedQueue&);
+	InterthreadBoundedQueue& operator=(const InterthreadBoundedQueue&);
+
+	public:
+
+	/**
+		Create a queue.
+		@param wCapacity The ring size, rounded up to a power of two.
+	*/
+	InterthreadBoundedQueue(size_t wCapacity=1024)
+		:mEnqueuePos(0),mDequeuePos(0),mReadWaiters(0),mWriteWaiters(0),
+		mStalls(0),mOverflows(0),mHighWater(0)
+	{
+		size_t size = 2;
+		while (size<wCapacity) size <<= 1;
+		mMask = size-1;
+		mRing = new Cell[size];
+		for (size_t i=0; i<size; i++) mRing[i].mSeq = i;
+	}
+
+	/** Delete contents. */
+	void clear()
+	{
+		while (T* val = tryPop()) delete val;
+		wake(mReadSignal,mWriteWaiters,true);
+	}
+
+	~InterthreadBoundedQueue()
+	{
+		clear();
+		delete[] mRing;
+	}
+
+	/** Approximate occupancy; exact when the queue is quiet. */
+	size_t size() const
+	{
+		size_t head = mDequeuePos;
+		size_t tail = mEnqueuePos;
+		return (tail>head) ? tail-head : 0;
+	}
+
+	size_t capacity() const { return mMask+1; }
+
+	/**@name Statistics */
+	//@{
+	unsigned stalls() const { return mStalls; }
+	unsigned overflows() const { return mOverflows; }
+	size_t highWater() const { return mHighWater; }
+	//@}
+
+	/**
+		Blocking read.
+		@return Pointer to object (will not be NULL).
+	*/
+	T* read()
+	{
+		T* retVal = tryPop();
+		if (retVal==NULL) {
+			mLock.lock();
+			mReadWaiters++;
+			__sync_synchronize();
+			while ((retVal=tryPop())==NULL) mWriteSignal.wait(mLock);
+			mReadWaiters--;
+			mLock.unlock();
+		}
+		wakeWriters();
+		return retVal;
+	}
+
+	/**
+		Blocking read with a timeout.
+		@param timeout The read timeout in ms.
+		@return Pointer to object or NULL on timeout.
+	*/
+	T* read(unsigned timeout)
+	{
+		if (timeout==0) return readNoBlock();
+		T* retVal = tryPop();
+		if (retVal==NULL) {
+			Timeval waitTime(timeout);
+			mLock.lock();
+			mReadWaiters++;
+			__sync_synchronize();
+			while (((retVal=tryPop())==NULL) && (!waitTime.passed())) {
+				long remaining = waitTime.remaining();
+				mWriteSignal.wait(mLock,remaining>0 ? remaining : 1);
+			}
+			mReadWaiters--;
+			mLock.unlock();
+			if (retVal==NULL) return NULL;
+		}
+		wakeWriters();
+		return retVal;
+	}
+
+	/**
+		Non-blocking read.
+		@return Pointer to object or NULL if FIFO is empty.
+	*/
+	T* readNoBlock()
+	{
+		T* retVal = tryPop();
+		if (retVal!=NULL) wakeWriters();
+		return retVal;
+	}
+
+	/**
+		Batch read.
+		Waits for the first object as read(timeout) does, then takes
+		whatever else is already queued, up to max.
+		@param out Array to receive the pointers.
+		@param max The size of out.
+		@param timeout The read timeout in ms, 0 for non-blocking.
+		@return The number of pointers read, 0 on timeout.
+	*/
+	unsigned readBatch(T** out, unsigned max, unsigned timeout)
+	{
+		if (max==0) return 0;
+		out[0] = read(timeout);
+		if (out[0]==NULL) return 0;
+		unsigned count = 1;
+		while (count<max && (out[count]=tryPop())!=NULL) count++;
+		if (count>1) wakeWriters();
+		return count;
+	}
+
+	/** Write, blocking while the ring is full. */
+	void write(T* val)
+	{
+		pushWait(val);
+		wake(mWriteSignal,mReadWaiters,false);
+	}
+
+	/**
+		Non-blocking write.
+		@return False, with val still owned by the caller, if the ring is full.
+	*/
+	bool writeNoBlock(T* val)
+	{
+		if (!tryPush(val)) {
+			__sync_fetch_and_add(&mOverflows,1);
+			return false;
+		}
+		wake(mWriteSignal,mReadWaiters,false);
+		return true;
+	}
+
+	/**
+		Batch write, blocking while the ring is full.
+		Sleeping readers are woken once, at the end.
+		@param vals The pointers to write.
+		@param count The number of pointers.
+	*/
+	void writeBatch(T* const* vals, unsigned count)
+	{
+		for (unsigned i=0; i<count; i++) pushWait(vals[i]);
+		if (count) wake(mWriteSignal,mReadWaiters,count>1);
+	}
+
+};
+
+
+
+
+/**@name Key hashing for InterthreadMap shards. */
+//@{
+/** Keys with no hash of their own all go in one shard. */
+template <class K> inline unsigned interthreadMapHash(const K&) { return 0; }
+inline unsigned interthreadMapHash(int key) { return (unsigned)key; }
+inline unsigned interthreadMapHash(unsigned key) { return key; }
+inline unsigned interthreadMapHash(long key) { return (unsigned)key; }
+inline unsigned interthreadMapHash(unsigned long key) { return (unsigned)key; }
+/** FNV-1a over the characters. */
+inline unsigned interthreadMapHash(const std::string& key)
+{
+	unsigned h = 2166136261U;
+	for (size_t i=0; i<key.size(); i++) {
+		h ^= (unsigned char)key[i];
+		h *= 16777619U;
+	}
+	return h;
+}
+//@}
+
+
+
+/**
+	Thread-safe map of pointers to class D, keyed by class K.
+	The map is split into SHARDS independently locked shards by key hash,
+	and a thread blocked on a key waits on a signal for that key alone,
+	so a write wakes only the threads waiting for the key written.
+*/
+template <class K, class D, unsigned SHARDS=16 > class InterthreadMap {
 
 protected:
 
 	typedef std::map<K,D*> Map;
-	Map mMap;
-	mutable Mutex mLock;
-	Signal mWriteSignal;
+
+	/** The slot shared by the threads blocked on one key. */
+	struct Waiter {
+		Signal mSignal;
+		unsigned mCount;		///< number of threads blocked on this slot
+		Waiter():mCount(0) {}
+	};
+
+	typedef std::map<K,Waiter*> WaiterMap;
+
+	/** One independently locked slice of the map. */
+	struct Shard {
+		Map mMap;
+		WaiterMap mWaiters;		///< waiter slots, present only while someone is blocked
+		Mutex mLock;
+	};
+
+	mutable Shard mShards[SHARDS];
+
+	Shard& shard(const K& key) const
+		{ return mShards[interthreadMapHash(key) % SHARDS]; }
+
+	/**
+		Block on the waiter slot for a key.
+		The shard lock must be held; spurious returns are possible.
+		@param s The shard holding the key.
+		@param key The key to wait for.
+		@param waitTime The deadline, or NULL to wait forever.
+	*/
+	static void waitFor(Shard& s, const K& key, const Timeval* waitTime)
+	{
+		Waiter* waiter;
+		typename WaiterMap::iterator w = s.mWaiters.find(key);
+		if (w!=s.mWaiters.end()) waiter = w->second;
+		else {
+			waiter = new Waiter;
+			s.mWaiters[key] = waiter;
+		}
+		waiter->mCount++;
+		if (waitTime) {
+			long remaining = waitTime->remaining();
+			waiter->mSignal.wait(s.mLock,remaining>0 ? remaining : 1);
+		}
+		else waiter->mSignal.wait(s.mLock);
+		waiter->mCount--;
+		if (waiter->mCount==0) {
+			s.mWaiters.erase(key);
+			delete waiter;
+		}
+	}
+
+	/**
+		Wait for a key to appear, with the shard lock held.
+		@param s The shard holding the key.
+		@param key The key to wait for.
+		@param waitTime The deadline, or NULL to wait forever.
+		@return An iterator at the key, or the end of the shard map on timeout.
+	*/
+	static typename Map::iterator find(Shard& s, const K& key, const Timeval* waitTime)
+	{
+		typename Map::iterator iter = s.mMap.find(key);
+		while (iter==s.mMap.end()) {
+			if (waitTime && waitTime->passed()) break;
+			waitFor(s,key,waitTime);
+			iter = s.mMap.find(key);
+		}
+		return iter;
+	}
 
 public:
 
 	void clear()
 	{
-		mLock.lock();
-		// Delete everything in the map.
-		typename Map::iterator iter = mMap.begin();
-		while (iter != mMap.end()) {
-			delete iter->second;
-			++iter;
+		for (unsigned i=0; i<SHARDS; i++) {
+			Shard& s = mShards[i];
+			s.mLock.lock();
+			// Delete everything in the map.
+			typename Map::iterator iter = s.mMap.begin();
+			while (iter != s.mMap.end()) {
+				delete iter->second;
+				++iter;
+			}
+			s.mMap.clear();
+			s.mLock.unlock();
 		}
-		mMap.clear();
-		mLock.unlock();
 	}
 
 	~InterthreadMap() { clear(); }
@@ -276,16 +703,18 @@ public:
 	*/
 	void write(const K &key, D * wData)
 	{
-		mLock.lock();
-		typename Map::iterator iter = mMap.find(key);
-		if (iter!=mMap.end()) {
+		Shard& s = shard(key);
+		s.mLock.lock();
+		typename Map::iterator iter = s.mMap.find(key);
+		if (iter!=s.mMap.end()) {
 			delete iter->second;
 			iter->second = wData;
 		} else {
-			mMap[key] = wData;
+			s.mMap[key] = wData;
 		}
-		mWriteSignal.broadcast();
-		mLock.unlock();
+		typename WaiterMap::iterator w = s.mWaiters.find(key);
+		if (w!=s.mWaiters.end()) w->second->mSignal.broadcast();
+		s.mLock.unlock();
 	}
 
 	/**
@@ -295,15 +724,16 @@ public:
 	*/
 	D* getNoBlock(const K& key)
 	{
-		mLock.lock();
-		typename Map::iterator iter = mMap.find(key);
-		if (iter==mMap.end()) {
-			mLock.unlock();
+		Shard& s = shard(key);
+		s.mLock.lock();
+		typename Map::iterator iter = s.mMap.find(key);
+		if (iter==s.mMap.end()) {
+			s.mLock.unlock();
 			return NULL;
 		}
 		D* retVal = iter->second;
-		mMap.erase(iter);
-		mLock.unlock();
+		s.mMap.erase(iter);
+		s.mLock.unlock();
 		return retVal;
 	}
 
@@ -316,20 +746,17 @@ public:
 	D* get(const K &key, unsigned timeout)
 	{
 		if (timeout==0) return getNoBlock(key);
-		mLock.lock();
+		Shard& s = shard(key);
+		s.mLock.lock();
 		Timeval waitTime(timeout);
-		typename Map::iterator iter = mMap.find(key);
-		while ((iter==mMap.end()) && (!waitTime.passed())) {
-			mWriteSignal.wait(mLock,waitTime.remaining());
-			iter = mMap.find(key);
-		}
-		if (iter==mMap.end()) {
-			mLock.unlock();
+		typename Map::iterator iter = find(s,key,&waitTime);
+		if (iter==s.mMap.end()) {
+			s.mLock.unlock();
 			return NULL;
 		}
 		D* retVal = iter->second;
-		mMap.erase(iter);
-		mLock.unlock();
+		s.mMap.erase(iter);
+		s.mLock.unlock();
 		return retVal;
 	}
 
@@ -340,15 +767,12 @@ public:
 	*/
 	D* get(const K &key)
 	{
-		mLock.lock();
-		typename Map::iterator iter = mMap.find(key);
-		while (iter==mMap.end()) {
-			mWriteSignal.wait(mLock);
-			iter = mMap.find(key);
-		}
+		Shard& s = shard(key);
+		s.mLock.lock();
+		typename Map::iterator iter = find(s,key,NULL);
 		D* retVal = iter->second;
-		mMap.erase(iter);
-		mLock.unlock();
+		s.mMap.erase(iter);
+		s.mLock.unlock();
 		return retVal;
 	}
 
@@ -375,10 +799,11 @@ public:
 	D* readNoBlock(const K& key) const
 	{
 		D* retVal=NULL;
-		mLock.lock();
-		typename Map::const_iterator iter = mMap.find(key);
-		if (iter!=mMap.end()) retVal = iter->second;
-		mLock.unlock();
+		Shard& s = shard(key);
+		s.mLock.lock();
+		typename Map::const_iterator iter = s.mMap.find(key);
+		if (iter!=s.mMap.end()) retVal = iter->second;
+		s.mLock.unlock();
 		return retVal;
 	}
 
@@ -391,19 +816,12 @@ public:
 	D* read(const K &key, unsigned timeout) const
 	{
 		if (timeout==0) return readNoBlock(key);
-		mLock.lock();
+		Shard& s = shard(key);
+		s.mLock.lock();
 		Timeval waitTime(timeout);
-		typename Map::const_iterator iter = mMap.find(key);
-		while ((iter==mMap.end()) && (!waitTime.passed())) {
-			mWriteSignal.wait(mLock,waitTime.remaining());
-			iter = mMap.find(key);
-		}
-		if (iter==mMap.end()) {
-			mLock.unlock();
-			return NULL;
-		}
-		D* retVal = iter->second;
-		mLock.unlock();
+		typename Map::iterator iter = find(s,key,&waitTime);
+		D* retVal = (iter==s.mMap.end()) ? NULL : iter->second;
+		s.mLock.unlock();
 		return retVal;
 	}
 
@@ -414,14 +832,11 @@ public:
 	*/
 	D* read(const K &key) const
 	{
-		mLock.lock();
-		typename Map::const_iterator iter = mMap.find(key);
-		while (iter==mMap.end()) {
-			mWriteSignal.wait(mLock);
-			iter = mMap.find(key);
-		}
+		Shard& s = shard(key);
+		s.mLock.lock();
+		typename Map::iterator iter = find(s,key,NULL);
 		D* retVal = iter->second;
-		mLock.unlock();
+		s.mLock.unlock();
 		return retVal;
 	}
 
@@ -28,6 +28,8 @@
 #include "Threads.h"
 #include "Interthread.h"
 #include <iostream>
+#include <cstdlib>
+#include <sys/resource.h>
 
 using namespace std;
 
@@ -80,7 +82,7 @@ void* mapWriter(void*)
 void* mapReader(void*)
 {
 	for (int i=0; i<20; i++) {
-		int *p = gMap.read(i);
+		int *p = gMap.get(i);
 		COUT("map read " << *p);
 		delete p;
 	}
@@ -88,6 +90,296 @@ void* mapReader(void*)
 }
 
 
+/**
+	A map with one signal shared by all keys, as InterthreadMap used to be.
+	Kept here as the baseline for the waiter benchmark.
+*/
+class BroadcastMap {
+
+	std::map<int,int*> mMap;
+	Mutex mLock;
+	Signal mWriteSignal;
+	unsigned mWakeups;
+
+	public:
+
+	BroadcastMap():mWakeups(0) {}
+
+	unsigned wakeups() const { return mWakeups; }
+
+	void write(int key, int* p)
+	{
+		mLock.lock();
+		mMap[key] = p;
+		mWriteSignal.broadcast();
+		mLock.unlock();
+	}
+
+	int* get(int key, unsigned timeout)
+	{
+		mLock.lock();
+		Timeval waitTime(timeout);
+		std::map<int,int*>::iterator iter = mMap.find(key);
+		while ((iter==mMap.end()) && (!waitTime.passed())) {
+			mWriteSignal.wait(mLock,waitTime.remaining());
+			mWakeups++;
+			iter = mMap.find(key);
+		}
+		int* retVal = NULL;
+		if (iter!=mMap.end()) {
+			retVal = iter->second;
+			mMap.erase(iter);
+		}
+		mLock.unlock();
+		return retVal;
+	}
+
+};
+
+
+template <class M> struct HerdWaiter {
+	M* map;
+	int key;
+	bool ok;
+};
+
+template <class M> void* herdWaiter(void* arg)
+{
+	HerdWaiter<M>* w = (HerdWaiter<M>*)arg;
+	int* p = w->map->get(w->key,10000);
+	w->ok = (p!=NULL);
+	delete p;
+	return NULL;
+}
+
+/**
+	Block one thread on each of count keys, then write the keys in
+	random order and time how long it takes to release them all.
+	@return The elapsed time in ms.
+*/
+template <class M> long herd(M& map, unsigned count)
+{
+	Thread* threads = new Thread[count];
+	HerdWaiter<M>* waiters = new HerdWaiter<M>[count];
+	for (unsigned i=0; i<count; i++) {
+		waiters[i].map = &map;
+		waiters[i].key = i;
+		waiters[i].ok = false;
+		threads[i].start(herdWaiter<M>,&waiters[i]);
+	}
+	// Let them all block.
+	usleep(500000);
+
+	int* order = new int[count];
+	for (unsigned i=0; i<count; i++) order[i] = i;
+	for (unsigned i=count-1; i>0; i--) {
+		unsigned j = random() % (i+1);
+		int t = order[i];
+		order[i] = order[j];
+		order[j] = t;
+	}
+
+	Timeval start;
+	for (unsigned i=0; i<count; i++) map.write(order[i],new int(order[i]));
+	for (unsigned i=0; i<count; i++) threads[i].join();
+	long elapsed = start.elapsed();
+
+	unsigned missed = 0;
+	for (unsigned i=0; i<count; i++) if (!waiters[i].ok) missed++;
+	if (missed) COUT(missed << " waiters timed out");
+	delete[] order;
+	delete[] waiters;
+	delete[] threads;
+	return elapsed;
+}
+
+
+/**
+	Calls with a FIFO each in a map, as SIPMessageMap keeps them.
+	Call threads block on their own FIFO, a driver looks FIFOs up and writes
+	to them as the SIP drive loop does, and pollers look them up as
+	fifoSize() does every reactor round.
+*/
+template <unsigned SHARDS> struct FIFOCalls {
+	typedef InterthreadMap<int,InterthreadQueue<int>,SHARDS> Map;
+	Map map;
+	unsigned calls;
+	unsigned messages;			///< per call
+	volatile unsigned received;
+	volatile bool done;
+};
+
+/** The FIFOs carry pointers to this. */
+int gMessage;
+
+template <unsigned SHARDS> struct FIFOCall {
+	FIFOCalls<SHARDS>* calls;
+	int key;
+};
+
+template <unsigned SHARDS> void* fifoCall(void* arg)
+{
+	FIFOCall<SHARDS>* c = (FIFOCall<SHARDS>*)arg;
+	InterthreadQueue<int>* fifo = c->calls->map.readNoBlock(c->key);
+	for (unsigned i=0; i<c->calls->messages; i++) {
+		if (fifo->read(10000)) __sync_fetch_and_add(&c->calls->received,1);
+	}
+	return NULL;
+}
+
+template <unsigned SHARDS> void* fifoDriver(void* arg)
+{
+	FIFOCalls<SHARDS>* calls = (FIFOCalls<SHARDS>*)arg;
+	for (unsigned i=0; i<calls->messages; i++) {
+		for (unsigned k=0; k<calls->calls; k++) calls->map.readNoBlock(k)->write(&gMessage);
+		// One message per call at a time, so every message finds its call blocked.
+		while (calls->received < (i+1)*calls->calls) usleep(1000);
+	}
+	return NULL;
+}
+
+template <unsigned SHARDS> void* fifoPoller(void* arg)
+{
+	FIFOCalls<SHARDS>* calls = (FIFOCalls<SHARDS>*)arg;
+	unsigned k = 0;
+	while (!calls->done) {
+		calls->map.readNoBlock(k)->size();
+		k = (k+1) % calls->calls;
+	}
+	return NULL;
+}
+
+/** Voluntary context switches so far, over all threads. */
+static long contextSwitches()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF,&usage);
+	return usage.ru_nvcsw;
+}
+
+/**
+	Send messages to calls through their FIFOs.
+	@param switches Set to the voluntary context switches per message.
+	@return Throughput in messages per second.
+*/
+template <unsigned SHARDS> double fifoCalls(unsigned calls, unsigned messages, double& switches)
+{
+	static const unsigned pollers = 2;
+	FIFOCalls<SHARDS> c;
+	c.calls = calls;
+	c.messages = messages;
+	c.received = 0;
+	c.done = false;
+	FIFOCall<SHARDS>* args = new FIFOCall<SHARDS>[calls];
+	Thread* callThreads = new Thread[calls];
+	for (unsigned i=0; i<calls; i++) {
+		c.map.write(i,new InterthreadQueue<int>);
+		args[i].calls = &c;
+		args[i].key = i;
+		callThreads[i].start(fifoCall<SHARDS>,&args[i]);
+	}
+	Thread pollerThreads[pollers];
+	for (unsigned i=0; i<pollers; i++) pollerThreads[i].start(fifoPoller<SHARDS>,&c);
+	// Let the calls block.
+	usleep(500000);
+
+	long startSwitches = contextSwitches();
+	Timeval start;
+	Thread driverThread;
+	driverThread.start(fifoDriver<SHARDS>,&c);
+	driverThread.join();
+	for (unsigned i=0; i<calls; i++) callThreads[i].join();
+	long elapsed = start.elapsed();
+	long endSwitches = contextSwitches();
+	c.done = true;
+	for (unsigned i=0; i<pollers; i++) pollerThreads[i].join();
+
+	unsigned total = calls*messages;
+	if (c.received!=total) COUT(total-c.received << " messages lost");
+	switches = (double)(endSwitches-startSwitches)/total;
+	delete[] callThreads;
+	delete[] args;
+	if (elapsed<1) elapsed = 1;
+	return 1000.0*total/elapsed;
+}
+
+
+/** Shared state for the queue contention benchmark. */
+template <class Q> struct Contention {
+	Q* q;
+	unsigned perProducer;		///< items each producer writes
+	unsigned total;				///< items all producers write
+	volatile unsigned consumed;
+};
+
+/** The queues carry pointers into this; nothing is allocated or deleted. */
+int gItems[16];
+
+static const unsigned gBatch = 16;
+
+template <class Q> void* producer(void* arg)
+{
+	Contention<Q>* c = (Contention<Q>*)arg;
+	for (unsigned i=0; i<c->perProducer; i++) c->q->write(&gItems[i%16]);
+	return NULL;
+}
+
+template <class Q> void* consumer(void* arg)
+{
+	Contention<Q>* c = (Contention<Q>*)arg;
+	while (c->consumed < c->total) {
+		if (c->q->read(10)) __sync_fetch_and_add(&c->consumed,1);
+	}
+	return NULL;
+}
+
+typedef InterthreadBoundedQueue<int> BoundedQueue;
+
+void* batchProducer(void* arg)
+{
+	Contention<BoundedQueue>* c = (Contention<BoundedQueue>*)arg;
+	int* batch[gBatch];
+	for (unsigned i=0; i<gBatch; i++) batch[i] = &gItems[i];
+	for (unsigned i=0; i<c->perProducer; i+=gBatch) {
+		unsigned n = c->perProducer - i;
+		c->q->writeBatch(batch, n<gBatch ? n : gBatch);
+	}
+	return NULL;
+}
+
+void* batchConsumer(void* arg)
+{
+	Contention<BoundedQueue>* c = (Contention<BoundedQueue>*)arg;
+	int* batch[gBatch];
+	while (c->consumed < c->total) {
+		unsigned n = c->q->readBatch(batch,gBatch,10);
+		if (n) __sync_fetch_and_add(&c->consumed,n);
+	}
+	return NULL;
+}
+
+/**
+	Pass items from producers to consumers through a queue.
+	@return Throughput in items per second.
+*/
+template <class Q> double contention(Q& q, unsigned producers, unsigned consumers, unsigned items,
+		void* (*prod)(void*), void* (*cons)(void*))
+{
+	Contention<Q> c;
+	c.q = &q;
+	c.perProducer = items/producers;
+	c.total = c.perProducer*producers;
+	c.consumed = 0;
+	Thread* threads = new Thread[producers+consumers];
+	Timeval start;
+	for (unsigned i=0; i<consumers; i++) threads[i].start(cons,&c);
+	for (unsigned i=0; i<producers; i++) threads[consumers+i].start(prod,&c);
+	for (unsigned i=0; i<producers+consumers; i++) threads[i].join();
+	long elapsed = start.elapsed();
+	delete[] threads;
+	if (elapsed<1) elapsed = 1;
+	return 1000.0*c.total/elapsed;
+}
 
 
 
@@ -108,6 +400,42 @@ int main(int argc, char *argv[])
 	qWriterThread.join();
 	mapReaderThread.join();
 	mapWriterThread.join();
+
+	// Many threads blocked on different keys.
+	const unsigned waiters = (argc>1) ? atoi(argv[1]) : 500;
+	BroadcastMap broadcastMap;
+	long broadcastMs = herd(broadcastMap,waiters);
+	COUT("shared signal: " << waiters << " waiters released in " << broadcastMs << " ms, "
+		<< broadcastMap.wakeups() << " wakeups");
+	InterthreadMap<int,int> keyedMap;
+	long keyedMs = herd(keyedMap,waiters);
+	COUT("per-key signal: " << waiters << " waiters released in " << keyedMs << " ms");
+
+	// SIP call threads, each blocked on its own FIFO in a map.
+	// A write signals only that FIFO, so the cost left is the map lock.
+	const unsigned messages = (argc>3) ? atoi(argv[3]) : 100;
+	double oneSwitches, shardedSwitches;
+	double oneRate = fifoCalls<1>(waiters,messages,oneSwitches);
+	double shardedRate = fifoCalls<16>(waiters,messages,shardedSwitches);
+	COUT("call FIFOs: " << waiters << " calls, 1 shard " << oneRate << " msg/s, "
+		<< oneSwitches << " switches/msg; 16 shards " << shardedRate << " msg/s, "
+		<< shardedSwitches << " switches/msg");
+
+	// Queue contention, in items per second.
+	const unsigned items = (argc>2) ? atoi(argv[2]) : 1000000;
+	static const unsigned threads[] = { 1, 2, 4, 8 };
+	for (unsigned i=0; i<sizeof(threads)/sizeof(unsigned); i++) {
+		unsigned n = threads[i];
+		InterthreadQueue<int> listQ;
+		double listRate = contention(listQ,n,n,items,producer<InterthreadQueue<int> >,consumer<InterthreadQueue<int> >);
+		BoundedQueue boundedQ(256);
+		double boundedRate = contention(boundedQ,n,n,items,producer<BoundedQueue>,consumer<BoundedQueue>);
+		BoundedQueue batchQ(256);
+		double batchRate = contention(batchQ,n,n,items,batchProducer,batchConsumer);
+		COUT(n << "x" << n << " threads: list " << listRate
+			<< ", bounded " << boundedRate << " (" << boundedQ.stalls() << " stalls)"
+			<< ", bounded batch " << batchRate << " (" << batchQ.stalls() << " stalls, high water " << batchQ.highWater() << ")");
+	}
 }
 
 
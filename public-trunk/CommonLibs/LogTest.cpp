@@ -24,6 +24,7 @@
 
 #include <iostream>
 #include <iterator>
+#include <stdint.h>
 
 #include "Logger.h"
 #include "Configuration.h"
@@ -39,6 +40,16 @@ void printAlarms()
     std::copy( alarms.begin(), alarms.end(), output );
 }
 
+void* logBurst(void* arg)
+{
+	Timeval start;
+	for (int i = 0 ; i < 1000 ; ++i) {
+		LOG(NOTICE) << "thread " << (long)(intptr_t)arg << " record " << i;
+	}
+	LOG(NOTICE) << "thread " << (long)(intptr_t)arg << " logged 1000 records in " << start.elapsed() << " ms";
+	return NULL;
+}
+
 int main(int argc, char *argv[])
 {
 	gLogInit("NOTICE");
@@ -60,6 +71,36 @@ int main(int argc, char *argv[])
     }
     std::cout << "you should see ten line with the numbers 10..19:" << std::endl;
     printAlarms();
+
+    std::cout << "----------- disabled log overhead ----------" << std::endl;
+    const int reps = 10000000;
+    Timeval start;
+    for (int i = 0 ; i < reps ; ++i) {
+        LOG(DEEPDEBUG) << "never printed " << i;
+    }
+    long cachedMs = start.elapsed();
+    start.now();
+    for (int i = 0 ; i < reps/100 ; ++i) {
+        if (gLoggingLevel(__FILE__)>=Log::LOG_DEEPDEBUG) std::cout << "never printed" << std::endl;
+    }
+    long uncachedMs = start.elapsed()*100;
+    std::cout << "disabled LOG(): " << (1.0e6*cachedMs/reps) << " ns cached, "
+        << (1.0e6*uncachedMs/reps) << " ns uncached" << std::endl;
+    gConfig.set("Log.Level.LogTest.cpp","DEEPDEBUG");
+    std::cout << "after changing the level, you should see one DEEPDEBUG line:" << std::endl;
+    for (int i = 0 ; i < 1 ; ++i) {
+        LOG(DEEPDEBUG) << " testing the level cache.";
+    }
+    gConfig.unset("Log.Level.LogTest.cpp");
+
+    std::cout << "----------- asynchronous logging ----------" << std::endl;
+    gLogAsyncStart(10,64);
+    Thread threads[4];
+    for (int i = 0 ; i < 4 ; ++i) threads[i].start(logBurst,(void*)(intptr_t)i);
+    for (int i = 0 ; i < 4 ; ++i) threads[i].join();
+    gLogFlush();
+    std::cout << "4 threads logged 1000 records each, " << gLogDropped()
+        << " dropped on full rings" << std::endl;
 }
 
 
@@ -25,6 +25,9 @@
 #include <string.h>
 #include <cstdio>
 #include <fstream>
+#include <vector>
+#include <algorithm>
+#include <sys/uio.h>
 
 #include "Configuration.h"
 #include "Sockets.h"
@@ -92,6 +95,22 @@ Log::Level gLoggingLevel(const char* filename)
 
 
 
+Log::Level LogLevelCache::refresh(const char* filename)
+{
+	const unsigned generation = gConfig.generation();
+	Log::Level level = gLoggingLevel(filename);
+	// The first file to use this site owns it.
+	if (mFilename==NULL) mFilename = filename;
+	if (mFilename!=filename) return level;
+	mLevel = level;
+	__sync_synchronize();
+	mGeneration = generation+1;
+	return level;
+}
+
+
+
+
 /** The current global log sink. */
 static FILE *gLoggingFile = stdout;
 
@@ -157,6 +176,23 @@ void addAlarm(const string& s)
 }
 
 
+/**
+	Format the record header, time, level and thread, into buf.
+	@return the header length.
+*/
+static unsigned formatHeader(char* buf, size_t size, const Timeval& time, Log::Level level, pthread_t thread)
+{
+	int len = snprintf(buf,size,"%u.%04u %s %lu ",
+		time.sec(), time.usec()/100, levelNames[level], (unsigned long)thread);
+	if (len<0) return 0;
+	if ((size_t)len>=size) return size-1;
+	return len;
+}
+
+
+static bool logAsync(Log::Level level, const Timeval& time, const string& text);
+
+
 Log::~Log()
 {
 	// XXX always handle alarms, even if the logging level is too low
@@ -166,13 +202,16 @@ Log::~Log()
 	}
 	// Current logging level was already checked by the macro.
 	// So just log.
-	gLogLock.lock();
 	mStream << std::endl;
+	if (logAsync(mReportLevel,mTime,mStream.str())) return;
 
+	char header[64];
+	formatHeader(header,sizeof(header),mTime,mReportLevel,pthread_self());
+	gLogLock.lock();
 	if (gLoggingFile == NULL)
 		gLoggingFile = stdout;
 
-	fprintf(gLoggingFile, "%s", mStream.str().c_str());
+	fprintf(gLoggingFile, "%s%s", header, mStream.str().c_str());
 	fflush(gLoggingFile);
 	gLogLock.unlock();
 }
@@ -180,14 +219,280 @@ Log::~Log()
 
 ostringstream& Log::get()
 {
-	Timeval now;
+	// The header is formatted when the record is written.
+	// Floats in the message keep the format the inline timestamp used to leave behind.
 	mStream.precision(4);
-	mStream << now << ' ' << mReportLevel <<  ' ';
+	mStream.setf(ios::fixed, ios::floatfield);
 	return mStream;
 }
 
 
 
+
+/** One pre-formatted log record, waiting in a ring. */
+struct LogRecord {
+	Timeval time;
+	pthread_t thread;
+	Log::Level level;
+	unsigned length;
+	char text[LOG_RECORD_BYTES];
+};
+
+
+/**
+	A single-producer, single-consumer ring of log records.
+	The producer is the thread that owns the ring.
+	The consumer is whoever holds gLogDrainLock.
+*/
+class LogRing {
+
+	private:
+
+	LogRecord* mRecords;
+	unsigned mSize;
+	volatile unsigned mHead;		///< next slot to write, advanced by the producer
+	volatile unsigned mTail;		///< next slot to read, advanced by the consumer
+	volatile unsigned long mDropped;	///< records lost on a full ring, producer only
+
+	public:
+
+	volatile bool mOrphaned;		///< the owning thread has exited
+
+	LogRing(unsigned wSize)
+		:mRecords(new LogRecord[wSize]),mSize(wSize),
+		mHead(0),mTail(0),mDropped(0),mOrphaned(false)
+	{ }
+
+	~LogRing() { delete[] mRecords; }
+
+	/** Producer side.  Return false if the ring is full. */
+	bool write(Log::Level level, const Timeval& time, const string& text)
+	{
+		const unsigned head = mHead;
+		if (head - mTail >= mSize) {
+			mDropped = mDropped + 1;
+			return false;
+		}
+		LogRecord& rec = mRecords[head % mSize];
+		rec.time = time;
+		rec.thread = pthread_self();
+		rec.level = level;
+		unsigned len = text.size();
+		if (len > LOG_RECORD_BYTES) {
+			// Truncate, but keep the newline.
+			len = LOG_RECORD_BYTES;
+			memcpy(rec.text,text.data(),len-1);
+			rec.text[len-1] = '\n';
+		} else {
+			memcpy(rec.text,text.data(),len);
+		}
+		rec.length = len;
+		// Publish the record after it is complete.
+		__sync_synchronize();
+		mHead = head+1;
+		return true;
+	}
+
+	/**@name Consumer side. */
+	//@{
+	unsigned head() const { __sync_synchronize(); return mHead; }
+	unsigned tail() const { return mTail; }
+	LogRecord* record(unsigned index) { return &mRecords[index % mSize]; }
+	void release(unsigned newTail) { __sync_synchronize(); mTail = newTail; }
+	unsigned long dropped() const { return mDropped; }
+	//@}
+};
+
+
+
+/**@name Asynchronous logging state. */
+//@{
+static volatile bool gLogAsyncRunning = false;
+static unsigned gLogFlushMs = DEFAULT_LOG_FLUSH_MS;
+static unsigned gLogRingSlots = DEFAULT_LOG_RING_SLOTS;
+static pthread_key_t gLogRingKey;
+static pthread_once_t gLogRingKeyOnce = PTHREAD_ONCE_INIT;
+static Mutex gLogRingsLock;				///< protects gLogRings and gLogDroppedRetired
+static vector<LogRing*>* gLogRings = NULL;	///< every thread's ring, never freed
+static unsigned long gLogDroppedRetired = 0;	///< drops from deleted rings
+static Mutex gLogDrainLock;				///< only one consumer at a time
+static unsigned long gLogDroppedReported = 0;	///< drops already noted in the log
+static Thread* gLogWriterThread = NULL;
+//@}
+
+
+/** Called when a logging thread exits. */
+static void orphanLogRing(void* ring)
+{
+	((LogRing*)ring)->mOrphaned = true;
+}
+
+
+static void makeLogRingKey()
+{
+	pthread_key_create(&gLogRingKey,orphanLogRing);
+}
+
+
+/** Queue a record on the caller's ring.  Return false if async logging is off. */
+static bool logAsync(Log::Level level, const Timeval& time, const string& text)
+{
+	if (!gLogAsyncRunning) return false;
+	LogRing* ring = (LogRing*)pthread_getspecific(gLogRingKey);
+	if (!ring) {
+		ring = new LogRing(gLogRingSlots);
+		pthread_setspecific(gLogRingKey,ring);
+		gLogRingsLock.lock();
+		gLogRings->push_back(ring);
+		gLogRingsLock.unlock();
+	}
+	ring->write(level,time,text);
+	return true;
+}
+
+
+static bool recordEarlier(const LogRecord* a, const LogRecord* b)
+{
+	if (a->time.sec()!=b->time.sec()) return a->time.sec() < b->time.sec();
+	return a->time.usec() < b->time.usec();
+}
+
+
+/** Write all of iov[], retrying short writes. */
+static void writeAll(int fd, struct iovec* iov, int count)
+{
+	while (count>0) {
+		ssize_t written = writev(fd,iov,count);
+		if (written<0) return;
+		while (count>0 && (size_t)written>=iov->iov_len) {
+			written -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if (count>0) {
+			iov->iov_base = (char*)iov->iov_base + written;
+			iov->iov_len -= written;
+		}
+	}
+}
+
+
+void gLogFlush()
+{
+	static const unsigned batch = 64;
+
+	if (!gLogAsyncRunning) return;
+	gLogDrainLock.lock();
+
+	// Take a snapshot of the rings, retiring empty orphans.
+	gLogRingsLock.lock();
+	vector<LogRing*> rings;
+	for (vector<LogRing*>::iterator i=gLogRings->begin(); i!=gLogRings->end(); ) {
+		LogRing* ring = *i;
+		if (ring->mOrphaned && ring->head()==ring->tail()) {
+			gLogDroppedRetired += ring->dropped();
+			i = gLogRings->erase(i);
+			delete ring;
+			continue;
+		}
+		rings.push_back(ring);
+		++i;
+	}
+	unsigned long dropped = gLogDroppedRetired;
+	gLogRingsLock.unlock();
+
+	// Collect the pending records and put them in time order.
+	vector<LogRecord*> records;
+	vector<unsigned> heads(rings.size());
+	for (unsigned r=0; r<rings.size(); r++) {
+		heads[r] = rings[r]->head();
+		for (unsigned i=rings[r]->tail(); i!=heads[r]; i++) records.push_back(rings[r]->record(i));
+		dropped += rings[r]->dropped();
+	}
+	stable_sort(records.begin(),records.end(),recordEarlier);
+
+	// Write them in batches, header and text from the ring slot.
+	char headers[batch][64];
+	struct iovec iov[2*batch+1];
+	char dropNote[80];
+	gLogLock.lock();
+	if (gLoggingFile == NULL)
+		gLoggingFile = stdout;
+	fflush(gLoggingFile);
+	const int fd = fileno(gLoggingFile);
+	for (unsigned start=0; start<records.size(); start+=batch) {
+		unsigned n = 0;
+		for (unsigned i=start; i<records.size() && i<start+batch; i++, n++) {
+			const LogRecord* rec = records[i];
+			iov[2*n].iov_base = headers[n];
+			iov[2*n].iov_len = formatHeader(headers[n],sizeof(headers[n]),rec->time,rec->level,rec->thread);
+			iov[2*n+1].iov_base = (void*)rec->text;
+			iov[2*n+1].iov_len = rec->length;
+		}
+		writeAll(fd,iov,2*n);
+	}
+	if (dropped > gLogDroppedReported) {
+		Timeval now;
+		unsigned len = formatHeader(dropNote,sizeof(dropNote),now,Log::LOG_WARN,pthread_self());
+		len += snprintf(dropNote+len,sizeof(dropNote)-len,"%lu log records dropped\n",dropped-gLogDroppedReported);
+		if (len>=sizeof(dropNote)) len = sizeof(dropNote)-1;
+		iov[0].iov_base = dropNote;
+		iov[0].iov_len = len;
+		writeAll(fd,iov,1);
+		gLogDroppedReported = dropped;
+	}
+	gLogLock.unlock();
+
+	// Free the slots.
+	for (unsigned r=0; r<rings.size(); r++) rings[r]->release(heads[r]);
+
+	gLogDrainLock.unlock();
+}
+
+
+unsigned long gLogDropped()
+{
+	if (!gLogAsyncRunning) return 0;
+	gLogRingsLock.lock();
+	unsigned long total = gLogDroppedRetired;
+	for (unsigned r=0; r<gLogRings->size(); r++) total += (*gLogRings)[r]->dropped();
+	gLogRingsLock.unlock();
+	return total;
+}
+
+
+static void *logWriterLoop(void*)
+{
+	while (true) {
+		gLogFlush();
+		msleep(gLogFlushMs);
+	}
+	return NULL;
+}
+
+
+static void flushAtExit()
+{
+	gLogFlush();
+}
+
+
+void gLogAsyncStart(unsigned flushMs, unsigned ringSlots)
+{
+	if (gLogAsyncRunning) return;
+	pthread_once(&gLogRingKeyOnce,makeLogRingKey);
+	gLogFlushMs = flushMs;
+	gLogRingSlots = ringSlots ? ringSlots : 1;
+	gLogRings = new vector<LogRing*>;
+	gLogWriterThread = new Thread;
+	gLogWriterThread->start(logWriterLoop,NULL,"log");
+	atexit(flushAtExit);
+	gLogAsyncRunning = true;
+	LOG(INFO) << "asynchronous logging, flush interval " << flushMs << " ms, " << ringSlots << " records per thread";
+}
+
+
+
 void gLogInit(const char* defaultLevel)
 {
 	// Define defaults in the global config
@@ -213,6 +518,13 @@ LogInitializer::LogInitializer(const char *logFile)
 	} else {
 		gSetLogFile(stdout);
 	}
+	if (gConfig.defines("Log.Async")) {
+		unsigned flushMs = DEFAULT_LOG_FLUSH_MS;
+		unsigned ringSlots = DEFAULT_LOG_RING_SLOTS;
+		if (gConfig.defines("Log.Async.FlushInterval")) flushMs = gConfig.getNum("Log.Async.FlushInterval");
+		if (gConfig.defines("Log.Async.RingSize")) ringSlots = gConfig.getNum("Log.Async.RingSize");
+		gLogAsyncStart(flushMs,ringSlots);
+	}
 }
 
 
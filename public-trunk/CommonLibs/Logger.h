@@ -33,22 +33,29 @@
 #include <map>
 #include <string>
 #include "Threads.h"
+#include "Timeval.h"
+#include "Configuration.h"
 
 
 #define DEFAULT_LOGGING_LEVEL "INFO"
 #define DEFAULT_ALARM_PORT 10101
 #define DEFAULT_MAX_ALARMS 10
+#define DEFAULT_LOG_FLUSH_MS 100
+#define DEFAULT_LOG_RING_SLOTS 256
+#define LOG_RECORD_BYTES 512
 
 #define _LOG(level) \
-	Log(Log::LOG_##level).get() << pthread_self() \
-	<< " " __FILE__  ":"  << __LINE__ << ":" << __FUNCTION__ << ": "
+	Log(Log::LOG_##level).get() \
+	<< __FILE__  ":"  << __LINE__ << ":" << __FUNCTION__ << ": "
+#define _LOGLEVEL \
+	LogSite<__COUNTER__>::sCache.level(__FILE__)
 #define LOG(wLevel) \
-	if (gLoggingLevel(__FILE__)>=Log::LOG_##wLevel) _LOG(wLevel)
+	if (_LOGLEVEL>=Log::LOG_##wLevel) _LOG(wLevel)
 #define OBJLOG(wLevel) \
-	if (gLoggingLevel(__FILE__)>=Log::LOG_##wLevel) _LOG(wLevel) << "obj: " << this << ' '
+	if (_LOGLEVEL>=Log::LOG_##wLevel) _LOG(wLevel) << "obj: " << this << ' '
 
 #define ISLOGGING(wLevel) \
-	(gLoggingLevel(__FILE__)>=Log::LOG_##wLevel)
+	(_LOGLEVEL>=Log::LOG_##wLevel)
 
 #define LOG_ASSERT(x) { if (!(x)) LOG(ALARM) << "assertion " #x " failed"; } assert(x);
 
@@ -81,6 +88,7 @@ class Log {
 
 	std::ostringstream mStream;	///< This is where we write the long.
 	Level mReportLevel;			///< Level of current report.
+	Timeval mTime;				///< Time of the report, formatted later.
 
 	static FILE *sFile;
 
@@ -114,6 +122,47 @@ bool gSetLogFile(const char*);
 void gLogInit(const char* defaultLevel = DEFAULT_LOGGING_LEVEL);
 Log::Level gLoggingLevel(const char *filename);
 
+extern ConfigurationTable gConfig;
+
+/**
+	The logging level for one LOG() call site.
+	It is looked up in gConfig once and again only when gConfig changes,
+	so a filtered-out LOG() costs a couple of loads and compares.
+*/
+class LogLevelCache {
+
+	private:
+
+	const char* mFilename;			///< the file this level was resolved for
+	volatile unsigned mGeneration;	///< gConfig generation at resolution, +1 so 0 is never valid
+	Log::Level mLevel;
+
+	public:
+
+	Log::Level level(const char* filename)
+	{
+		if (mGeneration==gConfig.generation()+1 && mFilename==filename) return mLevel;
+		return refresh(filename);
+	}
+
+	private:
+
+	Log::Level refresh(const char* filename);
+};
+
+
+namespace {
+/**
+	One cache per LOG() call site per translation unit.
+	Sites are numbered with __COUNTER__ rather than __LINE__, so that a header's
+	inline LOG() never shares a cache with a LOG() on the same line of the
+	including file.
+*/
+template <int line> struct LogSite { static LogLevelCache sCache; };
+template <int line> LogLevelCache LogSite<line>::sCache;
+}
+
+
 /** Class to initialize Logger during static variables initialization. */
 class LogInitializer {
 public:
@@ -124,6 +173,26 @@ public:
 //@}
 
 
+/**@name Asynchronous logging.
+	Records go into a lock-free ring owned by the logging thread and
+	are written out by a background thread, so logging never blocks on I/O.
+	If a ring fills, records are dropped and counted.
+	Alarms are still handled synchronously.
+*/
+//@{
+/**
+	Start the background writer.
+	@param flushMs How often the writer drains the rings.
+	@param ringSlots Records per thread ring.
+*/
+void gLogAsyncStart(unsigned flushMs=DEFAULT_LOG_FLUSH_MS, unsigned ringSlots=DEFAULT_LOG_RING_SLOTS);
+/** Write out everything queued so far. */
+void gLogFlush();
+/** Total records dropped on full rings. */
+unsigned long gLogDropped();
+//@}
+
+
 #endif
 
 // vim: ts=4 sw=4
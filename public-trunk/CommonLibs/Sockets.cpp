@@ -28,6 +28,7 @@
 #include <fcntl.h>
 #include <cstdio>
 #include <sys/select.h>
+#include <sys/epoll.h>
 
 #include "Threads.h"
 #include "Sockets.h"
@@ -181,25 +182,334 @@ int DatagramSocket::read(char* buffer)
 }
 
 
-int DatagramSocket::read(char* buffer, unsigned timeout)
+/** Wait up to timeout ms for fd to become readable; return false on timeout. */
+static bool waitReadable(int fd, unsigned timeout)
 {
 	fd_set fds;
 	FD_ZERO(&fds);
-	FD_SET(mSocketFD,&fds);
+	FD_SET(fd,&fds);
 	struct timeval tv;
 	tv.tv_sec = timeout/1000;
 	tv.tv_usec = (timeout%1000)*1000;
-	int sel = select(mSocketFD+1,&fds,NULL,NULL,&tv);
+	int sel = select(fd+1,&fds,NULL,NULL,&tv);
 	if (sel<0) {
 		perror("DatagramSocket::read() select() failed");
 		throw SocketError();
 	}
-	if (sel==0) return -1;
+	return sel!=0;
+}
+
+
+int DatagramSocket::read(char* buffer, unsigned timeout)
+{
+	if (!waitReadable(mSocketFD,timeout)) return -1;
 	return read(buffer);
 }
 
 
 
+/** Largest batch handed to the kernel in one recvmmsg/sendmmsg call. */
+static const unsigned maxBatch = 64;
+
+
+int DatagramSocket::readBatch(char* buffers, size_t* lengths, unsigned count)
+{
+	if (count>maxBatch) count = maxBatch;
+#ifdef HAVE_RECVMMSG
+	struct mmsghdr msgs[maxBatch];
+	struct iovec iovs[maxBatch];
+	memset(msgs,0,count*sizeof(struct mmsghdr));
+	for (unsigned i=0; i<count; i++) {
+		iovs[i].iov_base = buffers + i*MAX_UDP_LENGTH;
+		iovs[i].iov_len = MAX_UDP_LENGTH;
+		// Every header names mSource; the kernel fills them in order,
+		// so the last packet's sender is what remains.
+		msgs[i].msg_hdr.msg_name = mSource;
+		msgs[i].msg_hdr.msg_namelen = sizeof(mSource);
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	int received = recvmmsg(mSocketFD, msgs, count, MSG_WAITFORONE, NULL);
+	if (received==-1) {
+		if (errno==EAGAIN) return -1;
+		perror("DatagramSocket::readBatch() failed");
+		throw SocketError();
+	}
+	for (int i=0; i<received; i++) lengths[i] = msgs[i].msg_len;
+	return received;
+#else
+	// Block (or not) for the first, as read() does, then take only what is queued.
+	int length = read(buffers);
+	if (length<0) return -1;
+	lengths[0] = length;
+	unsigned received = 1;
+	while (received<count) {
+		socklen_t temp_len = sizeof(mSource);
+		length = recvfrom(mSocketFD, buffers + received*MAX_UDP_LENGTH, MAX_UDP_LENGTH,
+			MSG_DONTWAIT, (struct sockaddr*)&mSource, &temp_len);
+		if (length==-1) {
+			if (errno==EAGAIN) break;
+			perror("DatagramSocket::readBatch() failed");
+			throw SocketError();
+		}
+		lengths[received++] = length;
+	}
+	return received;
+#endif
+}
+
+
+int DatagramSocket::readBatch(char* buffers, size_t* lengths, unsigned count, unsigned timeout)
+{
+	if (!waitReadable(mSocketFD,timeout)) return -1;
+	return readBatch(buffers,lengths,count);
+}
+
+
+int DatagramSocket::writeBatch(const char* const* buffers, const size_t* lengths, unsigned count)
+{
+	unsigned sent = 0;
+#ifdef HAVE_SENDMMSG
+	struct mmsghdr msgs[maxBatch];
+	struct iovec iovs[maxBatch];
+	while (sent<count) {
+		unsigned chunk = count-sent;
+		if (chunk>maxBatch) chunk = maxBatch;
+		memset(msgs,0,chunk*sizeof(struct mmsghdr));
+		for (unsigned i=0; i<chunk; i++) {
+			assert(lengths[sent+i]<=MAX_UDP_LENGTH);
+			iovs[i].iov_base = (void*)buffers[sent+i];
+			iovs[i].iov_len = lengths[sent+i];
+			msgs[i].msg_hdr.msg_name = mDestination;
+			msgs[i].msg_hdr.msg_namelen = addressSize();
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+		int retVal = sendmmsg(mSocketFD, msgs, chunk, 0);
+		if (retVal<=0) {
+			perror("DatagramSocket::writeBatch() failed");
+			break;
+		}
+		sent += retVal;
+	}
+#else
+	while (sent<count) {
+		if (write(buffers[sent],lengths[sent])<0) break;
+		sent++;
+	}
+#endif
+	if (sent==0 && count>0) return -1;
+	return sent;
+}
+
+
+
+/** Set a socket buffer size option and return what the kernel granted. */
+static int setBufferSize(int fd, int option, int bytes)
+{
+	if (setsockopt(fd, SOL_SOCKET, option, &bytes, sizeof(bytes))<0) {
+		perror("DatagramSocket setsockopt() failed");
+		return -1;
+	}
+	int granted = 0;
+	socklen_t len = sizeof(granted);
+	if (getsockopt(fd, SOL_SOCKET, option, &granted, &len)<0) return -1;
+	return granted;
+}
+
+int DatagramSocket::receiveBufferSize(int bytes)
+{
+	return setBufferSize(mSocketFD,SO_RCVBUF,bytes);
+}
+
+int DatagramSocket::sendBufferSize(int bytes)
+{
+	return setBufferSize(mSocketFD,SO_SNDBUF,bytes);
+}
+
+
+
+
+
+SocketReactor::SocketReactor(unsigned wBatch)
+	:mBatch(wBatch),
+	mRunning(false),
+	mWakeups(0),mCalls(0),mPackets(0)
+{
+	if (mBatch==0) mBatch = 1;
+	if (mBatch>maxBatch) mBatch = maxBatch;
+	mBuffers = new char[mBatch*MAX_UDP_LENGTH];
+	mLengths = new size_t[mBatch];
+	mEpollFD = epoll_create(16);
+	if (mEpollFD<0) {
+		perror("epoll_create() failed");
+		throw SocketError();
+	}
+	fcntl(mEpollFD, F_SETFD, FD_CLOEXEC);
+	if (pipe(mWakeFD)<0) {
+		perror("pipe() failed");
+		throw SocketError();
+	}
+	for (int i=0; i<2; i++) {
+		fcntl(mWakeFD[i], F_SETFL, O_NONBLOCK);
+		fcntl(mWakeFD[i], F_SETFD, FD_CLOEXEC);
+	}
+	// The wake pipe is level-triggered; it is only drained, never dispatched.
+	struct epoll_event ev;
+	memset(&ev,0,sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = mWakeFD[0];
+	epoll_ctl(mEpollFD, EPOLL_CTL_ADD, mWakeFD[0], &ev);
+}
+
+
+SocketReactor::~SocketReactor()
+{
+	stop();
+	::close(mEpollFD);
+	::close(mWakeFD[0]);
+	::close(mWakeFD[1]);
+	delete[] mBuffers;
+	delete[] mLengths;
+}
+
+
+void SocketReactor::add(DatagramSocket* socket, DatagramHandler* handler)
+{
+	// Edge-triggered epoll needs every read to end in EAGAIN.
+	socket->nonblocking();
+	mLock.lock();
+	Registration& reg = mSockets[socket->fd()];
+	reg.mSocket = socket;
+	reg.mHandler = handler;
+	struct epoll_event ev;
+	memset(&ev,0,sizeof(ev));
+	ev.events = EPOLLIN | EPOLLET;
+	ev.data.fd = socket->fd();
+	if (epoll_ctl(mEpollFD, EPOLL_CTL_ADD, socket->fd(), &ev)<0) {
+		perror("SocketReactor::add() epoll_ctl() failed");
+		mSockets.erase(socket->fd());
+		mLock.unlock();
+		throw SocketError();
+	}
+	mLock.unlock();
+}
+
+
+void SocketReactor::remove(DatagramSocket* socket)
+{
+	mLock.lock();
+	RegistrationMap::iterator itr = mSockets.find(socket->fd());
+	if (itr!=mSockets.end()) {
+		epoll_ctl(mEpollFD, EPOLL_CTL_DEL, socket->fd(), NULL);
+		mSockets.erase(itr);
+	}
+	mLock.unlock();
+}
+
+
+unsigned SocketReactor::drain(int fd)
+{
+	unsigned packets = 0;
+	// The lock is recursive, so handlers may call add() and remove().
+	mLock.lock();
+	while (true) {
+		RegistrationMap::iterator itr = mSockets.find(fd);
+		if (itr==mSockets.end()) break;
+		Registration reg = itr->second;
+		int count;
+		try {
+			count = reg.mSocket->readBatch(mBuffers,mLengths,mBatch);
+		}
+		catch (SocketError) {
+			CERR("WARNING -- SocketReactor read failed on fd " << fd);
+			break;
+		}
+		mCalls++;
+		if (count<=0) break;
+		int i = 0;
+		while (i<count) {
+			reg.mHandler->handleDatagram(*reg.mSocket, mBuffers + i*MAX_UDP_LENGTH, mLengths[i]);
+			i++;
+			if (mSockets.find(fd)==mSockets.end()) break;
+		}
+		packets += i;
+		mPackets += i;
+		// A short batch means the queue was empty when the kernel looked;
+		// anything arriving later raises a new edge.
+		if ((unsigned)count<mBatch) break;
+	}
+	mLock.unlock();
+	return packets;
+}
+
+
+unsigned SocketReactor::poll(int timeout)
+{
+	static const int maxEvents = 32;
+	struct epoll_event events[maxEvents];
+	int n = epoll_wait(mEpollFD, events, maxEvents, timeout);
+	if (n<0) {
+		if (errno==EINTR) return 0;
+		perror("SocketReactor::poll() epoll_wait() failed");
+		throw SocketError();
+	}
+	if (n>0) {
+		mLock.lock();
+		mWakeups++;
+		mLock.unlock();
+	}
+	unsigned packets = 0;
+	for (int i=0; i<n; i++) {
+		int fd = events[i].data.fd;
+		if (fd==mWakeFD[0]) {
+			char junk[64];
+			while (::read(fd,junk,sizeof(junk))>0) {}
+			continue;
+		}
+		packets += drain(fd);
+	}
+	return packets;
+}
+
+
+void* SocketReactorServiceLoop(SocketReactor* reactor)
+{
+	while (reactor->mRunning) reactor->poll(-1);
+	return NULL;
+}
+
+
+void SocketReactor::start(const char* role)
+{
+	assert(!mRunning);
+	mRunning = true;
+	mThread.start((void*(*)(void*))SocketReactorServiceLoop,this,role);
+}
+
+
+void SocketReactor::stop()
+{
+	if (!mRunning) return;
+	mRunning = false;
+	char c = 0;
+	if (::write(mWakeFD[1],&c,1)<0) perror("SocketReactor::stop() write() failed");
+	mThread.join();
+}
+
+
+void SocketReactor::dump(std::ostream& os) const
+{
+	mLock.lock();
+	os << "sockets=" << mSockets.size() << " batch=" << mBatch;
+	os << " wakeups=" << mWakeups << " calls=" << mCalls << " packets=" << mPackets;
+	if (mCalls) os << " packets/call=" << (float)mPackets/mCalls;
+	os << std::endl;
+	mLock.unlock();
+}
+
+
+
 
 
 
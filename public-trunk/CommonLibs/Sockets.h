@@ -36,6 +36,9 @@
 #include <ostream>
 #include <assert.h>
 #include <stdint.h>
+#include <map>
+
+#include "Threads.h"
 
 
 
@@ -130,6 +133,54 @@ public:
 	/** Close the socket. */
 	void close();
 
+	/** Return the underlying file descriptor, for use with SocketReactor. */
+	int fd() const { return mSocketFD; }
+
+	/**@name Batched I/O, one system call per batch where the kernel supports it. */
+	//@{
+
+	/**
+		Receive up to count packets in one call.
+		Blocks for the first packet if the socket is blocking, never for the rest.
+		The source of the last packet received is left in mSource.
+		@param buffers count*MAX_UDP_LENGTH bytes procured by the caller; packet i starts at buffers+i*MAX_UDP_LENGTH.
+		@param lengths Array of count lengths, filled in for each packet received.
+		@param count The maximum number of packets to receive.
+		@return The number of packets received or -1 on non-blocking pass.
+	*/
+	int readBatch(char* buffers, size_t* lengths, unsigned count);
+
+	/**
+		Receive up to count packets with a timeout on the first one.
+		@param timeout maximum wait time in milliseconds
+		@return The number of packets received or -1 on timeout.
+	*/
+	int readBatch(char* buffers, size_t* lengths, unsigned count, unsigned timeout);
+
+	/**
+		Send count packets to mDestination in one call.
+		@param buffers Array of count packet pointers.
+		@param lengths Array of count packet lengths.
+		@return The number of packets sent, or -1 on error.
+	*/
+	int writeBatch(const char* const* buffers, const size_t* lengths, unsigned count);
+
+	//@}
+
+	/**@name Kernel buffer sizes, SO_RCVBUF and SO_SNDBUF. */
+	//@{
+	/**
+		Request a kernel receive buffer size.
+		@return The size actually granted by the kernel, or -1 on error.
+	*/
+	int receiveBufferSize(int bytes);
+	/**
+		Request a kernel send buffer size.
+		@return The size actually granted by the kernel, or -1 on error.
+	*/
+	int sendBufferSize(int bytes);
+	//@}
+
 };
 
 
@@ -181,6 +232,99 @@ public:
 
 };
 
+/** Receiver interface for datagrams dispatched by a SocketReactor. */
+class DatagramHandler {
+
+	public:
+
+	virtual ~DatagramHandler() {}
+
+	/**
+		Called from the reactor thread for each packet received.
+		@param socket The socket the packet arrived on; its source() is the sender.
+		@param data The packet, valid only for the duration of the call.
+		@param length The packet length in bytes.
+	*/
+	virtual void handleDatagram(DatagramSocket& socket, const char* data, size_t length) = 0;
+};
+
+
+/**
+	An edge-triggered epoll reactor that services several datagram sockets from one thread.
+	Registered sockets are made non-blocking and drained with readBatch on each edge,
+	so a busy socket costs one system call per batch rather than one per packet.
+*/
+class SocketReactor {
+
+	private:
+
+	/** A socket and its handler, keyed by file descriptor. */
+	struct Registration {
+		DatagramSocket* mSocket;
+		DatagramHandler* mHandler;
+	};
+	typedef std::map<int,Registration> RegistrationMap;
+
+	int mEpollFD;					///< the epoll instance
+	int mWakeFD[2];					///< pipe used to break the service thread out of epoll_wait
+	unsigned mBatch;				///< maximum packets per readBatch call
+	char* mBuffers;					///< mBatch*MAX_UDP_LENGTH receive buffers
+	size_t* mLengths;				///< mBatch receive lengths
+	mutable Mutex mLock;			///< protects mSockets and the counters
+	RegistrationMap mSockets;		///< registered sockets
+	Thread mThread;					///< service thread, if started
+	volatile bool mRunning;			///< cleared by stop()
+
+	/**@name Statistics. */
+	//@{
+	unsigned long mWakeups;			///< epoll_wait returns with events
+	unsigned long mCalls;			///< readBatch calls
+	unsigned long mPackets;			///< packets dispatched
+	//@}
+
+	public:
+
+	/** @param wBatch The maximum number of packets to pull from a socket per system call. */
+	SocketReactor(unsigned wBatch=16);
+
+	/** Stops the service thread, if any; does not close the registered sockets. */
+	~SocketReactor();
+
+	/** Register a socket; the socket is made non-blocking. */
+	void add(DatagramSocket* socket, DatagramHandler* handler);
+
+	/** Unregister a socket; safe to call from a handler. */
+	void remove(DatagramSocket* socket);
+
+	/**
+		Wait for and service one round of readable sockets.
+		@param timeout maximum wait time in milliseconds, or -1 to wait forever
+		@return The number of packets dispatched, 0 on timeout.
+	*/
+	unsigned poll(int timeout);
+
+	/** Start a service thread running poll() until stop(). */
+	void start(const char* role="reactor");
+
+	/** Stop and join the service thread. */
+	void stop();
+
+	/** Dump the reactor statistics. */
+	void dump(std::ostream& os) const;
+
+	private:
+
+	/** Drain one socket on an edge. */
+	unsigned drain(int fd);
+
+	friend void* SocketReactorServiceLoop(SocketReactor*);
+};
+
+/** Service thread entry for SocketReactor. */
+void* SocketReactorServiceLoop(SocketReactor*);
+
+
+
 /** A base class for connection-oriented sockets. */
 class ConnectionSocket {
 
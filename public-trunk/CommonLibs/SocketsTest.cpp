@@ -29,6 +29,8 @@
 #include "Threads.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
 
 
 static const int gNumToSend = 10;
@@ -73,9 +75,132 @@ void *testReaderUnix(void *)
 }
 
 
+
+static double now()
+{
+	struct timeval tv;
+	gettimeofday(&tv,NULL);
+	return tv.tv_sec + tv.tv_usec*1e-6;
+}
+
+
+static const unsigned gBurst = 32;
+static const unsigned gBursts = 2000;
+static const size_t gBenchLength = 156;		// a TRX uplink burst message
+
+
+/** Loop bursts through a loopback pair, one system call per packet. */
+static double benchSingle(UDPSocket& tx, UDPSocket& rx)
+{
+	char pkt[gBenchLength];
+	memset(pkt,0x55,sizeof(pkt));
+	char buf[MAX_UDP_LENGTH];
+	unsigned total = 0;
+	double start = now();
+	for (unsigned b=0; b<gBursts; b++) {
+		for (unsigned i=0; i<gBurst; i++) tx.write(pkt,sizeof(pkt));
+		for (unsigned i=0; i<gBurst; i++) {
+			if (rx.read(buf,1000)<0) break;
+			total++;
+		}
+	}
+	return total/(now()-start);
+}
+
+
+/** Loop bursts through a loopback pair, one system call per burst. */
+static double benchBatch(UDPSocket& tx, UDPSocket& rx)
+{
+	char pkt[gBenchLength];
+	memset(pkt,0x55,sizeof(pkt));
+	const char* pkts[gBurst];
+	size_t lengths[gBurst];
+	for (unsigned i=0; i<gBurst; i++) { pkts[i] = pkt; lengths[i] = sizeof(pkt); }
+	static char bufs[gBurst*MAX_UDP_LENGTH];
+	size_t rxLengths[gBurst];
+	unsigned total = 0;
+	unsigned calls = 0;
+	double start = now();
+	for (unsigned b=0; b<gBursts; b++) {
+		tx.writeBatch(pkts,lengths,gBurst);
+		unsigned got = 0;
+		while (got<gBurst) {
+			int n = rx.readBatch(bufs,rxLengths,gBurst-got,1000);
+			calls++;
+			if (n<0) break;
+			got += n;
+		}
+		total += got;
+	}
+	double rate = total/(now()-start);
+	COUT("batched: " << (float)total/calls << " packets per readBatch");
+	return rate;
+}
+
+
+/** Count packets per socket from the reactor thread. */
+class CountingHandler : public DatagramHandler {
+	public:
+	volatile unsigned mCount;
+	CountingHandler():mCount(0) {}
+	void handleDatagram(DatagramSocket&, const char*, size_t) { mCount++; }
+};
+
+
+static void benchmark()
+{
+	UDPSocket rx(5935);
+	UDPSocket tx(5062,"127.0.0.1",5935);
+	COUT("rx SO_RCVBUF granted " << rx.receiveBufferSize(1<<20));
+	COUT("tx SO_SNDBUF granted " << tx.sendBufferSize(1<<20));
+
+	double single = benchSingle(tx,rx);
+	double batch = benchBatch(tx,rx);
+	COUT("single: " << (unsigned)single << " packets/s");
+	COUT("batched: " << (unsigned)batch << " packets/s, " << batch/single << "x");
+
+	// Two sockets serviced from one reactor thread.
+	UDPSocket rxB(5936);
+	UDPSocket txB(5063,"127.0.0.1",5936);
+	rxB.receiveBufferSize(1<<20);
+	CountingHandler countA, countB;
+	SocketReactor reactor(gBurst);
+	reactor.add(&rx,&countA);
+	reactor.add(&rxB,&countB);
+	reactor.start();
+	char pkt[gBenchLength];
+	memset(pkt,0x55,sizeof(pkt));
+	const char* pkts[gBurst];
+	size_t lengths[gBurst];
+	for (unsigned i=0; i<gBurst; i++) { pkts[i] = pkt; lengths[i] = sizeof(pkt); }
+	const unsigned sent = 200*gBurst;
+	double start = now();
+	for (unsigned b=0; b<sent/gBurst; b++) {
+		tx.writeBatch(pkts,lengths,gBurst);
+		txB.writeBatch(pkts,lengths,gBurst);
+		// Don't outrun the reactor on a single CPU.
+		while (countA.mCount + countB.mCount + 2*gBurst*4 < 2*gBurst*(b+1)) usleep(100);
+	}
+	while (countA.mCount<sent || countB.mCount<sent) {
+		if (now()-start > 5.0) break;
+		usleep(1000);
+	}
+	double elapsed = now()-start;
+	reactor.stop();
+	COUT("reactor: " << countA.mCount << "+" << countB.mCount << " of " << 2*sent << " packets, "
+		<< (unsigned)((countA.mCount+countB.mCount)/elapsed) << " packets/s");
+	reactor.dump(std::cout);
+}
+
+
 int main(int argc, char * argv[] )
 {
 
+  if (argc>1 && strcmp(argv[1],"bench")==0) {
+    benchmark();
+    return 0;
+  }
+
   Thread readerThreadIP;
   readerThreadIP.start(testReaderIP,NULL);
   Thread readerThreadUnix;
@@ -97,6 +222,8 @@ int main(int argc, char * argv[] )
 
   readerThreadIP.join();
   readerThreadUnix.join();
+
+  benchmark();
 }
 
 // vim: ts=4 sw=4
@@ -29,6 +29,12 @@
 #include "Timeval.h"
 
 #include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
 
 using namespace std;
 
@@ -159,16 +165,187 @@ ThreadSemaphore::Result ThreadSemaphore::post()
 	return TSEM_OK;
 }
 
-void Thread::start(void *(*task)(void*), void *arg)
+ThreadPolicy::ThreadPolicy()
+	:mScheduler(SCHED_OTHER),mPriority(0)
+{}
+
+
+ThreadRegistry& gThreadRegistry()
+{
+	// Never destroyed, so threads can leave during static destruction.
+	static ThreadRegistry* registry = new ThreadRegistry;
+	return *registry;
+}
+
+
+/** Parse a CPU list like "0 2-3,5". */
+static void parseCPUs(const std::string& spec, std::vector<int>& cpus)
+{
+	cpus.clear();
+	const char* p = spec.c_str();
+	while (*p) {
+		char* end;
+		long first = strtol(p,&end,10);
+		if (end==p) {
+			p++;
+			continue;
+		}
+		long last = first;
+		p = end;
+		if (*p=='-') {
+			last = strtol(p+1,&end,10);
+			p = end;
+		}
+		for (long cpu=first; cpu<=last; cpu++) cpus.push_back(cpu);
+	}
+}
+
+
+bool ThreadRegistry::configure(const std::map<std::string,std::string>& config)
+{
+	static const std::string prefix("Thread.");
+	mLock.lock();
+	mPolicies.clear();
+	std::map<std::string,std::string>::const_iterator p = config.lower_bound(prefix);
+	for (; p!=config.end() && p->first.compare(0,prefix.size(),prefix)==0; ++p) {
+		size_t dot = p->first.rfind('.');
+		if (dot<=prefix.size()) continue;
+		std::string role = p->first.substr(prefix.size(),dot-prefix.size());
+		std::string attribute = p->first.substr(dot+1);
+		ThreadPolicy& policy = mPolicies[role];
+		if (attribute=="CPUs") parseCPUs(p->second,policy.mCPUs);
+		else if (attribute=="Priority") policy.mPriority = atoi(p->second.c_str());
+		else if (attribute=="Scheduler") {
+			if (p->second=="FIFO") policy.mScheduler = SCHED_FIFO;
+			else if (p->second=="RR") policy.mScheduler = SCHED_RR;
+			else policy.mScheduler = SCHED_OTHER;
+		}
+	}
+	bool retVal = true;
+	for (RecordList::const_iterator t = mThreads.begin(); t!=mThreads.end(); ++t) {
+		if (!apply(*t)) retVal = false;
+	}
+	mLock.unlock();
+	return retVal;
+}
+
+
+bool ThreadRegistry::apply(const Record& thread) const
+{
+	PolicyMap::const_iterator p = mPolicies.find(thread.mRole);
+	if (p==mPolicies.end()) return true;
+	const ThreadPolicy& policy = p->second;
+	bool retVal = true;
+	if (policy.mCPUs.size()) {
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		for (unsigned i=0; i<policy.mCPUs.size(); i++) CPU_SET(policy.mCPUs[i],&cpus);
+		int s = pthread_setaffinity_np(thread.mID,sizeof(cpus),&cpus);
+		if (s) {
+			CERR("cannot set CPUs of " << thread.mRole << " thread: " << strerror(s));
+			retVal = false;
+		}
+	}
+	struct sched_param param;
+	param.sched_priority = (policy.mScheduler==SCHED_OTHER) ? 0 : policy.mPriority;
+	int s = pthread_setschedparam(thread.mID,policy.mScheduler,&param);
+	if (s) {
+		CERR("cannot set scheduling of " << thread.mRole << " thread: " << strerror(s));
+		retVal = false;
+	}
+	return retVal;
+}
+
+
+void ThreadRegistry::enter(const std::string& role)
+{
+	Record thread;
+	thread.mRole = role;
+	thread.mID = pthread_self();
+	thread.mTID = syscall(SYS_gettid);
+	// Linux limits names to 15 characters.
+	if (role.size()) pthread_setname_np(thread.mID,role.substr(0,15).c_str());
+	mLock.lock();
+	mThreads.push_back(thread);
+	apply(thread);
+	mLock.unlock();
+}
+
+
+void ThreadRegistry::leave()
+{
+	pthread_t self = pthread_self();
+	mLock.lock();
+	for (RecordList::iterator t = mThreads.begin(); t!=mThreads.end(); ++t) {
+		if (!pthread_equal(t->mID,self)) continue;
+		mThreads.erase(t);
+		break;
+	}
+	mLock.unlock();
+}
+
+
+void ThreadRegistry::dump(std::ostream& os) const
+{
+	mLock.lock();
+	for (RecordList::const_iterator t = mThreads.begin(); t!=mThreads.end(); ++t) {
+		os << t->mTID << " " << (t->mRole.size() ? t->mRole : "-");
+		clockid_t clock;
+		struct timespec cpu;
+		if (pthread_getcpuclockid(t->mID,&clock)==0 && clock_gettime(clock,&cpu)==0) {
+			os << " cpu " << cpu.tv_sec + cpu.tv_nsec*1e-9 << " s";
+		}
+		PolicyMap::const_iterator p = mPolicies.find(t->mRole);
+		if (p!=mPolicies.end()) {
+			const ThreadPolicy& policy = p->second;
+			if (policy.mCPUs.size()) {
+				os << " CPUs";
+				for (unsigned i=0; i<policy.mCPUs.size(); i++) os << " " << policy.mCPUs[i];
+			}
+			if (policy.mScheduler==SCHED_FIFO) os << " FIFO " << policy.mPriority;
+			if (policy.mScheduler==SCHED_RR) os << " RR " << policy.mPriority;
+		}
+		os << endl;
+	}
+	mLock.unlock();
+}
+
+
+
+/** What a new thread needs to register itself before running its task. */
+struct ThreadLaunch {
+	void *(*mTask)(void*);
+	void *mArg;
+	std::string mRole;
+};
+
+
+static void *threadLaunch(void *arg)
+{
+	ThreadLaunch* launch = (ThreadLaunch*)arg;
+	gThreadRegistry().enter(launch->mRole);
+	void* retVal = launch->mTask(launch->mArg);
+	gThreadRegistry().leave();
+	delete launch;
+	return retVal;
+}
+
+
+void Thread::start(void *(*task)(void*), void *arg, const char* role)
 {
 	int s;
 	assert(mThread==((pthread_t)0));
 
+	ThreadLaunch* launch = new ThreadLaunch;
+	launch->mTask = task;
+	launch->mArg = arg;
+	launch->mRole = role;
+
 	s = pthread_attr_init(&mAttrib);
 	assert(s == 0);
 	s = pthread_attr_setstacksize(&mAttrib, mStackSize);
 	assert(s == 0);
-	s = pthread_create(&mThread, &mAttrib, task, arg);
+	s = pthread_create(&mThread, &mAttrib, threadLaunch, launch);
 	assert(s == 0);
 }
 
@@ -30,6 +30,11 @@
 #include <iostream>
 #include <assert.h>
 #include <semaphore.h>
+#include <sys/types.h>
+#include <map>
+#include <list>
+#include <string>
+#include <vector>
 
 class Mutex;
 
@@ -181,6 +186,72 @@ class ThreadSemaphore {
 #define START_THREAD(thread,function,argument) \
 	thread.start((void *(*)(void*))function, (void*)argument);
 
+/**
+	Scheduling policy for a thread role.
+	Configured as Thread.<role>.CPUs (a list like "2 3" or "2-3"),
+	Thread.<role>.Scheduler (OTHER, FIFO or RR) and Thread.<role>.Priority.
+*/
+struct ThreadPolicy {
+
+	std::vector<int> mCPUs;		///< allowed CPUs, empty for any
+	int mScheduler;				///< SCHED_OTHER, SCHED_FIFO or SCHED_RR
+	int mPriority;				///< static priority for FIFO and RR
+
+	ThreadPolicy();
+};
+
+
+/**
+	Registry of running threads by role, and of the policies for the roles.
+	Every Thread registers itself, is named after its role with
+	pthread_setname_np, and takes its role's policy as it starts.
+*/
+class ThreadRegistry {
+
+	private:
+
+	/** A running thread. */
+	struct Record {
+		std::string mRole;
+		pthread_t mID;
+		pid_t mTID;				///< kernel thread ID
+	};
+
+	typedef std::map<std::string,ThreadPolicy> PolicyMap;
+	typedef std::list<Record> RecordList;
+
+	mutable Mutex mLock;
+	PolicyMap mPolicies;
+	RecordList mThreads;
+
+	/** Apply a role's policy to a thread.  Caller holds mLock. */
+	bool apply(const Record& thread) const;
+
+	public:
+
+	/**
+		Load policies from configuration keys Thread.<role>.<attribute>,
+		and apply them to threads already running.
+		@param config The configuration, as a key-value map.
+		@return False if a policy could not be applied.
+	*/
+	bool configure(const std::map<std::string,std::string>& config);
+
+	/** Register the calling thread under a role; applies the name and policy. */
+	void enter(const std::string& role);
+
+	/** Unregister the calling thread. */
+	void leave();
+
+	/** Print each thread with its role, kernel ID, CPU time and CPUs. */
+	void dump(std::ostream&) const;
+};
+
+/** The process-wide registry, created on first use so threads started during static initialization can use it. */
+ThreadRegistry& gThreadRegistry();
+
+
+
 /** A C++ wrapper for pthread threads.  */
 class Thread {
 
@@ -204,8 +275,13 @@ class Thread {
 	~Thread() { int s = pthread_attr_destroy(&mAttrib); assert(s==0); }
 
 
-	/** Start the thread on a task. */
-	void start(void *(*task)(void*), void *arg);
+	/**
+		Start the thread on a task.
+		@param task The thread function.
+		@param arg Its argument.
+		@param role The role, which names the thread and selects its ThreadPolicy.
+	*/
+	void start(void *(*task)(void*), void *arg, const char* role="");
 
 	/** Join a thread that will stop on its own. */
 
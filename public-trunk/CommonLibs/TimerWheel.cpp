@@ -0,0 +1,256 @@
+/*
+* Copyright 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+
+#include "TimerWheel.h"
+#include <string.h>
+
+
+TimerWheel& gTimerWheel = *new TimerWheel;
+
+
+
+TimerEntry::~TimerEntry()
+{
+	if (mWheel) mWheel->cancel(this,true);
+}
+
+
+
+
+void *TimerWheelServiceLoopAdapter(TimerWheel* wheel)
+{
+	wheel->serviceLoop();
+	return NULL;
+}
+
+
+
+TimerWheel::TimerWheel()
+	:mNow(0),mWakeTick(0),mArmed(0),mRunning(NULL),
+	mThread(NULL),mExpirations(0),mWakeups(0)
+{
+	memset(mL0,0,sizeof(mL0));
+	memset(mLn,0,sizeof(mLn));
+}
+
+
+uint64_t TimerWheel::currentTick() const
+{
+	long elapsed = mEpoch.elapsed();
+	// The wall clock can step back; a tick never does.
+	if (elapsed<0) return 0;
+	return elapsed / mTickMs;
+}
+
+
+void TimerWheel::insert(TimerEntry* entry)
+{
+	// An overdue entry goes in the next slot to be processed.
+	if (entry->mExpiry < mNow) entry->mExpiry = mNow;
+	uint64_t delta = entry->mExpiry - mNow;
+	TimerEntry** slot;
+	if (delta < mL0Size) {
+		slot = &mL0[entry->mExpiry & (mL0Size-1)];
+	} else {
+		const uint64_t span = 1ULL << (mL0Bits + (mLevels-1)*mLnBits);
+		if (delta >= span) entry->mExpiry = mNow + span - 1;
+		unsigned level = 0;
+		unsigned shift = mL0Bits;
+		while (level < mLevels-2 && delta >= (1ULL << (shift+mLnBits))) {
+			level++;
+			shift += mLnBits;
+		}
+		slot = &mLn[level][(entry->mExpiry >> shift) & (mLnSize-1)];
+	}
+	entry->mNext = *slot;
+	if (entry->mNext) entry->mNext->mPrevNext = &entry->mNext;
+	entry->mPrevNext = slot;
+	*slot = entry;
+}
+
+
+void TimerWheel::unlink(TimerEntry* entry)
+{
+	*entry->mPrevNext = entry->mNext;
+	if (entry->mNext) entry->mNext->mPrevNext = entry->mPrevNext;
+	entry->mNext = NULL;
+	entry->mPrevNext = NULL;
+}
+
+
+unsigned TimerWheel::cascade(unsigned level)
+{
+	unsigned shift = mL0Bits + level*mLnBits;
+	unsigned index = (mNow >> shift) & (mLnSize-1);
+	TimerEntry* entry = mLn[level][index];
+	mLn[level][index] = NULL;
+	while (entry) {
+		TimerEntry* next = entry->mNext;
+		entry->mNext = NULL;
+		entry->mPrevNext = NULL;
+		insert(entry);
+		entry = next;
+	}
+	return index;
+}
+
+
+void TimerWheel::advance(uint64_t target)
+{
+	while (mNow <= target) {
+		unsigned index = mNow & (mL0Size-1);
+		if (index==0) {
+			for (unsigned level=0; level<mLevels-1; level++) {
+				if (cascade(level)!=0) break;
+			}
+		}
+		// Run the slot one entry at a time, without the lock,
+		// so that expire() can arm and cancel.
+		while (TimerEntry* entry = mL0[index]) {
+			unlink(entry);
+			mArmed--;
+			mExpirations++;
+			mRunning = entry;
+			mLock.unlock();
+			entry->expire();
+			mLock.lock();
+			mRunning = NULL;
+			mDoneSignal.broadcast();
+		}
+		mNow++;
+	}
+}
+
+
+uint64_t TimerWheel::nextWork() const
+{
+	// A cascade may be due now.
+	if ((mNow & (mL0Size-1))==0) return mNow;
+	// Otherwise scan level 0 up to the next cascade.
+	uint64_t tick = mNow;
+	while (!mL0[tick & (mL0Size-1)]) {
+		tick++;
+		if ((tick & (mL0Size-1))==0) break;
+	}
+	return tick;
+}
+
+
+void TimerWheel::arm(TimerEntry* entry, long ms)
+{
+	if (ms<0) ms = 0;
+	mLock.lock();
+	if (entry->mPrevNext) unlink(entry);
+	else mArmed++;
+	entry->mWheel = this;
+	// The first tick after the deadline, so that the entry never expires early,
+	// even though elapsed() truncates to the millisecond.
+	long elapsed = mEpoch.elapsed();
+	if (elapsed<0) elapsed = 0;
+	entry->mExpiry = (elapsed + ms) / mTickMs + 1;
+	insert(entry);
+	if (!mThread) {
+		mThread = new Thread;
+		mThread->start((void*(*)(void*))TimerWheelServiceLoopAdapter,this,"timer");
+	}
+	if (entry->mExpiry < mWakeTick) mWakeSignal.signal();
+	mLock.unlock();
+}
+
+
+bool TimerWheel::cancel(TimerEntry* entry, bool wait)
+{
+	mLock.lock();
+	bool wasArmed = (entry->mPrevNext!=NULL);
+	if (wasArmed) {
+		unlink(entry);
+		mArmed--;
+	}
+	if (wait && mThread && !pthread_equal(pthread_self(),mThreadID)) {
+		while (mRunning==entry) mDoneSignal.wait(mLock);
+	}
+	mLock.unlock();
+	return wasArmed;
+}
+
+
+bool TimerWheel::armed(const TimerEntry* entry) const
+{
+	mLock.lock();
+	bool retVal = (entry->mPrevNext!=NULL);
+	mLock.unlock();
+	return retVal;
+}
+
+
+unsigned TimerWheel::armed() const
+{
+	mLock.lock();
+	unsigned retVal = mArmed;
+	mLock.unlock();
+	return retVal;
+}
+
+
+unsigned TimerWheel::expirations() const
+{
+	mLock.lock();
+	unsigned retVal = mExpirations;
+	mLock.unlock();
+	return retVal;
+}
+
+
+unsigned TimerWheel::wakeups() const
+{
+	mLock.lock();
+	unsigned retVal = mWakeups;
+	mLock.unlock();
+	return retVal;
+}
+
+
+void TimerWheel::serviceLoop()
+{
+	mLock.lock();
+	mThreadID = pthread_self();
+	while (true) {
+		mWakeups++;
+		advance(currentTick());
+		if (mArmed==0) {
+			mWakeTick = ~(uint64_t)0;
+			mWakeSignal.wait(mLock);
+			continue;
+		}
+		mWakeTick = nextWork();
+		long ms = mWakeTick*mTickMs - mEpoch.elapsed();
+		if (ms>0) mWakeSignal.wait(mLock,ms);
+	}
+}
+
+
+// vim: ts=4 sw=4
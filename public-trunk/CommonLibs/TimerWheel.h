@@ -0,0 +1,185 @@
+/*
+* Copyright 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include "Threads.h"
+#include "Timeval.h"
+#include <stdint.h>
+
+
+class TimerWheel;
+
+
+/**
+	An expiration registered on a TimerWheel.
+	Subclasses say what happens when it expires.
+*/
+class TimerEntry {
+
+	private:
+
+	friend class TimerWheel;
+
+	TimerEntry* mNext;			///< next entry in the same wheel slot
+	TimerEntry** mPrevNext;		///< the pointer to this entry in its slot, NULL if not armed
+	uint64_t mExpiry;			///< expiration time, in wheel ticks
+	TimerWheel* mWheel;			///< the wheel this entry was last armed on
+
+	public:
+
+	TimerEntry():mNext(NULL),mPrevNext(NULL),mExpiry(0),mWheel(NULL) {}
+
+	/**
+		Cancel the entry and wait out any expiration in progress.
+		By now the subclass is gone, so owners that can be destroyed
+		while armed should cancel in their own destructors.
+	*/
+	virtual ~TimerEntry();
+
+	/**
+		Called from the timer thread when the entry expires, with no wheel lock held.
+		It should be quick and must not wait on any lock held by code that
+		arms or cancels timers.  It may re-arm the entry.
+	*/
+	virtual void expire() =0;
+};
+
+
+
+/**
+	Hierarchical timing wheel, after Varghese and Lauck.
+
+	One thread serves every timer.  Arm and cancel are O(1).
+	Level 0 has one slot per tick; each higher level covers
+	a whole turn of the level below in each slot, and its slots are
+	cascaded down as the level below wraps.  The thread sleeps until
+	the next occupied level-0 slot or the next cascade, and not at all
+	while nothing is armed.
+
+	Expirations are never early, and late by about a tick.
+	Times beyond the top level, about 3.9 days, are clamped to it.
+*/
+class TimerWheel {
+
+	public:
+
+	static const unsigned mTickMs = 5;				///< tick length
+
+	private:
+
+	static const unsigned mLevels = 4;
+	static const unsigned mL0Bits = 8;
+	static const unsigned mL0Size = 1<<mL0Bits;		///< level 0 slots
+	static const unsigned mLnBits = 6;
+	static const unsigned mLnSize = 1<<mLnBits;		///< slots on each higher level
+
+	mutable Mutex mLock;
+	TimerEntry* mL0[mL0Size];						///< level 0, one tick per slot
+	TimerEntry* mLn[mLevels-1][mLnSize];			///< levels 1 and up
+	uint64_t mNow;				///< the next tick to be processed
+	uint64_t mWakeTick;			///< the tick the thread is sleeping until
+	Timeval mEpoch;				///< the time of tick 0
+	unsigned mArmed;			///< armed entries
+	TimerEntry* mRunning;		///< the entry whose expire() is running, if any
+
+	Signal mWakeSignal;			///< wakes the thread for an earlier expiration
+	Signal mDoneSignal;			///< signalled after each expire() returns
+	Thread* mThread;			///< started on the first arm()
+	pthread_t mThreadID;
+
+	/**@name Statistics */
+	//@{
+	unsigned mExpirations;
+	unsigned mWakeups;
+	//@}
+
+	/** The current time, in ticks, rounded down. */
+	uint64_t currentTick() const;
+
+	/** Link an entry into the slot for its expiry.  Caller holds mLock. */
+	void insert(TimerEntry* entry);
+
+	/** Unlink an armed entry.  Caller holds mLock. */
+	void unlink(TimerEntry* entry);
+
+	/**
+		Move the entries of the current slot at a level down the wheel.
+		Caller holds mLock.
+		@return The index of the slot cascaded.
+	*/
+	unsigned cascade(unsigned level);
+
+	/** Process ticks up to and including target.  Caller holds mLock. */
+	void advance(uint64_t target);
+
+	/** The tick at which the thread next has work.  Caller holds mLock. */
+	uint64_t nextWork() const;
+
+	public:
+
+	TimerWheel();
+
+	/**
+		Arm or re-arm an entry.
+		@param entry The entry, which may already be armed on this wheel.
+		@param ms The time to expiration in milliseconds.
+	*/
+	void arm(TimerEntry* entry, long ms);
+
+	/**
+		Cancel an entry.
+		An expire() already in progress on another thread may still finish,
+		unless wait is set.
+		@param entry The entry.
+		@param wait If true, wait for an expire() in progress to return.
+		@return True if the entry was armed.
+	*/
+	bool cancel(TimerEntry* entry, bool wait=false);
+
+	/** True if the entry is armed on this wheel. */
+	bool armed(const TimerEntry* entry) const;
+
+	/**@name Statistics */
+	//@{
+	unsigned armed() const;
+	unsigned expirations() const;
+	/** Number of times the timer thread has woken. */
+	unsigned wakeups() const;
+	//@}
+
+	/** The timer thread.  Never returns. */
+	void serviceLoop();
+};
+
+
+/** The process-wide timer service; never destroyed, so static objects can cancel at exit. */
+extern TimerWheel& gTimerWheel;
+
+
+#endif
+// vim: ts=4 sw=4
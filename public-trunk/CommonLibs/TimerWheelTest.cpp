@@ -0,0 +1,107 @@
+/*
+* Copyright 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+
+#include "TimerWheel.h"
+#include <iostream>
+#include <cstdlib>
+
+using namespace std;
+
+
+/** Records when it expired, against when it should have. */
+class Probe : public TimerEntry {
+
+	public:
+
+	Timeval mDeadline;
+	bool mFired;
+	long mLateness;			///< ms after the deadline
+	bool mCancelled;
+
+	Probe():mFired(false),mLateness(0),mCancelled(false) {}
+
+	void arm(long ms)
+	{
+		mDeadline = Timeval(ms);
+		gTimerWheel.arm(this,ms);
+	}
+
+	void expire()
+	{
+		mLateness = mDeadline.elapsed();
+		mFired = true;
+	}
+};
+
+
+int main(int argc, char *argv[])
+{
+	const unsigned count = (argc>1) ? atoi(argv[1]) : 1000;
+	const long span = 3000;
+	Probe* probes = new Probe[count];
+	for (unsigned i=0; i<count; i++) probes[i].arm(random() % span);
+	COUT(gTimerWheel.armed() << " armed");
+
+	// Cancel some and move some.
+	for (unsigned i=0; i<count; i+=4) {
+		gTimerWheel.cancel(&probes[i]);
+		probes[i].mCancelled = true;
+	}
+	for (unsigned i=2; i<count; i+=8) probes[i].arm(random() % span);
+
+	sleep(span/1000 + 1);
+
+	unsigned fired = 0;
+	unsigned early = 0;
+	unsigned wrong = 0;
+	long maxLate = 0;
+	for (unsigned i=0; i<count; i++) {
+		const Probe& p = probes[i];
+		if (p.mFired==p.mCancelled) {
+			wrong++;
+			continue;
+		}
+		if (!p.mFired) continue;
+		fired++;
+		if (p.mLateness<0) early++;
+		if (p.mLateness>maxLate) maxLate = p.mLateness;
+	}
+	COUT(fired << " expired, " << early << " early, " << wrong << " wrong, "
+		<< "latest " << maxLate << " ms (tick " << TimerWheel::mTickMs << " ms)");
+	COUT(gTimerWheel.expirations() << " expirations in " << gTimerWheel.wakeups() << " wakeups, "
+		<< gTimerWheel.armed() << " still armed");
+
+	// A long timer goes through the upper levels.
+	Probe slow;
+	slow.arm(3*256*TimerWheel::mTickMs);
+	sleep(5);
+	COUT("cascaded timer " << slow.mLateness << " ms late");
+	delete[] probes;
+}
+
+
+// vim: ts=4 sw=4
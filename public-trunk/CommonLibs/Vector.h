@@ -32,6 +32,30 @@
 #include <string.h>
 #include <iostream>
 #include <assert.h>
+#include "VectorPool.h"
+
+
+/**
+	Storage policy for Vector<T>: plain new[] and delete[].
+	The choice is made per element type, never per instance, because the shifting
+	constructors hand blocks between Vectors and each must be freed as it was allocated.
+*/
+template <class T> struct VectorStorage {
+	static T* allocate(size_t count) { return new T[count]; }
+	static void release(T* data) { delete[] data; }
+};
+
+/** BitVector storage, for bursts and frames, comes from VectorPool. */
+template <> struct VectorStorage<char> {
+	static char* allocate(size_t count) { return (char*)VectorPool::allocate(count); }
+	static void release(char* data) { VectorPool::release(data); }
+};
+
+/** SoftVector storage, for received bursts and soft frames, comes from VectorPool. */
+template <> struct VectorStorage<float> {
+	static float* allocate(size_t count) { return (float*)VectorPool::allocate(count*sizeof(float)); }
+	static void release(float* data) { VectorPool::release(data); }
+};
 
 
 /**
@@ -73,9 +97,9 @@ template <class T> class Vector {
 	/** Change the size of the Vector, discarding content. */
 	void resize(size_t newSize)
 	{
-		if (mData!=NULL) delete[] mData;
+		if (mData!=NULL) VectorStorage<T>::release(mData);
 		if (newSize==0) mData=NULL;
-		else mData = new T[newSize];
+		else mData = VectorStorage<T>::allocate(newSize);
 		mStart = mData;
 		mEnd = mStart + newSize;
 	}
@@ -0,0 +1,309 @@
+/*
+* Copyright 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+
+#include "VectorPool.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <assert.h>
+
+
+// Everything here is POD and statically initialized, because Vectors are
+// built and destroyed by static constructors and destructors in other modules.
+
+
+namespace {
+
+/** A free block; the link lives in the payload. */
+struct FreeBlock {
+	FreeBlock* mNext;
+};
+
+/** The header in front of every block, keeping the payload 16-byte aligned. */
+union BlockHeader {
+	unsigned mClass;			///< size class, or bigClass for malloc'd blocks
+	char mPad[16];
+};
+
+/** A thread's private free lists. */
+struct ThreadCache {
+	FreeBlock* mFree[VectorPool::numClasses];
+	unsigned mCount[VectorPool::numClasses];
+	unsigned long mAllocations;
+	unsigned long mReleases;
+	ThreadCache* mNext;			///< next in sCaches
+};
+
+}
+
+static const unsigned bigClass = VectorPool::numClasses;
+static const unsigned batchSize = 32;		///< blocks moved per refill, and per slab
+static const unsigned cacheLimit = 64;		///< blocks per class a thread may hold
+
+static pthread_mutex_t sLock = PTHREAD_MUTEX_INITIALIZER;	///< protects everything below
+static FreeBlock* sDepot[VectorPool::numClasses];
+static unsigned sDepotCount[VectorPool::numClasses];
+static ThreadCache* sCaches;				///< caches of live threads
+static unsigned long sRetiredAllocations;	///< counts from exited threads
+static unsigned long sRetiredReleases;
+static unsigned long sMallocs;				///< also bumped atomically for big blocks
+static unsigned long sRefills;
+static unsigned long sFlushes;
+static unsigned long sReserved;
+
+static pthread_once_t sKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t sKey;
+
+static __thread ThreadCache* tCache;
+static __thread bool tRetired;
+
+
+
+static size_t payloadSize(unsigned sizeClass) { return VectorPool::minBlock << sizeClass; }
+
+static unsigned classFor(size_t bytes)
+{
+	if (bytes>VectorPool::maxBlock) return bigClass;
+	unsigned sizeClass = 0;
+	while (payloadSize(sizeClass)<bytes) sizeClass++;
+	return sizeClass;
+}
+
+static BlockHeader* header(void* payload) { return (BlockHeader*)payload - 1; }
+
+
+
+/** Carve a new slab into the depot.  Caller holds sLock. */
+static void grow(unsigned sizeClass)
+{
+	size_t blockSize = sizeof(BlockHeader) + payloadSize(sizeClass);
+	char* slab = (char*)malloc(batchSize*blockSize);
+	assert(slab);
+	sMallocs++;
+	sReserved += batchSize*blockSize;
+	for (unsigned i=0; i<batchSize; i++) {
+		BlockHeader* hdr = (BlockHeader*)(slab + i*blockSize);
+		hdr->mClass = sizeClass;
+		FreeBlock* block = (FreeBlock*)(hdr+1);
+		block->mNext = sDepot[sizeClass];
+		sDepot[sizeClass] = block;
+	}
+	sDepotCount[sizeClass] += batchSize;
+}
+
+
+/** Move up to count blocks from the depot onto a list.  Caller holds sLock. */
+static unsigned takeFromDepot(unsigned sizeClass, FreeBlock** list, unsigned count)
+{
+	if (sDepot[sizeClass]==NULL) grow(sizeClass);
+	unsigned moved = 0;
+	while (moved<count && sDepot[sizeClass]) {
+		FreeBlock* block = sDepot[sizeClass];
+		sDepot[sizeClass] = block->mNext;
+		block->mNext = *list;
+		*list = block;
+		moved++;
+	}
+	sDepotCount[sizeClass] -= moved;
+	return moved;
+}
+
+
+/** Move up to count blocks from a list to the depot.  Caller holds sLock. */
+static unsigned giveToDepot(unsigned sizeClass, FreeBlock** list, unsigned count)
+{
+	unsigned moved = 0;
+	while (moved<count && *list) {
+		FreeBlock* block = *list;
+		*list = block->mNext;
+		block->mNext = sDepot[sizeClass];
+		sDepot[sizeClass] = block;
+		moved++;
+	}
+	sDepotCount[sizeClass] += moved;
+	return moved;
+}
+
+
+/** Thread exit: hand the cache's blocks and counts back to the depot. */
+static void retireCache(void* arg)
+{
+	ThreadCache* cache = (ThreadCache*)arg;
+	pthread_mutex_lock(&sLock);
+	for (unsigned c=0; c<VectorPool::numClasses; c++) {
+		giveToDepot(c,&cache->mFree[c],cache->mCount[c]);
+	}
+	sRetiredAllocations += cache->mAllocations;
+	sRetiredReleases += cache->mReleases;
+	ThreadCache** pp = &sCaches;
+	while (*pp!=cache) pp = &(*pp)->mNext;
+	*pp = cache->mNext;
+	pthread_mutex_unlock(&sLock);
+	free(cache);
+	// Anything this thread frees from here on goes straight to the depot.
+	tCache = NULL;
+	tRetired = true;
+}
+
+
+static void makeKey()
+{
+	pthread_key_create(&sKey,retireCache);
+}
+
+
+/** Return this thread's cache, creating it on first use; NULL once the thread is exiting. */
+static ThreadCache* threadCache()
+{
+	if (tCache) return tCache;
+	if (tRetired) return NULL;
+	pthread_once(&sKeyOnce,makeKey);
+	ThreadCache* cache = (ThreadCache*)calloc(1,sizeof(ThreadCache));
+	assert(cache);
+	pthread_mutex_lock(&sLock);
+	cache->mNext = sCaches;
+	sCaches = cache;
+	pthread_mutex_unlock(&sLock);
+	pthread_setspecific(sKey,cache);
+	tCache = cache;
+	return cache;
+}
+
+
+
+void* VectorPool::allocate(size_t bytes)
+{
+	unsigned sizeClass = classFor(bytes);
+	ThreadCache* cache = threadCache();
+	if (sizeClass==bigClass) {
+		__sync_fetch_and_add(&sMallocs,1);
+		BlockHeader* hdr = (BlockHeader*)malloc(sizeof(BlockHeader)+bytes);
+		assert(hdr);
+		hdr->mClass = bigClass;
+		if (cache) cache->mAllocations++;
+		else __sync_fetch_and_add(&sRetiredAllocations,1);
+		return hdr+1;
+	}
+
+	FreeBlock* block;
+	if (cache) {
+		cache->mAllocations++;
+		if (cache->mFree[sizeClass]==NULL) {
+			pthread_mutex_lock(&sLock);
+			cache->mCount[sizeClass] += takeFromDepot(sizeClass,&cache->mFree[sizeClass],batchSize);
+			sRefills++;
+			pthread_mutex_unlock(&sLock);
+		}
+		block = cache->mFree[sizeClass];
+		cache->mFree[sizeClass] = block->mNext;
+		cache->mCount[sizeClass]--;
+	} else {
+		block = NULL;
+		pthread_mutex_lock(&sLock);
+		takeFromDepot(sizeClass,&block,1);
+		sRetiredAllocations++;
+		pthread_mutex_unlock(&sLock);
+	}
+	return block;
+}
+
+
+
+void VectorPool::release(void* payload)
+{
+	if (payload==NULL) return;
+	BlockHeader* hdr = header(payload);
+	unsigned sizeClass = hdr->mClass;
+	ThreadCache* cache = threadCache();
+	if (sizeClass==bigClass) {
+		free(hdr);
+		if (cache) cache->mReleases++;
+		else __sync_fetch_and_add(&sRetiredReleases,1);
+		return;
+	}
+	assert(sizeClass<numClasses);
+
+	FreeBlock* block = (FreeBlock*)payload;
+	if (cache) {
+		cache->mReleases++;
+		block->mNext = cache->mFree[sizeClass];
+		cache->mFree[sizeClass] = block;
+		if (++cache->mCount[sizeClass] > cacheLimit) {
+			// Spill half, so a thread that only frees (a consumer of another
+			// thread's frames) feeds the producers instead of hoarding.
+			pthread_mutex_lock(&sLock);
+			cache->mCount[sizeClass] -= giveToDepot(sizeClass,&cache->mFree[sizeClass],cacheLimit/2);
+			sFlushes++;
+			pthread_mutex_unlock(&sLock);
+		}
+	} else {
+		block->mNext = NULL;
+		pthread_mutex_lock(&sLock);
+		giveToDepot(sizeClass,&block,1);
+		sRetiredReleases++;
+		pthread_mutex_unlock(&sLock);
+	}
+}
+
+
+
+void VectorPool::stats(VectorPoolStats& s)
+{
+	pthread_mutex_lock(&sLock);
+	s.mAllocations = sRetiredAllocations;
+	s.mReleases = sRetiredReleases;
+	// Other threads' counters are read without their cooperation;
+	// the totals are for monitoring, not accounting.
+	for (ThreadCache* cache=sCaches; cache; cache=cache->mNext) {
+		s.mAllocations += cache->mAllocations;
+		s.mReleases += cache->mReleases;
+	}
+	s.mMallocs = sMallocs;
+	s.mRefills = sRefills;
+	s.mFlushes = sFlushes;
+	s.mReserved = sReserved;
+	pthread_mutex_unlock(&sLock);
+}
+
+
+
+void VectorPool::dump(std::ostream& os)
+{
+	VectorPoolStats s;
+	stats(s);
+	os << "allocations=" << s.mAllocations << " releases=" << s.mReleases;
+	os << " outstanding=" << (long)(s.mAllocations - s.mReleases) << std::endl;
+	os << "mallocs=" << s.mMallocs << " refills=" << s.mRefills << " flushes=" << s.mFlushes;
+	os << " reserved=" << s.mReserved << " bytes" << std::endl;
+	pthread_mutex_lock(&sLock);
+	os << "depot:";
+	for (unsigned c=0; c<numClasses; c++) os << " " << payloadSize(c) << "B=" << sDepotCount[c];
+	pthread_mutex_unlock(&sLock);
+	os << std::endl;
+}
+
+
+// vim: ts=4 sw=4
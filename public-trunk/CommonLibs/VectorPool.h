@@ -0,0 +1,79 @@
+/*
+* Copyright 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+
+#ifndef VECTORPOOL_H
+#define VECTORPOOL_H
+
+#include <stddef.h>
+#include <ostream>
+
+
+/** Counters reported by VectorPool::stats(). */
+struct VectorPoolStats {
+	unsigned long mAllocations;		///< blocks handed out
+	unsigned long mReleases;		///< blocks given back
+	unsigned long mMallocs;			///< calls to malloc, for slabs and oversize blocks
+	unsigned long mRefills;			///< thread cache refills from the shared depot
+	unsigned long mFlushes;			///< thread cache spills back to the shared depot
+	unsigned long mReserved;		///< bytes held in slabs
+};
+
+
+/**
+	A size-class allocator for Vector storage.
+	Blocks come from per-thread free lists that are refilled in batches from a
+	shared depot, and the depot is refilled from malloc a slab at a time.
+	Slabs are kept for reuse and never returned to the system, so once a steady
+	load has warmed the pool it runs without calling malloc at all.
+	Blocks larger than maxBlock go straight to malloc.
+	All state is statically initialized, so Vectors may be built and destroyed
+	during static construction and destruction.
+*/
+class VectorPool {
+
+	public:
+
+	static const unsigned numClasses = 7;							///< power-of-two size classes
+	static const size_t minBlock = 64;								///< smallest class, in bytes
+	static const size_t maxBlock = minBlock<<(numClasses-1);		///< largest class, in bytes
+
+	/** Return a block of at least the given size, 16-byte aligned. */
+	static void* allocate(size_t bytes);
+
+	/** Return a block from allocate() to the pool. */
+	static void release(void* block);
+
+	/** Sum the counters across all threads. */
+	static void stats(VectorPoolStats&);
+
+	/** Dump the counters and the depot occupancy. */
+	static void dump(std::ostream&);
+};
+
+
+#endif
+// vim: ts=4 sw=4
@@ -25,12 +25,59 @@
 
 
 #include "Vector.h"
+#include "Interthread.h"
 #include <iostream>
+#include <sys/time.h>
 
 using namespace std;
 
 typedef Vector<int> TestVector;
 
+
+static double now()
+{
+	struct timeval tv;
+	gettimeofday(&tv,NULL);
+	return tv.tv_sec + tv.tv_usec*1e-6;
+}
+
+
+static unsigned long poolMallocs()
+{
+	VectorPoolStats stats;
+	VectorPool::stats(stats);
+	return stats.mMallocs;
+}
+
+
+/** Build and destroy burst- and frame-sized Vectors, as L1 does at burst rate. */
+template <class T>
+static double churn(unsigned count)
+{
+	double start = now();
+	for (unsigned i=0; i<count; i++) {
+		Vector<T> burst(148);		// RxBurst/TxBurst
+		Vector<T> frame(184);		// L2Frame
+		burst[0] = frame[0] = 0;
+	}
+	return (now()-start)*1e9/(2*count);
+}
+
+
+/** Frames built on one thread and destroyed on another, as from decoder to LAPDm. */
+static InterthreadQueue< Vector<float> > gFrames;
+static const unsigned gNumFrames = 200000;
+
+static void* producer(void*)
+{
+	for (unsigned i=0; i<gNumFrames; i++) {
+		gFrames.write(new Vector<float>(148));
+		// Keep the queue short, as a real frame path does.
+		if (gFrames.size()>32) usleep(100);
+	}
+	return NULL;
+}
+
 int main(int argc, char *argv[])
 {
 	TestVector test1(5);
@@ -58,5 +105,26 @@ int main(int argc, char *argv[])
 		cout << testD << endl;
 	}
 
+	// Pool: a steady load should stop calling malloc once warmed.
+	churn<float>(1000);
+	unsigned long mallocs = poolMallocs();
+	double pooled = churn<float>(1000000);
+	cout << "pooled float: " << pooled << " ns/alloc, mallocs during run " << poolMallocs()-mallocs << endl;
+	double plain = churn<int>(1000000);
+	cout << "new[] int: " << plain << " ns/alloc" << endl;
+
+	Thread producerThread;
+	producerThread.start(producer,NULL);
+	mallocs = poolMallocs();
+	unsigned long warm = 0;
+	for (unsigned i=0; i<gNumFrames; i++) {
+		delete gFrames.read();
+		if (i==gNumFrames/10) warm = poolMallocs();
+	}
+	producerThread.join();
+	cout << "cross-thread: mallocs while warming " << warm-mallocs
+		<< ", after " << poolMallocs()-warm << endl;
+	VectorPool::dump(cout);
+
 	return 0;
 }
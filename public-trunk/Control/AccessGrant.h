@@ -0,0 +1,203 @@
+/**@file RACH processing stage, answering channel requests on the AGCHs. */
+/*
+* Copyright 2008, 2009, 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#ifndef ACCESSGRANT_H
+#define ACCESSGRANT_H
+
+#include <deque>
+#include <vector>
+#include <ostream>
+
+#include <Threads.h>
+#include <Timeval.h>
+#include <GSMCommon.h>
+#include <GSML3RRElements.h>
+
+
+namespace Control {
+
+
+/**
+	Answers channel requests from the RACH decoders on the AGCHs,
+	in its own thread, so a burst of access bursts is answered as a batch.
+	- A burst repeating the RA of one already taken, within the RACH
+	  retransmission window, is dropped as a retransmission.
+	- Requests are answered in priority order: emergency calls, then
+	  paging responses, then other services, then location updates.
+	  While the AGCHs are congested only the first two are answered.
+	- Answers are packed per CCCH block: two assignments to an Immediate
+	  Assignment Extended and up to four rejections to an Immediate
+	  Assignment Reject.  While every AGCH has a block queued, requests
+	  accumulate so that more of them share blocks.
+	- A rejection's wait indication is the time for enough channels of the
+	  needed type to free up, from their measured holding time, rather than
+	  a T3122 grown on every rejection.
+*/
+class AccessGrantStage {
+
+	public:
+
+	/** Request priorities, highest first. */
+	enum Priority {
+		Emergency,
+		PagingResponse,
+		Normal,
+		LocationUpdate,
+		NumPriorities
+	};
+
+	private:
+
+	/** A channel request waiting for an answer. */
+	class Request {
+
+		public:
+
+		unsigned mRA;
+		GSM::Time mWhen;			///< receive time of the burst
+		float mRSSI;
+		float mTimingError;
+		Priority mPriority;
+
+		Request(unsigned wRA, const GSM::Time& wWhen, float wRSSI, float wTimingError, Priority wPriority)
+			:mRA(wRA),mWhen(wWhen),mRSSI(wRSSI),mTimingError(wTimingError),
+			mPriority(wPriority)
+		{}
+	};
+
+	/** An allocated channel waiting for its assignment to be sent. */
+	class Grant {
+
+		public:
+
+		GSM::L3RequestReference mReference;
+		GSM::L3ChannelDescription mDescription;
+		GSM::L3TimingAdvance mTimingAdvance;
+		GSM::Time mWhen;
+
+		Grant(const Request& req, const GSM::L3ChannelDescription& wDescription, unsigned TA)
+			:mReference(req.mRA,req.mWhen),mDescription(wDescription),
+			mTimingAdvance(TA),mWhen(req.mWhen)
+		{}
+	};
+
+	mutable Mutex mLock;
+	std::deque<Request> mQueues[NumPriorities];
+	Signal mSignal;						///< signalled when a request is queued
+	Thread mThread;
+	bool mRunning;
+	int mWindow;						///< RACH retransmission window, in frames
+
+	/**@name Receive times of the latest request taken for each RA, for de-duplication. */
+	//@{
+	GSM::Time mLastSeen[256];
+	bool mSeen[256];
+	//@}
+
+	/**@name Statistics. */
+	//@{
+	unsigned long mBursts;				///< RACH bursts posted
+	unsigned long mDuplicates;			///< dropped as retransmissions
+	unsigned long mStale;				///< too old when their turn came
+	unsigned long mShed;				///< dropped for AGCH congestion
+	unsigned long mRequests[NumPriorities];	///< taken, by priority
+	unsigned long mGrants;
+	unsigned long mRejects;
+	unsigned long mAssignments;			///< Immediate Assignments sent
+	unsigned long mExtended;			///< Immediate Assignment Extendeds sent
+	unsigned long mRejections;			///< Immediate Assignment Rejects sent
+	Timeval mRateStart;					///< start of the current rate period
+	unsigned mRateCount;				///< bursts in the current rate period
+	float mRate;						///< bursts per second, last period
+	float mPeakRate;
+	float mLatency;						///< mean ms from burst to assignment queued
+	unsigned mMaxLatency;
+	//@}
+
+	public:
+
+	AccessGrantStage();
+
+	/** Start the service thread.  The RACH parameters come from gConfig. */
+	void start();
+
+	bool running() const { return mRunning; }
+
+	/**
+		Queue a decoded RACH burst for an answer.
+		Called from the RACH decoders; never blocks on the AGCH.
+	*/
+	void post(unsigned RA, const GSM::Time& when, float RSSI, float timingError);
+
+	/** Service thread loop.  Never returns. */
+	void serviceLoop();
+
+	void dump(std::ostream& os) const;
+
+	/** The priority of a request, from its RA. */
+	static Priority priority(unsigned RA);
+
+	private:
+
+	/** Allocate channels for a batch and send the answers. */
+	void answer(const std::vector<Request>& batch);
+
+	/**
+		The wait indication for a rejection.
+		@param type The channel type needed.
+		@param position This rejection's place among this batch's for that type, from 1.
+		@return The wait, in seconds.
+	*/
+	unsigned waitTime(GSM::ChannelType type, unsigned position);
+
+	/** Let a later burst with this RA through, if this request was the latest. */
+	void forget(const Request& req);
+
+	/** Send assignments, two per message where possible. */
+	void sendGrants(const std::vector<Grant>& grants);
+
+	/**
+		Send rejections, four per message where possible.
+		@param wait The wait indication for all of them, in seconds.
+	*/
+	void sendRejects(const std::vector<Request>& rejects, unsigned wait);
+};
+
+
+/** Service thread entry for AccessGrantStage. */
+void* AccessGrantStageServiceLoop(AccessGrantStage*);
+
+
+std::ostream& operator<<(std::ostream& os, AccessGrantStage::Priority);
+
+
+}	// namespace Control
+
+
+#endif
+
+// vim: ts=4 sw=4
@@ -57,6 +57,10 @@ using namespace Control;
 using namespace SIP;
 
 
+/** Speech queue limit, read every 20 ms for each call. */
+static ConfigurationNum gMaxSpeechLatency(gConfig,"GSM.MaxSpeechLatency");
+
+
 
 
 
@@ -402,13 +406,13 @@ bool updateCallTraffic(TransactionEntry &transaction, TCHFACCHLogicalChannel *TC
 
 	// Transfer in the uplink direction (GSM->RTP).
 	// Flush FIFO to limit latency.
-	unsigned maxQ = gConfig.getNum("GSM.MaxSpeechLatency");
-	while (TCH->queueSize()>maxQ) delete[] TCH->recvTCH();
+	unsigned maxQ = gMaxSpeechLatency;
+	while (TCH->queueSize()>maxQ) TCH->releaseTCH(TCH->recvTCH());
 	if (unsigned char *txFrame = TCH->recvTCH()) {
 		activity = true;
 		// Send on RTP.
 		engine.TxFrame(txFrame);
-		delete[] txFrame;
+		TCH->releaseTCH(txFrame);
 	}
 
 	// Return a flag so the caller will know if anything transferred.
@@ -494,14 +498,13 @@ bool updateSignalling(TransactionEntry &transaction, LogicalChannel *LCH, unsign
 
 
 /**
-	Poll for activity while in a call.
-	Sleep if needed to prevent fast spinning.
-	Will block for up to 250 ms.
+	Check the radio link and the call's SIP and GSM signalling once.
+	Can block, in LCH::send and while waiting for SIP responses.
 	@param transaction The call's TransactionEntry.
 	@param TCH The call's TCH+FACCH.
 	@return true If the call was cleared.
 */
-bool pollInCall(TransactionEntry &transaction, TCHFACCHLogicalChannel *TCH)
+bool serviceSignalling(TransactionEntry &transaction, TCHFACCHLogicalChannel *TCH)
 {
 	// See if the radio link disappeared.
 	if (TCH->radioFailure()) {
@@ -512,16 +515,217 @@ bool pollInCall(TransactionEntry &transaction, TCHFACCHLogicalChannel *TCH)
 	}
 	// Process pending SIP and GSM signalling.
 	// If this returns true, it means the call is fully cleared.
-	if (updateSignalling(transaction,TCH)) return true;
-	// Transfer vocoder data.
+	return updateSignalling(transaction,TCH);
+}
+
+
+/**
+	Service a call once, without waiting for anything new.
+	Signalling already under way can still block, in LCH::send.
+	@param transaction The call's TransactionEntry.
+	@param TCH The call's TCH+FACCH.
+	@param activity Set true if any vocoder data was transferred.
+	@return true If the call was cleared.
+*/
+bool serviceInCall(TransactionEntry &transaction, TCHFACCHLogicalChannel *TCH, bool &activity)
+{
+	activity = false;
+	if (serviceSignalling(transaction,TCH)) return true;
+	// Transfer vocoder data, unless gMediaRelay carries it.
+	if (!gMediaRelay.running()) activity = updateCallTraffic(transaction,TCH);
+	return false;
+}
+
+
+/**
+	Poll for activity while in a call.
+	Sleep if needed to prevent fast spinning.
+	Will block for up to 250 ms.
+	@param transaction The call's TransactionEntry.
+	@param TCH The call's TCH+FACCH.
+	@return true If the call was cleared.
+*/
+bool pollInCall(TransactionEntry &transaction, TCHFACCHLogicalChannel *TCH)
+{
+	bool activity;
+	if (serviceInCall(transaction,TCH,activity)) return true;
 	// If anything happened, then the call is still up.
-	if (updateCallTraffic(transaction,TCH)) return false;
+	if (activity) return false;
 	// If nothing happened, sleep so we don't burn up the CPU cycles.
 	msleep(250);
 	return false;
 }
 
 
+
+/** Wakes a call for speech, which needs no blocking step. */
+class SpeechWake : public QueueListener {
+
+	private:
+
+	ReactorCall* mCall;
+
+	public:
+
+	SpeechWake(ReactorCall* wCall):mCall(wCall) {}
+
+	void queueWritten() { mCall->wake(); }
+};
+
+
+/**
+	A connected call, served by gCallReactor.
+	Rounds are driven by uplink FACCH and speech frames, SIP messages for the call,
+	RTP input and the Q.931 and radio link timers, instead of a 250 ms poll.
+	Signalling waits on LAPDm acknowledgements and SIP responses, so FACCH,
+	SIP and timer wakes are handled in blocking steps; a round on the worker
+	only relays ortp speech, which pauses while a step runs.
+	The call holds no dispatcher thread: the end-of-call work, including the
+	channel release for an exception from a step, is done by finished(),
+	on the blocking thread of the last step.
+*/
+class InCall : public ReactorCall {
+
+	private:
+
+	TransactionEntry mTransaction;			///< our own copy; the dispatcher's is gone
+	TCHFACCHLogicalChannel* mTCH;
+	MediaStream* mMedia;					///< the call's stream on gMediaRelay, if any
+	int mRTPSocket;
+	SpeechWake mSpeechWake;
+
+	Mutex mSignalLock;
+	unsigned mSignals;						///< signalling wakes not yet taken by a step; mSignalLock
+
+	/**@name An exception that ended the call, mapped as DCCHTransaction maps it. */
+	//@{
+	const char* mFailure;					///< what was thrown, or NULL
+	unsigned mFailedID;						///< the transaction to clear, or 0 to leave it
+	unsigned mCause;						///< the RR cause for the Channel Release
+	//@}
+
+	void fail(const char* failure, unsigned transactionID, unsigned cause)
+	{
+		mFailure = failure;
+		mFailedID = transactionID;
+		mCause = cause;
+	}
+
+	public:
+
+	InCall(const TransactionEntry& wTransaction, TCHFACCHLogicalChannel* wTCH, MediaStream* wMedia)
+		:mTransaction(wTransaction),mTCH(wTCH),mMedia(wMedia),
+		mRTPSocket(-1),mSpeechWake(this),
+		mSignals(1),
+		mFailure(NULL),mFailedID(0),mCause(0)
+	{
+		// With gMediaRelay, speech is not ours and there is no ortp session.
+		if (gMediaRelay.running()) return;
+		mTransaction.SIP().RTPNonBlocking();
+		mRTPSocket = mTransaction.SIP().RTPSocket();
+	}
+
+	~InCall() { gTimerWheel.cancel(this,true); }
+
+	/** Count a signalling wake, from an L3 frame, a SIP message or a timer. */
+	void signal()
+	{
+		mSignalLock.lock();
+		mSignals++;
+		mSignalLock.unlock();
+		wake();
+	}
+
+	void queueWritten() { signal(); }
+
+	void expire() { signal(); }
+
+	int fd() const { return mRTPSocket; }
+
+	void attach()
+	{
+		mTCH->listener(this);
+		if (mRTPSocket>=0) mTCH->speechListener(&mSpeechWake);
+		gSIPInterface.listener(mTransaction.SIP().callID(),this);
+	}
+
+	void detach()
+	{
+		mTCH->listener(NULL);
+		if (mRTPSocket>=0) mTCH->speechListener(NULL);
+		gSIPInterface.listener(mTransaction.SIP().callID(),NULL);
+	}
+
+	bool service();
+
+	bool blockingStep();
+
+	/** End the call: stop the media, clear the transaction, release the channel after an exception. */
+	void end();
+
+	/** End the call and give the TCH back to gDCCHPool. */
+	void finished()
+	{
+		end();
+		gDCCHPool.giveBack(mTCH);
+		delete this;
+	}
+};
+
+
+bool InCall::service()
+{
+	mSignalLock.lock();
+	bool signalling = (mSignals>0);
+	mSignalLock.unlock();
+	if (signalling) offload();
+	if (mRTPSocket<0) return false;
+	updateCallTraffic(mTransaction,mTCH);
+	// Frames that arrived together woke us once; take the rest in a later round.
+	if (mTCH->queueSize()>0) wake();
+	return false;
+}
+
+
+bool InCall::blockingStep()
+{
+	mSignalLock.lock();
+	unsigned signals = mSignals;
+	mSignals = 0;
+	mSignalLock.unlock();
+	try {
+		// One L3 frame or SIP message per wake.
+		for (unsigned i=0; i<signals; i++) {
+			if (serviceSignalling(mTransaction,mTCH)) return true;
+		}
+		// Come back when the next Q.931 or radio link timer is due.
+		long timeout = mTransaction.timerRemaining();
+		long radio = mTCH->radioRemaining();
+		if ((radio>=0) && ((timeout<0) || (radio<timeout))) timeout = radio;
+		if (timeout>=0) gTimerWheel.arm(this,timeout);
+		else gTimerWheel.cancel(this);
+		return false;
+	}
+	// Cause 0x62 means "message type not not compatible with protocol state".
+	// Nothing in a connected call throws one with a frame to dispatch.
+	catch (UnexpectedMessage& e) {
+		delete e.mpFrame;
+		fail("UnexpectedMessage",e.transactionID(),0x62);
+	}
+	// Cause 0x03 means "abnormal release, timer expired".
+	catch (ChannelReadTimeout& e) { fail("ChannelReadTimeout",e.transactionID(),0x03); }
+	// Cause 0x61 means "message type not implemented".
+	catch (UnsupportedMessage& e) { fail("UnsupportedMessage",e.transactionID(),0x61); }
+	catch (UnexpectedPrimitive& e) { fail("UnexpectedPrimitive",e.transactionID(),0x62); }
+	catch (Q931TimerExpired& e) { fail("Q.931 T3xx timer expired",e.transactionID(),0x03); }
+	// Cause 0x03 means "abnormal release, timer expired".
+	catch (SIP::SIPTimeout&) { fail("SIPTimeout",0,0x03); }
+	// Cause 0x01 means "abnormal release, unspecified".
+	catch (SIP::SIPError&) { fail("SIPError",0,0x01); }
+	return true;
+}
+
+
 /**
 	Pause for a given time while managing the connection.
 	Returns on timeout or call clearing.
@@ -543,18 +747,82 @@ bool waitInCall(TransactionEntry& transaction, TCHFACCHLogicalChannel *TCH, unsi
 
 
 
+/** End a call's MediaStream, if it has one. */
+static void stopMedia(TransactionEntry& transaction, MediaStream* media)
+{
+	if (!media) return;
+	media->stop();
+	gMediaRelay.wait(media);
+	LOG(INFO) << transaction.subscriber() << " " << *media;
+	delete media;
+}
+
+
+void InCall::end()
+{
+	// The stream's next media round sees the stop, so this wait is short.
+	stopMedia(mTransaction,mMedia);
+	mMedia = NULL;
+	if (!mFailure) {
+		clearTransactionHistory(mTransaction);
+		return;
+	}
+	LOG(NOTICE) << mFailure << " in call " << mTransaction.ID();
+	if (mFailedID) clearTransactionHistory(mFailedID);
+	else LOG(WARN) << "uncaught " << mFailure << ", will leave a stray transaction";
+	mTCH->send(L3ChannelRelease(mCause));
+}
+
+
 /**
 	This is the standard call manangement loop, regardless of the origination type.
-	This function returns when the call is cleared and the channel is released.
-	@param transaction The transaction record for this call, will be cleared on exit.
+	With gCallReactor the connected call is handed to the reactor with its TCH,
+	and this returns at once; the dispatching worker goes back to gDCCHPool.
+	Otherwise this polls the call and returns when it is cleared.
+	@param transaction The transaction record for this call, will be cleared when the call ends.
 	@param TCH The TCH+FACCH for the call.
 */
 void callManagementLoop(TransactionEntry &transaction, TCHFACCHLogicalChannel* TCH)
 {
 	LOG(INFO) << transaction.subscriber() << " call connected";
 	transaction.SIP().FlushRTP();
-	// poll everything until the call is cleared
-	while (!pollInCall(transaction,TCH)) { }
+	// With gMediaRelay, speech goes straight between RTP and the TCH on its threads.
+	MediaStream *media = NULL;
+	if (gMediaRelay.running()) {
+		unsigned jitter = 2;
+		if (gConfig.defines("Control.Media.JitterFrames")) jitter = gConfig.getNum("Control.Media.JitterFrames");
+		SIPEngine& engine = transaction.SIP();
+		try {
+			media = new MediaStream(TCH,engine.RTPPort(),engine.RTPRemoteIP(),engine.RTPRemotePort(),jitter);
+			gMediaRelay.add(media);
+		}
+		catch (SocketError) {
+			LOG(ALARM) << "cannot open RTP port " << engine.RTPPort() << ", call continues without speech";
+			media = NULL;
+		}
+	}
+	if (gCallReactor.running()) {
+		InCall* call = new InCall(transaction,TCH,media);
+		// Lend first, since a short call can be given back before launch returns.
+		if (gDCCHPool.lend(TCH)) {
+			gCallReactor.launch(call);
+			return;
+		}
+		// Not a pooled channel, so its dispatcher thread must not read it meanwhile.
+		gCallReactor.run(call);
+		call->end();
+		delete call;
+		return;
+	}
+	try {
+		// poll everything until the call is cleared
+		while (!pollInCall(transaction,TCH)) { }
+	}
+	catch (...) {
+		stopMedia(transaction,media);
+		throw;
+	}
+	stopMedia(transaction,media);
 	clearTransactionHistory(transaction);
 }
 
@@ -834,7 +1102,7 @@ void Control::MOCController(TransactionEntry& transaction, TCHFACCHLogicalChanne
 	gTransactionTable.update(transaction);
 	callManagementLoop(transaction,TCH);
 
-	// The radio link should have been cleared with the call.
+	// The call runs on, or has been cleared with its radio link.
 	// So just return.
 }
 
@@ -989,7 +1257,7 @@ void Control::MTCController(TransactionEntry& transaction, TCHFACCHLogicalChanne
 	TCH->send(L3ConnectAcknowledge(0,L3TI));
 
 	// At this point, everything is ready to run for the call.
-	// The radio link should have been cleared with the call.
+	// The call runs on, or has been cleared with its radio link.
 	gTransactionTable.update(transaction);
 	callManagementLoop(transaction,TCH);
 }
@@ -0,0 +1,388 @@
+/**@file Call reactor, multiplexing in-call service onto a few threads. */
+
+/*
+* Copyright 2008, 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+
+#include "CallReactor.h"
+#include <Logger.h>
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+
+using namespace std;
+using namespace Control;
+
+
+
+ReactorCall::~ReactorCall()
+{
+	gTimerWheel.cancel(this,true);
+}
+
+
+void ReactorCall::wake()
+{
+	CallReactorWorker* worker = mWorker;
+	// Not running yet; CallReactor::add schedules the first round itself.
+	if (!worker) return;
+	worker->mLock.lock();
+	if (!mDone) worker->schedule(this);
+	worker->mLock.unlock();
+}
+
+
+
+
+CallReactorWorker::CallReactorWorker(CallReactor* wReactor)
+	:mReactor(wReactor),mCalls(0),mSleeping(false),
+	mRounds(0),mWakeups(0)
+{
+	mEpollFD = epoll_create(16);
+	if (mEpollFD<0) {
+		perror("epoll_create() failed");
+		abort();
+	}
+	fcntl(mEpollFD, F_SETFD, FD_CLOEXEC);
+	if (pipe(mWakeFD)<0) {
+		perror("pipe() failed");
+		abort();
+	}
+	for (int i=0; i<2; i++) {
+		fcntl(mWakeFD[i], F_SETFL, O_NONBLOCK);
+		fcntl(mWakeFD[i], F_SETFD, FD_CLOEXEC);
+	}
+	// The wake pipe is level-triggered and carries a NULL call pointer.
+	struct epoll_event ev;
+	memset(&ev,0,sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	epoll_ctl(mEpollFD, EPOLL_CTL_ADD, mWakeFD[0], &ev);
+}
+
+
+void CallReactorWorker::start(const char* role)
+{
+	mThread.start((void*(*)(void*))CallReactorWorkerServiceLoop,this,role);
+}
+
+
+void CallReactorWorker::schedule(ReactorCall* call)
+{
+	if (call->mQueued) return;
+	call->mQueued = true;
+	// An offloaded call is pushed when its blocking step ends.
+	if (call->mBlocking) return;
+	push(call);
+}
+
+
+void CallReactorWorker::push(ReactorCall* call)
+{
+	mReady.push_back(call);
+	// Only the first wake after the thread goes idle needs the pipe.
+	if (!mSleeping) return;
+	mSleeping = false;
+	char c = 0;
+	if (::write(mWakeFD[1],&c,1)<0) LOG(ERROR) << "wake pipe write failed, errno=" << errno;
+}
+
+
+void CallReactorWorker::add(ReactorCall* call)
+{
+	call->mFD = call->fd();
+	if (call->mFD<0) return;
+	// Edge-triggered: the call is woken by new input, not by input it chose to leave.
+	struct epoll_event ev;
+	memset(&ev,0,sizeof(ev));
+	ev.events = EPOLLIN | EPOLLET;
+	ev.data.ptr = call;
+	if (epoll_ctl(mEpollFD, EPOLL_CTL_ADD, call->mFD, &ev)<0) {
+		LOG(ERROR) << "cannot watch fd " << call->mFD << ", errno=" << errno;
+		call->mFD = -1;
+	}
+}
+
+
+void CallReactorWorker::finish(ReactorCall* call)
+{
+	// The descriptor may already be closed, which removes it anyway.
+	if (call->mFD>=0) epoll_ctl(mEpollFD, EPOLL_CTL_DEL, call->mFD, NULL);
+	mLock.lock();
+	call->mDone = true;
+	if (call->mQueued) {
+		mReady.erase(std::remove(mReady.begin(),mReady.end(),call),mReady.end());
+		call->mQueued = false;
+	}
+	mCalls--;
+	call->mDoneSignal.signal();
+	mLock.unlock();
+	if (!call->mLaunched) return;
+
+	// Nobody waits for a launched call, so do what CallReactor::wait would.
+	call->detach();
+	gTimerWheel.cancel(call,true);
+	call->mWorker = NULL;
+	call->finished();
+}
+
+
+void CallReactorWorker::block(ReactorCall* call)
+{
+	mLock.lock();
+	call->mBlocking = true;
+	// A wake during the round still counts, after the step.
+	if (call->mQueued) mReady.erase(std::remove(mReady.begin(),mReady.end(),call),mReady.end());
+	mLock.unlock();
+	mReactor->block(call);
+}
+
+
+void CallReactorWorker::unblock(ReactorCall* call)
+{
+	mLock.lock();
+	call->mBlocking = false;
+	if (call->mQueued) push(call);
+	mLock.unlock();
+}
+
+
+void CallReactorWorker::serviceLoop()
+{
+	static const int maxEvents = 32;
+	struct epoll_event events[maxEvents];
+	std::deque<ReactorCall*> ready;
+	while (true) {
+		mLock.lock();
+		bool idle = mReady.empty();
+		mSleeping = idle;
+		mLock.unlock();
+		int n = epoll_wait(mEpollFD, events, maxEvents, idle ? -1 : 0);
+		if ((n<0) && (errno!=EINTR)) {
+			LOG(ERROR) << "epoll_wait failed, errno=" << errno;
+			continue;
+		}
+		mLock.lock();
+		mSleeping = false;
+		if (idle && (n>0)) mWakeups++;
+		for (int i=0; i<n; i++) {
+			ReactorCall* call = (ReactorCall*)events[i].data.ptr;
+			if (call) {
+				schedule(call);
+				continue;
+			}
+			char junk[64];
+			while (::read(mWakeFD[0],junk,sizeof(junk))>0) {}
+		}
+		// Calls woken during this round go into the next one.
+		ready.swap(mReady);
+		for (unsigned i=0; i<ready.size(); i++) ready[i]->mQueued = false;
+		mRounds += ready.size();
+		mLock.unlock();
+		while (!ready.empty()) {
+			ReactorCall* call = ready.front();
+			ready.pop_front();
+			if (call->service()) {
+				call->mOffload = false;
+				finish(call);
+				continue;
+			}
+			if (!call->mOffload) continue;
+			call->mOffload = false;
+			block(call);
+		}
+	}
+}
+
+
+void* Control::CallReactorWorkerServiceLoop(CallReactorWorker* worker)
+{
+	worker->serviceLoop();
+	return NULL;
+}
+
+
+
+
+void* Control::CallReactorBlockingLoop(CallReactor* reactor)
+{
+	reactor->blockingLoop();
+	return NULL;
+}
+
+
+
+
+void CallReactor::start(unsigned numWorkers, const char* role, unsigned numBlocking)
+{
+	assert(!running());
+	if (numWorkers==0) numWorkers = 1;
+	for (unsigned i=0; i<numWorkers; i++) {
+		CallReactorWorker* worker = new CallReactorWorker(this);
+		mWorkers.push_back(worker);
+		worker->start(role);
+	}
+	for (unsigned i=0; i<numBlocking; i++) {
+		Thread* thread = new Thread;
+		mBlockingThreads.push_back(thread);
+		thread->start((void*(*)(void*))CallReactorBlockingLoop,this,role);
+	}
+	LOG(INFO) << "started " << numWorkers << " " << role << " reactor threads, "
+		<< numBlocking << " blocking threads";
+}
+
+
+void CallReactor::block(ReactorCall* call)
+{
+	if (mBlockingThreads.empty()) {
+		step(call);
+		return;
+	}
+	mBlockingLock.lock();
+	mBlockingQueue.push_back(call);
+	mBlockingSignal.signal();
+	mBlockingLock.unlock();
+}
+
+
+void CallReactor::step(ReactorCall* call)
+{
+	// finish() clears mWorker for a launched call.
+	CallReactorWorker* worker = call->mWorker;
+	bool done = call->blockingStep();
+	mBlockingLock.lock();
+	mBlockingSteps++;
+	mBlockingLock.unlock();
+	if (done) worker->finish(call);
+	else worker->unblock(call);
+}
+
+
+void CallReactor::blockingLoop()
+{
+	while (true) {
+		mBlockingLock.lock();
+		while (mBlockingQueue.empty()) mBlockingSignal.wait(mBlockingLock);
+		ReactorCall* call = mBlockingQueue.front();
+		mBlockingQueue.pop_front();
+		mBlockingLock.unlock();
+		step(call);
+	}
+}
+
+
+void CallReactor::add(ReactorCall* call)
+{
+	assert(running());
+	assert(!call->mWorker);
+
+	// Take the least loaded worker.
+	CallReactorWorker* worker = mWorkers[0];
+	worker->mLock.lock();
+	unsigned load = worker->mCalls;
+	worker->mLock.unlock();
+	for (unsigned i=1; i<mWorkers.size(); i++) {
+		mWorkers[i]->mLock.lock();
+		unsigned thisLoad = mWorkers[i]->mCalls;
+		mWorkers[i]->mLock.unlock();
+		if (thisLoad>=load) continue;
+		worker = mWorkers[i];
+		load = thisLoad;
+	}
+
+	worker->mLock.lock();
+	worker->mCalls++;
+	call->mDone = false;
+	call->mQueued = false;
+	call->mBlocking = false;
+	call->mWorker = worker;
+	worker->mLock.unlock();
+	worker->add(call);
+	call->attach();
+	call->wake();
+}
+
+
+void CallReactor::launch(ReactorCall* call)
+{
+	// Set before the first round, which may be the last.
+	call->mLaunched = true;
+	add(call);
+}
+
+
+void CallReactor::wait(ReactorCall* call)
+{
+	CallReactorWorker* worker = call->mWorker;
+	assert(worker);
+	assert(!call->mLaunched);
+	worker->mLock.lock();
+	while (!call->mDone) call->mDoneSignal.wait(worker->mLock);
+	worker->mLock.unlock();
+
+	// Later wakes see mDone and do nothing, until the call is reused.
+	call->detach();
+	gTimerWheel.cancel(call,true);
+	call->mWorker = NULL;
+}
+
+
+unsigned CallReactor::calls() const
+{
+	unsigned count = 0;
+	for (unsigned i=0; i<mWorkers.size(); i++) {
+		mWorkers[i]->mLock.lock();
+		count += mWorkers[i]->mCalls;
+		mWorkers[i]->mLock.unlock();
+	}
+	return count;
+}
+
+
+void CallReactor::dump(ostream& os) const
+{
+	for (unsigned i=0; i<mWorkers.size(); i++) {
+		const CallReactorWorker* worker = mWorkers[i];
+		worker->mLock.lock();
+		os << "worker " << i << " calls=" << worker->mCalls;
+		os << " rounds=" << worker->mRounds << " wakeups=" << worker->mWakeups;
+		os << endl;
+		worker->mLock.unlock();
+	}
+	mBlockingLock.lock();
+	os << "blocking threads=" << mBlockingThreads.size();
+	os << " steps=" << mBlockingSteps << " queued=" << mBlockingQueue.size();
+	os << endl;
+	mBlockingLock.unlock();
+}
+
+
+// vim: ts=4 sw=4
@@ -0,0 +1,284 @@
+/**@file Call reactor, multiplexing in-call service onto a few threads. */
+/*
+* Copyright 2008, 2009, 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#ifndef CALLREACTOR_H
+#define CALLREACTOR_H
+
+#include <deque>
+#include <vector>
+#include <ostream>
+
+#include <Threads.h>
+#include <Interthread.h>
+#include <TimerWheel.h>
+
+
+namespace Control {
+
+
+class CallReactor;
+class CallReactorWorker;
+
+
+/**
+	A call served by a CallReactor.
+	A round of service is scheduled by wake(), which queues feeding the
+	call reach as their QueueListener and timers reach through gTimerWheel,
+	and by input on fd().  Each call is served by one worker thread,
+	so rounds of the same call never overlap.
+	A call started with CallReactor::launch() has no waiter; the worker
+	detaches it and calls finished() after its last round.
+	A round that would block, on the radio or on a SIP transaction, calls
+	offload() and returns; the reactor then runs blockingStep() on one of
+	its blocking threads, and wakes meanwhile wait for that step to end.
+*/
+class ReactorCall : public QueueListener, public TimerEntry {
+
+	private:
+
+	friend class CallReactor;
+	friend class CallReactorWorker;
+
+	CallReactorWorker* volatile mWorker;	///< the worker serving this call, if any
+	int mFD;						///< the descriptor registered with the worker, or -1
+	bool mQueued;					///< in the worker's ready list; worker lock
+	bool mDone;						///< finished; worker lock
+	bool mLaunched;					///< started by launch(), so nobody waits
+	bool mOffload;					///< the round asked for a blocking step; serving thread only
+	bool mBlocking;					///< in a blocking step; worker lock
+	Signal mDoneSignal;				///< signalled when mDone is set
+
+	public:
+
+	ReactorCall()
+		:mWorker(NULL),mFD(-1),mQueued(false),mDone(false),mLaunched(false),
+		mOffload(false),mBlocking(false)
+	{}
+
+	/** Cancels the timer, waiting out any expiration in progress. */
+	virtual ~ReactorCall();
+
+	/** Schedule a round of service.  Safe from any thread; a no-op once the call is done. */
+	void wake();
+
+	void queueWritten() { wake(); }
+
+	void expire() { wake(); }
+
+	/** A descriptor whose input should wake the call, or -1. */
+	virtual int fd() const { return -1; }
+
+	/** Attach the call to its event sources, once it can be woken. */
+	virtual void attach() {}
+
+	/** Detach the call from its event sources, after the last round. */
+	virtual void detach() {}
+
+	/**
+		Run one round of service without blocking.
+		Called from a worker thread; must not throw.
+		@return true If the call is finished.
+	*/
+	virtual bool service() =0;
+
+	/**
+		From service(): run blockingStep() once this round returns.
+		No round is served until the step ends.
+	*/
+	void offload() { mOffload = true; }
+
+	/**
+		Work that can block, asked for by offload().
+		Called from a blocking thread, or from the worker if the reactor has none;
+		must not throw.
+		@return true If the call is finished.
+	*/
+	virtual bool blockingStep() { return false; }
+
+	/**
+		The end of a launched call, once it is detached, on the thread that
+		ended it: a blocking thread if it ended in blockingStep(), where it may block.
+		The reactor is done with the call, which may delete itself here.
+		On a worker thread it must not block for long; the worker's other calls wait.
+	*/
+	virtual void finished() {}
+};
+
+
+
+/** One reactor thread and the calls it serves. */
+class CallReactorWorker {
+
+	private:
+
+	friend class CallReactor;
+	friend class ReactorCall;
+
+	mutable Mutex mLock;
+	CallReactor* mReactor;			///< the reactor running our blocking steps
+	std::deque<ReactorCall*> mReady;	///< calls with a round pending
+	unsigned mCalls;				///< calls assigned to this worker
+	bool mSleeping;					///< waiting in epoll with nothing ready
+	int mEpollFD;					///< call descriptors and the wake pipe
+	int mWakeFD[2];					///< pipe used to break the thread out of epoll_wait
+	Thread mThread;
+
+	/**@name Statistics. */
+	//@{
+	unsigned long mRounds;			///< calls to ReactorCall::service
+	unsigned long mWakeups;			///< returns from an idle epoll_wait
+	//@}
+
+	public:
+
+	CallReactorWorker(CallReactor* wReactor);
+
+	/**
+		Start the thread.
+		@param role The thread's name in the logs.
+	*/
+	void start(const char* role);
+
+	/** The worker thread.  Never returns. */
+	void serviceLoop();
+
+	private:
+
+	/** Schedule a round, or one after the blocking step of an offloaded call.  Caller holds mLock. */
+	void schedule(ReactorCall* call);
+
+	/** Put a call on the ready list, waking the thread.  Caller holds mLock. */
+	void push(ReactorCall* call);
+
+	/** Hand a call whose round called offload() to the reactor's blocking threads. */
+	void block(ReactorCall* call);
+
+	/** Take back a call after a blocking step that did not finish it. */
+	void unblock(ReactorCall* call);
+
+	/** Register a call's descriptor, if any. */
+	void add(ReactorCall* call);
+
+	/** Mark a call finished and release its waiter, or end it if it was launched. */
+	void finish(ReactorCall* call);
+};
+
+/** Service thread entry for CallReactorWorker. */
+void* CallReactorWorkerServiceLoop(CallReactorWorker*);
+
+/** Blocking thread entry for CallReactor. */
+void* CallReactorBlockingLoop(CallReactor*);
+
+
+
+/**
+	Serves many calls from a few threads.
+	A call is woken by its uplink L3 frames, speech frames, SIP messages,
+	RTP input and timers instead of being polled, so clearing is seen
+	as soon as it is signalled and idle calls cost nothing.
+	Steps that wait on the radio or on SIP run on separate blocking threads,
+	so they do not hold up the other calls of their worker.
+*/
+class CallReactor {
+
+	private:
+
+	friend class CallReactorWorker;
+
+	std::vector<CallReactorWorker*> mWorkers;
+
+	/**@name Blocking threads and the steps waiting for them. */
+	//@{
+	mutable Mutex mBlockingLock;
+	Signal mBlockingSignal;			///< signalled when a step is queued
+	std::deque<ReactorCall*> mBlockingQueue;
+	std::vector<Thread*> mBlockingThreads;
+	unsigned long mBlockingSteps;	///< calls to ReactorCall::blockingStep
+	//@}
+
+	/** Queue a call's blocking step, or run it here if there are no blocking threads. */
+	void block(ReactorCall* call);
+
+	/** Run a call's blocking step and give it back to its worker or finish it. */
+	void step(ReactorCall* call);
+
+	public:
+
+	CallReactor():mBlockingSteps(0) {}
+
+	/**
+		Start the worker threads; no calls can be run before this.
+		@param numWorkers Number of threads.
+		@param role The threads' name in the logs.
+		@param numBlocking Threads for blocking steps, or 0 to run them on the workers.
+	*/
+	void start(unsigned numWorkers, const char* role="call", unsigned numBlocking=0);
+
+	/** A blocking thread.  Never returns. */
+	void blockingLoop();
+
+	/** True if started. */
+	bool running() const { return mWorkers.size()>0; }
+
+	/**
+		Serve a call until its service() reports it finished.
+		The calling thread waits meanwhile.
+		@param call The call, which must outlive this call.
+	*/
+	void run(ReactorCall* call) { add(call); wait(call); }
+
+	/**
+		Serve a call and return at once; nobody waits for it.
+		When service() reports it finished, its worker detaches it
+		and calls its finished().
+		@param call The call, which must live until finished().
+	*/
+	void launch(ReactorCall* call);
+
+	/**
+		Start serving a call and return; follow with wait().
+		@param call The call, which must outlive the wait.
+	*/
+	void add(ReactorCall* call);
+
+	/** Wait for a call added with add() to finish and detach it. */
+	void wait(ReactorCall* call);
+
+	/** Number of calls being served. */
+	unsigned calls() const;
+
+	/** Dump the worker statistics. */
+	void dump(std::ostream& os) const;
+};
+
+
+}	// namespace Control
+
+
+#endif
+
+// vim: ts=4 sw=4
@@ -0,0 +1,264 @@
+/*
+* Copyright 2008, 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+
+#include "CallReactor.h"
+#include <Logger.h>
+#include <Configuration.h>
+#include <iostream>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+ConfigurationTable gConfig;
+
+using namespace std;
+using namespace Control;
+
+
+/** Sleep for ms milliseconds. */
+static void sleepMs(unsigned ms)
+{
+	usleep(ms*1000);
+}
+
+
+/** A message to a test call, stamped with its send time. */
+struct Event {
+	enum Kind { Frame, Timer, Block, Clear } mKind;
+	Timeval mSent;
+	Event(Kind wKind):mKind(wKind) {}
+};
+
+
+/**
+	A call woken by its queue, its pipe and its timer.
+	It records how long each event waited for its round.
+*/
+class TestCall : public ReactorCall {
+
+	private:
+
+	InterthreadQueue<Event> mQ;
+	int mPipe[2];
+	Timeval mTimerSet;				///< when the timer was armed
+	long mTimerMs;					///< the timer length, or -1 if not armed
+
+	public:
+
+	/**@name Latencies in ms, written only by the worker. */
+	//@{
+	long mMaxFrame;
+	long mFrames;
+	long mMaxPipe;
+	long mPipes;
+	long mTimerLate;				///< lateness of the last timer round
+	Timeval mCleared;				///< when the clear event was serviced
+	volatile long mSteps;			///< blocking steps, which stand in for a SIP wait
+	volatile bool mFinished;		///< finished() was called
+	//@}
+
+	TestCall()
+		:mTimerMs(-1),
+		mMaxFrame(0),mFrames(0),mMaxPipe(0),mPipes(0),mTimerLate(-1),
+		mSteps(0),mFinished(false)
+	{
+		if (pipe(mPipe)<0) abort();
+		fcntl(mPipe[0],F_SETFL,O_NONBLOCK);
+	}
+
+	~TestCall()
+	{
+		gTimerWheel.cancel(this,true);
+		close(mPipe[0]);
+		close(mPipe[1]);
+	}
+
+	int fd() const { return mPipe[0]; }
+	void attach() { mQ.listener(this); }
+	void detach() { mQ.listener(NULL); }
+
+	void post(Event::Kind kind) { mQ.write(new Event(kind)); }
+
+	/** Write the send time into the pipe. */
+	void poke()
+	{
+		Timeval now;
+		if (write(mPipe[1],&now,sizeof(now))!=sizeof(now)) abort();
+	}
+
+	bool service()
+	{
+		Timeval sent;
+		while (read(mPipe[0],&sent,sizeof(sent))==sizeof(sent)) {
+			long wait = sent.elapsed();
+			if (wait>mMaxPipe) mMaxPipe = wait;
+			mPipes++;
+		}
+		if ((mTimerMs>=0) && (mTimerSet.elapsed()>=mTimerMs)) {
+			mTimerLate = mTimerSet.elapsed() - mTimerMs;
+			mTimerMs = -1;
+		}
+		while (Event* event = mQ.readNoBlock()) {
+			long wait = event->mSent.elapsed();
+			Event::Kind kind = event->mKind;
+			delete event;
+			switch (kind) {
+				case Event::Frame:
+					if (wait>mMaxFrame) mMaxFrame = wait;
+					mFrames++;
+					break;
+				case Event::Timer:
+					mTimerMs = 50;
+					mTimerSet = Timeval();
+					gTimerWheel.arm(this,mTimerMs);
+					break;
+				case Event::Block:
+					offload();
+					break;
+				case Event::Clear:
+					mCleared = Timeval();
+					return true;
+			}
+		}
+		return false;
+	}
+
+	bool blockingStep()
+	{
+		sleepMs(200);
+		mSteps++;
+		return false;
+	}
+
+	void finished() { mFinished = true; }
+};
+
+
+// Never destroyed, since its blocking threads wait on it until exit.
+static CallReactor& gReactor = *new CallReactor;
+
+static const unsigned numCalls = 256;
+static TestCall gCalls[numCalls];
+
+
+/** Stands in for a DCCH dispatcher thread, which waits for its call. */
+static void* dispatcher(TestCall* call)
+{
+	gReactor.run(call);
+	return NULL;
+}
+
+
+int main(int argc, char *argv[])
+{
+	gLogInit("WARN");
+	gReactor.start(4,"call",8);
+
+	// Half the calls are launched, as gDCCHPool workers do, and half hold a thread.
+	static const unsigned numWaited = numCalls/2;
+	Thread threads[numWaited];
+	for (unsigned i=0; i<numWaited; i++) {
+		threads[i].start((void*(*)(void*))dispatcher,&gCalls[i]);
+	}
+	for (unsigned i=numWaited; i<numCalls; i++) gReactor.launch(&gCalls[i]);
+	while (gReactor.calls()<numCalls) sleepMs(10);
+	cout << gReactor.calls() << " calls on 4 threads, " << numWaited << " with waiting threads" << endl;
+
+	// Speech frames at 50 per second for a second.
+	for (unsigned n=0; n<50; n++) {
+		for (unsigned i=0; i<numCalls; i++) gCalls[i].post(Event::Frame);
+		sleepMs(20);
+	}
+	sleepMs(50);
+	long frames = 0, maxFrame = 0;
+	for (unsigned i=0; i<numCalls; i++) {
+		frames += gCalls[i].mFrames;
+		if (gCalls[i].mMaxFrame>maxFrame) maxFrame = gCalls[i].mMaxFrame;
+	}
+	cout << "frames " << frames << " (expect " << 50*numCalls << "), max wait " << maxFrame << " ms" << endl;
+
+	// Input on each call's descriptor.
+	for (unsigned i=0; i<numCalls; i++) gCalls[i].poke();
+	sleepMs(50);
+	long pipes = 0, maxPipe = 0;
+	for (unsigned i=0; i<numCalls; i++) {
+		pipes += gCalls[i].mPipes;
+		if (gCalls[i].mMaxPipe>maxPipe) maxPipe = gCalls[i].mMaxPipe;
+	}
+	cout << "descriptor events " << pipes << " (expect " << numCalls << "), max wait " << maxPipe << " ms" << endl;
+
+	// A 50 ms timer on each call.
+	for (unsigned i=0; i<numCalls; i++) gCalls[i].post(Event::Timer);
+	sleepMs(150);
+	long timers = 0, maxLate = 0;
+	for (unsigned i=0; i<numCalls; i++) {
+		if (gCalls[i].mTimerLate<0) continue;
+		timers++;
+		if (gCalls[i].mTimerLate>maxLate) maxLate = gCalls[i].mTimerLate;
+	}
+	cout << "timers " << timers << " (expect " << numCalls << "), max late " << maxLate << " ms" << endl;
+
+	// A 200 ms blocking step on every 16th call, which must not delay the others.
+	for (unsigned i=0; i<numCalls; i++) gCalls[i].mMaxFrame = 0;
+	for (unsigned i=0; i<numCalls; i+=16) gCalls[i].post(Event::Block);
+	sleepMs(10);
+	for (unsigned n=0; n<5; n++) {
+		for (unsigned i=0; i<numCalls; i++) gCalls[i].post(Event::Frame);
+		sleepMs(20);
+	}
+	sleepMs(300);
+	long steps = 0, maxOther = 0, maxBlocked = 0;
+	for (unsigned i=0; i<numCalls; i++) {
+		steps += gCalls[i].mSteps;
+		long& max = (i%16) ? maxOther : maxBlocked;
+		if (gCalls[i].mMaxFrame>max) max = gCalls[i].mMaxFrame;
+	}
+	cout << "blocking steps " << steps << " (expect " << numCalls/16 << "), ";
+	cout << "max frame wait " << maxOther << " ms on other calls, " << maxBlocked << " ms on blocked calls" << endl;
+
+	// Clearing, which polling used to notice up to 250 ms late.
+	Timeval clearStart;
+	for (unsigned i=0; i<numCalls; i++) gCalls[i].post(Event::Clear);
+	long maxClear = 0;
+	for (unsigned i=0; i<numWaited; i++) threads[i].join();
+	for (unsigned i=numWaited; i<numCalls; i++) {
+		while (!gCalls[i].mFinished) sleepMs(1);
+	}
+	for (unsigned i=0; i<numCalls; i++) {
+		long clear = clearStart.delta(gCalls[i].mCleared);
+		if (clear>maxClear) maxClear = clear;
+	}
+	cout << "cleared all in " << clearStart.elapsed() << " ms, last seen " << maxClear << " ms after the first clear" << endl;
+	unsigned finished = 0;
+	for (unsigned i=0; i<numCalls; i++) if (gCalls[i].mFinished) finished++;
+	cout << "finished " << finished << " (expect " << numCalls-numWaited << ")" << endl;
+	cout << gReactor.calls() << " calls left" << endl;
+	gReactor.dump(cout);
+	return 0;
+}
+
+// vim: ts=4 sw=4
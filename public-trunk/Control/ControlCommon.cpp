@@ -39,6 +39,8 @@
 
 #include <Regexp.h>
 
+#include <algorithm>
+
 using namespace std;
 using namespace GSM;
 using namespace Control;
@@ -51,6 +53,21 @@ TransactionTable gTransactionTable;
 // The global TMSI table.
 TMSITable gTMSITable;
 
+// The global call reactor.
+CallReactor gCallReactor;
+
+// The global media relay, serving MediaStreams.
+CallReactor gMediaRelay;
+
+// The global SIP registrar.
+Registrar gRegistrar;
+
+// The global DCCH worker pool.
+DCCHPool gDCCHPool;
+
+// The global RACH processing stage.
+AccessGrantStage gAccessGrant;
+
 
 ostream& Control::operator<<(ostream& os, USSDData::USSDMessageType type)
 {
@@ -206,6 +223,21 @@ bool TransactionEntry::timerExpired() const
 }
 
 
+long TransactionEntry::timerRemaining() const
+{
+	// Same timers as timerExpired.
+	const GSM::Z100Timer* timers[] = { &mT301, &mT302, &mT303, &mT304,
+		&mT305, &mT308, &mT310, &mT313, &mTR1M };
+	long retVal = -1;
+	for (unsigned i=0; i<sizeof(timers)/sizeof(timers[0]); i++) {
+		if (!timers[i]->active()) continue;
+		long rem = timers[i]->remaining();
+		if ((retVal<0) || (rem<retVal)) retVal = rem;
+	}
+	return retVal;
+}
+
+
 void TransactionEntry::resetTimers()
 {
 	mT301.reset();
@@ -269,407 +301,363 @@ ostream& Control::operator<<(ostream& os, const TransactionEntry& entry)
 }
 
 
-unsigned TransactionTable::newID()
-{
-	mLock.lock();
-	unsigned ID = mIDCounter++;
-	mLock.unlock();
-	return ID;
-}
-
-
-void TransactionTable::add(const TransactionEntry& value)
+string Control::mobileIDKey(const L3MobileIdentity& mobileID)
 {
-	LOG(INFO) << "new transaction " << value;
-	mLock.lock();
-	mTable[value.ID()]=value;
-	mLock.unlock();
+	char buf[20];
+	if (mobileID.type()==TMSIType) {
+		sprintf(buf,"%d%x",(int)TMSIType,mobileID.TMSI());
+		return string(buf);
+	}
+	sprintf(buf,"%d",(int)mobileID.type());
+	return string(buf) + mobileID.digits();
 }
 
 
-void TransactionTable::update(const TransactionEntry& value)
-{
-	// ID==0 is a non-valid special case.
-	assert(value.ID());
-	mLock.lock();
-	if (mTable.find(value.ID())==mTable.end()) {
-		mLock.unlock();
-		LOG(WARN) << "attempt to update non-existent transaction entry with key " << value.ID();
-		return;
-	}
-	mTable[value.ID()]=value;
-	mLock.unlock();
-}
+/** The index keys of an entry, saved so they can be unfiled after the entry is gone. */
+struct TransactionKeys {
+	unsigned mID;
+	string mMobileKey;
+	string mCallID;
 
+	TransactionKeys(const TransactionEntry& entry)
+		:mID(entry.ID()),
+		mMobileKey(mobileIDKey(entry.subscriber())),
+		mCallID(entry.SIP().callID())
+	{ }
+};
 
 
 
-bool TransactionTable::find(unsigned key, TransactionEntry& target)
+void TransactionSweeper::expire()
 {
-	// ID==0 is a non-valid special case.
-	assert(key);
-	mLock.lock();
-	TransactionMap::iterator itr = mTable.find(key);
-	if (itr==mTable.end()) {
-		mLock.unlock();
-		return false;
-	}
-	if (itr->second.dead()) {
-		mTable.erase(itr);
-		mLock.unlock();
-		return false;
-	}
-	mLock.unlock();
-	target = itr->second;
-	return true;
+	mTable.clearDeadEntries(mNext);
+	mNext = (mNext+1) % TransactionTable::numShards;
+	gTimerWheel.arm(this,TransactionTable::sweepMs/TransactionTable::numShards);
 }
 
 
 
-bool TransactionTable::remove(unsigned key)
+TransactionTable::~TransactionTable()
 {
-	// ID==0 is a non-valid special case.
-	assert(key);
-	mLock.lock();
-	bool retVal = mTable.erase(key);
-	mLock.unlock();
-	return retVal;
+	if (mSweeperArmed) gTimerWheel.cancel(&mSweeper,true);
 }
 
 
-
-void TransactionTable::clearDeadEntries()
+void TransactionTable::startSweeper()
 {
-	mLock.lock();
-	TransactionMap::iterator itr = mTable.begin();
-	while (itr!=mTable.end()) {
-		if (!itr->second.dead()) ++itr;
-		else {
-			LOG(DEBUG) << "erasing " << itr->first;
-			TransactionMap::iterator old = itr;
-			itr++;
-			mTable.erase(old);
-		}
-	}
-	mLock.unlock();
+	if (mSweeperArmed) return;
+	if (!__sync_bool_compare_and_swap(&mSweeperArmed,0,1)) return;
+	gTimerWheel.arm(&mSweeper,sweepMs/numShards);
 }
 
 
-
-bool TransactionTable::find(const L3MobileIdentity& mobileID, TransactionEntry& target)
+unsigned TransactionTable::newID()
 {
-	// Yes, it's linear time.
-	// Even in a 6-ARFCN system, it should rarely be more than a dozen entries.
-
-	// Since clearDeadEntries is also linear, do that here, too.
-
-	// Brute force search.
-	bool foundIt = false;
-	mLock.lock();
-	clearDeadEntries();
-	TransactionMap::const_iterator itr = mTable.begin();
-	while (itr!=mTable.end()) {
-		const TransactionEntry& transaction = itr->second;
-		if (transaction.subscriber()==mobileID) {
-			// No need to check dead(), since we just cleared the table.
-			foundIt = true;
-			target = transaction;
-			break;
-		}
-		++itr;
-	}
-	mLock.unlock();
-	return foundIt;
+	return __sync_fetch_and_add(&mIDCounter,1);
 }
 
 
 
-bool TransactionTable::find(const L3MobileIdentity& mobileID, GSM::L3CMServiceType serviceType, TransactionEntry& target)
+TransactionTable::IndexStripe& TransactionTable::stripe(IndexStripe* index, const string& key)
 {
-	// Yes, it's linear time.
-	// Even in a 6-ARFCN system, it should rarely be more than a dozen entries.
-
-	// Since clearDeadEntries is also linear, do that here, too.
-
-	// Brute force search.
-	bool foundIt = false;
-	mLock.lock();
-	clearDeadEntries();
-	TransactionMap::const_iterator itr = mTable.begin();
-	while (itr!=mTable.end()) {
-		const TransactionEntry& transaction = itr->second;
-		if (transaction.subscriber()==mobileID && transaction.service()==serviceType) {
-			// No need to check dead(), since we just cleared the table.
-			foundIt = true;
-			target = transaction;
-			break;
-		}
-		++itr;
-	}
-	mLock.unlock();
-	return foundIt;
+	return index[interthreadMapHash(key)%numShards];
 }
 
-size_t TransactionTable::size()
+
+void TransactionTable::indexAdd(IndexStripe* index, const string& key, unsigned ID)
 {
-	return mTable.size();
+	if (key.empty()) return;
+	IndexStripe& s = stripe(index,key);
+	s.mLock.lock();
+	s.mIndex[key].push_back(ID);
+	s.mLock.unlock();
 }
 
 
-void TransactionTable::dump(ostream& os) const
+void TransactionTable::indexRemove(IndexStripe* index, const string& key, unsigned ID)
 {
-	mLock.lock();
-	TransactionMap::const_iterator tp = mTable.begin();
-	while (tp != mTable.end()) {
-		os << hex << "0x" << tp->first << " " << dec << tp->second << endl;
-		++tp;
+	if (key.empty()) return;
+	IndexStripe& s = stripe(index,key);
+	s.mLock.lock();
+	IDIndex::iterator itr = s.mIndex.find(key);
+	if (itr!=s.mIndex.end()) {
+		vector<unsigned>& IDs = itr->second;
+		for (size_t i=0; i<IDs.size(); i++) {
+			if (IDs[i]!=ID) continue;
+			IDs[i] = IDs.back();
+			IDs.pop_back();
+			break;
+		}
+		if (IDs.empty()) s.mIndex.erase(itr);
 	}
-	mLock.unlock();
+	s.mLock.unlock();
 }
 
 
-void Control::clearTransactionHistory( TransactionEntry& transaction )
+void TransactionTable::indexFind(IndexStripe* index, const string& key, vector<unsigned>& IDs)
 {
-	SIP::SIPEngine& engine = transaction.SIP();
-	LOG(DEBUG) << engine.callID()<<" "<< transaction.ID();
-	gSIPInterface.removeCall(engine.callID());
-	gTransactionTable.remove(transaction.ID());
+	IDs.clear();
+	if (key.empty()) return;
+	IndexStripe& s = stripe(index,key);
+	s.mLock.lock();
+	IDIndex::const_iterator itr = s.mIndex.find(key);
+	if (itr!=s.mIndex.end()) IDs = itr->second;
+	s.mLock.unlock();
+	sort(IDs.begin(),IDs.end());
 }
 
 
-void Control::clearTransactionHistory(unsigned transactionID)
+void TransactionTable::indexAdd(const TransactionEntry& entry)
 {
-	if (transactionID==0) return;
-	TransactionEntry transaction;
-	if (gTransactionTable.find(transactionID,transaction)) {
-		clearTransactionHistory(transaction);
-	} else {
-		LOG(INFO) << "clearTransactionHistory didn't find " << transactionID << "(size = " << gTransactionTable.size() << ")";
-	}
+	indexAdd(mByMobileID,mobileIDKey(entry.subscriber()),entry.ID());
+	indexAdd(mByCallID,entry.SIP().callID(),entry.ID());
 }
 
 
+void TransactionTable::indexRemove(const TransactionEntry& entry)
+{
+	indexRemove(mByMobileID,mobileIDKey(entry.subscriber()),entry.ID());
+	indexRemove(mByCallID,entry.SIP().callID(),entry.ID());
+}
 
 
 
-void TMSIRecord::save(unsigned TMSI, FILE* fp) const
+void TransactionTable::add(const TransactionEntry& value)
 {
-	fprintf(fp, "%10u %10u %10u %15s %15s\n", TMSI, mCreated.sec(), mTouched.sec(), mIMSI.c_str(), mIMEI.c_str());
+	LOG(INFO) << "new transaction " << value;
+	startSweeper();
+	Shard& s = shard(value.ID());
+	s.mLock.lock();
+	s.mMap[value.ID()]=value;
+	s.mLock.unlock();
+	indexAdd(value);
 }
 
 
-unsigned TMSIRecord::load(FILE* fp)
+void TransactionTable::update(const TransactionEntry& value)
 {
-	unsigned TMSI=0;
-	unsigned created, touched;
-	char IMSI[16];
-	char IMEI[16];
-	int res = fscanf(fp, "%10u %10u %10u %15s %15s\n", &TMSI, &created, &touched, IMSI, IMEI);
-	if (res == EOF) {
-		return 0;
-	} else if (res < 5 || created > touched) {
-		LOG(ALARM) << "corrupt TMSI file";
-		return 0;
+	// ID==0 is a non-valid special case.
+	assert(value.ID());
+	Shard& s = shard(value.ID());
+	s.mLock.lock();
+	TransactionMap::iterator itr = s.mMap.find(value.ID());
+	if (itr==s.mMap.end()) {
+		s.mLock.unlock();
+		LOG(WARN) << "attempt to update non-existent transaction entry with key " << value.ID();
+		return;
 	}
-	mIMSI = IMSI;
-	mIMEI = IMEI;
-	mTouched = Timeval(touched,0);
-	mCreated = Timeval(created,0);
-	return TMSI;
+	// The index keys rarely change, but when they do, refile the entry.
+	bool rekey = !(itr->second.subscriber()==value.subscriber())
+		|| itr->second.SIP().callID()!=value.SIP().callID();
+	TransactionKeys old(itr->second);
+	itr->second=value;
+	s.mLock.unlock();
+	if (!rekey) return;
+	indexRemove(mByMobileID,old.mMobileKey,old.mID);
+	indexRemove(mByCallID,old.mCallID,old.mID);
+	indexAdd(value);
 }
 
 
 
-unsigned TMSITable::assign(const char* IMSI, const char* IMEI)
-{
-	purge();
-	mLock.lock();
-	// Is this IMSI already in here?
-	unsigned oldTMSI = TMSI(IMSI);
-	if (oldTMSI) {
-		mLock.unlock();
-		return oldTMSI;
-	}
-	unsigned TMSI = mCounter++;
-	mMap[TMSI] = TMSIRecord(IMSI, IMEI);
-	mLock.unlock();
-	if (gConfig.defines("Control.TMSITable.SavePath")) save(gConfig.getStr("Control.TMSITable.SavePath"));
-	return TMSI;
-}
 
-
-bool TMSITable::setIMEI(unsigned TMSI, const std::string& IMEI)
+bool TransactionTable::find(unsigned key, TransactionEntry& target)
 {
-	mLock.lock();
-	TMSIMap::iterator iter = mMap.find(TMSI);
-	if (iter==mMap.end()) {
-		mLock.unlock();
+	// ID==0 is a non-valid special case.
+	assert(key);
+	Shard& s = shard(key);
+	s.mLock.lock();
+	TransactionMap::iterator itr = s.mMap.find(key);
+	if (itr==s.mMap.end()) {
+		s.mLock.unlock();
+		return false;
+	}
+	if (itr->second.dead()) {
+		TransactionKeys old(itr->second);
+		s.mMap.erase(itr);
+		s.mLock.unlock();
+		indexRemove(mByMobileID,old.mMobileKey,old.mID);
+		indexRemove(mByCallID,old.mCallID,old.mID);
 		return false;
 	}
-	iter->second.IMEI(IMEI);
-	iter->second.touch();
-	mLock.unlock();
+	target = itr->second;
+	s.mLock.unlock();
 	return true;
 }
 
 
-bool TMSITable::find(unsigned TMSI, TMSIRecord& target)
+
+bool TransactionTable::remove(unsigned key)
 {
-	mLock.lock();
-	TMSIMap::iterator iter = mMap.find(TMSI);
-	if (iter==mMap.end()) {
-		mLock.unlock();
-		return false;
-	}
-	target = iter->second;
-	// Is it too old?
-	if (target.age() > 3600*gConfig.getNum("Control.TMSITable.MaxAge")) {
-		mMap.erase(iter);
-		mLock.unlock();
+	// ID==0 is a non-valid special case.
+	assert(key);
+	Shard& s = shard(key);
+	s.mLock.lock();
+	TransactionMap::iterator itr = s.mMap.find(key);
+	if (itr==s.mMap.end()) {
+		s.mLock.unlock();
 		return false;
 	}
-	iter->second.touch();
-	mLock.unlock();
+	TransactionKeys old(itr->second);
+	s.mMap.erase(itr);
+	s.mLock.unlock();
+	indexRemove(mByMobileID,old.mMobileKey,old.mID);
+	indexRemove(mByCallID,old.mCallID,old.mID);
 	return true;
 }
 
-const char* TMSITable::IMSI(unsigned TMSI) const
-{
-	mLock.lock();
-	TMSIMap::const_iterator iter = mMap.find(TMSI);
-	mLock.unlock();
-	if (iter==mMap.end()) return NULL;
-	iter->second.touch();
-	return iter->second.IMSI();
-}
 
-unsigned TMSITable::TMSI(const char* IMSI) const
+
+void TransactionTable::clearDeadEntries(unsigned shardIndex)
 {
-	// FIXME -- If we were smart, we'd organize the table for a log-time search.
-	unsigned TMSI = 0;
-	string IMSIc(IMSI);
-	mLock.lock();
-	// brute force search
-	TMSIMap::const_iterator itr = mMap.begin();
-	while (itr!=mMap.end()) {
-		if (itr->second.IMSI() == IMSIc) {
-			TMSI = itr->first;
-			itr->second.touch();
-			break;
+	Shard& s = mShards[shardIndex%numShards];
+	vector<TransactionKeys> erased;
+	s.mLock.lock();
+	TransactionMap::iterator itr = s.mMap.begin();
+	while (itr!=s.mMap.end()) {
+		if (!itr->second.dead()) ++itr;
+		else {
+			LOG(DEBUG) << "erasing " << itr->first;
+			erased.push_back(TransactionKeys(itr->second));
+			TransactionMap::iterator old = itr;
+			itr++;
+			s.mMap.erase(old);
 		}
-		++itr;
 	}
-	mLock.unlock();
-	return TMSI;
+	s.mLock.unlock();
+	for (size_t i=0; i<erased.size(); i++) {
+		indexRemove(mByMobileID,erased[i].mMobileKey,erased[i].mID);
+		indexRemove(mByCallID,erased[i].mCallID,erased[i].mID);
+	}
 }
 
 
+void TransactionTable::clearDeadEntries()
+{
+	for (unsigned i=0; i<numShards; i++) clearDeadEntries(i);
+}
+
 
 
-void TMSITable::erase(unsigned TMSI)
+bool TransactionTable::find(const L3MobileIdentity& mobileID, TransactionEntry& target)
 {
-	mLock.lock();
-	TMSIMap::iterator iter = mMap.find(TMSI);
-	if (iter!=mMap.end()) mMap.erase(iter);
-	mLock.unlock();
+	// The index hits are checked here, so a stale hit just costs a shard lookup.
+	string key = mobileIDKey(mobileID);
+	vector<unsigned> IDs;
+	indexFind(mByMobileID,key,IDs);
+	for (size_t i=0; i<IDs.size(); i++) {
+		if (!find(IDs[i],target)) {
+			indexRemove(mByMobileID,key,IDs[i]);
+			continue;
+		}
+		if (target.subscriber()==mobileID) return true;
+		indexRemove(mByMobileID,key,IDs[i]);
+	}
+	return false;
 }
 
 
 
-
-size_t TMSITable::size() const {
-	mLock.lock();
-	size_t retVal = mMap.size();
-	mLock.unlock();
-	return retVal;
+bool TransactionTable::find(const L3MobileIdentity& mobileID, GSM::L3CMServiceType serviceType, TransactionEntry& target)
+{
+	string key = mobileIDKey(mobileID);
+	vector<unsigned> IDs;
+	indexFind(mByMobileID,key,IDs);
+	for (size_t i=0; i<IDs.size(); i++) {
+		if (!find(IDs[i],target)) {
+			indexRemove(mByMobileID,key,IDs[i]);
+			continue;
+		}
+		if (!(target.subscriber()==mobileID)) {
+			indexRemove(mByMobileID,key,IDs[i]);
+			continue;
+		}
+		if (target.service()==serviceType) return true;
+	}
+	return false;
 }
 
 
-void TMSITable::purge()
+bool TransactionTable::findByCallID(const string& callID, TransactionEntry& target)
 {
-	mLock.lock();
-	// We rely on the fact the TMSIs are assigned in numeric order
-	// to erase the oldest first.
-	while ( (mMap.size()>gConfig.getNum("Control.TMSITable.MaxSize")) && (mClear!=mCounter) )
-		mMap.erase(mClear++);
-	mLock.unlock();
+	vector<unsigned> IDs;
+	indexFind(mByCallID,callID,IDs);
+	for (size_t i=0; i<IDs.size(); i++) {
+		if (find(IDs[i],target) && target.SIP().callID()==callID) return true;
+		indexRemove(mByCallID,callID,IDs[i]);
+	}
+	return false;
 }
 
 
-
-size_t printAge(unsigned seconds, char *buf)
+void TransactionTable::snapshot(TransactionMap& copy)
 {
-	static const unsigned k=5;
-	if (seconds<k*60) return sprintf(buf,"%4us",seconds);
-	unsigned minutes = (seconds+30) / 60;
-	if (minutes<k*60) return sprintf(buf,"%4um",minutes);
-	unsigned hours = (minutes+30) / 60;
-	if (hours<k*24) return sprintf(buf,"%4uh", hours);
-	return sprintf(buf,"%4ud",(hours+12)/24);
+	copy.clear();
+	for (unsigned i=0; i<numShards; i++) {
+		Shard& s = mShards[i];
+		s.mLock.lock();
+		for (TransactionMap::const_iterator itr = s.mMap.begin(); itr!=s.mMap.end(); ++itr) {
+			if (!itr->second.dead()) copy[itr->first] = itr->second;
+		}
+		s.mLock.unlock();
+	}
 }
 
-ostream& Control::operator<<(ostream& os, const TMSIRecord& rec)
+
+size_t TransactionTable::size()
 {
-	char buf[100];
-	char ageStr[10];
-	printAge(rec.age(),ageStr);
-	char touchedStr[10];
-	printAge(rec.touched(),touchedStr);
-	sprintf(buf,"%15s %15s %s %s", rec.IMSI(), rec.IMEI(), ageStr, touchedStr);
-	os << buf;
-	return os;
+	size_t total = 0;
+	for (unsigned i=0; i<numShards; i++) {
+		mShards[i].mLock.lock();
+		total += mShards[i].mMap.size();
+		mShards[i].mLock.unlock();
+	}
+	return total;
 }
 
 
-void TMSITable::dump(ostream& os) const
+void TransactionTable::dump(ostream& os) const
 {
-	mLock.lock();
-	TMSIMap::const_iterator tp = mMap.begin();
-	while (tp != mMap.end()) {
+	// Merge the shards so the dump stays in ID order.
+	TransactionMap copy;
+	for (unsigned i=0; i<numShards; i++) {
+		const Shard& s = mShards[i];
+		s.mLock.lock();
+		copy.insert(s.mMap.begin(),s.mMap.end());
+		s.mLock.unlock();
+	}
+	TransactionMap::const_iterator tp = copy.begin();
+	while (tp != copy.end()) {
 		os << hex << "0x" << tp->first << " " << dec << tp->second << endl;
 		++tp;
 	}
-	mLock.unlock();
 }
 
 
-void TMSITable::save(const char* filename) const
+void Control::clearTransactionHistory( TransactionEntry& transaction )
 {
-	FILE* fp = fopen(filename,"w");
-	if (!fp) {
-		LOG(ALARM) << "TMSITable cannot open " << filename << " for writing";
-		return;
-	}
-	LOG(INFO) << "saving TMSI table to " << filename;
-	mLock.lock();
-	TMSIMap::const_iterator tp = mMap.begin();
-	while (tp != mMap.end()) {
-		tp->second.save(tp->first,fp);
-		++tp;
-	}
-	mLock.unlock();
-	fclose(fp);
+	SIP::SIPEngine& engine = transaction.SIP();
+	LOG(DEBUG) << engine.callID()<<" "<< transaction.ID();
+	gSIPInterface.removeCall(engine.callID());
+	gTransactionTable.remove(transaction.ID());
 }
 
-void TMSITable::load(const char* filename)
+
+void Control::clearTransactionHistory(unsigned transactionID)
 {
-	FILE* fp = fopen(filename,"r");
-	if (!fp) {
-		LOG(ALARM) << "TMSITable cannot open " << filename << " for reading";
-		return;
-	}
-	LOG(INFO) << "loading TMSI table from " << filename;
-	mLock.lock();
-	while (!feof(fp)) {
-		TMSIRecord val;
-		unsigned key = val.load(fp);
-		if (!key) break;
-		mMap[key] = val;
+	if (transactionID==0) return;
+	TransactionEntry transaction;
+	if (gTransactionTable.find(transactionID,transaction)) {
+		clearTransactionHistory(transaction);
+	} else {
+		LOG(INFO) << "clearTransactionHistory didn't find " << transactionID << "(size = " << gTransactionTable.size() << ")";
 	}
-	mLock.unlock();
-	fclose(fp);
 }
 
+
+
+
+
 USSDHandler::ResultCode USSDHandler::waitUSSDData(Control::USSDData::USSDMessageType* messageType,
                                                   std::string* USSDString,
                                                   unsigned timeout)
@@ -1312,27 +1300,27 @@ unsigned Control::USSDDispatcher(GSM::L3MobileIdentity &mobileIdentity,
 		if (USSDMatchHandler("HTTP", ussdString))
 		{
 			 MOHttpHandler* handler = new MOHttpHandler(transaction.ID());
-			thread->start((void*(*)(void*))USSDHandler::runWrapper, handler);
+			thread->start((void*(*)(void*))USSDHandler::runWrapper, handler, "ussd");
 		}
 		else if (USSDMatchHandler("CLI", ussdString))
 		{
 			 MOCLIHandler* handler = new MOCLIHandler(transaction.ID());
-			thread->start((void*(*)(void*))USSDHandler::runWrapper, handler);
+			thread->start((void*(*)(void*))USSDHandler::runWrapper, handler, "ussd");
 		}
 		else if (USSDMatchHandler("Test", ussdString))
 		{
 			MOTestHandler* handler = new MOTestHandler(transaction.ID());
-			thread->start((void*(*)(void*))USSDHandler::runWrapper, handler);
+			thread->start((void*(*)(void*))USSDHandler::runWrapper, handler, "ussd");
 		}
 		else if (USSDMatchHandler("SIP", ussdString))
 		{
 			UssdSipHandler* handler = new UssdSipHandler(transaction.ID());
-			thread->start((void*(*)(void*))USSDHandler::runWrapper, handler);
+			thread->start((void*(*)(void*))USSDHandler::runWrapper, handler, "ussd");
 		}
 		else
 		{
 			MOTestHandler* handler = new MOTestHandler(transaction.ID());
-			thread->start((void*(*)(void*))USSDHandler::runWrapper, handler);
+			thread->start((void*(*)(void*))USSDHandler::runWrapper, handler, "ussd");
 		}
 	}
 	else
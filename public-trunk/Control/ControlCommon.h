@@ -43,6 +43,18 @@
 #include <GSML3RRMessages.h>
 #include <SIPEngine.h>
 
+#include <TimerWheel.h>
+#include <map>
+#include <vector>
+#include <tr1/unordered_map>
+
+#include "TMSITable.h"
+#include "CallReactor.h"
+#include "MediaRelay.h"
+#include "Registrar.h"
+#include "DCCHPool.h"
+#include "AccessGrant.h"
+
 
 // Enough forward refs to prevent "kitchen sick" includes and circularity.
 
@@ -146,6 +158,9 @@ void clearTransactionHistory(TransactionEntry& transaction);
 */
 void clearTransactionHistory(unsigned transactionID);
 
+/** A hash key for a mobile identity: the identity type, then the TMSI or the digits. */
+std::string mobileIDKey(const GSM::L3MobileIdentity& mobileID);
+
 //@}
 
 /**@name USSD */
@@ -166,7 +181,7 @@ void LocationUpdatingController(const GSM::L3LocationUpdatingRequest* lur, GSM::
 
 /**@name Functions for radio resource operations. */
 //@{
-/** Decode RACH bits and send an immediate assignment. */
+/** Screen a decoded RACH burst and post it to gAccessGrant to be answered. */
 void AccessGrantResponder(
 	unsigned requestReference, const GSM::Time& when,
 	float RSSI, float timingError);
@@ -260,15 +275,22 @@ void  resolveIMSI(GSM::L3MobileIdentity& mobID, GSM::LogicalChannel* LCH);
 //@{
 
 
+/** Expiration times of paging entries, in seconds, to the keys of the paged mobiles. */
+typedef std::multimap<double,std::string> PagingDeadlines;
+
+
 /** An entry in the paging list. */
 class PagingEntry {
 
 	private:
 
 	GSM::L3MobileIdentity mID;		///< The mobile ID.
+	GSM::L3MobileIdentity mPagedID;	///< The ID sent on the air, maybe a TMSI for an IMSI.
 	GSM::ChannelType mType;			///< The needed channel type.
 	unsigned mTransactionID;		///< The associated transaction ID.
 	Timeval mExpiration;			///< The expiration time for this entry.
+	int mGroup;						///< The paging group, or -1 if not known.
+	PagingDeadlines::iterator mDeadline;	///< Our place in the pager's deadline order.
 
 	public:
 
@@ -279,17 +301,30 @@ class PagingEntry {
 	*/
 	PagingEntry(const GSM::L3MobileIdentity& wID, GSM::ChannelType wType,
 			unsigned wTransactionID, unsigned wLife)
-		:mID(wID),mType(wType),mTransactionID(wTransactionID),mExpiration(wLife)
+		:mID(wID),mPagedID(wID),mType(wType),mTransactionID(wTransactionID),mExpiration(wLife),
+		mGroup(-1)
 	{}
 
 	/** Access the ID. */
 	const GSM::L3MobileIdentity& ID() const { return mID; }
 
+	/** The ID to put in the paging request. */
+	const GSM::L3MobileIdentity& pagedID() const { return mPagedID; }
+	void pagedID(const GSM::L3MobileIdentity& wPagedID) { mPagedID = wPagedID; }
+
 	/** Access the channel type needed. */
 	GSM::ChannelType type() const { return mType; }
 
 	unsigned transactionID() const { return mTransactionID; }
 
+	int group() const { return mGroup; }
+	void group(int wGroup) { mGroup = wGroup; }
+
+	const Timeval& expiration() const { return mExpiration; }
+
+	PagingDeadlines::iterator deadline() const { return mDeadline; }
+	void deadline(PagingDeadlines::iterator wDeadline) { mDeadline = wDeadline; }
+
 	/** Renew the timer. */
 	void renew(unsigned wLife) { mExpiration = Timeval(wLife); }
 
@@ -305,26 +340,43 @@ typedef std::list<PagingEntry> PagingEntryList;
 	The pager is a global object that generates paging messages on the CCCH.
 	To page a mobile, add the mobile ID to the pager.
 	The entry will be deleted automatically when it expires.
-	All pager operations are linear time.
-	Not much point in optimizing since the main operation is inherently linear.
+
+	Each paging group of GSM 05.02 6.5.2 has its own queue, and the PCH
+	asks for a page as each block comes up, so a mobile is paged only in
+	the blocks it listens to.  Each page packs as many mobiles of the group
+	as fit in a Paging Request type 1, 2 or 3.
+	Mobiles are found through a hash index, and entries expire in deadline order.
 */
-class Pager {
+class Pager : public GSM::PagingSource {
 
 	private:
 
-	PagingEntryList mPageIDs;				///< List of ID's to be paged.
-	Mutex mLock;							///< Lock for thread-safe access.
-	Signal mPageSignal;						///< signal to wake the paging loop
-	Thread mPagingThread;					///< Thread for the paging loop.
+	typedef std::tr1::unordered_map<std::string,PagingEntryList::iterator> PagingIndex;
+
+	std::vector<PagingEntryList> mGroups;	///< a paging queue for each paging group
+	PagingEntryList mAnyGroup;				///< mobiles of unknown paging group, paged in every block
+	PagingIndex mIndex;						///< mobile ID key to paging entry
+	PagingDeadlines mDeadlines;				///< entry expirations, soonest first
+	unsigned mBlocks;						///< paging blocks per multiframe
+	unsigned mMultiframes;					///< BS_PA_MFRMS, multiframes per paging cycle
+	bool mUseTMSIs;							///< page by TMSI when the IMSI has one
+	std::vector<bool> mAnyFirst;			///< by group, the any-group queue went first in the last page
+	mutable Mutex mLock;					///< Lock for thread-safe access.
 	volatile bool mRunning;
 
+	/**@name Statistics */
+	//@{
+	unsigned mRequests[3];					///< paging requests sent, by type
+	unsigned mPages;						///< mobile IDs sent in paging requests
+	//@}
+
 	public:
 
 	Pager()
-		:mRunning(false)
-	{}
+		:mBlocks(1),mMultiframes(1),mUseTMSIs(false),mRunning(false),mPages(0)
+	{ mRequests[0]=mRequests[1]=mRequests[2]=0; mGroups.resize(1); mAnyFirst.resize(1,false); }
 
-	/** Set the output FIFO and start the paging loop. */
+	/** Attach to the PCHs and start paging. */
 	void start();
 
 	/**
@@ -348,19 +400,32 @@ class Pager {
 	*/
 	unsigned removeID(const GSM::L3MobileIdentity&);
 
+	/** Build the page for a paging block; called from the PCH service loop. */
+	GSM::L3Frame* pagingFrame(unsigned block, const GSM::Time& when);
+
 	private:
 
 	/**
-		Traverse the paging list, paging all IDs.
-		@return Number of IDs paged.
+		The paging group of a mobile, GSM 05.02 6.5.2, with one CCCH.
+		@return The group, or -1 if it cannot be known.
 	*/
-	unsigned pageAll();
+	int pagingGroup(const GSM::L3MobileIdentity&) const;
 
-	/** A loop that repeatedly calls pageAll. */
-	void serviceLoop();
+	/** The queue holding an entry of the given group. */
+	PagingEntryList& queue(int group) { return group<0 ? mAnyGroup : mGroups[group]; }
 
-	/** C-style adapter. */
-	friend void *PagerServiceLoopAdapter(Pager*);
+	/** Drop an entry from the queue, index and deadlines.  Caller holds mLock. */
+	void erase(PagingEntryList::iterator entry);
+
+	/** Drop expired entries.  Caller holds mLock. */
+	void expire();
+
+	/**
+		Pack the mobiles at the front of a queue into a paging request,
+		moving the paged entries to the back.  Caller holds mLock.
+		@return A new frame, or NULL if there is nothing to page.
+	*/
+	GSM::L3Frame* pack(PagingEntryList& first, PagingEntryList& second);
 
 public:
 
@@ -372,9 +437,6 @@ public:
 };
 
 
-void *PagerServiceLoopAdapter(Pager*);
-
-
 //@}	// paging mech
 
 
@@ -592,6 +654,9 @@ class TransactionEntry {
 	/** Return true if any Q.931 timer is expired. */
 	bool timerExpired() const;
 
+	/** Time until the next Q.931 timer expires, in ms, or -1 if none is running. */
+	long timerRemaining() const;
+
 	/** Reset all Q.931 timers. */
 	void resetTimers();
 
@@ -613,29 +678,79 @@ std::ostream& operator<<(std::ostream& os, TransactionEntry::Q931CallState);
 /** A map of transactions keyed by ID. */
 class TransactionMap : public std::map<unsigned,TransactionEntry> {};
 
+
+/** Sweeps a TransactionTable for dead entries, one shard per expiration. */
+class TransactionSweeper : public TimerEntry {
+
+	private:
+
+	TransactionTable& mTable;
+	unsigned mNext;				///< next shard to sweep
+
+	public:
+
+	TransactionSweeper(TransactionTable& wTable):mTable(wTable),mNext(0) {}
+
+	void expire();
+};
+
+
 /**
 	A table for tracking the states of active transactions.
 	Note that transaction table add and find operations
 	are pass-by-copy, not pass-by-reference.
+
+	Entries are sharded by ID, each shard with its own lock, so call threads
+	working on different transactions do not serialize on one mutex.
+	Hash indexes by subscriber and by SIP call ID map to transaction IDs.
+	The indexes are hints: every hit is checked against the entry itself,
+	and stale IDs are pruned when a lookup meets them, so the indexes
+	may lag an update or an erase without harm.
+	Dead entries are erased when a lookup meets them and by a sweep that
+	visits one shard at a time from the timer wheel, not by a scan on every lookup.
 */
 class TransactionTable {
 
+	public:
+
+	static const unsigned numShards = 16;		///< ID shards, and stripes per index
+	static const unsigned sweepMs = 2000;		///< period of a full sweep of dead entries
+
 	private:
 
-	// FIXME -- We need to support log-time lookup by transaction ID _or_ IMSI.
-	// Right now, it's log-time for transaction ID and linear time for IMSI.
+	/** Entries whose ID falls in one shard. */
+	struct Shard {
+		TransactionMap mMap;
+		mutable Mutex mLock;
+	};
 
-	TransactionMap mTable;
-	mutable Mutex mLock;
-	unsigned mIDCounter;
+	/** Key to transaction IDs; a subscriber may have several transactions. */
+	typedef std::tr1::unordered_map<std::string, std::vector<unsigned> > IDIndex;
+
+	/** The keys of an index that hash to one stripe. */
+	struct IndexStripe {
+		IDIndex mIndex;
+		mutable Mutex mLock;
+	};
+
+	Shard mShards[numShards];
+	IndexStripe mByMobileID[numShards];		///< subscriber index
+	IndexStripe mByCallID[numShards];		///< SIP call ID index
+	volatile unsigned mIDCounter;
+	TransactionSweeper mSweeper;
+	volatile int mSweeperArmed;
 
 	public:
 
 	TransactionTable()
 		// This assumes the main application uses sdevrandom.
-		:mIDCounter(random())
+		:mIDCounter(random()),
+		mSweeper(*this),
+		mSweeperArmed(0)
 	{ }
 
+	~TransactionTable();
+
 	/**
 		Return a new ID for use in the table.
 	*/
@@ -672,7 +787,7 @@ class TransactionTable {
 
 	/**
 		Find an entry by its mobile ID.
-		Also clears dead entries during search.
+		If there are several, the one with the lowest ID.
 		@param mobileID The mobile at to search for.
 		@param target A TransactionEntry to accept the found record.
 		@return true is the mobile ID was found.
@@ -681,7 +796,6 @@ class TransactionTable {
 
 	/**
 		Find an entry by its mobile ID and service type.
-		Also clears dead entries during search.
 		@param mobileID The mobile at to search for.
 		@param serviceType Service type we're looking for.
 		@param target A TransactionEntry to accept the found record.
@@ -689,167 +803,52 @@ class TransactionTable {
 	*/
 	bool find(const GSM::L3MobileIdentity& mobileID, GSM::L3CMServiceType serviceType, TransactionEntry& target);
 
+	/**
+		Find an entry by the call ID of its SIP engine.
+		@param callID The SIP call ID.
+		@param target A TransactionEntry to accept the found record.
+		@return true if the call ID was found.
+	*/
+	bool findByCallID(const std::string& callID, TransactionEntry& target);
+
 	/**
 		Remove "dead" entries from the table.
 		A "dead" entry is a transaction that is no longer active.
+		This sweeps every shard; the timer wheel also does it a shard at a time.
 	*/
 	void clearDeadEntries();
 
-	/**@Access to raw map. */
-	//@{
-	TransactionMap::const_iterator begin() { clearDeadEntries(); return mTable.begin(); }
-	TransactionMap::const_iterator end() const { return mTable.end(); }
-	//@}
+	/** Remove dead entries from one shard. */
+	void clearDeadEntries(unsigned shard);
+
+	/** Copy the live entries, in ID order, into a map. */
+	void snapshot(TransactionMap& copy);
 
 	size_t size();
 
 	/** Write entries as text to a stream. */
 	void dump(std::ostream&) const;
-};
-
-//@} // Transaction Table
-
-
-
-
-/**@ TMSI mechanisms */
-//@{
-
-class TMSIRecord {
 
 	private:
 
-	std::string mIMSI;
-	std::string mIMEI;
-	Timeval mCreated;				///< Time when this TMSI was created.
-	mutable Timeval mTouched;		///< Time when this TMSI was last accessed.
-
-	public:
-
-	TMSIRecord() {}
-	
-	TMSIRecord(const char* wIMSI, const char* wIMEI = NULL):
-		mIMSI(wIMSI), mIMEI(wIMEI!=NULL?wIMEI:"?")
-	{ }
-
-	const char* IMSI() const { return mIMSI.c_str(); }
-	const char* IMEI() const { return mIMEI.c_str(); }
-	void IMEI(const std::string &imei) { mIMEI = imei; }
-	void touch() const { mTouched.now(); }
-
-	/** Record age in seconds. */
-	unsigned age() const { return mCreated.elapsed()/1000; }
-
-	/** Time since last access in seconds. */
-	unsigned touched() const { return mTouched.elapsed()/1000; }
-
-	void save(unsigned TMSI, FILE*) const;
+	Shard& shard(unsigned ID) { return mShards[ID%numShards]; }
 
-	/**
-		Load a TMSI record from a file.
-		@return TMSI or 0 on read failure.
-	*/
-	unsigned load(FILE*);
+	/**@name Index maintenance; never called with a shard lock held. */
+	//@{
+	static IndexStripe& stripe(IndexStripe* index, const std::string& key);
+	static void indexAdd(IndexStripe* index, const std::string& key, unsigned ID);
+	static void indexRemove(IndexStripe* index, const std::string& key, unsigned ID);
+	/** Return the IDs filed under a key, lowest first. */
+	static void indexFind(IndexStripe* index, const std::string& key, std::vector<unsigned>& IDs);
+	void indexAdd(const TransactionEntry& entry);
+	void indexRemove(const TransactionEntry& entry);
+	//@}
 
+	/** Arm the sweeper on first use, once the timer wheel is surely constructed. */
+	void startSweeper();
 };
 
-std::ostream& operator<<(std::ostream&, const TMSIRecord&);
-
-typedef std::map<unsigned,TMSIRecord> TMSIMap;
-
-class TMSITable {
-
-	private:
-
-	TMSIMap mMap;							///< IMSI/TMSI mapping
-	unsigned mCounter;						///< a counter to generate new TMSIs
-	unsigned mClear;						///< next TMSI to be cleared from the table
-	mutable Mutex mLock;					///< concurrency control
-
-
-	public:
-
-	TMSITable()
-		:mCounter(time(NULL)),
-		mClear(mCounter)
-	{}
-
-	/**
-		Create a new entry in the table.
-		@param IMSI	The IMSI to create an entry for.
-		@return The assigned TMSI.
-	*/
-	unsigned assign(const char* IMSI, const char* IMEI = NULL);
-
-	/**
-		Set IMEI for a selected TMSI.
-		@param TMSI	The TMSI to set IMEI for
-		@param IMEI	The IMEI to set.
-		@return true if the TMSI exists and we've set IMEI for it.
-	*/
-	bool setIMEI(unsigned TMSI, const std::string& IMEI);
-
-	/**
-		Find an IMSI in the table.
-		This is a log-time operation.
-		@param TMSI The TMSI to find.post to
-		@return Pointer to c-string IMSI or NULL.
-	*/
-	const char* IMSI(unsigned TMSI) const;
-
-
-	/**
-		Find an entry in the table.
-		This is a log-time operation.
-		@param TMSI The TMSI to find.
-		@param target A TMSI record to catch the result.
-		@return true if the TMSI was found.
-	*/
-	bool find(unsigned TMSI, TMSIRecord& target);
-
-	/**
-		Find a TMSI in the table.
-		This is a linear-time operation.
-		@param IMSI The IMSI to mach.
-		@return A TMSI value or zero on failure.
-	*/
-	unsigned TMSI(const char* IMSI) const;
-
-	/**
-		Update the record's timestamp.
-	*/
-	void touch(unsigned TMSI) const;
-
-	/**
-		Remove an entry from the table.
-		@param TMSI The TMSI to remove.
-	*/
-	void erase(unsigned TMSI);
-
-	/** Write entries as text to a stream. */
-	void dump(std::ostream&) const;
-	
-	/** Save the table to a file. */
-	void save(const char* filename) const;
-
-	/** Load the table from a file. */
-	void load(const char*filename);
-
-	/** Clear the table completely. */
-	void clear() { mMap.clear(); }
-
-	size_t size() const;
-
-	// FIXME -- These are not thread safe and should be removed.
-	TMSIMap::const_iterator begin() const { return mMap.begin(); }
-	TMSIMap::const_iterator end() const { return mMap.end(); }
-
-	private:
-
-	/** Erase entries, oldest first, to limit the table size. */
-	void purge();
-
-};
+//@} // Transaction Table
 
 
 
@@ -925,6 +924,16 @@ class Q931TimerExpired : public ControlLayerException {
 extern Control::TransactionTable gTransactionTable;
 /** A single global TMSI table in the global namespace. */
 extern Control::TMSITable gTMSITable;
+/** A single global call reactor in the global namespace. */
+extern Control::CallReactor gCallReactor;
+/** A single global media relay in the global namespace. */
+extern Control::CallReactor gMediaRelay;
+/** A single global SIP registrar in the global namespace. */
+extern Control::Registrar gRegistrar;
+/** A single global DCCH worker pool in the global namespace. */
+extern Control::DCCHPool gDCCHPool;
+/** A single global RACH processing stage in the global namespace. */
+extern Control::AccessGrantStage gAccessGrant;
 //@}
 
 
@@ -102,17 +102,20 @@ void DCCHDispatchRR(const L3RRMessage* req, LogicalChannel *DCCH)
 
 
 
-/** Example of a closed-loop, persistent-thread control function for the DCCH. */
-void Control::DCCHDispatcher(LogicalChannel *DCCH)
+/**
+	Serve a transaction on a DCCH after its ESTABLISH.
+	A transaction cut short by an unexpected message that could start
+	another is followed by that one, and so on until one ends cleanly.
+*/
+static void DCCHTransaction(LogicalChannel *DCCH)
 {
 	const L3Message *message = NULL;
-	while (1) {
+	bool first = true;
+	while (first || message) {
+		first = false;
 		try {
 			if (!message)
 			{
-				// Wait for a transaction to start.
-				LOG(DEBUG) << "waiting for " << DCCH->type() << " ESTABLISH";
-				waitForPrimitive(DCCH,ESTABLISH);
 				// Pull the first message and dispatch a new transaction.
 				message = getMessage(DCCH);
 				LOG(DEBUG) << "received " << *message;
@@ -185,6 +188,18 @@ void Control::DCCHDispatcher(LogicalChannel *DCCH)
 			// Cause 0x01 means "abnormal release, unspecified".
 			DCCH->send(L3ChannelRelease(0x01));
 		}
+	}
+}
+
+
+/** Example of a closed-loop, persistent-thread control function for the DCCH. */
+void Control::DCCHDispatcher(LogicalChannel *DCCH)
+{
+	while (1) {
+		// Wait for a transaction to start.
+		LOG(DEBUG) << "waiting for " << DCCH->type() << " ESTABLISH";
+		waitForPrimitive(DCCH,ESTABLISH);
+		DCCHTransaction(DCCH);
 
 		//FIXME -- What's the GSM 04.08 Txxx value for this?
 		// Probably N200 * T200
@@ -193,4 +208,180 @@ void Control::DCCHDispatcher(LogicalChannel *DCCH)
 	}
 }
 
+
+
+
+void PooledDCCH::queueWritten()
+{
+	mPool->mLock.lock();
+	if (mState==Idle) mPool->post(this);
+	else if (mState==Busy) mRecheck = true;
+	mPool->mLock.unlock();
+}
+
+
+
+DCCHPool::DCCHPool()
+	:mIdle(0),mMaxWorkers(0),
+	mTransactions(0),mBusy(0),mPeakBusy(0),mLent(0)
+{}
+
+
+void DCCHPool::start(unsigned minWorkers, unsigned maxWorkers)
+{
+	if (maxWorkers==0) maxWorkers = 1;
+	if (minWorkers>maxWorkers) minWorkers = maxWorkers;
+	mLock.lock();
+	assert(mMaxWorkers==0);
+	mMaxWorkers = maxWorkers;
+	while (mWorkers.size()<minWorkers) startWorker();
+	// Work posted before the start.
+	while ((mWorkers.size()<mMaxWorkers) && (mWorkers.size()<mReady.size())) startWorker();
+	mLock.unlock();
+	LOG(INFO) << "started " << minWorkers << " DCCH workers, at most " << maxWorkers;
+}
+
+
+void DCCHPool::add(LogicalChannel* DCCH)
+{
+	PooledDCCH* chan = new PooledDCCH(DCCH,this);
+	mLock.lock();
+	mChannels.push_back(chan);
+	mLock.unlock();
+	DCCH->listener(chan);
+	// Catch anything that came in before the listener.
+	chan->queueWritten();
+}
+
+
+bool DCCHPool::lend(LogicalChannel* DCCH)
+{
+	mLock.lock();
+	PooledDCCH* chan = find(DCCH);
+	if (chan) {
+		chan->mLent = true;
+		mLent++;
+	}
+	mLock.unlock();
+	return chan!=NULL;
+}
+
+
+void DCCHPool::giveBack(LogicalChannel* DCCH)
+{
+	mLock.lock();
+	PooledDCCH* chan = find(DCCH);
+	if (chan && chan->mLent) {
+		chan->mLent = false;
+		mLent--;
+	}
+	mLock.unlock();
+	if (!chan) return;
+	DCCH->listener(chan);
+	// Catch anything that came in after the call let go.
+	chan->queueWritten();
+}
+
+
+PooledDCCH* DCCHPool::find(LogicalChannel* DCCH)
+{
+	for (unsigned i=0; i<mChannels.size(); i++) {
+		if (mChannels[i]->mDCCH==DCCH) return mChannels[i];
+	}
+	return NULL;
+}
+
+
+bool DCCHPool::lent(PooledDCCH* chan) const
+{
+	mLock.lock();
+	bool retVal = chan->mLent;
+	mLock.unlock();
+	return retVal;
+}
+
+
+void DCCHPool::startWorker()
+{
+	Thread* thread = new Thread;
+	mWorkers.push_back(thread);
+	mIdle++;
+	thread->start((void*(*)(void*))DCCHPoolServiceLoop,this,"dcch");
+}
+
+
+void DCCHPool::post(PooledDCCH* chan)
+{
+	chan->mState = PooledDCCH::Queued;
+	mReady.push_back(chan);
+	// Grow while every worker is held by a transaction.
+	if ((mIdle<mReady.size()) && (mWorkers.size()<mMaxWorkers)) startWorker();
+	mReadySignal.signal();
+}
+
+
+void DCCHPool::serviceLoop()
+{
+	while (true) {
+		mLock.lock();
+		while (mReady.empty()) mReadySignal.wait(mLock);
+		PooledDCCH* chan = mReady.front();
+		mReady.pop_front();
+		chan->mState = PooledDCCH::Busy;
+		chan->mRecheck = false;
+		mIdle--;
+		mBusy++;
+		if (mBusy>mPeakBusy) mPeakBusy = mBusy;
+		mLock.unlock();
+
+		serve(chan);
+
+		mLock.lock();
+		mIdle++;
+		mBusy--;
+		if (chan->mRecheck) post(chan);
+		else chan->mState = PooledDCCH::Idle;
+		mLock.unlock();
+	}
+}
+
+
+void* Control::DCCHPoolServiceLoop(DCCHPool* pool)
+{
+	pool->serviceLoop();
+	return NULL;
+}
+
+
+void DCCHPool::serve(PooledDCCH* chan)
+{
+	LogicalChannel* DCCH = chan->mDCCH;
+	// A lent channel's frames are its call's, even if we were posted before it took over.
+	while (!lent(chan)) {
+		L3Frame* frame = DCCH->recv(0);
+		if (!frame) return;
+		// Anything before an ESTABLISH is left over from the last transaction.
+		bool establish = (frame->primitive()==ESTABLISH);
+		delete frame;
+		if (!establish) continue;
+		mLock.lock();
+		mTransactions++;
+		mLock.unlock();
+		DCCHTransaction(DCCH);
+	}
+}
+
+
+void DCCHPool::dump(ostream& os) const
+{
+	mLock.lock();
+	os << "DCCH pool: channels=" << mChannels.size() << " workers=" << mWorkers.size() << "/" << mMaxWorkers;
+	os << " busy=" << mBusy << " peak=" << mPeakBusy << " queued=" << mReady.size();
+	os << " calls=" << mLent;
+	os << " transactions=" << mTransactions << endl;
+	mLock.unlock();
+}
+
+
+
 // vim: ts=4 sw=4
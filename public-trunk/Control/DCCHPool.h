@@ -0,0 +1,175 @@
+/**@file Worker pool serving the SDCCH and TCH transactions. */
+/*
+* Copyright 2008, 2009, 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef DCCHPOOL_H
+#define DCCHPOOL_H
+
+#include <deque>
+#include <vector>
+#include <ostream>
+
+#include <Threads.h>
+#include <Interthread.h>
+
+
+namespace GSM {
+class LogicalChannel;
+};
+
+
+namespace Control {
+
+
+class DCCHPool;
+
+
+/**
+	A DCCH served by a DCCHPool.
+	It is the channel's L3 queue listener while no transaction is running,
+	so uplink frames post it to the pool's run queue.
+	While lent to a connected call the call is the listener instead.
+*/
+class PooledDCCH : public QueueListener {
+
+	private:
+
+	friend class DCCHPool;
+
+	/** Where the channel stands with the pool; pool lock. */
+	enum State {
+		Idle,		///< nothing to do
+		Queued,		///< in the run queue
+		Busy		///< being served by a worker
+	};
+
+	GSM::LogicalChannel* mDCCH;
+	DCCHPool* mPool;
+	State mState;
+	bool mRecheck;					///< written to while busy; serve again
+	bool mLent;						///< lent to a call on gCallReactor; pool lock
+
+	public:
+
+	PooledDCCH(GSM::LogicalChannel* wDCCH, DCCHPool* wPool)
+		:mDCCH(wDCCH),mPool(wPool),mState(Idle),mRecheck(false),mLent(false)
+	{}
+
+	/** Called with the channel's queue locked; only posts the channel. */
+	void queueWritten();
+};
+
+
+
+/**
+	Serves DCCH transactions from a shared run queue and a pool of workers,
+	instead of a thread per channel blocked waiting for ESTABLISH.
+	An idle channel costs no thread. A worker runs a transaction
+	from its ESTABLISH until it ends or, for a call, until it is connected;
+	the connected call is lent to gCallReactor with its TCH and the worker
+	goes back to the pool.  So the number of threads follows the number of
+	transactions in signalling, not the number of calls, up to a maximum.
+	Work beyond that waits in the run queue.
+*/
+class DCCHPool {
+
+	private:
+
+	friend class PooledDCCH;
+
+	mutable Mutex mLock;
+	std::vector<PooledDCCH*> mChannels;
+	std::deque<PooledDCCH*> mReady;			///< channels with uplink frames to look at
+	Signal mReadySignal;
+	std::vector<Thread*> mWorkers;
+	unsigned mIdle;							///< workers waiting for work
+	unsigned mMaxWorkers;					///< zero until started
+
+	/**@name Statistics. */
+	//@{
+	unsigned long mTransactions;			///< ESTABLISHes served
+	unsigned mBusy;							///< workers serving channels
+	unsigned mPeakBusy;
+	unsigned mLent;							///< channels lent to calls
+	//@}
+
+	public:
+
+	DCCHPool();
+
+	/**
+		Start the workers.  Channels may be added before or after.
+		@param minWorkers Workers started now.
+		@param maxWorkers Most workers ever started, as transactions need them.
+	*/
+	void start(unsigned minWorkers, unsigned maxWorkers);
+
+	/** Add a channel.  It must be connected to L2. */
+	void add(GSM::LogicalChannel* DCCH);
+
+	/**
+		Lend a channel to a connected call, from the transaction serving it.
+		The worker stops reading the channel when the transaction returns.
+		@return false If the channel is not in the pool.
+	*/
+	bool lend(GSM::LogicalChannel* DCCH);
+
+	/** Take a lent channel back after its call and look at anything queued meanwhile. */
+	void giveBack(GSM::LogicalChannel* DCCH);
+
+	/** Worker loop.  Never returns. */
+	void serviceLoop();
+
+	void dump(std::ostream& os) const;
+
+	private:
+
+	/** Add a channel to the run queue, starting a worker if needed.  Caller holds mLock. */
+	void post(PooledDCCH* chan);
+
+	/** Start one worker.  Caller holds mLock. */
+	void startWorker();
+
+	/** The pool's record of a channel, or NULL.  Caller holds mLock. */
+	PooledDCCH* find(GSM::LogicalChannel* DCCH);
+
+	/** True if the channel is lent to a call. */
+	bool lent(PooledDCCH* chan) const;
+
+	/** Take the channel's queued frames and run any transaction they start. */
+	void serve(PooledDCCH* chan);
+};
+
+
+/** Worker thread entry for DCCHPool. */
+void* DCCHPoolServiceLoop(DCCHPool*);
+
+
+}	// namespace Control
+
+
+#endif
+
+// vim: ts=4 sw=4
@@ -0,0 +1,112 @@
+/**@file Fixed-size RTP jitter buffer for speech frames. */
+
+/*
+* Copyright 2008, 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+
+#include "JitterBuffer.h"
+#include <string.h>
+
+
+using namespace std;
+using namespace Control;
+
+
+
+JitterBuffer::JitterBuffer(unsigned wTarget)
+	:mNext(0),mStarted(false),mHeld(0),mTarget(wTarget),
+	mIn(0),mLate(0),mDuplicate(0),mLost(0),mOverrun(0)
+{
+	if (mTarget>=mSlots) mTarget = mSlots-1;
+	memset(mValid,0,sizeof(mValid));
+}
+
+
+bool JitterBuffer::put(uint16_t seq, const unsigned char* frame)
+{
+	if (!mStarted) {
+		mNext = seq;
+		mStarted = true;
+	}
+	int16_t ahead = (int16_t)(seq - mNext);
+	if (ahead<0) {
+		mLate++;
+		return false;
+	}
+	// Too far ahead; play on without whatever is in the way.
+	while ((unsigned)ahead>=mSlots) {
+		unsigned slot = mNext % mSlots;
+		if (mValid[slot]) {
+			mValid[slot] = false;
+			mHeld--;
+			mOverrun++;
+		} else {
+			mLost++;
+		}
+		mNext++;
+		ahead--;
+	}
+	unsigned slot = seq % mSlots;
+	if (mValid[slot]) {
+		mDuplicate++;
+		return false;
+	}
+	memcpy(mFrames[slot],frame,mFrameBytes);
+	mValid[slot] = true;
+	mHeld++;
+	mIn++;
+	return true;
+}
+
+
+const unsigned char* JitterBuffer::get()
+{
+	if (mHeld==0) return NULL;
+	// Wait for a missing frame until too many are held behind it.
+	if (!mValid[mNext % mSlots]) {
+		if (mHeld<=mTarget) return NULL;
+		while (!mValid[mNext % mSlots]) {
+			mLost++;
+			mNext++;
+		}
+	}
+	unsigned slot = mNext % mSlots;
+	mValid[slot] = false;
+	mHeld--;
+	mNext++;
+	return mFrames[slot];
+}
+
+
+ostream& Control::operator<<(ostream& os, const JitterBuffer& jb)
+{
+	os << "in=" << jb.in() << " late=" << jb.late() << " dup=" << jb.duplicate();
+	os << " lost=" << jb.lost() << " overrun=" << jb.overrun() << " held=" << jb.held();
+	return os;
+}
+
+
+// vim: ts=4 sw=4
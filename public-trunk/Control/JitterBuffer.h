@@ -0,0 +1,112 @@
+/**@file Fixed-size RTP jitter buffer for speech frames. */
+/*
+* Copyright 2008, 2009, 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#ifndef JITTERBUFFER_H
+#define JITTERBUFFER_H
+
+#include <stdint.h>
+#include <ostream>
+
+
+namespace Control {
+
+
+/**
+	Puts RTP speech frames back in sequence order, without allocating.
+	Frames wait for a missing one until more than the target depth are held,
+	then the gap is skipped, so the added delay is bounded by the target.
+*/
+class JitterBuffer {
+
+	public:
+
+	static const unsigned mSlots = 16;			///< maximum frames held
+	static const unsigned mFrameBytes = 33;		///< GSM 06.10 frame size
+
+	private:
+
+	unsigned char mFrames[mSlots][mFrameBytes];
+	bool mValid[mSlots];
+	uint16_t mNext;				///< sequence number of the next frame out
+	bool mStarted;				///< true once mNext is set
+	unsigned mHeld;				///< valid slots
+	unsigned mTarget;			///< frames held before a gap is skipped
+
+	/**@name Statistics. */
+	//@{
+	unsigned long mIn;			///< frames accepted
+	unsigned long mLate;		///< arrived after their slot was played or skipped
+	unsigned long mDuplicate;	///< arrived twice
+	unsigned long mLost;		///< skipped and never seen
+	unsigned long mOverrun;		///< pushed out by a frame too far ahead
+	//@}
+
+	public:
+
+	/** @param wTarget Frames to hold while waiting for a missing one, at most mSlots-1. */
+	JitterBuffer(unsigned wTarget=2);
+
+	/**
+		Add a frame.
+		@param seq The RTP sequence number.
+		@param frame mFrameBytes bytes.
+		@return false if the frame was dropped as late or duplicate.
+	*/
+	bool put(uint16_t seq, const unsigned char* frame);
+
+	/**
+		Take the next frame to play.
+		@return A pointer valid until the next put, or NULL if nothing is due.
+	*/
+	const unsigned char* get();
+
+	/** Frames held. */
+	unsigned held() const { return mHeld; }
+
+	/** Frames to hold while waiting for a missing one. */
+	unsigned target() const { return mTarget; }
+
+	/**@name Statistics. */
+	//@{
+	unsigned long in() const { return mIn; }
+	unsigned long late() const { return mLate; }
+	unsigned long duplicate() const { return mDuplicate; }
+	unsigned long lost() const { return mLost; }
+	unsigned long overrun() const { return mOverrun; }
+	//@}
+};
+
+
+std::ostream& operator<<(std::ostream& os, const JitterBuffer&);
+
+
+}	// namespace Control
+
+
+#endif
+
+// vim: ts=4 sw=4
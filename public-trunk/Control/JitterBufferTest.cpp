@@ -0,0 +1,93 @@
+/*
+* Copyright 2008, 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+
+#include "JitterBuffer.h"
+#include <iostream>
+#include <string.h>
+
+using namespace std;
+using namespace Control;
+
+
+/** Put frame number seq, marked with its low byte. */
+static void put(JitterBuffer& jb, uint16_t seq)
+{
+	unsigned char frame[JitterBuffer::mFrameBytes];
+	memset(frame,seq&0xff,sizeof(frame));
+	cout << "put " << seq << (jb.put(seq,frame) ? "" : " dropped") << endl;
+}
+
+
+/** Play out whatever is due. */
+static void drain(JitterBuffer& jb)
+{
+	cout << "get";
+	while (const unsigned char* frame = jb.get()) cout << " " << (unsigned)frame[0];
+	cout << endl;
+}
+
+
+int main(int argc, char *argv[])
+{
+	JitterBuffer jb(2);
+
+	cout << "reordered" << endl;
+	put(jb,100);
+	put(jb,102);
+	put(jb,101);
+	drain(jb);
+
+	cout << "late and duplicate" << endl;
+	put(jb,101);
+	put(jb,104);
+	put(jb,104);
+
+	cout << "gap waits for the target depth, then is skipped" << endl;
+	drain(jb);
+	put(jb,105);
+	drain(jb);
+	put(jb,106);
+	drain(jb);
+
+	cout << "sequence wrap" << endl;
+	JitterBuffer wrap(2);
+	put(wrap,65534);
+	put(wrap,0);
+	put(wrap,65535);
+	put(wrap,1);
+	drain(wrap);
+
+	cout << "far ahead" << endl;
+	put(jb,107);
+	put(jb,140);
+	drain(jb);
+
+	cout << jb << endl;
+	cout << wrap << endl;
+}
+
+// vim: ts=4 sw=4
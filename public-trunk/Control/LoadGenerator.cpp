@@ -0,0 +1,1317 @@
+/**@file Control-plane load generator, simulating handsets above L1. */
+/*
+* Copyright 2008, 2009, 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "LoadGenerator.h"
+#include "ControlCommon.h"
+
+#include <GSMConfig.h>
+#include <GSML1FEC.h>
+#include <Logger.h>
+
+#include <algorithm>
+#include <sstream>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+using namespace std;
+using namespace GSM;
+using namespace Control;
+
+
+/**@name Handset timers, ms. */
+//@{
+static const unsigned AccessWaitTime = 2000;	///< wait for an assignment after each burst, plus up to 250
+static const unsigned MaxBursts = 4;			///< RACH bursts before giving up, like GSM.RACH.MaxRetrans
+static const unsigned MaxRejects = 2;			///< immediate assignment rejects before giving up
+static const unsigned AcquireTime = 2000;		///< wait for an assigned handset to come free
+static const unsigned DownlinkTimeout = 20000;	///< longest silence from the network
+static const unsigned MTTimeout = 60000;		///< longest wait for the final response to an MT request
+//@}
+
+
+
+
+void LatencyRecord::add(long ms)
+{
+	if (ms<0) ms=0;
+	mLock.lock();
+	mSamples.push_back(ms);
+	mLock.unlock();
+}
+
+
+unsigned LatencyRecord::count() const
+{
+	mLock.lock();
+	unsigned retVal = mSamples.size();
+	mLock.unlock();
+	return retVal;
+}
+
+
+unsigned LatencyRecord::percentile(unsigned p) const
+{
+	mLock.lock();
+	vector<unsigned> sorted(mSamples);
+	mLock.unlock();
+	if (sorted.size()==0) return 0;
+	sort(sorted.begin(),sorted.end());
+	size_t index = (sorted.size()*p)/100;
+	if (index>=sorted.size()) index = sorted.size()-1;
+	return sorted[index];
+}
+
+
+void LatencyRecord::dump(ostream& os) const
+{
+	mLock.lock();
+	vector<unsigned> sorted(mSamples);
+	mLock.unlock();
+	os << "n=" << sorted.size();
+	if (sorted.size()==0) return;
+	sort(sorted.begin(),sorted.end());
+	double sum = 0.0;
+	for (size_t i=0; i<sorted.size(); i++) sum += sorted[i];
+	size_t n = sorted.size();
+	os << " mean=" << (unsigned)(sum/n)
+		<< " p50=" << sorted[n/2]
+		<< " p90=" << sorted[min(n-1,(n*90)/100)]
+		<< " p99=" << sorted[min(n-1,(n*99)/100)]
+		<< " max=" << sorted[n-1] << " ms";
+}
+
+
+ostream& Control::operator<<(ostream& os, LoadProcedure proc)
+{
+	switch (proc) {
+		case LoadLocationUpdate: os << "LUR"; break;
+		case LoadMOSMS: os << "MO-SMS"; break;
+		case LoadMOC: os << "MOC"; break;
+		case LoadMTSMS: os << "MT-SMS"; break;
+		case LoadMTC: os << "MTC"; break;
+		default: os << "?" << (int)proc << "?";
+	}
+	return os;
+}
+
+
+
+
+/**@name Encoders for the uplink messages, as octet strings. */
+//@{
+
+/** A mobile identity LV from a digit string. */
+static string mobileIDLV(const string& digits, unsigned type)
+{
+	size_t n = digits.size();
+	string value;
+	value += (char)(((digits[0]-'0')<<4) | ((n%2)<<3) | type);
+	for (size_t i=1; i<n; i+=2) {
+		unsigned low = digits[i]-'0';
+		unsigned high = (i+1<n) ? digits[i+1]-'0' : 0x0f;
+		value += (char)((high<<4)|low);
+	}
+	return string(1,(char)value.size()) + value;
+}
+
+/** A TMSI mobile identity LV. */
+static string TMSILV(unsigned TMSI)
+{
+	string value("\x05\xf4",2);
+	for (int shift=24; shift>=0; shift-=8) value += (char)((TMSI>>shift)&0x0ff);
+	return value;
+}
+
+/** The identity a mobile uses: its TMSI if it has one, else its IMSI. */
+static string identityLV(const string& IMSI, unsigned TMSI)
+{
+	if (TMSI) return TMSILV(TMSI);
+	return mobileIDLV(IMSI,1);
+}
+
+/** Mobile station classmark 2 LV, for a GSM 900/1800 phone with SMS. */
+static const string classmark2("\x03\x33\x19\xa2",4);
+
+/** The cell's LAI, 5 octets. */
+static string LAIOctets()
+{
+	L3Frame frame(DATA,40);
+	size_t wp=0;
+	gBTS.LAI().writeV(frame,wp);
+	unsigned char octets[5];
+	frame.pack(octets);
+	return string((const char*)octets,5);
+}
+
+/** A called party BCD number TLV. */
+static string calledPartyTLV(const char* digits)
+{
+	string value("\x81",1);
+	size_t n = strlen(digits);
+	for (size_t i=0; i<n; i+=2) {
+		unsigned low = digits[i]-'0';
+		unsigned high = (i+1<n) ? digits[i+1]-'0' : 0x0f;
+		value += (char)((high<<4)|low);
+	}
+	return string("\x5e",1) + string(1,(char)value.size()) + value;
+}
+
+/** Send an octet string as an L3 DATA frame. */
+static void sendOctets(SimHandset* handset, const string& octets, unsigned SAPI=0)
+{
+	handset->send(L3Frame(octets.data(),octets.size()),SAPI);
+}
+
+//@}
+
+
+
+
+SimHandset::SimHandset(LogicalChannel& wNetwork)
+	:mNetwork(wNetwork),mChannel(wNetwork),
+	mWritten(0),mHeld(false)
+{
+	mChannel.listener(this,0);
+	mChannel.listener(this,3);
+}
+
+
+bool SimHandset::acquire(unsigned timeout)
+{
+	Timeval deadline(timeout);
+	mLock.lock();
+	while (mHeld && !deadline.passed()) mSignal.wait(mLock,deadline.remaining());
+	if (mHeld) {
+		mLock.unlock();
+		return false;
+	}
+	mHeld = true;
+	mWritten = 0;
+	mLock.unlock();
+	return true;
+}
+
+
+void SimHandset::release()
+{
+	mChannel.send(HARDRELEASE);
+	// Drop whatever the network sent after we stopped listening.
+	while (L3Frame* frame = mChannel.recv(0,0)) delete frame;
+	while (L3Frame* frame = mChannel.recv(0,3)) delete frame;
+	mLock.lock();
+	mHeld = false;
+	mWritten = 0;
+	mSignal.broadcast();
+	mLock.unlock();
+}
+
+
+void SimHandset::open()
+{
+	mChannel.open();
+}
+
+
+L3Frame* SimHandset::recv(unsigned timeout, unsigned& SAPI)
+{
+	Timeval deadline(timeout);
+	while (true) {
+		// Zero the count before polling, so a write after the polls still wakes us.
+		mLock.lock();
+		mWritten = 0;
+		mLock.unlock();
+		L3Frame* frame = mChannel.recv(0,0);
+		if (frame) {
+			SAPI = 0;
+			return frame;
+		}
+		frame = mChannel.recv(0,3);
+		if (frame) {
+			SAPI = 3;
+			return frame;
+		}
+		mLock.lock();
+		while (mWritten==0 && !deadline.passed()) mSignal.wait(mLock,deadline.remaining());
+		bool expired = (mWritten==0);
+		mLock.unlock();
+		if (expired) return NULL;
+	}
+}
+
+
+void SimHandset::queueWritten()
+{
+	mLock.lock();
+	mWritten++;
+	mSignal.broadcast();
+	mLock.unlock();
+}
+
+
+
+
+void CCCHMonitor::listen(SimCCCHLogicalChannel& CCCH)
+{
+	SimL1Decoder* decoder = new SimL1Decoder(0,CCCH.txMapping(),NULL);
+	decoder->upstream(this);
+	decoder->open();
+	mDecoders.push_back(decoder);
+	CCCH.peer(decoder);
+}
+
+
+void CCCHMonitor::writeLowSide(const L2Frame& frame)
+{
+	// The decoder also passes up ESTABLISH on its first frame.
+	if (frame.primitive()!=DATA) return;
+	unsigned char octets[23];
+	frame.pack(octets);
+	// Skip the L2 pseudo-length.
+	mGenerator->CCCHFrame(octets+1,22);
+}
+
+
+
+
+SimSIPServer::SimSIPServer(LoadGenerator* wGenerator)
+	:mGenerator(wGenerator),
+	mSerial(0),
+	mRequests(0),mInvites(0),mResponses(0),mTimeouts(0),mCongestion(0)
+{
+}
+
+
+SimSIPServer::~SimSIPServer()
+{
+	SIP::standInObserver(NULL);
+}
+
+
+void SimSIPServer::start()
+{
+	SIP::standInObserver(this);
+}
+
+
+void SimSIPServer::request(const char* method)
+{
+	mLock.lock();
+	mRequests++;
+	if (strcmp(method,"INVITE")==0) mInvites++;
+	mLock.unlock();
+}
+
+
+void SimSIPServer::originate(LoadProcedure proc, unsigned mobile, const string& IMSI)
+{
+	assert(proc==LoadMTSMS || proc==LoadMTC);
+
+	mLock.lock();
+	unsigned serial = ++mSerial;
+	char callID[32];
+	sprintf(callID,"load%u",serial);
+	Pending& pending = mPending[callID];
+	pending.mProcedure = proc;
+	pending.mMobile = mobile;
+	pending.mIMSI = IMSI;
+	pending.mStarted.now();
+	mLock.unlock();
+
+	const char* RPDU = NULL;
+	if (proc==LoadMTSMS) {
+		if (gConfig.defines("Control.SendWelcomeRPDU")) RPDU = gConfig.getStr("Control.SendWelcomeRPDU");
+		else RPDU = "014603a1000000138003a121f30000117042711404e104d4f29c0e";
+	}
+	if (SIP::standInOriginate(callID,IMSI.c_str(),RPDU)) return;
+
+	// Turned away, as Asterisk would hear a 503.
+	mLock.lock();
+	Pending turnedAway = mPending[callID];
+	mPending.erase(callID);
+	mCongestion++;
+	mLock.unlock();
+	mGenerator->MTFinished(proc,mobile,false,turnedAway.mStarted.elapsed());
+}
+
+
+void SimSIPServer::answered(const string& callID)
+{
+	mLock.lock();
+	PendingMap::iterator itr = mPending.find(callID);
+	if (itr==mPending.end()) {
+		mLock.unlock();
+		LOG(DEBUG) << "answer for unknown or finished " << callID;
+		return;
+	}
+	Pending pending = itr->second;
+	mPending.erase(itr);
+	mResponses++;
+	mLock.unlock();
+
+	LOG(DEBUG) << pending.mProcedure << " for " << pending.mIMSI << " answered";
+	mGenerator->MTFinished(pending.mProcedure,pending.mMobile,true,pending.mStarted.elapsed());
+}
+
+
+void SimSIPServer::sweep(unsigned timeout)
+{
+	vector<Pending> expired;
+	mLock.lock();
+	PendingMap::iterator itr = mPending.begin();
+	while (itr!=mPending.end()) {
+		if (itr->second.mStarted.elapsed() < (long)timeout) {
+			++itr;
+			continue;
+		}
+		expired.push_back(itr->second);
+		mPending.erase(itr++);
+		mTimeouts++;
+	}
+	mLock.unlock();
+	// Report outside the lock; the generator takes its own.
+	for (size_t i=0; i<expired.size(); i++) {
+		LOG(NOTICE) << expired[i].mProcedure << " for " << expired[i].mIMSI << " timed out";
+		mGenerator->MTFinished(expired[i].mProcedure,expired[i].mMobile,false,expired[i].mStarted.elapsed());
+	}
+}
+
+
+unsigned SimSIPServer::pending() const
+{
+	mLock.lock();
+	unsigned retVal = mPending.size();
+	mLock.unlock();
+	return retVal;
+}
+
+
+void SimSIPServer::dump(ostream& os) const
+{
+	mLock.lock();
+	os << "SIP stand-in: requests=" << mRequests << " INVITEs=" << mInvites
+		<< " MT-responses=" << mResponses << " MT-timeouts=" << mTimeouts
+		<< " MT-congestion=" << mCongestion
+		<< " MT-pending=" << mPending.size() << endl;
+	mLock.unlock();
+}
+
+
+
+
+void* Control::LoadGeneratorArrivals(LoadGenerator* generator)
+{
+	generator->arrivals();
+	return NULL;
+}
+
+
+void* Control::LoadGeneratorWorker(LoadGenerator* generator)
+{
+	generator->work();
+	return NULL;
+}
+
+
+LoadGenerator::LoadGenerator(unsigned numMobiles)
+	:mMobiles(numMobiles),
+	mHoldTime(0),mRunning(false),
+	mMonitor(this),mSIP(this),
+	mSkipped(0),mPages(0),mCollisions(0)
+{
+	for (unsigned i=0; i<numMobiles; i++) {
+		char IMSI[16];
+		sprintf(IMSI,"00101%010u",i);
+		Mobile& mobile = mMobiles[i];
+		mobile.mIMSI = IMSI;
+		mobile.mTMSI = 0;
+		mobile.mAttached = false;
+		mobile.mBusy = false;
+		mobile.mPaged = false;
+		mByIMSI[mobile.mIMSI] = i;
+	}
+}
+
+
+void LoadGenerator::addHandset(LogicalChannel& network)
+{
+	assert(!mRunning);
+	SimHandset* handset = new SimHandset(network);
+	mHandsets[handset->key()] = handset;
+}
+
+
+void LoadGenerator::start(const Rates& rates, unsigned holdTime, unsigned numWorkers)
+{
+	assert(!mRunning);
+	mRates = rates;
+	mHoldTime = holdTime;
+	mRunning = true;
+	mSIP.start();
+	for (unsigned i=0; i<numWorkers; i++) {
+		Thread* thread = new Thread;
+		mWorkers.push_back(thread);
+		thread->start((void*(*)(void*))LoadGeneratorWorker,this,"loadworker");
+	}
+	mArrivals.start((void*(*)(void*))LoadGeneratorArrivals,this,"loadarrivals");
+	LOG(INFO) << "started " << mMobiles.size() << " mobiles on " << mHandsets.size()
+		<< " handsets with " << numWorkers << " workers";
+}
+
+
+void LoadGenerator::stop()
+{
+	mRunning = false;
+}
+
+
+unsigned LoadGenerator::outstanding() const
+{
+	// Queued and running procedures hold their mobiles busy; MT requests hold them paged.
+	unsigned count = 0;
+	mLock.lock();
+	for (size_t i=0; i<mMobiles.size(); i++) {
+		if (mMobiles[i].mBusy || mMobiles[i].mPaged) count++;
+	}
+	mLock.unlock();
+	return count;
+}
+
+
+void LoadGenerator::count(ProcedureRecord& record, unsigned ProcedureRecord::*field)
+{
+	mLock.lock();
+	record.*field += 1;
+	mLock.unlock();
+}
+
+
+void LoadGenerator::arrivals()
+{
+	float total = 0.0F;
+	for (unsigned i=0; i<LoadNumProcedures; i++) total += mRates.mRate[i];
+	Timeval lastSweep;
+	while (true) {
+		// Exponential interarrival times make the arrivals Poisson.
+		unsigned gap = 100;
+		if (mRunning && total>0.0F) gap = (unsigned)(-log(1.0-drand48())*1000.0/total);
+		Timeval next(gap);
+		while (!next.passed()) {
+			long remaining = next.remaining();
+			usleep(1000*min(remaining,100L));
+			if (lastSweep.elapsed()>=1000) {
+				mSIP.sweep(MTTimeout);
+				lastSweep.now();
+			}
+		}
+		// After stop(), keep sweeping so the last MT requests finish.
+		if (!mRunning || total==0.0F) continue;
+
+		float pick = drand48()*total;
+		unsigned p = 0;
+		while (p<LoadNumProcedures-1 && pick>=mRates.mRate[p]) pick -= mRates.mRate[p++];
+		LoadProcedure proc = (LoadProcedure)p;
+
+		unsigned mobile;
+		if (!pickIdle(mobile,proc)) {
+			mLock.lock();
+			mSkipped++;
+			mLock.unlock();
+			continue;
+		}
+
+		if (proc==LoadMTSMS || proc==LoadMTC) {
+			MTStarted(proc);
+			mLock.lock();
+			string IMSI = mMobiles[mobile].mIMSI;
+			mLock.unlock();
+			mSIP.originate(proc,mobile,IMSI);
+			continue;
+		}
+
+		Task* task = new Task;
+		task->mProcedure = proc;
+		task->mMobile = mobile;
+		task->mPage = false;
+		task->mRA = 0;
+		task->mTMSI = 0;
+		mTasks.write(task);
+	}
+}
+
+
+void LoadGenerator::work()
+{
+	while (true) {
+		Task* task = mTasks.read();
+		run(*task);
+		delete task;
+	}
+}
+
+
+bool LoadGenerator::pickIdle(unsigned& mobile, LoadProcedure proc)
+{
+	unsigned numMobiles = mMobiles.size();
+	if (numMobiles==0) return false;
+	bool needsAttach = (proc!=LoadLocationUpdate);
+	unsigned start = random() % numMobiles;
+	mLock.lock();
+	for (unsigned i=0; i<numMobiles; i++) {
+		Mobile& candidate = mMobiles[(start+i)%numMobiles];
+		if (candidate.mBusy || candidate.mPaged) continue;
+		if (needsAttach && !candidate.mAttached) continue;
+		mobile = (start+i)%numMobiles;
+		if (proc==LoadMTSMS || proc==LoadMTC) candidate.mPaged = true;
+		else candidate.mBusy = true;
+		mLock.unlock();
+		return true;
+	}
+	mLock.unlock();
+	return false;
+}
+
+
+void LoadGenerator::idle(unsigned mobile)
+{
+	mLock.lock();
+	mMobiles[mobile].mBusy = false;
+	mLock.unlock();
+}
+
+
+void LoadGenerator::MTStarted(LoadProcedure proc)
+{
+	mLock.lock();
+	mRecords[proc].mAttempts++;
+	mLock.unlock();
+}
+
+
+void LoadGenerator::MTFinished(LoadProcedure proc, unsigned mobile, bool success, long latency)
+{
+	mLock.lock();
+	mMobiles[mobile].mPaged = false;
+	if (success) {
+		mRecords[proc].mSuccesses++;
+		mRecords[proc].mSetup.add(latency);
+	} else {
+		mRecords[proc].mFailures++;
+	}
+	mLock.unlock();
+}
+
+
+
+
+/** The request reference of a CCCH message, 3 octets. */
+static unsigned requestReference(const unsigned char* octets)
+{
+	return (octets[0]<<16) | (octets[1]<<8) | octets[2];
+}
+
+/** The handset key of a channel description, 3 octets. */
+static unsigned channelKey(const unsigned char* octets)
+{
+	unsigned typeAndOffset = octets[0]>>3;
+	unsigned TN = octets[0] & 0x07;
+	unsigned ARFCN = ((octets[1]&0x03)<<8) | octets[2];
+	return SimHandset::key(ARFCN,TN,typeAndOffset);
+}
+
+/**
+	Decode a mobile identity value.
+	@return false unless it is an IMSI or TMSI.
+*/
+static bool decodeID(const unsigned char* ID, unsigned length, string& IMSI, unsigned& TMSI)
+{
+	if (length==0) return false;
+	unsigned type = ID[0] & 0x07;
+	if (type==4) {
+		if (length<5) return false;
+		TMSI = (ID[1]<<24) | (ID[2]<<16) | (ID[3]<<8) | ID[4];
+		return true;
+	}
+	if (type!=1) return false;
+	IMSI = string(1,'0'+(ID[0]>>4));
+	for (unsigned i=1; i<length; i++) {
+		IMSI += (char)('0'+(ID[i]&0x0f));
+		if ((ID[i]>>4)!=0x0f) IMSI += (char)('0'+(ID[i]>>4));
+	}
+	TMSI = 0;
+	return true;
+}
+
+
+void LoadGenerator::CCCHFrame(const unsigned char* L3, size_t length)
+{
+	// Only RR messages go on the CCCH.
+	if (length<3 || (L3[0]&0x0f)!=6) return;
+
+	switch (L3[1]) {
+		// Immediate Assignment, GSM 04.08 9.1.18
+		case 0x3f:
+			answer(requestReference(L3+6),false,0,channelKey(L3+3));
+			return;
+		// Immediate Assignment Extended, GSM 04.08 9.1.19
+		case 0x39:
+			answer(requestReference(L3+6),false,0,channelKey(L3+3));
+			answer(requestReference(L3+13),false,0,channelKey(L3+10));
+			return;
+		// Immediate Assignment Reject, GSM 04.08 9.1.20
+		// Unused references repeat the last one.
+		case 0x3a: {
+			unsigned last = 0xffffffff;
+			for (unsigned i=0; i<4; i++) {
+				unsigned reference = requestReference(L3+3+4*i);
+				if (reference==last) continue;
+				answer(reference,true,L3[6+4*i],0);
+				last = reference;
+			}
+			return;
+		}
+		// Paging Request Type 1, GSM 04.08 9.1.22
+		case 0x21: {
+			unsigned channel1 = (L3[2]>>4) & 0x03;
+			unsigned channel2 = (L3[2]>>6) & 0x03;
+			string IMSI;
+			unsigned TMSI;
+			// The idle fill is a page with an empty identity.
+			size_t rp = 3;
+			unsigned len = L3[rp];
+			if (rp+1+len>length) return;
+			if (decodeID(L3+rp+1,len,IMSI,TMSI)) paged(IMSI,TMSI,channel1);
+			rp += 1+len;
+			if (rp+2>length || L3[rp]!=0x17) return;
+			len = L3[rp+1];
+			if (rp+2+len>length) return;
+			if (decodeID(L3+rp+2,len,IMSI,TMSI)) paged(IMSI,TMSI,channel2);
+			return;
+		}
+		// Paging Request Type 2, GSM 04.08 9.1.23
+		case 0x22: {
+			unsigned channel1 = (L3[2]>>4) & 0x03;
+			unsigned channel2 = (L3[2]>>6) & 0x03;
+			paged(string(),(L3[3]<<24)|(L3[4]<<16)|(L3[5]<<8)|L3[6],channel1);
+			paged(string(),(L3[7]<<24)|(L3[8]<<16)|(L3[9]<<8)|L3[10],channel2);
+			if (length<13 || L3[11]!=0x17) return;
+			string IMSI;
+			unsigned TMSI;
+			unsigned len = L3[12];
+			if (13+len>length) return;
+			if (decodeID(L3+13,len,IMSI,TMSI)) paged(IMSI,TMSI,0);
+			return;
+		}
+		// Paging Request Type 3, GSM 04.08 9.1.24
+		case 0x24:
+			for (unsigned i=0; i<4; i++) {
+				const unsigned char* p = L3+3+4*i;
+				paged(string(),(p[0]<<24)|(p[1]<<16)|(p[2]<<8)|p[3],(i<2) ? ((L3[2]>>(4+2*i))&0x03) : 0);
+			}
+			return;
+		default:
+			return;
+	}
+}
+
+
+void LoadGenerator::answer(unsigned reference, bool reject, unsigned wait, unsigned handset)
+{
+	mAccessLock.lock();
+	for (list<AccessWait*>::iterator itr=mWaits.begin(); itr!=mWaits.end(); ++itr) {
+		AccessWait* waiting = *itr;
+		if (waiting->mAnswered) continue;
+		unsigned count = min(waiting->mCount,3U);
+		for (unsigned i=0; i<count; i++) {
+			if (waiting->mKeys[i]!=reference) continue;
+			waiting->mAnswered = true;
+			waiting->mRejected = reject;
+			waiting->mWait = wait;
+			waiting->mHandset = handset;
+			mAccessSignal.broadcast();
+			mAccessLock.unlock();
+			return;
+		}
+	}
+	mAccessLock.unlock();
+}
+
+
+void LoadGenerator::paged(const string& IMSI, unsigned TMSI, unsigned channelNeeded)
+{
+	// RACH establishment causes for "answer to paging", GSM 04.08 9.1.8.
+	static const unsigned pageRA[4] = { 0x80, 0x10, 0x20, 0x30 };
+	static const unsigned pageBits[4] = { 5, 4, 4, 4 };
+
+	mLock.lock();
+	unsigned mobile;
+	if (TMSI) {
+		map<unsigned,unsigned>::const_iterator itr = mByTMSI.find(TMSI);
+		if (itr==mByTMSI.end()) {
+			mLock.unlock();
+			return;
+		}
+		mobile = itr->second;
+	} else {
+		map<string,unsigned>::const_iterator itr = mByIMSI.find(IMSI);
+		if (itr==mByIMSI.end()) {
+			mLock.unlock();
+			return;
+		}
+		mobile = itr->second;
+	}
+	// A mobile on a channel ignores pages; the pager repeats them.
+	Mobile& target = mMobiles[mobile];
+	if (target.mBusy) {
+		mLock.unlock();
+		return;
+	}
+	target.mBusy = true;
+	mPages++;
+	mLock.unlock();
+
+	// The page does not say what it is for; the handset finds out on the channel.
+	Task* task = new Task;
+	task->mProcedure = LoadMTSMS;
+	task->mMobile = mobile;
+	task->mPage = true;
+	task->mRA = (pageRA[channelNeeded]<<8) | pageBits[channelNeeded];
+	task->mTMSI = TMSI;
+	mTasks.write(task);
+}
+
+
+SimHandset* LoadGenerator::access(unsigned RAbase, unsigned RAbits, ProcedureRecord& record, const Timeval& started)
+{
+	AccessWait wait;
+	wait.mCount = 0;
+	wait.mAnswered = false;
+	wait.mRejected = false;
+	wait.mWait = 0;
+	wait.mHandset = 0;
+	mAccessLock.lock();
+	mWaits.push_back(&wait);
+	mAccessLock.unlock();
+
+	unsigned rejects = 0;
+	unsigned bursts = 0;
+	Timeval firstBurst;
+	bool assigned = false;
+	while (bursts<MaxBursts) {
+		if (bursts==0) firstBurst.now();
+		unsigned RA = RAbase | (random() & ((1<<RAbits)-1));
+		Time when = gBTS.time();
+		unsigned key = (RA<<16) | ((when.T1()%32)<<11) | (when.T3()<<5) | when.T2();
+		mAccessLock.lock();
+		wait.mKeys[wait.mCount%3] = key;
+		wait.mCount++;
+		mAccessLock.unlock();
+		bursts++;
+		AccessGrantResponder(RA,when,0.0F,0.0F);
+
+		Timeval deadline(AccessWaitTime + random()%250);
+		mAccessLock.lock();
+		while (!wait.mAnswered && !deadline.passed()) mAccessSignal.wait(mAccessLock,deadline.remaining());
+		bool answered = wait.mAnswered;
+		bool rejected = wait.mRejected;
+		unsigned T3122 = wait.mWait;
+		if (rejected) {
+			// Start over after T3122, with new references.
+			wait.mAnswered = false;
+			wait.mRejected = false;
+			wait.mCount = 0;
+		}
+		mAccessLock.unlock();
+
+		if (!answered) continue;
+		if (!rejected) {
+			assigned = true;
+			break;
+		}
+		if (++rejects>MaxRejects) break;
+		LOG(DEBUG) << "rejected, waiting T3122=" << T3122;
+		sleep(T3122);
+		bursts = 0;
+	}
+
+	mAccessLock.lock();
+	mWaits.remove(&wait);
+	mAccessLock.unlock();
+
+	if (!assigned) {
+		if (rejects>MaxRejects) count(record,&ProcedureRecord::mRejects);
+		else count(record,&ProcedureRecord::mAccessFailures);
+		return NULL;
+	}
+	record.mAccessDelay.add(firstBurst.elapsed());
+
+	map<unsigned,SimHandset*>::const_iterator itr = mHandsets.find(wait.mHandset);
+	if (itr==mHandsets.end()) {
+		LOG(ALARM) << "assignment to unknown channel key " << hex << wait.mHandset << dec;
+		count(record,&ProcedureRecord::mFailures);
+		return NULL;
+	}
+	SimHandset* handset = itr->second;
+	if (!handset->acquire(AcquireTime)) {
+		LOG(NOTICE) << "assigned handset " << hex << wait.mHandset << dec << " is still held";
+		mLock.lock();
+		mCollisions++;
+		record.mFailures++;
+		mLock.unlock();
+		return NULL;
+	}
+	return handset;
+}
+
+
+void LoadGenerator::run(Task& task)
+{
+	const bool NECI = gConfig.getNum("GSM.CS.NECI");
+	ProcedureRecord& record = task.mPage ? mPageRecord : mRecords[task.mProcedure];
+	const LoadProcedure proc = task.mProcedure;
+	if (!task.mPage) task.mStarted.now();
+
+	mLock.lock();
+	const string IMSI = mMobiles[task.mMobile].mIMSI;
+	const unsigned TMSI = mMobiles[task.mMobile].mTMSI;
+	const bool attached = mMobiles[task.mMobile].mAttached;
+	record.mAttempts++;
+	mLock.unlock();
+
+	// The establishment cause, GSM 04.08 9.1.8.
+	unsigned RAbase, RAbits;
+	if (task.mPage) {
+		RAbase = task.mRA>>8;
+		RAbits = task.mRA & 0x0ff;
+	} else if (proc==LoadLocationUpdate) {
+		RAbase = 0x00;
+		RAbits = NECI ? 4 : 5;
+	} else if (proc==LoadMOSMS && NECI) {
+		RAbase = 0x10;
+		RAbits = 4;
+	} else {
+		RAbase = 0xe0;
+		RAbits = 5;
+	}
+
+	SimHandset* handset = access(RAbase,RAbits,record,task.mStarted);
+	if (!handset) {
+		idle(task.mMobile);
+		return;
+	}
+
+	// Tune to the channel and start the link, with SABM.
+	handset->open();
+	Timeval SDCCHStart;
+	handset->send(ESTABLISH);
+
+	bool onTCH = false;
+	bool succeeded = false;
+	bool rejected = false;
+	bool failed = false;
+	bool done = false;
+	bool connected = false;
+	bool disconnecting = false;
+	bool MTCall = false;
+	unsigned callTI = 0;
+	Timeval hangup;
+	const unsigned MOTI = random() % 7;
+
+	while (!done) {
+		unsigned timeout = DownlinkTimeout;
+		if (connected && !disconnecting) {
+			long remaining = hangup.remaining();
+			if (remaining<=0) {
+				// Hang up, GSM 04.08 5.4.3.
+				string disconnect;
+				disconnect += (char)(((MTCall?1:0)<<7) | (callTI<<4) | 0x03);
+				disconnect += string("\x25\x02\xe0\x90",4);
+				sendOctets(handset,disconnect);
+				disconnecting = true;
+				continue;
+			}
+			if (remaining<(long)timeout) timeout = remaining;
+		}
+
+		unsigned SAPI;
+		L3Frame* frame = handset->recv(timeout,SAPI);
+		if (!frame) {
+			if (connected && !disconnecting) continue;
+			LOG(NOTICE) << proc << " for " << IMSI << " timed out waiting for the network";
+			failed = true;
+			break;
+		}
+		Primitive prim = frame->primitive();
+		size_t length = frame->size()/8;
+		vector<unsigned char> octets(length+8,0);
+		frame->pack(&octets[0]);
+		delete frame;
+		const unsigned char* msg = &octets[0];
+
+		if (prim==ESTABLISH) {
+			if (SAPI==3) {
+				// Our SAP3 link for an MO SMS is up; send RP-DATA.
+				if (proc==LoadMOSMS && !task.mPage) {
+					string RPDU("\x00\x00\x00\x03\x91\x21\x43\x0e\x01\x00\x04\x81\x21\x43\x00\x00\x05\xe8\x32\x9b\xfd\x06",22);
+					RPDU[1] = (char)(random()%255);
+					string data;
+					data += (char)((MOTI<<4) | 0x09);
+					data += (char)0x01;
+					data += (char)RPDU.size();
+					data += RPDU;
+					sendOctets(handset,data,3);
+				}
+				continue;
+			}
+			if (onTCH) {
+				sendOctets(handset,string("\x06\x29\x00",3));
+				if (MTCall) {
+					string alerting, connect;
+					alerting += (char)(0x80 | (callTI<<4) | 0x03);
+					alerting += (char)0x01;
+					sendOctets(handset,alerting);
+					connect += (char)(0x80 | (callTI<<4) | 0x03);
+					connect += (char)0x07;
+					sendOctets(handset,connect);
+				}
+				continue;
+			}
+			// The initial message, GSM 04.08 3.1.5.
+			string initial;
+			if (task.mPage) {
+				initial = string("\x06\x27\x07",3) + classmark2;
+				if (task.mTMSI) initial += TMSILV(task.mTMSI);
+				else initial += mobileIDLV(IMSI,1);
+			} else if (proc==LoadLocationUpdate) {
+				initial = string("\x05\x08",2);
+				initial += (char)(0x70 | (attached ? 0x00 : 0x02));
+				initial += LAIOctets();
+				initial += (char)0x33;
+				initial += identityLV(IMSI,TMSI);
+			} else {
+				initial = string("\x05\x24",2);
+				initial += (char)(0x70 | ((proc==LoadMOSMS) ? 0x04 : 0x01));
+				initial += classmark2;
+				initial += identityLV(IMSI,TMSI);
+			}
+			sendOctets(handset,initial);
+			continue;
+		}
+
+		if (prim!=DATA) {
+			// A SAP3 link may come and go; losing SAP0 loses the channel.
+			if (SAPI==3) continue;
+			LOG(NOTICE) << proc << " for " << IMSI << " lost the channel with " << prim;
+			failed = true;
+			break;
+		}
+		if (length<2) continue;
+
+		unsigned PD = msg[0] & 0x0f;
+		unsigned TI = (msg[0]>>4) & 0x07;
+
+		// Radio resource management, GSM 04.08 9.1
+		if (PD==0x06) {
+			switch (msg[1]) {
+				// Channel Release
+				case 0x0d:
+					if (!onTCH) record.mSDCCHHold.add(SDCCHStart.elapsed());
+					handset->send(RELEASE);
+					done = true;
+					break;
+				// Classmark Enquiry
+				case 0x13:
+					sendOctets(handset,string("\x06\x16",2) + classmark2);
+					break;
+				// Channel Mode Modify
+				case 0x10:
+					if (length>=6) {
+						string ack("\x06\x17",2);
+						ack += string((const char*)msg+2,4);
+						sendOctets(handset,ack);
+					}
+					break;
+				// Assignment Command
+				case 0x2e: {
+					if (length<5) break;
+					unsigned key = channelKey(msg+2);
+					map<unsigned,SimHandset*>::const_iterator itr = mHandsets.find(key);
+					if (itr==mHandsets.end()) {
+						LOG(ALARM) << "assignment to unknown channel key " << hex << key << dec;
+						failed = true;
+						done = true;
+						break;
+					}
+					SimHandset* TCH = itr->second;
+					if (!TCH->acquire(AcquireTime)) {
+						mLock.lock();
+						mCollisions++;
+						mLock.unlock();
+						failed = true;
+						done = true;
+						break;
+					}
+					record.mSDCCHHold.add(SDCCHStart.elapsed());
+					handset->release();
+					handset = TCH;
+					handset->open();
+					handset->send(ESTABLISH);
+					onTCH = true;
+					break;
+				}
+				default:
+					break;
+			}
+			continue;
+		}
+
+		// Mobility management, GSM 04.08 9.2
+		if (PD==0x05) {
+			switch (msg[1] & 0x3f) {
+				// Location Updating Accept
+				case 0x02: {
+					unsigned newTMSI = 0;
+					if (length>=14 && msg[7]==0x17 && (msg[9]&0x07)==4) {
+						newTMSI = (msg[10]<<24) | (msg[11]<<16) | (msg[12]<<8) | msg[13];
+						sendOctets(handset,string("\x05\x1b",2));
+					}
+					mLock.lock();
+					Mobile& mobile = mMobiles[task.mMobile];
+					mobile.mAttached = true;
+					if (newTMSI && newTMSI!=mobile.mTMSI) {
+						if (mobile.mTMSI) mByTMSI.erase(mobile.mTMSI);
+						mobile.mTMSI = newTMSI;
+						mByTMSI[newTMSI] = task.mMobile;
+					}
+					mLock.unlock();
+					record.mSetup.add(task.mStarted.elapsed());
+					succeeded = true;
+					break;
+				}
+				// Location Updating Reject
+				case 0x04:
+					rejected = true;
+					break;
+				// Identity Request
+				case 0x18: {
+					string response("\x05\x19",2);
+					if ((msg[2]&0x07)==2) {
+						// IMEI, from the IMSI's index.
+						response += mobileIDLV(string("35") + IMSI.substr(2),2);
+					} else {
+						response += mobileIDLV(IMSI,1);
+					}
+					sendOctets(handset,response);
+					break;
+				}
+				// CM Service Accept
+				case 0x21:
+					if (proc==LoadMOSMS) {
+						handset->send(ESTABLISH,3);
+					} else {
+						string setup;
+						setup += (char)((MOTI<<4) | 0x03);
+						setup += (char)0x05;
+						setup += string("\x04\x01\xa0",3);
+						setup += calledPartyTLV("2125551212");
+						callTI = MOTI;
+						sendOctets(handset,setup);
+					}
+					break;
+				// CM Service Reject
+				case 0x22:
+					rejected = true;
+					break;
+				default:
+					break;
+			}
+			continue;
+		}
+
+		// Call control, GSM 04.08 9.3
+		if (PD==0x03) {
+			unsigned flag = (msg[0]&0x80) ? 0 : 1;
+			switch (msg[1] & 0x3f) {
+				// Setup, for an MTC
+				case 0x05: {
+					MTCall = true;
+					callTI = TI;
+					string confirmed;
+					confirmed += (char)(0x80 | (TI<<4) | 0x03);
+					confirmed += (char)0x08;
+					sendOctets(handset,confirmed);
+					break;
+				}
+				// Connect, for an MOC
+				case 0x07: {
+					string ack;
+					ack += (char)((flag<<7) | (TI<<4) | 0x03);
+					ack += (char)0x0f;
+					sendOctets(handset,ack);
+					record.mSetup.add(task.mStarted.elapsed());
+					connected = true;
+					succeeded = true;
+					hangup.future(mHoldTime);
+					break;
+				}
+				// Connect Acknowledge, for an MTC
+				case 0x0f:
+					record.mSetup.add(task.mStarted.elapsed());
+					connected = true;
+					succeeded = true;
+					hangup.future(mHoldTime);
+					break;
+				// Disconnect, from the far end
+				case 0x25: {
+					string release;
+					release += (char)((flag<<7) | (TI<<4) | 0x03);
+					release += (char)0x2d;
+					sendOctets(handset,release);
+					disconnecting = true;
+					break;
+				}
+				// Release
+				case 0x2d: {
+					string complete;
+					complete += (char)((flag<<7) | (TI<<4) | 0x03);
+					complete += (char)0x2a;
+					sendOctets(handset,complete);
+					disconnecting = true;
+					break;
+				}
+				default:
+					break;
+			}
+			continue;
+		}
+
+		// Short message service, GSM 04.11 8.1
+		if (PD==0x09) {
+			unsigned flag = (msg[0]&0x80) ? 0 : 1;
+			unsigned char header = (flag<<7) | (TI<<4) | 0x09;
+			switch (msg[1]) {
+				// CP-DATA
+				case 0x01: {
+					if (length<5) break;
+					const unsigned char* RPDU = msg+3;
+					string ack;
+					ack += (char)header;
+					ack += (char)0x04;
+					sendOctets(handset,ack,SAPI);
+					switch (RPDU[0] & 0x07) {
+						// RP-DATA, network to MS
+						case 1: {
+							string data;
+							data += (char)header;
+							data += (char)0x01;
+							data += (char)0x02;
+							data += (char)0x02;
+							data += (char)RPDU[1];
+							sendOctets(handset,data,SAPI);
+							if (task.mPage) {
+								record.mSetup.add(task.mStarted.elapsed());
+								succeeded = true;
+							}
+							break;
+						}
+						// RP-ACK, for our RP-DATA
+						case 3:
+							if (proc==LoadMOSMS && !task.mPage) {
+								record.mSetup.add(task.mStarted.elapsed());
+								succeeded = true;
+							}
+							break;
+						// RP-ERROR
+						case 5:
+							rejected = true;
+							break;
+						default:
+							break;
+					}
+					break;
+				}
+				// CP-ERROR
+				case 0x10:
+					failed = true;
+					break;
+				default:
+					break;
+			}
+			continue;
+		}
+	}
+
+	handset->release();
+
+	mLock.lock();
+	if (succeeded && !failed) record.mSuccesses++;
+	else if (rejected) record.mRejects++;
+	else record.mFailures++;
+	mLock.unlock();
+
+	idle(task.mMobile);
+}
+
+
+void LoadGenerator::report(ostream& os, double seconds) const
+{
+	if (seconds<=0.0) seconds = 1.0;
+	char line[128];
+	sprintf(line,"%-10s %10s %8s %8s %8s %8s %8s",
+		"procedure","attempts","success","access","reject","fail","TPS");
+	os << line << endl;
+	mLock.lock();
+	for (unsigned i=0; i<=LoadNumProcedures; i++) {
+		const ProcedureRecord& record = (i<LoadNumProcedures) ? mRecords[i] : mPageRecord;
+		ostringstream name;
+		if (i<LoadNumProcedures) name << (LoadProcedure)i;
+		else name << "page-resp";
+		sprintf(line,"%-10s %10u %8u %8u %8u %8u %8.2f",
+			name.str().c_str(),
+			record.mAttempts,record.mSuccesses,record.mAccessFailures,
+			record.mRejects,record.mFailures,record.mSuccesses/seconds);
+		os << line << endl;
+	}
+	for (unsigned i=0; i<=LoadNumProcedures; i++) {
+		const ProcedureRecord& record = (i<LoadNumProcedures) ? mRecords[i] : mPageRecord;
+		if (record.mAttempts==0) continue;
+		if (i<LoadNumProcedures) os << (LoadProcedure)i;
+		else os << "page-resp";
+		os << endl;
+		os << "  access delay: "; record.mAccessDelay.dump(os); os << endl;
+		os << "  setup:        "; record.mSetup.dump(os); os << endl;
+		os << "  SDCCH hold:   "; record.mSDCCHHold.dump(os); os << endl;
+	}
+	os << "skipped arrivals=" << mSkipped << " pages heard=" << mPages
+		<< " handset collisions=" << mCollisions << endl;
+	mLock.unlock();
+}
+
+
+// vim: ts=4 sw=4
@@ -0,0 +1,419 @@
+/**@file Control-plane load generator, simulating handsets above L1. */
+/*
+* Copyright 2008, 2009, 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+#include <ostream>
+
+#include <Threads.h>
+#include <Interthread.h>
+#include <Timeval.h>
+
+#include <GSMSAPMux.h>
+#include <GSMLogicalChannel.h>
+
+#include "SIPStandIn.h"
+
+
+namespace Control {
+
+
+class LoadGenerator;
+
+
+/** Latency samples, in ms, for percentiles. */
+class LatencyRecord {
+
+	private:
+
+	mutable Mutex mLock;
+	std::vector<unsigned> mSamples;
+
+	public:
+
+	void add(long ms);
+
+	unsigned count() const;
+
+	/** The p-th percentile, p in 0..100, or 0 with no samples. */
+	unsigned percentile(unsigned p) const;
+
+	/** Print count, mean, p50, p90, p99 and max. */
+	void dump(std::ostream& os) const;
+};
+
+
+/** The procedures a simulated handset can run. */
+enum LoadProcedure {
+	LoadLocationUpdate,
+	LoadMOSMS,
+	LoadMOC,
+	LoadMTSMS,
+	LoadMTC,
+	LoadNumProcedures
+};
+
+std::ostream& operator<<(std::ostream& os, LoadProcedure);
+
+
+/** Outcomes and latencies for one kind of procedure; generator lock. */
+struct ProcedureRecord {
+
+	unsigned mAttempts;
+	unsigned mSuccesses;
+	unsigned mAccessFailures;		///< no assignment after the last RACH burst
+	unsigned mRejects;				///< assignment, LU or CM service rejected
+	unsigned mFailures;				///< timeouts, lost channels, SIP errors
+
+	LatencyRecord mAccessDelay;		///< first RACH burst to immediate assignment
+	LatencyRecord mSetup;			///< start to completion, end to end
+	LatencyRecord mSDCCHHold;		///< SDCCH holding time, as seen by the handset
+
+	ProcedureRecord()
+		:mAttempts(0),mSuccesses(0),mAccessFailures(0),mRejects(0),mFailures(0)
+	{}
+};
+
+
+/**
+	The handset end of one network SDCCH or TCH/FACCH.
+	One simulated mobile at a time holds it, from immediate assignment to release.
+*/
+class SimHandset : public QueueListener {
+
+	private:
+
+	GSM::LogicalChannel& mNetwork;		///< the channel we answer
+	GSM::SimMSLogicalChannel mChannel;	///< our end of it
+	mutable Mutex mLock;
+	Signal mSignal;						///< signaled on uplink writes and on release
+	unsigned mWritten;					///< frames queued since the last poll
+	bool mHeld;							///< a mobile has this handset
+
+	public:
+
+	SimHandset(GSM::LogicalChannel& wNetwork);
+
+	/** The lookup key of the channel named in an assignment. */
+	static unsigned key(unsigned ARFCN, unsigned TN, unsigned typeAndOffset)
+		{ return (ARFCN<<16) | (TN<<8) | typeAndOffset; }
+
+	unsigned key() const
+		{ return key(mNetwork.ARFCN(),mNetwork.TN(),mNetwork.typeAndOffset()); }
+
+	GSM::ChannelType type() const { return mNetwork.type(); }
+
+	/**
+		Take the handset for a mobile.
+		@return false if another mobile still holds it after the timeout.
+	*/
+	bool acquire(unsigned timeout);
+
+	/** Give the handset back, closing our end if it is still open. */
+	void release();
+
+	/** Open our end, as on tuning to an assigned channel. */
+	void open();
+
+	/** Send on our end. */
+	void send(const GSM::L3Frame& frame, unsigned SAPI=0)
+		{ mChannel.send(frame,SAPI); }
+
+	/** Send a primitive on our end; RELEASE returns when the link is down. */
+	void send(GSM::Primitive prim, unsigned SAPI=0)
+		{ mChannel.send(prim,SAPI); }
+
+	/**
+		Wait for a downlink frame on SAP0 or SAP3.
+		@param timeout The wait in ms.
+		@param SAPI Set to the SAP the frame came from.
+		@return The frame, which the caller deletes, or NULL on timeout.
+	*/
+	GSM::L3Frame* recv(unsigned timeout, unsigned& SAPI);
+
+	/** Called with a queue lock held; only counts and signals. */
+	void queueWritten();
+};
+
+
+/** A listener on the simulated CCCHs, passing what it hears to the generator. */
+class CCCHMonitor : public GSM::SAPMux {
+
+	private:
+
+	LoadGenerator* mGenerator;
+	std::vector<GSM::SimL1Decoder*> mDecoders;
+
+	public:
+
+	CCCHMonitor(LoadGenerator* wGenerator)
+		:mGenerator(wGenerator)
+	{}
+
+	/** Start listening to a CCCH. */
+	void listen(GSM::SimCCCHLogicalChannel& CCCH);
+
+	void writeLowSide(const GSM::L2Frame& frame);
+
+	void writeHighSide(const GSM::L2Frame&) { assert(0); }
+};
+
+
+/**
+	A stand-in for Asterisk and smqueue, on top of the SIP stand-in in SIPStandIn.cpp.
+	It counts what the BTS sends and originates the MT MESSAGEs and INVITEs.
+*/
+class SimSIPServer : public SIP::SIPStandInObserver {
+
+	private:
+
+	/** An MT request waiting for its final response. */
+	struct Pending {
+		LoadProcedure mProcedure;
+		unsigned mMobile;
+		std::string mIMSI;
+		Timeval mStarted;
+	};
+	typedef std::map<std::string,Pending> PendingMap;
+
+	LoadGenerator* mGenerator;
+	mutable Mutex mLock;
+	PendingMap mPending;			///< MT requests by call ID
+	unsigned mSerial;				///< for call IDs
+
+	/**@name Statistics; mLock. */
+	//@{
+	unsigned mRequests;				///< requests from the BTS
+	unsigned mInvites;				///< of which INVITEs
+	unsigned mResponses;			///< responses to our requests
+	unsigned mTimeouts;				///< MT requests never answered
+	unsigned mCongestion;			///< MT requests turned away for lack of a channel
+	//@}
+
+	public:
+
+	SimSIPServer(LoadGenerator* wGenerator);
+
+	~SimSIPServer();
+
+	/** Start watching the SIP stand-in. */
+	void start();
+
+	/**
+		Send an MT MESSAGE or INVITE to a mobile.
+		The outcome goes to the generator on the final response or timeout.
+	*/
+	void originate(LoadProcedure proc, unsigned mobile, const std::string& IMSI);
+
+	/** Fail the MT requests older than a timeout, in ms. */
+	void sweep(unsigned timeout);
+
+	/** MT requests still waiting. */
+	unsigned pending() const;
+
+	void request(const char* method);
+
+	void answered(const std::string& callID);
+
+	void dump(std::ostream& os) const;
+};
+
+
+/**
+	A population of simulated mobiles running control-plane procedures
+	against the BTS on the simulated L1.
+	Procedures arrive as Poisson processes and are served by a pool of
+	worker threads, one per procedure in progress.
+*/
+class LoadGenerator {
+
+	public:
+
+	/** One simulated mobile; generator lock. */
+	struct Mobile {
+		std::string mIMSI;
+		unsigned mTMSI;				///< 0 if none assigned yet
+		bool mAttached;				///< a location update has succeeded
+		bool mBusy;					///< running a procedure
+		bool mPaged;				///< an MT request is out for it
+	};
+
+	/** Arrival rates, per second. */
+	struct Rates {
+		float mRate[LoadNumProcedures];
+		Rates() { for (unsigned i=0; i<LoadNumProcedures; i++) mRate[i]=0.0F; }
+	};
+
+	private:
+
+	/** A procedure for a worker. */
+	struct Task {
+		LoadProcedure mProcedure;
+		unsigned mMobile;
+		bool mPage;					///< answering a page for an MT request
+		unsigned mRA;				///< establishment cause for a page
+		unsigned mTMSI;				///< the TMSI paged, or 0 for the IMSI
+		Timeval mStarted;
+	};
+
+	/** A mobile waiting for its immediate assignment; mAccessLock. */
+	struct AccessWait {
+		unsigned mKeys[3];			///< request references of the last 3 bursts
+		unsigned mCount;			///< bursts sent
+		bool mAnswered;
+		bool mRejected;
+		unsigned mWait;				///< T3122 in s, on reject
+		unsigned mHandset;			///< handset key, on assignment
+	};
+
+	std::vector<Mobile> mMobiles;
+	std::map<std::string,unsigned> mByIMSI;
+	std::map<unsigned,unsigned> mByTMSI;
+	std::map<unsigned,SimHandset*> mHandsets;
+	mutable Mutex mLock;			///< mobiles, maps and records
+	ProcedureRecord mRecords[LoadNumProcedures];
+	ProcedureRecord mPageRecord;	///< the handset side of MT requests
+
+	Mutex mAccessLock;
+	Signal mAccessSignal;			///< broadcast on each answer
+	std::list<AccessWait*> mWaits;
+
+	InterthreadQueue<Task> mTasks;
+	std::vector<Thread*> mWorkers;
+	Thread mArrivals;
+	Rates mRates;
+	unsigned mHoldTime;				///< call holding time, ms
+	volatile bool mRunning;
+
+	CCCHMonitor mMonitor;
+	SimSIPServer mSIP;
+
+	/**@name Totals; mLock. */
+	//@{
+	unsigned mSkipped;				///< arrivals with no idle mobile
+	unsigned mPages;				///< pages heard for idle mobiles
+	unsigned mCollisions;			///< assigned handsets still held
+	//@}
+
+	public:
+
+	/** @param numMobiles The population; IMSIs are 00101 and a 10-digit index. */
+	LoadGenerator(unsigned numMobiles);
+
+	/** Add the handset end of a simulated SDCCH or TCH/FACCH. */
+	void addHandset(GSM::LogicalChannel& network);
+
+	/** Listen to a simulated CCCH for assignments and pages. */
+	void listen(GSM::SimCCCHLogicalChannel& CCCH) { mMonitor.listen(CCCH); }
+
+	/**
+		Start the SIP stand-in, the workers and the arrivals.
+		@param rates The arrival rate of each procedure.
+		@param holdTime The holding time of calls, in ms.
+		@param numWorkers The most procedures in progress at once.
+	*/
+	void start(const Rates& rates, unsigned holdTime, unsigned numWorkers);
+
+	/** Stop new arrivals; procedures in progress run to completion. */
+	void stop();
+
+	/** Procedures queued or in progress, including MT requests. */
+	unsigned outstanding() const;
+
+	/** Print the outcomes and latencies, normalized to a run time in s. */
+	void report(std::ostream& os, double seconds) const;
+
+	/**@name Callbacks from the monitor and the SIP stand-in. */
+	//@{
+	/** Take an immediate assignment, extended assignment or reject from the CCCH. */
+	void CCCHFrame(const unsigned char* L3, size_t length);
+
+	/** Count an MT request; the mobile is already marked as paged. */
+	void MTStarted(LoadProcedure proc);
+
+	/** The end of an MT request, from the SIP side. */
+	void MTFinished(LoadProcedure proc, unsigned mobile, bool success, long latency);
+	//@}
+
+	private:
+
+	/** Arrival thread body. */
+	void arrivals();
+
+	/** Worker thread body. */
+	void work();
+
+	/**
+		Pick an idle mobile for a procedure and mark it busy, or paged for an MT one.
+		Only location updates go to mobiles that are not yet attached.
+		@return false if there is none.
+	*/
+	bool pickIdle(unsigned& mobile, LoadProcedure proc);
+
+	/** Make the mobile idle again. */
+	void idle(unsigned mobile);
+
+	/** Run a procedure for a mobile. */
+	void run(Task& task);
+
+	/**
+		RACH until assigned or given up.
+		@return The held handset, or NULL.
+	*/
+	SimHandset* access(unsigned RAbase, unsigned RAbits, ProcedureRecord& record, const Timeval& started);
+
+	/** Hand an assignment or reject to the mobile whose burst it names. */
+	void answer(unsigned reference, bool reject, unsigned wait, unsigned handset);
+
+	/** Queue a page response for the mobile with this IMSI, or TMSI if not 0. */
+	void paged(const std::string& IMSI, unsigned TMSI, unsigned channelNeeded);
+
+	/** Update a record under the generator lock. */
+	void count(ProcedureRecord& record, unsigned ProcedureRecord::*field);
+
+	friend void* LoadGeneratorArrivals(LoadGenerator*);
+	friend void* LoadGeneratorWorker(LoadGenerator*);
+	friend class CCCHMonitor;
+};
+
+/** Arrival thread entry for LoadGenerator. */
+void* LoadGeneratorArrivals(LoadGenerator*);
+
+/** Worker thread entry for LoadGenerator. */
+void* LoadGeneratorWorker(LoadGenerator*);
+
+
+};		// Control
+
+
+#endif
+
+// vim: ts=4 sw=4
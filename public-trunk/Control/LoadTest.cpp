@@ -0,0 +1,221 @@
+/*
+* Copyright 2008, 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+/*
+	Control-plane load test.
+	The real control layer, L2 and the access grant stage run on a
+	simulated L1 that passes whole frames, with a population of simulated
+	mobiles on the handset side and a SIP stand-in for Asterisk and smqueue.
+	The mobiles run location updates, MO and MT SMS and MO and MT calls as
+	Poisson arrivals; the report gives transactions per second, access delay,
+	setup latency and SDCCH holding time.
+	Run this from a directory with an OpenBTS.config.  The SIP stand-in runs
+	in-process, so no SIP ports get bound.
+*/
+
+#include "ControlCommon.h"
+#include "LoadGenerator.h"
+#include <GSMConfig.h>
+#include <GSMLogicalChannel.h>
+#include <GSMTDMA.h>
+#include <SIPInterface.h>
+#include <TRXManager.h>
+#include <Logger.h>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace GSM;
+using namespace Control;
+
+
+ConfigurationTable gConfig("OpenBTS.config");
+SIP::SIPInterface gSIPInterface;
+GSMConfig gBTS;
+TransceiverManager gTRX(1, gConfig.getStr("TRX.IP"), gConfig.getNum("TRX.Port"));
+
+void shutdownOpenbts()
+{
+	kill(getpid(),SIGTERM);
+}
+
+
+/** The longest wait for procedures in progress after the arrivals stop, s. */
+static const unsigned drainTime = 120;
+
+
+static void usage(const char* name)
+{
+	cerr << "usage: " << name << " [options]" << endl
+		<< "  -d seconds   arrival period (60)" << endl
+		<< "  -m mobiles   population (1000)" << endl
+		<< "  -l rate      location updates per second (2)" << endl
+		<< "  -s rate      MO SMS per second (1)" << endl
+		<< "  -c rate      MO calls per second (0.2)" << endl
+		<< "  -t rate      MT SMS per second (1)" << endl
+		<< "  -r rate      MT calls per second (0.2)" << endl
+		<< "  -h seconds   call holding time (10)" << endl
+		<< "  -7 count     C-VII timeslots, 8 SDCCHs each (1)" << endl
+		<< "  -1 count     C-I timeslots, 1 TCH/F each (2)" << endl
+		<< "  -w count     handset worker threads (256)" << endl;
+	exit(1);
+}
+
+
+int main(int argc, char *argv[])
+{
+	gLogInit("WARN");
+
+	unsigned duration = 60;
+	unsigned numMobiles = 1000;
+	unsigned holdTime = 10;
+	unsigned numC7s = 1;
+	unsigned numC1s = 2;
+	unsigned numWorkers = 256;
+	LoadGenerator::Rates rates;
+	rates.mRate[LoadLocationUpdate] = 2.0F;
+	rates.mRate[LoadMOSMS] = 1.0F;
+	rates.mRate[LoadMOC] = 0.2F;
+	rates.mRate[LoadMTSMS] = 1.0F;
+	rates.mRate[LoadMTC] = 0.2F;
+
+	int opt;
+	while ((opt=getopt(argc,argv,"d:m:l:s:c:t:r:h:7:1:w:"))!=-1) {
+		switch (opt) {
+			case 'd': duration = atoi(optarg); break;
+			case 'm': numMobiles = atoi(optarg); break;
+			case 'l': rates.mRate[LoadLocationUpdate] = atof(optarg); break;
+			case 's': rates.mRate[LoadMOSMS] = atof(optarg); break;
+			case 'c': rates.mRate[LoadMOC] = atof(optarg); break;
+			case 't': rates.mRate[LoadMTSMS] = atof(optarg); break;
+			case 'r': rates.mRate[LoadMTC] = atof(optarg); break;
+			case 'h': holdTime = atoi(optarg); break;
+			case '7': numC7s = atoi(optarg); break;
+			case '1': numC1s = atoi(optarg); break;
+			case 'w': numWorkers = atoi(optarg); break;
+			default: usage(argv[0]);
+		}
+	}
+	if (numMobiles==0 || numWorkers==0 || 1+numC7s+numC1s>8) usage(argv[0]);
+
+	srandom(time(NULL));
+	srand48(time(NULL));
+
+	// The control layer's services, as OpenBTS starts them.
+	gSIPInterface.start();
+	gCallReactor.start(4,"call",8);
+	gMediaRelay.start(2,"media");
+	gRegistrar.start(8,30,10);
+	gDCCHPool.start(4,64);
+	gAccessGrant.start();
+
+	// The generator is never deleted; its threads run until exit.
+	LoadGenerator* generator = new LoadGenerator(numMobiles);
+	const unsigned ARFCN = gConfig.getNum("GSM.ARFCN");
+
+	// CCCHs, on C0T0 as in OpenBTS.
+	SimCCCHLogicalChannel* CCCH[3] = {
+		new SimCCCHLogicalChannel(gCCCH_0Mapping,ARFCN),
+		new SimCCCHLogicalChannel(gCCCH_1Mapping,ARFCN),
+		new SimCCCHLogicalChannel(gCCCH_2Mapping,ARFCN),
+	};
+	for (int i=0; i<3; i++) {
+		CCCH[i]->open();
+		gBTS.addAGCH(CCCH[i]);
+		generator->listen(*CCCH[i]);
+	}
+	gBTS.addPCH(CCCH[2]);
+
+	// C-V SDCCHs on C0T0, then C-VII and C-I slots.
+	unsigned numSDCCHs = 0;
+	unsigned numTCHs = 0;
+	for (int i=0; i<4; i++) {
+		SimSDCCHLogicalChannel* chan = new SimSDCCHLogicalChannel(0,gSDCCH4[i],ARFCN);
+		chan->open();
+		gDCCHPool.add(chan);
+		gBTS.addSDCCH(chan);
+		generator->addHandset(*chan);
+		numSDCCHs++;
+	}
+	unsigned TN = 1;
+	for (unsigned s=0; s<numC7s; s++, TN++) {
+		for (int i=0; i<8; i++) {
+			SimSDCCHLogicalChannel* chan = new SimSDCCHLogicalChannel(TN,gSDCCH8[i],ARFCN);
+			chan->open();
+			gDCCHPool.add(chan);
+			gBTS.addSDCCH(chan);
+			generator->addHandset(*chan);
+			numSDCCHs++;
+		}
+	}
+	for (unsigned s=0; s<numC1s; s++, TN++) {
+		SimTCHFACCHLogicalChannel* chan = new SimTCHFACCHLogicalChannel(TN,gTCHF_T[TN],ARFCN);
+		chan->open();
+		gDCCHPool.add(chan);
+		gBTS.addTCH(chan);
+		generator->addHandset(*chan);
+		numTCHs++;
+	}
+
+	// No radio, so no power manager; just the pager.
+	gBTS.pager().start();
+
+	// Wait for the channels to come up recyclable.
+	for (unsigned i=0; i<50 && gBTS.SDCCHAvailable()<numSDCCHs; i++) usleep(100000);
+	cout << gBTS.SDCCHAvailable() << "/" << numSDCCHs << " SDCCHs and "
+		<< gBTS.TCHAvailable() << "/" << numTCHs << " TCHs available" << endl;
+
+	cout << "running " << numMobiles << " mobiles for " << duration << " s" << endl;
+	Timeval started;
+	generator->start(rates,holdTime*1000,numWorkers);
+	sleep(duration);
+	generator->stop();
+	double seconds = started.elapsed()/1000.0;
+
+	cout << "draining " << generator->outstanding() << " procedures" << endl;
+	Timeval drainDeadline(drainTime*1000);
+	while (generator->outstanding() && !drainDeadline.passed()) sleep(1);
+	if (generator->outstanding()) cout << generator->outstanding() << " procedures did not finish" << endl;
+
+	cout << endl;
+	generator->report(cout,seconds);
+	cout << endl;
+	cout << "SDCCH hold " << gBTS.SDCCHHoldTime() << " ms, TCH hold " << gBTS.TCHHoldTime() << " ms" << endl;
+	gBTS.dumpAllocators(cout);
+	gAccessGrant.dump(cout);
+	gDCCHPool.dump(cout);
+	gRegistrar.dump(cout);
+	gBTS.pager().dump(cout);
+	cout << "transaction table size " << gTransactionTable.size() << endl;
+
+	// The channels and threads are left to the exit.
+	exit(0);
+}
+
+// vim: ts=4 sw=4
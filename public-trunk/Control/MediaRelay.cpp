@@ -0,0 +1,181 @@
+/**@file Media plane, relaying speech between RTP and the TCH. */
+
+/*
+* Copyright 2008, 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+
+#include "MediaRelay.h"
+#include <GSMLogicalChannel.h>
+#include <Logger.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+using namespace std;
+using namespace GSM;
+using namespace Control;
+
+
+/** RFC 3551 payload type for GSM 06.10. */
+static const unsigned gRTPPayloadGSM = 3;
+
+/** Fixed RTP header size, RFC 3550 5.1. */
+static const unsigned gRTPHeaderBytes = 12;
+
+/** A GSM 06.10 frame of silence, played when the jitter buffer runs dry. */
+static const unsigned char gSilenceFrame[JitterBuffer::mFrameBytes] = {
+	0xd8,0x20,0xa2,0xe1,0x5a,0x50,0x00,0x49,0x24,0x92,0x49,0x24,0x50,0x00,0x49,0x24,0x92,
+	0x49,0x24,0x50,0x00,0x49,0x24,0x92,0x49,0x24,0x50,0x00,0x49,0x24,0x92,0x49,0x24
+};
+
+
+
+MediaStream::MediaStream(TCHFACCHLogicalChannel* wTCH,
+		unsigned short localPort, const char* remoteIP, unsigned short remotePort,
+		unsigned jitterFrames)
+	:mTCH(wTCH),
+	mSocket(localPort,remoteIP,remotePort),
+	mJitter(jitterFrames),
+	mStopping(false),mHeard(false),mPlaying(false),
+	mSSRC(random()),mTxSeq(random()),mTxTimestamp(random()),
+	mRxPackets(0),mRxBad(0),mTxPackets(0),mFills(0)
+{
+	mSocket.nonblocking();
+}
+
+
+void MediaStream::attach()
+{
+	mTCH->speechListener(this);
+}
+
+
+void MediaStream::detach()
+{
+	mTCH->speechListener(NULL);
+}
+
+
+bool MediaStream::service()
+{
+	if (mStopping) return true;
+	downlink();
+	uplink();
+	return false;
+}
+
+
+void MediaStream::downlink()
+{
+	// Edge-triggered, so read until the socket is dry.
+	while (true) {
+		int count = mSocket.readBatch(mBuffers,mLengths,mBatch);
+		if (count<=0) break;
+		for (int i=0; i<count; i++) {
+			const unsigned char* packet = (const unsigned char*)mBuffers + i*MAX_UDP_LENGTH;
+			size_t length = mLengths[i];
+			mRxPackets++;
+			// RFC 3550 5.1: version 2, then CSRCs, an extension and padding may follow.
+			if ((length<gRTPHeaderBytes) || ((packet[0]>>6)!=2) || ((packet[1]&0x7f)!=gRTPPayloadGSM)) {
+				mRxBad++;
+				continue;
+			}
+			size_t header = gRTPHeaderBytes + 4*(packet[0]&0x0f);
+			if ((packet[0]&0x10) && (header+4<=length)) {
+				header += 4 + 4*((packet[header+2]<<8) | packet[header+3]);
+			}
+			size_t payload = (header<=length) ? length-header : 0;
+			if ((packet[0]&0x20) && payload) payload -= packet[length-1];
+			if (payload!=JitterBuffer::mFrameBytes) {
+				mRxBad++;
+				continue;
+			}
+			uint16_t seq = (packet[2]<<8) | packet[3];
+			mJitter.put(seq,packet+header);
+			mHeard = true;
+		}
+		// A short batch means the socket was dry when the kernel looked.
+		if ((unsigned)count<mBatch) break;
+	}
+}
+
+
+void MediaStream::playout()
+{
+	// Fill to the target depth before playing, at the start and after running dry,
+	// so the buffer has frames in hand to ride out jitter.
+	if (mJitter.held()>=mJitter.target()) mPlaying = true;
+	const unsigned char* frame = mPlaying ? mJitter.get() : NULL;
+	if (!frame) {
+		mPlaying = false;
+		frame = gSilenceFrame;
+		mFills++;
+	}
+	mTCH->sendTCH(frame);
+}
+
+
+void MediaStream::uplink()
+{
+	char packet[gRTPHeaderBytes+JitterBuffer::mFrameBytes];
+	while (unsigned char* frame = mTCH->recvTCH()) {
+		packet[0] = (char)0x80;
+		packet[1] = gRTPPayloadGSM;
+		packet[2] = mTxSeq>>8;
+		packet[3] = mTxSeq;
+		packet[4] = mTxTimestamp>>24;
+		packet[5] = mTxTimestamp>>16;
+		packet[6] = mTxTimestamp>>8;
+		packet[7] = mTxTimestamp;
+		packet[8] = mSSRC>>24;
+		packet[9] = mSSRC>>16;
+		packet[10] = mSSRC>>8;
+		packet[11] = mSSRC;
+		memcpy(packet+gRTPHeaderBytes,frame,JitterBuffer::mFrameBytes);
+		mTCH->releaseTCH(frame);
+		// Symmetric RTP: once the far end is heard, answer where it sends from.
+		int sent = mHeard ? mSocket.writeBack(packet,sizeof(packet)) : mSocket.write(packet,sizeof(packet));
+		if (sent>0) mTxPackets++;
+		mTxSeq++;
+		// 160 samples per 20 ms frame at 8 kHz.
+		mTxTimestamp += 160;
+		// The same block's downlink frame.
+		playout();
+	}
+}
+
+
+ostream& Control::operator<<(ostream& os, const MediaStream& stream)
+{
+	os << "RTP port " << stream.mSocket.port();
+	os << " rx=" << stream.mRxPackets << " bad=" << stream.mRxBad << " tx=" << stream.mTxPackets;
+	os << " fills=" << stream.mFills;
+	os << " jitter " << stream.mJitter;
+	return os;
+}
+
+
+// vim: ts=4 sw=4
@@ -0,0 +1,135 @@
+/**@file Media plane, relaying speech between RTP and the TCH. */
+/*
+* Copyright 2008, 2009, 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#ifndef MEDIARELAY_H
+#define MEDIARELAY_H
+
+#include <stdint.h>
+#include <Sockets.h>
+
+#include "CallReactor.h"
+#include "JitterBuffer.h"
+
+
+namespace GSM {
+class TCHFACCHLogicalChannel;
+};
+
+
+namespace Control {
+
+
+/**
+	The speech path of one call, RTP/GSM 06.10 (RFC 3551 payload type 3) to and from a TCH/F.
+	It runs on gMediaRelay, a reactor of its own, woken by RTP input and uplink
+	speech frames, so a signalling round that blocks never holds up speech.
+	Packets are read in batches into buffers owned by the stream and built on the stack;
+	nothing is allocated per frame.
+	The downlink plays out on the TCH clock: the TCH yields one uplink frame per
+	20 ms block, good or bad, and each one lets one downlink frame go to the TCH.
+*/
+class MediaStream : public ReactorCall {
+
+	public:
+
+	static const unsigned mBatch = 4;			///< packets per read
+
+	private:
+
+	GSM::TCHFACCHLogicalChannel* mTCH;
+	UDPSocket mSocket;				///< the call's RTP port
+	JitterBuffer mJitter;			///< downlink reordering
+	volatile bool mStopping;		///< set by stop()
+	bool mHeard;					///< packets have come in; answer to their source
+	bool mPlaying;					///< the jitter buffer has filled to its target; play from it
+
+	/**@name Uplink RTP state. */
+	//@{
+	uint32_t mSSRC;
+	uint16_t mTxSeq;
+	uint32_t mTxTimestamp;
+	//@}
+
+	char mBuffers[mBatch*MAX_UDP_LENGTH];	///< readBatch buffers
+	size_t mLengths[mBatch];				///< readBatch lengths
+
+	/**@name Statistics, written only by the serving thread. */
+	//@{
+	unsigned long mRxPackets;		///< RTP packets read
+	unsigned long mRxBad;			///< not RTP/GSM, or the wrong size
+	unsigned long mTxPackets;		///< RTP packets sent
+	unsigned long mFills;			///< blocks played with the fill frame
+	//@}
+
+	public:
+
+	/**
+		@param wTCH The traffic channel.
+		@param localPort The RTP port given in our SDP.
+		@param remoteIP The RTP address in the far end's SDP.
+		@param remotePort The RTP port in the far end's SDP.
+		@param jitterFrames Frames to hold while waiting for a missing one.
+	*/
+	MediaStream(GSM::TCHFACCHLogicalChannel* wTCH,
+		unsigned short localPort, const char* remoteIP, unsigned short remotePort,
+		unsigned jitterFrames);
+
+	int fd() const { return mSocket.fd(); }
+
+	void attach();
+
+	void detach();
+
+	bool service();
+
+	/** End the stream; follow with gMediaRelay.wait(). */
+	void stop() { mStopping = true; wake(); }
+
+	private:
+
+	/** Read RTP into the jitter buffer. */
+	void downlink();
+
+	/** Send the uplink speech frames out as RTP, playing one downlink frame for each. */
+	void uplink();
+
+	/** Play one block's frame to the TCH: the next one due, or the fill frame if the buffer is dry. */
+	void playout();
+
+	friend std::ostream& operator<<(std::ostream&, const MediaStream&);
+};
+
+
+std::ostream& operator<<(std::ostream& os, const MediaStream&);
+
+
+}	// namespace Control
+
+
+#endif
+
+// vim: ts=4 sw=4
@@ -48,6 +48,13 @@ using namespace GSM;
 using namespace Control;
 
 
+/**
+	The longest a location update waits for its registration, in ms.
+	SIPEngine::Register gives up after 10 s; the rest covers a queue in gRegistrar.
+*/
+static const unsigned SIPRegistrationTimeout = 15000;
+
+
 /** Controller for CM Service requests, dispatches out to multiple possible transaction controllers. */
 void Control::CMServiceResponder(const L3CMServiceRequest* cmsrq, LogicalChannel* DCCH)
 {
@@ -156,52 +163,23 @@ void Control::LocationUpdatingController(const L3LocationUpdatingRequest* lur, S
 	unsigned preexistingTMSI = resolveIMSI(sameLAI,mobID,SDCCH);
 	// IMSIAttach set to true if this is a new registration.
 	bool IMSIAttach = (preexistingTMSI==0);
-	// Try to register the IMSI with Asterisk.
-	// This will be set true if registration succeeded in the SIP world.
-	bool success = false;
-	try {
-		SIPEngine engine;
-		engine.User(mobID.digits());
-		LOG(DEBUG) << "waiting for registration";
-		success = engine.Register(); 
-	}
-	catch(SIPTimeout) {
-		LOG(ALARM) "SIP registration timed out.  Is Asterisk running?";
-		// Reject with a "network failure" cause code, 0x11.
-		SDCCH->send(L3LocationUpdatingReject(0x11));
-		// HACK -- wait long enough for a response
-		// FIXME -- Why are we doing this?
-		sleep(4);
-		// Release the channel and return.
-		SDCCH->send(L3ChannelRelease());
-		return;
-	}
-
-	// This allows us to configure Open Registration
-	bool openRegistration = gConfig.defines("Control.OpenRegistration");
-
-	// Do we need to assign a TMSI?
-	unsigned newTMSI = 0;
-	if (!preexistingTMSI && (
-			gConfig.defines("Control.LUR.TMSIsAll") ||
-			success ||
-			openRegistration
-		) ) {
-			newTMSI = gTMSITable.assign(mobID.digits());
-	}
-
+	// Start registering the IMSI with Asterisk.
+	// The SIP round trip overlaps the queries below, and a recent result
+	// for this IMSI comes from gRegistrar's cache without a REGISTER.
+	string IMSI = mobID.digits();
+	Registrar::Result registration = gRegistrar.request(IMSI);
 
 	// Query for IMEI?
 	// Note: IMEI is requested only on IMSI attach, i.e. only when user
 	// registers for the first time or after a long inactivity. I.e. this
 	// will not work if user changes mobiles frequently.
+	string IMEI;
 	if (IMSIAttach && gConfig.defines("Control.LUR.QueryIMEI")) {
 		SDCCH->send(L3IdentityRequest(IMEIType));
 		L3Message* msg = getMessage(SDCCH);
 		L3IdentityResponse *resp = dynamic_cast<L3IdentityResponse*>(msg);
 		if (resp) {
-			unsigned tmsi = newTMSI?newTMSI:preexistingTMSI;
-			gTMSITable.setIMEI(tmsi, resp->mobileID().digits());
+			IMEI = resp->mobileID().digits();
 		} else {
 			if (msg) {
 				LOG(WARN) << "Unexpected message " << *msg;
@@ -210,6 +188,7 @@ void Control::LocationUpdatingController(const L3LocationUpdatingRequest* lur, S
 			throw UnexpectedMessage();
 		}
 		LOG(INFO) << *resp;
+		delete resp;
 	}
 
 	// Query for classmark?
@@ -228,11 +207,44 @@ void Control::LocationUpdatingController(const L3LocationUpdatingRequest* lur, S
 			throw UnexpectedMessage();
 		}
 		LOG(INFO) << *resp;
+		delete resp;
 	}
 
 	// Query for RRLP?
 	GSM::RRLP::collectMSInfo(mobID, SDCCH, gConfig.defines("GSM.RRLP.LUR"));
 
+	// Now the registration result is needed.
+	LOG(DEBUG) << "waiting for registration";
+	if (registration==Registrar::Pending) registration = gRegistrar.wait(IMSI,SIPRegistrationTimeout);
+	if (registration==Registrar::TimedOut) {
+		LOG(ALARM) "SIP registration timed out.  Is Asterisk running?";
+		// Reject with a "network failure" cause code, 0x11.
+		// The release follows the reject on the same DL, so there is nothing to wait for.
+		SDCCH->send(L3LocationUpdatingReject(0x11));
+		SDCCH->send(L3ChannelRelease());
+		return;
+	}
+	// This will be set true if registration succeeded in the SIP world.
+	bool success = (registration==Registrar::Registered);
+
+	// This allows us to configure Open Registration
+	bool openRegistration = gConfig.defines("Control.OpenRegistration");
+
+	// Do we need to assign a TMSI?
+	unsigned newTMSI = 0;
+	if (!preexistingTMSI && (
+			gConfig.defines("Control.LUR.TMSIsAll") ||
+			success ||
+			openRegistration
+		) ) {
+			newTMSI = gTMSITable.assign(mobID.digits());
+	}
+
+	if (IMEI.size()) {
+		unsigned tmsi = newTMSI?newTMSI:preexistingTMSI;
+		gTMSITable.setIMEI(tmsi, IMEI);
+	}
+
 	// We fail closed unless we're configured otherwise
 	if (!success && !openRegistration) {
 		LOG(INFO) << "registration FAILED: " << mobID;
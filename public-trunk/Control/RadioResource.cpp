@@ -126,6 +126,8 @@ void Control::AccessGrantResponder(
 	// Given a request reference, try to allocate a channel
 	// and send the assignment to the handset on the CCCH.
 	// This GSM's version of medium access control.
+	// The burst is screened here, in the RACH decoder's thread;
+	// the allocation and the answer are left to gAccessGrant.
 	// Papa Legba, open that door...
 
 	// Are we holding off new allocations?
@@ -134,20 +136,9 @@ void Control::AccessGrantResponder(
 		return;
 	}
 
-	// Check "when" against current clock to see if we're too late.
-	// Calculate maximum number of frames of delay.
-	// See GSM 04.08 3.3.1.1.2 for the logic here.
-	static const unsigned txInteger = gConfig.getNum("GSM.RACH.TxInteger");
-	static const int maxAge = GSM::RACHSpreadSlots[txInteger] + GSM::RACHWaitSParam[txInteger];
-	// Check burst age.
-	int age = gBTS.time() - when;
 	LOG(INFO) << "RA=0x" << hex << RA << dec
-		<< " when=" << when << " age=" << age
+		<< " when=" << when
 		<< " delay=" << timingError << " RSSI=" << RSSI;
-	if (age>maxAge) {
-		LOG(WARN) << "ignoring RACH bust with age " << age;
-		return;
-	}
 
 	// Screen for delay.
 	if (timingError > gConfig.getNum("GSM.MS.TA.Max")) {
@@ -155,74 +146,342 @@ void Control::AccessGrantResponder(
 		return;
 	}
 
-	// Get an AGCH to send on.
-	CCCHLogicalChannel *AGCH = gBTS.getAGCH();
-	// Someone had better have created a least one AGCH.
-	assert(AGCH);
-	// Check AGCH load now.
-	if (AGCH->load()>gConfig.getNum("GSM.AGCH.QMax")) {
-		LOG(NOTICE) "AccessGrantResponder: AGCH congestion";
-		return;
-	}
+	gAccessGrant.post(RA,when,RSSI,timingError);
+}
+
+
+
+
+AccessGrantStage::AccessGrantStage()
+	:mRunning(false),mWindow(0),
+	mBursts(0),mDuplicates(0),mStale(0),mShed(0),
+	mGrants(0),mRejects(0),
+	mAssignments(0),mExtended(0),mRejections(0),
+	mRateCount(0),mRate(0.0F),mPeakRate(0.0F),
+	mLatency(0.0F),mMaxLatency(0)
+{
+	for (unsigned i=0; i<256; i++) mSeen[i]=false;
+	for (unsigned i=0; i<NumPriorities; i++) mRequests[i]=0;
+}
+
+
+void AccessGrantStage::start()
+{
+	// Calculate maximum number of frames of delay.
+	// See GSM 04.08 3.3.1.1.2 for the logic here.
+	// An MS repeats its request within this many frames,
+	// and an answer later than that is too late.
+	unsigned txInteger = gConfig.getNum("GSM.RACH.TxInteger");
+	mLock.lock();
+	mWindow = GSM::RACHSpreadSlots[txInteger] + GSM::RACHWaitSParam[txInteger];
+	mRunning = true;
+	mLock.unlock();
+	mThread.start((void*(*)(void*))AccessGrantStageServiceLoop,this,"rach");
+}
 
-	// Check for location update.
-	// This gives LUR a lower priority than other services.
-	if (requestingLUR(RA)) {
-		if (gBTS.SDCCHAvailable()<=gConfig.getNum("GSM.PagingReservations")) {
-			unsigned waitTime = gBTS.growT3122()/1000;
-			LOG(NOTICE) << "AccessGrantResponder: LUR congestion, RA=" << RA << " T3122=" << waitTime;
-			const L3ImmediateAssignmentReject reject(L3RequestReference(RA,when),waitTime);
-			LOG(DEBUG) << "AccessGrantResponder: LUR rejection, sending " << reject;
-			AGCH->send(reject);
+
+AccessGrantStage::Priority AccessGrantStage::priority(unsigned RA)
+{
+	// This code is based on GSM 04.08 Table 9.9.
+	unsigned RA4 = RA>>4;
+	unsigned RA5 = RA>>5;
+	if (RA5 == 0x05) return Emergency;
+	// Answer to paging, Table 9.9a.
+	// With NECI, 0001xxxx could also be "other procedures on SDCCH".
+	if (RA5 == 0x04) return PagingResponse;
+	if ((RA4 == 0x02) || (RA4 == 0x03)) return PagingResponse;
+	if ((RA4 == 0x01) && (gConfig.getNum("GSM.CS.NECI")==0)) return PagingResponse;
+	if (requestingLUR(RA)) return LocationUpdate;
+	return Normal;
+}
+
+
+void AccessGrantStage::post(unsigned RA, const GSM::Time& when, float RSSI, float timingError)
+{
+	assert(RA<256);
+	Priority pri = priority(RA);
+	mLock.lock();
+	// RACH rate, over periods of a second or so.
+	mBursts++;
+	mRateCount++;
+	long period = mRateStart.elapsed();
+	if (period>=1000) {
+		mRate = mRateCount*1000.0F/period;
+		if (mRate>mPeakRate) mPeakRate = mRate;
+		mRateCount = 0;
+		mRateStart.now();
+	}
+	// The same RA again within the retransmission window is taken for a
+	// repeat of a request already in hand.  The MS accepts an answer to
+	// any of its last three requests, so one answer serves both.
+	if (mSeen[RA]) {
+		int gap = when - mLastSeen[RA];
+		if (gap<0) gap = -gap;
+		if (gap<=mWindow) {
+			mDuplicates++;
+			mLock.unlock();
+			LOG(DEBUG) << "dropping RACH burst RA=0x" << hex << RA << dec << " as a retransmission";
 			return;
 		}
 	}
+	mSeen[RA] = true;
+	mLastSeen[RA] = when;
+	mRequests[pri]++;
+	mQueues[pri].push_back(Request(RA,when,RSSI,timingError,pri));
+	mSignal.signal();
+	mLock.unlock();
+}
+
+
+void AccessGrantStage::forget(const Request& req)
+{
+	mLock.lock();
+	if (mSeen[req.mRA] && (mLastSeen[req.mRA]==req.mWhen)) mSeen[req.mRA] = false;
+	mLock.unlock();
+}
+
 
-	// Allocate the channel according to the needed type indicated by RA.
-	// The returned channel is already open and ready for the transaction.
-	LogicalChannel *LCH = NULL;
-	switch (decodeChannelNeeded(RA)) {
-		case TCHFType: LCH = gBTS.getTCH(); break;
-		case SDCCHType: LCH = gBTS.getSDCCH(); break;
+void AccessGrantStage::serviceLoop()
+{
+	// A CCCH block is 4 frames, in ms.
+	static const unsigned blockTime = (4*gFrameMicroseconds+999)/1000;
+	while (true) {
+		vector<Request> batch;
+		mLock.lock();
+		while (true) {
+			bool empty = true;
+			for (unsigned p=0; p<NumPriorities; p++) {
+				if (!mQueues[p].empty()) empty = false;
+			}
+			if (empty) {
+				mSignal.wait(mLock);
+				continue;
+			}
+			// With a block queued on every AGCH, answers sent now
+			// would wait anyway.  Let more requests join this batch.
+			if (gBTS.AGCHLoad()>=gBTS.numAGCHs()) {
+				mSignal.wait(mLock,blockTime);
+				continue;
+			}
+			break;
+		}
+		for (unsigned p=0; p<NumPriorities; p++) {
+			batch.insert(batch.end(),mQueues[p].begin(),mQueues[p].end());
+			mQueues[p].clear();
+		}
+		mLock.unlock();
+		answer(batch);
+	}
+}
+
+
+void AccessGrantStage::answer(const vector<Request>& batch)
+{
+	// Check AGCH load now.
+	// Someone had better have created a least one AGCH.
+	CCCHLogicalChannel *AGCH = gBTS.getAGCH();
+	assert(AGCH);
+	bool congested = (AGCH->load() > gConfig.getNum("GSM.AGCH.QMax"));
+	unsigned reservations = gConfig.getNum("GSM.PagingReservations");
+
+	vector<Grant> grants;
+	vector<Request> rejects;
+	unsigned SDCCHRejects = 0;
+	unsigned TCHRejects = 0;
+	unsigned wait = 0;
+	for (unsigned i=0; i<batch.size(); i++) {
+		const Request& req = batch[i];
+
+		// Check burst age.
+		int age = gBTS.time() - req.mWhen;
+		if (age>mWindow) {
+			LOG(WARN) << "ignoring RACH burst with age " << age;
+			mLock.lock();
+			mStale++;
+			mLock.unlock();
+			forget(req);
+			continue;
+		}
+
+		// Under AGCH congestion, answer only emergency calls and paging responses.
+		if (congested && (req.mPriority>PagingResponse)) {
+			LOG(NOTICE) << "AGCH congestion, ignoring RA=0x" << hex << req.mRA << dec;
+			mLock.lock();
+			mShed++;
+			mLock.unlock();
+			forget(req);
+			continue;
+		}
+
+		// Allocate the channel according to the needed type indicated by RA.
+		// The returned channel is already open and ready for the transaction.
+		ChannelType type = decodeChannelNeeded(req.mRA);
 		// If we don't support the service, assign to an SDCCH and we can reject it in L3.
-		case UndefinedCHType:
+		if (type==UndefinedCHType) {
 			LOG(NOTICE) << "RACH burst for unsupported service";
-			LCH = gBTS.getSDCCH();
-			break;
-		// We should never be here.
-		default: assert(0);
+			type = SDCCHType;
+		}
+		LogicalChannel *LCH = NULL;
+		// Location updates leave the reserved SDCCHs to paging responses.
+		if ((req.mPriority!=LocationUpdate) || (gBTS.SDCCHAvailable()>reservations)) {
+			if (type==TCHFType) LCH = gBTS.getTCH();
+			else LCH = gBTS.getSDCCH();
+		}
+
+		// Nothing available?
+		if (!LCH) {
+			// Rejection, GSM 04.08 3.3.1.1.3.2.
+			// BTW, emergency calls are not subject to T3122 hold-off.
+			unsigned position = (type==TCHFType) ? ++TCHRejects : ++SDCCHRejects;
+			unsigned reqWait = waitTime(type,position);
+			LOG(NOTICE) << "congestion, RA=" << req.mRA << " priority=" << req.mPriority << " T3122=" << reqWait;
+			// The rejections share messages, so they share the longest wait.
+			if (reqWait>wait) wait = reqWait;
+			rejects.push_back(req);
+			continue;
+		}
+
+		// Set the channel physical parameters from the RACH burst.
+		LCH->setPhy(req.mRSSI,req.mTimingError);
+		int initialTA = (int)(req.mTimingError + 0.5F);
+		if (initialTA<0) initialTA=0;
+		if (initialTA>63) initialTA=63;
+		grants.push_back(Grant(req,LCH->channelDescription(),initialTA));
+	}
+
+	sendGrants(grants);
+	sendRejects(rejects,wait);
+
+	// On successful allocation without congestion, shrink T3122.
+	if (grants.size() && !rejects.size()) gBTS.shrinkT3122();
+}
+
+
+unsigned AccessGrantStage::waitTime(ChannelType type, unsigned position)
+{
+	unsigned hold = gBTS.SDCCHHoldTime();
+	unsigned total = gBTS.SDCCHTotal();
+	if (type==TCHFType) {
+		hold = gBTS.TCHHoldTime();
+		total = gBTS.TCHTotal();
+	}
+	// Nothing measured yet, so fall back on growing T3122.
+	if (!hold || !total) return gBTS.growT3122()/1000;
+	// With the channels busy, one frees up every hold/total ms on average,
+	// and this request needs the position-th of them.
+	unsigned wait = gBTS.T3122((hold*position + total-1)/total);
+	return (wait+999)/1000;
+}
+
+
+void AccessGrantStage::sendGrants(const vector<Grant>& grants)
+{
+	// Assignment, GSM 04.08 3.3.1.1.3.1.
+	// In pairs, the first of the batch first.
+	for (unsigned i=0; i<grants.size(); ) {
+		CCCHLogicalChannel *AGCH = gBTS.getAGCH();
+		assert(AGCH);
+		const Grant& g1 = grants[i];
+		if (i+1<grants.size()) {
+			const Grant& g2 = grants[i+1];
+			const L3ImmediateAssignmentExtended assign(
+				g1.mReference,g1.mDescription,g1.mTimingAdvance,
+				g2.mReference,g2.mDescription,g2.mTimingAdvance);
+			LOG(INFO) << "sending " << assign;
+			AGCH->send(assign);
+			mLock.lock();
+			mExtended++;
+			mLock.unlock();
+			i += 2;
+			continue;
+		}
+		const L3ImmediateAssignment assign(g1.mReference,g1.mDescription,g1.mTimingAdvance);
+		LOG(INFO) << "sending " << assign;
+		AGCH->send(assign);
+		mLock.lock();
+		mAssignments++;
+		mLock.unlock();
+		i++;
+	}
+
+	// Grant latency, from the burst to its assignment queued on the AGCH.
+	if (!grants.size()) return;
+	GSM::Time now = gBTS.time();
+	mLock.lock();
+	for (unsigned i=0; i<grants.size(); i++) {
+		int frames = now - grants[i].mWhen;
+		if (frames<0) frames = 0;
+		unsigned latency = frames*gFrameMicroseconds/1000;
+		if (mGrants==0) mLatency = latency;
+		else mLatency = 0.9F*mLatency + 0.1F*latency;
+		if (latency>mMaxLatency) mMaxLatency = latency;
+		mGrants++;
 	}
+	mLock.unlock();
+}
 
-	// Nothing available?
-	if (!LCH) {
-		// Rejection, GSM 04.08 3.3.1.1.3.2.
-		// BTW, emergency calls are not subject to T3122 hold-off.
-		unsigned waitTime = gBTS.growT3122()/1000;
-		LOG(NOTICE) << "AccessGrantResponder: congestion, RA=" << RA << " T3122=" << waitTime;
-		const L3ImmediateAssignmentReject reject(L3RequestReference(RA,when),waitTime);
+
+void AccessGrantStage::sendRejects(const vector<Request>& rejects, unsigned wait)
+{
+	for (unsigned i=0; i<rejects.size(); i+=4) {
+		CCCHLogicalChannel *AGCH = gBTS.getAGCH();
+		assert(AGCH);
+		L3ImmediateAssignmentReject reject(L3RequestReference(rejects[i].mRA,rejects[i].mWhen),wait);
+		for (unsigned j=i+1; (j<i+4) && (j<rejects.size()); j++) {
+			reject.addReference(L3RequestReference(rejects[j].mRA,rejects[j].mWhen));
+		}
 		LOG(DEBUG) << "rejection, sending " << reject;
 		AGCH->send(reject);
-		return;
+		mLock.lock();
+		mRejections++;
+		mRejects += reject.references();
+		mLock.unlock();
 	}
+}
 
-	// Set the channel physical parameters from the RACH burst.
-	LCH->setPhy(RSSI,timingError);
 
-	// Assignment, GSM 04.08 3.3.1.1.3.1.
-	// Create the ImmediateAssignment message.
-	int initialTA = (int)(timingError + 0.5F);
-	if (initialTA<0) initialTA=0;
-	if (initialTA>63) initialTA=63;
-	const L3ImmediateAssignment assign(
-		L3RequestReference(RA,when),
-		LCH->channelDescription(),
-		L3TimingAdvance(initialTA)
-	);
-	LOG(INFO) << "sending " << assign;
-	AGCH->send(assign);
-
-	// On successful allocation, shrink T3122.
-	gBTS.shrinkT3122();
+void AccessGrantStage::dump(ostream& os) const
+{
+	mLock.lock();
+	// A period already longer than a second is the latest word on the rate.
+	float rate = mRate;
+	long period = mRateStart.elapsed();
+	if (period>=1000) rate = mRateCount*1000.0F/period;
+	os << "RACH: rate=" << rate << "/s peak=" << mPeakRate << "/s";
+	os << " bursts=" << mBursts << " duplicates=" << mDuplicates;
+	os << " stale=" << mStale << " shed=" << mShed;
+	unsigned queued = 0;
+	for (unsigned p=0; p<NumPriorities; p++) queued += mQueues[p].size();
+	os << " queued=" << queued << endl;
+	os << "RACH requests:";
+	for (unsigned p=0; p<NumPriorities; p++) {
+		os << " " << (Priority)p << "=" << mRequests[p];
+	}
+	os << endl;
+	os << "AGCH: grants=" << mGrants << " rejects=" << mRejects;
+	os << " IA=" << mAssignments << " IA-extended=" << mExtended << " IA-reject=" << mRejections;
+	os << " latency=" << mLatency << "ms max=" << mMaxLatency << "ms" << endl;
+	mLock.unlock();
+}
+
+
+void* Control::AccessGrantStageServiceLoop(AccessGrantStage* stage)
+{
+	stage->serviceLoop();
+	return NULL;
+}
+
+
+ostream& Control::operator<<(ostream& os, AccessGrantStage::Priority pri)
+{
+	switch (pri) {
+		case AccessGrantStage::Emergency: os << "emergency"; break;
+		case AccessGrantStage::PagingResponse: os << "paging"; break;
+		case AccessGrantStage::Normal: os << "normal"; break;
+		case AccessGrantStage::LocationUpdate: os << "LUR"; break;
+		default: os << "?" << (int)pri << "?";
+	}
+	return os;
 }
 
 
@@ -314,7 +573,7 @@ void Control::AssignmentCompleteHandler(const L3AssignmentComplete *confirm, TCH
 	}
 	LOG(INFO) << "service="<<transaction.service().type();
 
-	// These "controller" functions don't return until the call is cleared.
+	// These "controller" functions return once the call is connected and on gCallReactor.
 	switch (transaction.service().type()) {
 		case L3CMServiceType::MobileOriginatedCall:
 			MOCController(transaction,TCH);
@@ -326,7 +585,7 @@ void Control::AssignmentCompleteHandler(const L3AssignmentComplete *confirm, TCH
 			LOG(WARN) << "unsupported service " << transaction.service();
 			throw UnsupportedMessage(transaction.ID());
 	}
-	// If we got here, the call is cleared.
+	// If we got here, the call is running or cleared.
 }
 
 
@@ -336,6 +595,47 @@ void Control::AssignmentCompleteHandler(const L3AssignmentComplete *confirm, TCH
 
 
 
+void Pager::start()
+{
+	if (mRunning) return;
+	L3ControlChannelDescription CCD;
+	mLock.lock();
+	mBlocks = CCD.pagingBlocks();
+	mMultiframes = CCD.BS_PA_MFRMS();
+	mGroups.resize(mBlocks*mMultiframes);
+	mAnyFirst.resize(mGroups.size(),false);
+	mUseTMSIs = gConfig.defines("Control.Pager.UseTMSIs");
+	// Anything added before now stays in the any-group queue.
+	mRunning=true;
+	mLock.unlock();
+	LOG(INFO) << mBlocks*mMultiframes << " paging groups in " << mBlocks << " blocks x " << mMultiframes << " multiframes";
+	if (gBTS.numPCHs()!=mBlocks) {
+		LOG(WARN) << gBTS.numPCHs() << " PCHs for " << mBlocks << " paging blocks per multiframe";
+	}
+	for (unsigned i=0; i<mBlocks && i<gBTS.numPCHs(); i++) {
+		gBTS.getPCH(i)->pagingSource(this,i);
+	}
+}
+
+
+
+int Pager::pagingGroup(const L3MobileIdentity& mobileID) const
+{
+	if (!mRunning) return -1;
+	// GSM 05.02 6.5.2, with BS_CC_CHANS=1:
+	// PAGING_GROUP = (IMSI mod 1000) mod N.
+	const char* IMSI = NULL;
+	if (mobileID.type()==IMSIType) IMSI = mobileID.digits();
+	else if (mobileID.type()==TMSIType) IMSI = gTMSITable.IMSI(mobileID.TMSI());
+	if (!IMSI) return -1;
+	size_t len = strlen(IMSI);
+	if (len<3) return -1;
+	unsigned mod1000 = atoi(IMSI+len-3);
+	return mod1000 % mGroups.size();
+}
+
+
+
 void Pager::addID(const L3MobileIdentity& newID, ChannelType chanType,
 		TransactionEntry& transaction, unsigned wLife)
 {
@@ -343,40 +643,53 @@ void Pager::addID(const L3MobileIdentity& newID, ChannelType chanType,
 	transaction.T3113().set(wLife);
 	gTransactionTable.update(transaction);
 	// Add a mobile ID to the paging list for a given lifetime.
+	string key = mobileIDKey(newID);
 	mLock.lock();
 	// If this ID is already in the list, just reset its timer.
-	// Uhg, another linear time search.
-	// This would be faster if the paging list were ordered by ID.
-	// But the list should usually be short, so it may not be worth the effort.
-	for (PagingEntryList::iterator lp = mPageIDs.begin(); lp != mPageIDs.end(); ++lp) {
-		if (lp->ID()==newID) {
-			LOG(DEBUG) << newID << " already in table";
-			lp->renew(wLife);
-			mPageSignal.signal();
-			mLock.unlock();
-			return;
-		}
+	PagingIndex::iterator idx = mIndex.find(key);
+	if (idx!=mIndex.end()) {
+		PagingEntryList::iterator lp = idx->second;
+		LOG(DEBUG) << newID << " already in table";
+		lp->renew(wLife);
+		mDeadlines.erase(lp->deadline());
+		lp->deadline(mDeadlines.insert(PagingDeadlines::value_type(lp->expiration().seconds(),key)));
+		mLock.unlock();
+		return;
 	}
-	// If this ID is new, put it in the list.
-	mPageIDs.push_back(PagingEntry(newID,chanType,transaction.ID(),wLife));
-	LOG(INFO) << newID << " added to table";
-	mPageSignal.signal();
+	// If this ID is new, put it in the queue of its paging group.
+	PagingEntry entry(newID,chanType,transaction.ID(),wLife);
+	entry.group(pagingGroup(newID));
+	if (mUseTMSIs && newID.type()==IMSIType) {
+		unsigned TMSI = gTMSITable.TMSI(newID.digits());
+		if (TMSI) entry.pagedID(L3MobileIdentity(TMSI));
+	}
+	PagingEntryList& q = queue(entry.group());
+	PagingEntryList::iterator lp = q.insert(q.end(),entry);
+	lp->deadline(mDeadlines.insert(PagingDeadlines::value_type(lp->expiration().seconds(),key)));
+	mIndex[key] = lp;
+	LOG(INFO) << newID << " added to table, group " << entry.group();
 	mLock.unlock();
 }
 
 
+void Pager::erase(PagingEntryList::iterator lp)
+{
+	mDeadlines.erase(lp->deadline());
+	mIndex.erase(mobileIDKey(lp->ID()));
+	queue(lp->group()).erase(lp);
+}
+
+
 unsigned Pager::removeID(const L3MobileIdentity& delID)
 {
 	// Return the associated transaction ID, or 0 if none found.
 	unsigned retVal = 0;
 	LOG(INFO) << delID;
 	mLock.lock();
-	for (PagingEntryList::iterator lp = mPageIDs.begin(); lp != mPageIDs.end(); ++lp) {
-		if (lp->ID()==delID) {
-			retVal = lp->transactionID();
-			mPageIDs.erase(lp);
-			break;
-		}
+	PagingIndex::iterator idx = mIndex.find(mobileIDKey(delID));
+	if (idx!=mIndex.end()) {
+		retVal = idx->second->transactionID();
+		erase(idx->second);
 	}
 	mLock.unlock();
 	return retVal;
@@ -384,110 +697,172 @@ unsigned Pager::removeID(const L3MobileIdentity& delID)
 
 
 
-unsigned Pager::pageAll()
+void Pager::expire()
 {
-	// Traverse the full list and page all IDs.
-	// Remove expired IDs.
-	// Return the number of IDs paged.
-	// This is a linear time operation.
+	double now = Timeval().seconds();
+	while (!mDeadlines.empty() && mDeadlines.begin()->first<=now) {
+		PagingIndex::iterator idx = mIndex.find(mDeadlines.begin()->second);
+		assert(idx!=mIndex.end());
+		// DO NOT remove the transaction entry here.
+		// It may be in use in an active call.
+		LOG(INFO) << "erasing " << idx->second->ID();
+		erase(idx->second);
+	}
+}
 
-	mLock.lock();
 
-	// Clear expired entries.
-	PagingEntryList::iterator lp = mPageIDs.begin();
-	while (lp != mPageIDs.end()) {
-		if (!lp->expired()) ++lp;
-		else {
-			// DO NOT remove the transaction entry here.
-			// It may be in use in an active call.
-			LOG(INFO) << "erasing " << lp->ID();
-			lp=mPageIDs.erase(lp);
+
+/** True if a mobile can go where a paging request has no channel needed field for it. */
+static bool anyChannelOK(const PagingEntry& entry)
+{
+	// An "any channel" answer gets a TCH/F; see decodeChannelNeeded.
+	return entry.type()!=SDCCHType;
+}
+
+
+L3Frame* Pager::pack(PagingEntryList& first, PagingEntryList& second)
+{
+	// The candidates are the mobiles at the front of one queue,
+	// then those of the other.  The first one is always paged,
+	// so nobody waits behind a run of better-packing mobiles.
+	static const unsigned window = 8;
+	vector<PagingEntryList::iterator> cand;
+	for (PagingEntryList::iterator lp=first.begin(); lp!=first.end() && cand.size()<window; ++lp) cand.push_back(lp);
+	for (PagingEntryList::iterator lp=second.begin(); lp!=second.end() && cand.size()<window; ++lp) cand.push_back(lp);
+	if (cand.size()==0) return NULL;
+
+	// The chosen mobiles, in message order.
+	vector<PagingEntryList::iterator> chosen;
+	L3RRMessage* msg = NULL;
+	const PagingEntryList::iterator head = cand[0];
+	vector<PagingEntryList::iterator> TMSIs;		// other TMSI candidates, "any channel" ones first
+	for (unsigned i=1; i<cand.size(); i++) {
+		if (cand[i]->pagedID().type()==TMSIType && anyChannelOK(*cand[i])) TMSIs.push_back(cand[i]);
+	}
+	for (unsigned i=1; i<cand.size(); i++) {
+		if (cand[i]->pagedID().type()==TMSIType && !anyChannelOK(*cand[i])) TMSIs.push_back(cand[i]);
+	}
+
+	if (head->pagedID().type()==TMSIType && TMSIs.size()>=3) {
+		// Type 3, four TMSIs, if two of them can take "any channel".
+		vector<PagingEntryList::iterator> four(1,head);
+		four.insert(four.end(),TMSIs.begin(),TMSIs.begin()+3);
+		vector<PagingEntryList::iterator> flagged, unflagged;
+		for (unsigned i=0; i<4; i++) {
+			if (anyChannelOK(*four[i]) && unflagged.size()<2) unflagged.push_back(four[i]);
+			else flagged.push_back(four[i]);
+		}
+		if (unflagged.size()==2) {
+			chosen = flagged;
+			chosen.insert(chosen.end(),unflagged.begin(),unflagged.end());
+			msg = new L3PagingRequestType3(
+				chosen[0]->pagedID(),chosen[0]->type(),
+				chosen[1]->pagedID(),chosen[1]->type(),
+				chosen[2]->pagedID(),chosen[3]->pagedID());
 		}
 	}
 
-	LOG(INFO) << "paging " << mPageIDs.size() << " mobile(s)";
-
-	// Page remaining entries, two at a time if possible.
-	// These PCH send operations are non-blocking.
-	lp = mPageIDs.begin();
-	while (lp != mPageIDs.end()) {
-		// FIXME -- This completely ignores the paging groups.
-		// HACK -- So we send every page twice.
-		// That will probably mean a different Pager for each subchannel.
-		// See GSM 04.08 10.5.2.11 and GSM 05.02 6.5.2.
-		const L3MobileIdentity& id1 = lp->ID();
-		ChannelType type1 = lp->type();
-		++lp;
-		if (lp==mPageIDs.end()) {
-			// Just one ID left?
-			LOG(DEBUG) << "paging " << id1;
-			gBTS.getPCH(0)->send(L3PagingRequestType1(id1,type1));
-			gBTS.getPCH(0)->send(L3PagingRequestType1(id1,type1));
-			break;
+	if (!msg) {
+		// Type 2, two TMSIs and a third mobile of any identity that can take "any channel".
+		PagingEntryList::iterator t1 = head, t2 = head, third = head;
+		bool ok = false;
+		if (head->pagedID().type()==TMSIType && TMSIs.size()>=1) {
+			t2 = TMSIs[0];
+			for (unsigned i=1; i<cand.size() && !ok; i++) {
+				if (cand[i]==t2 || !anyChannelOK(*cand[i])) continue;
+				third = cand[i];
+				ok = true;
+			}
+		} else if (anyChannelOK(*head) && TMSIs.size()>=2) {
+			t1 = TMSIs[0];
+			t2 = TMSIs[1];
+			ok = true;
 		}
-		// Page by pairs when possible.
-		const L3MobileIdentity& id2 = lp->ID();
-		ChannelType type2 = lp->type();
-		++lp;
-		LOG(DEBUG) << "paging " << id1 << " and " << id2;
-		gBTS.getPCH(0)->send(L3PagingRequestType1(id1,type1,id2,type2));
-		gBTS.getPCH(0)->send(L3PagingRequestType1(id1,type1,id2,type2));
-	}
-	
-	mLock.unlock();
+		if (ok) {
+			chosen.push_back(t1);
+			chosen.push_back(t2);
+			chosen.push_back(third);
+			L3PagingRequestType2* req = new L3PagingRequestType2(t1->pagedID(),t1->type(),t2->pagedID(),t2->type());
+			req->third(third->pagedID());
+			msg = req;
+		}
+	}
 
-	return mPageIDs.size();
-}
+	if (!msg) {
+		// Type 1, one or two mobiles of any identity.
+		chosen.push_back(head);
+		if (cand.size()>1) {
+			chosen.push_back(cand[1]);
+			msg = new L3PagingRequestType1(head->pagedID(),head->type(),cand[1]->pagedID(),cand[1]->type());
+		} else {
+			msg = new L3PagingRequestType1(head->pagedID(),head->type());
+		}
+	}
 
-size_t Pager::pagingEntryListSize()
-{
-	return mPageIDs.size();
-}
+	LOG(DEBUG) << "paging " << *msg;
+	mRequests[msg->MTI()==L3RRMessage::PagingRequestType1 ? 0 : (msg->MTI()==L3RRMessage::PagingRequestType2 ? 1 : 2)]++;
+	mPages += chosen.size();
+	L3Frame* frame = new L3Frame(*msg,UNIT_DATA);
+	delete msg;
 
-void Pager::start()
-{
-	if (mRunning) return;
-	mRunning=true;
-	mPagingThread.start((void* (*)(void*))PagerServiceLoopAdapter, (void*)this);
+	// Move the paged mobiles to the back of their queues.
+	for (unsigned i=0; i<chosen.size(); i++) {
+		PagingEntryList& q = queue(chosen[i]->group());
+		q.splice(q.end(),q,chosen[i]);
+	}
+	return frame;
 }
 
 
 
-void* Control::PagerServiceLoopAdapter(Pager *pager)
+L3Frame* Pager::pagingFrame(unsigned block, const Time& when)
 {
-	pager->serviceLoop();
-	return NULL;
+	mLock.lock();
+	expire();
+	if (mIndex.size()==0 || block>=mBlocks) {
+		mLock.unlock();
+		return NULL;
+	}
+	// GSM 05.02 6.5.3: the group listens in multiframes where
+	// (FN div 51) mod BS_PA_MFRMS = PAGING_GROUP div (N div BS_PA_MFRMS),
+	// in the block PAGING_GROUP mod (N div BS_PA_MFRMS).
+	unsigned group = ((when.FN()/51) % mMultiframes)*mBlocks + block;
+	// Mobiles of unknown group take turns at the head with the group's own,
+	// so neither can starve the other.
+	mAnyFirst[group] = !mAnyFirst[group];
+	L3Frame* frame = mAnyFirst[group] ? pack(mAnyGroup,mGroups[group]) : pack(mGroups[group],mAnyGroup);
+	mLock.unlock();
+	return frame;
 }
 
-void Pager::serviceLoop()
-{
-	while (mRunning) {
-
-		LOG(DEBUG) << "Pager blocking for signal";
-		mLock.lock();
-		while (mPageIDs.size()==0) mPageSignal.wait(mLock);
-		mLock.unlock();
 
-		// page everything
-		pageAll();
 
-		// Wait for pending activity to clear the channel.
-		// This wait is what causes PCH to have lower priority than AGCH.
-		unsigned load = gBTS.getPCH()->load();
-		LOG(DEBUG) << "Pager waiting for " << load << " multiframes";
-		if (load) sleepFrames(51*load);
-	}
+size_t Pager::pagingEntryListSize()
+{
+	mLock.lock();
+	size_t retVal = mIndex.size();
+	mLock.unlock();
+	return retVal;
 }
 
 
 
 void Pager::dump(ostream& os) const
 {
-	PagingEntryList::const_iterator lp = mPageIDs.begin();
-	while (lp != mPageIDs.end()) {
-		os << lp->ID() << " " << lp->type() << " " << lp->expired() << endl;
-		++lp;
+	mLock.lock();
+	for (int g=-1; g<(int)mGroups.size(); g++) {
+		const PagingEntryList& q = g<0 ? mAnyGroup : mGroups[g];
+		PagingEntryList::const_iterator lp = q.begin();
+		while (lp != q.end()) {
+			os << lp->ID() << " " << lp->type() << " " << lp->expired() << " group=" << lp->group();
+			if (!(lp->pagedID()==lp->ID())) os << " as " << lp->pagedID();
+			os << endl;
+			++lp;
+		}
 	}
+	os << "requests type1=" << mRequests[0] << " type2=" << mRequests[1] << " type3=" << mRequests[2];
+	os << " mobiles paged=" << mPages << endl;
+	mLock.unlock();
 }
 
 
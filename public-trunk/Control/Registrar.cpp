@@ -0,0 +1,199 @@
+/**@file Pipelined SIP registration with a short-lived result cache. */
+
+/*
+* Copyright 2008, 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+
+#include "Registrar.h"
+#include <SIPEngine.h>
+#include <SIPUtility.h>
+#include <Logger.h>
+
+
+using namespace std;
+using namespace SIP;
+using namespace Control;
+
+
+
+Registrar::Registrar()
+	:mInFlight(0),mPurgeSize(1024),
+	mPositiveTTL(0),mNegativeTTL(0),
+	mRequests(0),mHits(0),mJoined(0),mSent(0),mTimeouts(0)
+{}
+
+
+void Registrar::start(unsigned window, unsigned positiveTTL, unsigned negativeTTL)
+{
+	assert(!running());
+	if (window==0) window = 1;
+	mPositiveTTL = positiveTTL*1000;
+	mNegativeTTL = negativeTTL*1000;
+	for (unsigned i=0; i<window; i++) {
+		Thread* thread = new Thread;
+		mSenders.push_back(thread);
+		thread->start((void*(*)(void*))RegistrarServiceLoop,this,"register");
+	}
+	LOG(INFO) << "started " << window << " registration senders";
+}
+
+
+Registrar::Result Registrar::request(const string& IMSI)
+{
+	assert(running());
+	mLock.lock();
+	mRequests++;
+	if (mEntries.size()>=mPurgeSize) purge();
+	EntryMap::iterator itr = mEntries.find(IMSI);
+	if (itr!=mEntries.end()) {
+		Result result = itr->second.mResult;
+		if (result==Pending) {
+			mJoined++;
+			mLock.unlock();
+			return Pending;
+		}
+		if (!itr->second.mExpiry.passed()) {
+			mHits++;
+			mLock.unlock();
+			LOG(DEBUG) << "IMSI" << IMSI << " " << result << " from cache";
+			return result;
+		}
+		itr->second.mResult = Pending;
+	} else {
+		mEntries[IMSI] = Entry();
+	}
+	mQueue.push_back(IMSI);
+	mQueueSignal.signal();
+	mLock.unlock();
+	return Pending;
+}
+
+
+Registrar::Result Registrar::wait(const string& IMSI, unsigned timeout)
+{
+	Timeval deadline(timeout);
+	mLock.lock();
+	Result result = TimedOut;
+	while (true) {
+		EntryMap::iterator itr = mEntries.find(IMSI);
+		// Purged, which takes a long wait after the result came in.
+		if (itr==mEntries.end()) break;
+		if (itr->second.mResult!=Pending) {
+			result = itr->second.mResult;
+			break;
+		}
+		if (deadline.passed()) break;
+		mDoneSignal.wait(mLock,deadline.remaining());
+	}
+	mLock.unlock();
+	return result;
+}
+
+
+void Registrar::serviceLoop()
+{
+	while (true) {
+		mLock.lock();
+		while (mQueue.empty()) mQueueSignal.wait(mLock);
+		string IMSI = mQueue.front();
+		mQueue.pop_front();
+		mInFlight++;
+		mSent++;
+		mLock.unlock();
+
+		Result result;
+		try {
+			SIPEngine engine;
+			engine.User(IMSI.c_str());
+			result = engine.Register() ? Registered : Rejected;
+		}
+		catch (SIPTimeout) {
+			result = TimedOut;
+		}
+		LOG(INFO) << "IMSI" << IMSI << " " << result;
+
+		mLock.lock();
+		mInFlight--;
+		Entry& entry = mEntries[IMSI];
+		entry.mResult = result;
+		// A timeout is handed to the waiters but not cached.
+		switch (result) {
+			case Registered: entry.mExpiry = Timeval(mPositiveTTL); break;
+			case Rejected: entry.mExpiry = Timeval(mNegativeTTL); break;
+			default: entry.mExpiry = Timeval(); mTimeouts++; break;
+		}
+		mDoneSignal.broadcast();
+		mLock.unlock();
+	}
+}
+
+
+void* Control::RegistrarServiceLoop(Registrar* registrar)
+{
+	registrar->serviceLoop();
+	return NULL;
+}
+
+
+void Registrar::purge()
+{
+	EntryMap::iterator itr = mEntries.begin();
+	while (itr!=mEntries.end()) {
+		EntryMap::iterator here = itr++;
+		if (here->second.mResult==Pending) continue;
+		if (here->second.mExpiry.passed()) mEntries.erase(here);
+	}
+	// Keep purges to one per doubling, so they cost O(1) per request.
+	mPurgeSize = 2*mEntries.size();
+	if (mPurgeSize<1024) mPurgeSize = 1024;
+}
+
+
+void Registrar::dump(ostream& os) const
+{
+	mLock.lock();
+	os << "registrations: requests=" << mRequests << " cached=" << mHits << " joined=" << mJoined;
+	os << " sent=" << mSent << " timeouts=" << mTimeouts;
+	os << " queued=" << mQueue.size() << " in flight=" << mInFlight << "/" << mSenders.size();
+	os << " entries=" << mEntries.size() << endl;
+	mLock.unlock();
+}
+
+
+ostream& Control::operator<<(ostream& os, Registrar::Result result)
+{
+	switch (result) {
+		case Registrar::Pending: os << "pending"; break;
+		case Registrar::Registered: os << "registered"; break;
+		case Registrar::Rejected: os << "rejected"; break;
+		case Registrar::TimedOut: os << "timed out"; break;
+		default: os << "?" << (int)result << "?";
+	}
+	return os;
+}
+
+
+// vim: ts=4 sw=4
@@ -0,0 +1,156 @@
+/**@file Call reactor, multiplexing in-call service onto a few threads. */
+/*
+* Copyright 2008, 2009, 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef REGISTRAR_H
+#define REGISTRAR_H
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include <ostream>
+
+#include <Threads.h>
+#include <Timeval.h>
+
+
+namespace Control {
+
+
+/**
+	Registers IMSIs with the SIP server apart from the SDCCH that asked.
+	A location update starts its REGISTER with request() and collects the
+	result with wait(), so the SIP round trip overlaps its other RR/MM work.
+	- Up to a window of REGISTERs are in flight at once, one per sender thread;
+	  the rest queue.
+	- Requests for an IMSI already queued or in flight share its REGISTER.
+	- Results are cached briefly, positive and negative apart, so repeated
+	  location updates in a storm complete without a REGISTER at all.
+	  Timeouts are not cached.
+*/
+class Registrar {
+
+	public:
+
+	/** Where an IMSI's registration stands. */
+	enum Result {
+		Pending,		///< queued or in flight
+		Registered,		///< 200 OK
+		Rejected,		///< a final error response
+		TimedOut		///< no final response from the server
+	};
+
+	private:
+
+	/** An IMSI's latest registration. */
+	class Entry {
+
+		public:
+
+		Result mResult;
+		Timeval mExpiry;		///< when a cached result lapses
+
+		Entry():mResult(Pending) {}
+	};
+
+	typedef std::map<std::string,Entry> EntryMap;
+
+	mutable Mutex mLock;
+	EntryMap mEntries;						///< pending and cached registrations
+	std::deque<std::string> mQueue;			///< IMSIs waiting for a sender
+	Signal mQueueSignal;					///< signalled when mQueue is written
+	Signal mDoneSignal;						///< broadcast when a registration completes
+	std::vector<Thread*> mSenders;
+	unsigned mInFlight;						///< REGISTERs being sent
+	unsigned mPurgeSize;					///< entries that trigger the next purge
+
+	/**@name Cache lifetimes, in ms. */
+	//@{
+	long mPositiveTTL;
+	long mNegativeTTL;
+	//@}
+
+	/**@name Statistics. */
+	//@{
+	unsigned long mRequests;
+	unsigned long mHits;					///< answered from the cache
+	unsigned long mJoined;					///< shared a pending REGISTER
+	unsigned long mSent;					///< REGISTERs sent
+	unsigned long mTimeouts;
+	//@}
+
+	public:
+
+	Registrar();
+
+	/**
+		Start the sender threads.
+		@param window REGISTERs in flight at most.
+		@param positiveTTL Seconds a success is cached.
+		@param negativeTTL Seconds a rejection is cached.
+	*/
+	void start(unsigned window, unsigned positiveTTL, unsigned negativeTTL);
+
+	bool running() const { return mSenders.size()>0; }
+
+	/**
+		Start registering an IMSI unless a result is cached or a REGISTER is pending.
+		@return The cached result, or Pending.
+	*/
+	Result request(const std::string& IMSI);
+
+	/**
+		Wait for an IMSI's registration, after request().
+		@param timeout The longest wait in ms.
+		@return The result, or TimedOut if the wait ran out first.
+	*/
+	Result wait(const std::string& IMSI, unsigned timeout);
+
+	/** Sender thread loop.  Never returns. */
+	void serviceLoop();
+
+	void dump(std::ostream& os) const;
+
+	private:
+
+	/** Drop lapsed results.  Caller holds mLock. */
+	void purge();
+};
+
+
+/** Sender thread entry for Registrar. */
+void* RegistrarServiceLoop(Registrar*);
+
+
+std::ostream& operator<<(std::ostream& os, Registrar::Result);
+
+
+}	// namespace Control
+
+
+#endif
+
+// vim: ts=4 sw=4
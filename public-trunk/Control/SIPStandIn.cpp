@@ -0,0 +1,401 @@
+/**@file SIPEngine and SIPInterface without osip or ortp, answering for Asterisk and smqueue. */
+/*
+* Copyright 2008, 2009, 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "SIPStandIn.h"
+#include "ControlCommon.h"
+
+#include <SIPEngine.h>
+#include <SIPInterface.h>
+#include <GSMConfig.h>
+#include <Logger.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+using namespace std;
+using namespace SIP;
+using namespace GSM;
+using namespace Control;
+
+
+static SIPStandInObserver* sObserver = NULL;
+
+static const char* sCallerID = "2125551212";
+
+
+void SIP::standInObserver(SIPStandInObserver* observer)
+{
+	sObserver = observer;
+}
+
+
+/** Tell the observer about a request from the BTS. */
+static void request(const char* method)
+{
+	LOG(DEBUG) << method << " from the BTS";
+	if (sObserver) sObserver->request(method);
+}
+
+
+bool SIP::standInOriginate(const string& callID, const char* IMSI, const char* message)
+{
+	// The same channel checks as SIPInterface::checkInvite.
+	ChannelType requiredChannel;
+	bool channelAvailable;
+	L3CMServiceType::TypeCode serviceType;
+	if (!message) {
+		if (gConfig.defines("GSM.VEA")) {
+			requiredChannel = TCHFType;
+			channelAvailable = gBTS.TCHAvailable();
+		} else {
+			requiredChannel = SDCCHType;
+			channelAvailable = gBTS.SDCCHAvailable() && gBTS.TCHAvailable();
+		}
+		serviceType = L3CMServiceType::MobileTerminatedCall;
+	} else {
+		requiredChannel = SDCCHType;
+		channelAvailable = gBTS.SDCCHAvailable();
+		serviceType = L3CMServiceType::MobileTerminatedShortMessage;
+	}
+	if (!channelAvailable) {
+		LOG(NOTICE) << "MT CONGESTION, no " << requiredChannel << " availble for assignment";
+		return false;
+	}
+
+	L3MobileIdentity mobileID(IMSI);
+	TransactionEntry transaction(mobileID,serviceType,sCallerID);
+	transaction.SIP().User(callID.c_str(),IMSI,sCallerID,gConfig.getStr("Asterisk.IP"));
+	if (message) transaction.message(message);
+	LOG(INFO) << "MT request " << callID << " for " << mobileID;
+	gTransactionTable.add(transaction);
+	gBTS.pager().addID(mobileID,requiredChannel,transaction);
+	return true;
+}
+
+
+
+
+ostream& SIP::operator<<(ostream& os, SIP::SIPState s)
+{
+	switch(s)
+	{	
+		case NullState:		os<<"Null"; break;
+		case Timeout :	 	os<<"Timeout"; break;
+		case Starting : 	os<<"Starting"; break;
+		case Proceeding : 	os<<"Proceeding"; break;
+		case Ringing : 		os<<"Ringing"; break;
+		case Connecting : 	os<<"Connecting"; break;
+		case Active :		os<<"Active"; break;
+		case Fail:			os<<"Fail"; break; 
+		case Busy:			os<<"Busy"; break;
+		case Clearing:		os<<"Clearing"; break;
+		case Cleared:		os<<"Cleared"; break;
+		case MessageSubmit: os<<"SMS-Submit"; break;
+		default: os << "??" << (int)s << "??";
+	}
+	return os;
+}
+
+
+
+SIPEngine::~SIPEngine()
+{
+}
+
+
+void SIPEngine::User( const char * IMSI )
+{
+	unsigned id = random();
+	char tmp[20];
+	sprintf(tmp, "%u", id);
+	mCallID = tmp; 
+	mSIPUsername = string("IMSI") + IMSI;
+}
+
+
+void SIPEngine::User( const char * wCallID, const char * IMSI, const char *origID, const char *origHost) 
+{
+	mSIPUsername = string("IMSI") + IMSI;
+	mCallID = wCallID;
+	mRemoteUsername = origID;
+	mRemoteDomain = origHost;
+}
+
+
+bool SIPEngine::Register( Method wMethod )
+{
+	request("REGISTER");
+	return true;
+}
+
+
+SIPState SIPEngine::MOCSendINVITE( const char * wCalledUsername, 
+	const char * wCalledDomain , short wRtp_port, unsigned  wCodec)
+{
+	request("INVITE");
+	mRemoteUsername = wCalledUsername;
+	mRemoteDomain = wCalledDomain;
+	mRTPPort = wRtp_port;
+	mCodec = wCodec;
+	mState = Starting;
+	return mState;
+}
+
+
+SIPState SIPEngine::MOCResendINVITE()
+{
+	return mState;
+}
+
+
+SIPState SIPEngine::MOCWaitForOK()
+{
+	// 100 Trying, 180 Ringing and 200 OK, one per call, as Asterisk sends them.
+	switch (mState) {
+		case Starting: mState = Proceeding; break;
+		case Proceeding: mState = Ringing; break;
+		case Ringing: mState = Active; break;
+		default: break;
+	}
+	return mState;
+}
+
+
+SIPState SIPEngine::MOCSendACK()
+{
+	request("ACK");
+	mState = Active;
+	return mState;
+}
+
+
+SIPState SIPEngine::MODSendBYE()
+{
+	request("BYE");
+	mState = Clearing;
+	return mState;
+}
+
+
+SIPState SIPEngine::MODResendBYE()
+{
+	return mState;
+}
+
+
+SIPState SIPEngine::MODWaitForOK()
+{
+	mState = Cleared;
+	return mState;
+}
+
+
+SIPState SIPEngine::MTDCheckBYE()
+{
+	// The far end never hangs up first.
+	return mState;
+}
+
+
+SIPState SIPEngine::MTDSendOK()
+{
+	mState = Cleared;
+	return mState;
+}
+
+
+SIPState SIPEngine::MTCSendTrying()
+{
+	return mState;
+}
+
+
+SIPState SIPEngine::MTCSendRinging()
+{
+	mState = Proceeding;
+	return mState;
+}
+
+
+SIPState SIPEngine::MTCSendOK( short wRTPPort, unsigned wCodec )
+{
+	mRTPPort = wRTPPort;
+	mCodec = wCodec;
+	mState = Connecting;
+	if (sObserver) sObserver->answered(mCallID);
+	return mState;
+}
+
+
+SIPState SIPEngine::MTCWaitForACK()
+{
+	// The ACK follows the OK at once; before the OK, nothing comes.
+	if (mState==Connecting) mState = Active;
+	else if (mState!=Active) mState = Timeout;
+	return mState;
+}
+
+
+void SIPEngine::saveINVITE(const osip_message_t *)
+{
+}
+
+
+void SIPEngine::saveOK(const osip_message_t *)
+{
+}
+
+
+void SIPEngine::saveBYE(const osip_message_t *)
+{
+}
+
+
+void SIPEngine::InitRTP(const osip_message_t *)
+{
+	// The far end is an echo on our own RTP port.
+	mRTPRemoteIP = "127.0.0.1";
+	mRTPRemotePort = mRTPPort;
+}
+
+
+void SIPEngine::MTCInitRTP()
+{
+	InitRTP(NULL);
+}
+
+
+void SIPEngine::MOCInitRTP()
+{
+	InitRTP(NULL);
+}
+
+
+void SIPEngine::TxFrame( unsigned char * )
+{
+}
+
+
+int SIPEngine::RxFrame(unsigned char * )
+{
+	return 0;
+}
+
+
+void SIPEngine::RTPNonBlocking()
+{
+	mRTPNonBlocking = true;
+}
+
+
+int SIPEngine::RTPSocket() const
+{
+	return -1;
+}
+
+
+SIPState SIPEngine::MOSMSSendMESSAGE(const char * wCalledUsername, 
+	const char * wCalledDomain , const char *messageText, bool plainText)
+{
+	request("MESSAGE");
+	mRemoteUsername = wCalledUsername;
+	mRemoteDomain = wCalledDomain;
+	mState = MessageSubmit;
+	return mState;
+}
+
+
+SIPState SIPEngine::MOSMSWaitForSubmit()
+{
+	mState = Cleared;
+	return mState;
+}
+
+
+SIPState SIPEngine::MTSMSSendOK()
+{
+	mState = Cleared;
+	if (sObserver) sObserver->answered(mCallID);
+	return mState;
+}
+
+
+bool SIPEngine::sendINFOAndWaitForOK(unsigned)
+{
+	request("INFO");
+	return true;
+}
+
+
+
+
+SIPInterface::SIPInterface()
+	:mSIPSocket()
+{
+	mSIPPort = gConfig.getNum("SIP.Port");
+	mAsteriskPort = gConfig.getNum("Asterisk.Port");
+	mMessengerPort = gConfig.getNum("Smqueue.Port");
+}
+
+
+void SIPInterface::start()
+{
+}
+
+
+void SIPInterface::drive()
+{
+}
+
+
+bool SIPInterface::addCall(const string &)
+{
+	return true;
+}
+
+
+bool SIPInterface::removeCall(const string &)
+{
+	return true;
+}
+
+
+int SIPInterface::fifoSize(const std::string&)
+{
+	// Nothing ever arrives after the fact.
+	return -1;
+}
+
+
+bool SIPInterface::listener(const std::string&, QueueListener*)
+{
+	return false;
+}
+
+
+
+// vim: ts=4 sw=4
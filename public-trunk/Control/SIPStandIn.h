@@ -0,0 +1,78 @@
+/**@file An in-process stand-in for the SIP side, for tests that link it in place of libSIP. */
+/*
+* Copyright 2008, 2009, 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef SIPSTANDIN_H
+#define SIPSTANDIN_H
+
+#include <string>
+
+
+namespace SIP {
+
+
+/**
+	Someone watching the SIP stand-in.
+
+	SIPStandIn.cpp defines SIPEngine and SIPInterface without osip or ortp.
+	It plays Asterisk and smqueue in-process: every request from the BTS
+	succeeds at once, and MT requests come from standInOriginate().
+	Calls echo their RTP back to the BTS.
+	A program links it instead of libSIP, never with it; Control/Makefile.am
+	checks that.
+*/
+class SIPStandInObserver {
+
+	public:
+
+	virtual ~SIPStandInObserver() {}
+
+	/** A request from the BTS, by SIP method name. */
+	virtual void request(const char* method) = 0;
+
+	/** The BTS accepted an MT request with a 200 OK. */
+	virtual void answered(const std::string& callID) = 0;
+};
+
+
+/** Set the one observer, or NULL for none.  Set it before any traffic. */
+void standInObserver(SIPStandInObserver* observer);
+
+
+/**
+	Start an MT request, as SIPInterface::checkInvite does for an INVITE or MESSAGE.
+	@param callID The SIP call ID.
+	@param IMSI The called IMSI, without the "IMSI" prefix.
+	@param message The RPDU, in hex, for an MT SMS, or NULL for an MT call.
+	@return false if there is no channel for it.
+*/
+bool standInOriginate(const std::string& callID, const char* IMSI, const char* message);
+
+
+}; // namespace SIP
+
+
+#endif
+// vim: ts=4 sw=4
@@ -0,0 +1,629 @@
+/**@file TMSI table, with its IMSI index and journaled persistence. */
+
+/*
+* Copyright 2008, 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+
+#include "TMSITable.h"
+#include <Logger.h>
+#include <Configuration.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+extern ConfigurationTable gConfig;
+
+using namespace std;
+using namespace Control;
+
+
+/** Journal records allowed beyond the table size before compacting. */
+static const unsigned minCompaction = 1000;
+
+static string journalPath(const string& path) { return path + ".journal"; }
+
+
+/** A buffered line reader for the snapshot and journal; fgets costs more than the parsing. */
+class LineReader {
+
+	private:
+
+	FILE* mFP;
+	char mBuffer[1<<16];
+	size_t mStart;				///< start of unread data in mBuffer
+	size_t mEnd;				///< end of data in mBuffer
+	bool mEOF;
+
+	public:
+
+	LineReader(FILE* wFP):mFP(wFP),mStart(0),mEnd(0),mEOF(false) {}
+
+	/** Return the next line, without its newline, or NULL at the end of the file. */
+	char* next()
+	{
+		while (true) {
+			char* start = mBuffer + mStart;
+			char* newline = (char*)memchr(start,'\n',mEnd-mStart);
+			if (newline) {
+				*newline = '\0';
+				mStart = newline - mBuffer + 1;
+				return start;
+			}
+			if (mEOF || mEnd-mStart==sizeof(mBuffer)-1) {
+				// The last line may lack its newline; an overlong one is returned in pieces.
+				if (mStart==mEnd) return NULL;
+				mBuffer[mEnd] = '\0';
+				mStart = mEnd;
+				return start;
+			}
+			memmove(mBuffer,start,mEnd-mStart);
+			mEnd -= mStart;
+			mStart = 0;
+			size_t got = fread(mBuffer+mEnd,1,sizeof(mBuffer)-1-mEnd,mFP);
+			if (got==0) mEOF = true;
+			mEnd += got;
+		}
+	}
+};
+
+
+
+
+void TMSIRecord::save(unsigned TMSI, FILE* fp) const
+{
+	fprintf(fp, "%10u %10u %10u %15s %15s\n", TMSI, mCreated.sec(), mTouched.sec(), mIMSI.c_str(), mIMEI.c_str());
+}
+
+
+/** Parse a space-led decimal field and advance past it; return false if there are no digits. */
+static bool parseUnsigned(const char*& line, unsigned& value)
+{
+	while (*line==' ') line++;
+	const char* start = line;
+	value = 0;
+	while (*line>='0' && *line<='9') value = value*10 + (*line++ - '0');
+	return line!=start;
+}
+
+
+unsigned TMSIRecord::parse(const char* line)
+{
+	// Hand-parsed rather than scanf'd; a million-entry table loads in a fraction of a second.
+	unsigned TMSI, created, touched;
+	if (!parseUnsigned(line,TMSI)) return 0;
+	if (!parseUnsigned(line,created)) return 0;
+	if (!parseUnsigned(line,touched)) return 0;
+	const char* field[2];
+	size_t length[2];
+	for (int i=0; i<2; i++) {
+		while (isspace(*line)) line++;
+		field[i] = line;
+		while (*line && !isspace(*line)) line++;
+		length[i] = line - field[i];
+		if (length[i]==0 || length[i]>15) return 0;
+	}
+	if (created > touched) return 0;
+	mIMSI.assign(field[0],length[0]);
+	mIMEI.assign(field[1],length[1]);
+	mTouched = Timeval(touched,0);
+	mCreated = Timeval(created,0);
+	return TMSI;
+}
+
+
+unsigned TMSIRecord::load(FILE* fp)
+{
+	char line[200];
+	if (!fgets(line,sizeof(line),fp)) return 0;
+	unsigned TMSI = parse(line);
+	if (!TMSI) LOG(ALARM) << "corrupt TMSI file";
+	return TMSI;
+}
+
+
+
+TMSITable::~TMSITable()
+{
+	if (mSyncThread) {
+		mLock.lock();
+		mStopping = true;
+		mSyncSignal.signal();
+		mLock.unlock();
+		mSyncThread->join();
+		delete mSyncThread;
+	}
+	mLock.lock();
+	syncLocked();
+	mLock.unlock();
+	if (mJournal) fclose(mJournal);
+}
+
+
+
+/**
+	Pack an IMSI of up to 18 digits, and its length, into an index key.
+	@return false if the IMSI is not a short digit string.
+*/
+static bool IMSIKey(const char* IMSI, uint64_t& key)
+{
+	uint64_t value = 0;
+	unsigned length = 0;
+	while (IMSI[length]) {
+		char c = IMSI[length];
+		if (c<'0' || c>'9' || length==18) return false;
+		value = value*10 + (c-'0');
+		length++;
+	}
+	key = ((uint64_t)length<<60) | value;
+	return true;
+}
+
+
+unsigned TMSITable::indexFindLocked(const char* IMSI) const
+{
+	uint64_t key;
+	if (IMSIKey(IMSI,key)) {
+		IMSIIndex::const_iterator idx = mIndex.find(key);
+		return idx==mIndex.end() ? 0 : idx->second;
+	}
+	std::map<std::string,unsigned>::const_iterator idx = mOddIndex.find(IMSI);
+	return idx==mOddIndex.end() ? 0 : idx->second;
+}
+
+
+void TMSITable::indexEraseLocked(const char* IMSI, unsigned TMSI)
+{
+	// Only if the index still points at this TMSI.
+	uint64_t key;
+	if (IMSIKey(IMSI,key)) {
+		IMSIIndex::iterator idx = mIndex.find(key);
+		if (idx!=mIndex.end() && idx->second==TMSI) mIndex.erase(idx);
+		return;
+	}
+	std::map<std::string,unsigned>::iterator idx = mOddIndex.find(IMSI);
+	if (idx!=mOddIndex.end() && idx->second==TMSI) mOddIndex.erase(idx);
+}
+
+
+void TMSITable::insertLocked(unsigned TMSI, const TMSIRecord& rec)
+{
+	// TMSIs are assigned in order, so the end is almost always the right hint.
+	size_t before = mMap.size();
+	TMSIMap::iterator itr = mMap.insert(mMap.end(),TMSIMap::value_type(TMSI,rec));
+	if (mMap.size()==before) {
+		indexEraseLocked(itr->second.IMSI(),TMSI);
+		itr->second = rec;
+	}
+	uint64_t key;
+	if (IMSIKey(rec.IMSI(),key)) mIndex[key] = TMSI;
+	else mOddIndex[rec.IMSI()] = TMSI;
+}
+
+
+void TMSITable::eraseLocked(TMSIMap::iterator itr)
+{
+	indexEraseLocked(itr->second.IMSI(),itr->first);
+	mMap.erase(itr);
+}
+
+
+void TMSITable::clearLocked()
+{
+	mMap.clear();
+	mIndex.clear();
+	mOddIndex.clear();
+}
+
+
+
+void TMSITable::journalLocked(char op, unsigned TMSI, const char* arg)
+{
+	if (!mJournal) return;
+	if (arg) fprintf(mJournal,"%c %u %s\n",op,TMSI,arg);
+	else fprintf(mJournal,"%c %u\n",op,TMSI);
+	journaledLocked();
+}
+
+
+void TMSITable::journalLocked(unsigned TMSI, const TMSIRecord& rec)
+{
+	if (!mJournal) return;
+	fputs("A ",mJournal);
+	rec.save(TMSI,mJournal);
+	journaledLocked();
+}
+
+
+void TMSITable::journaledLocked()
+{
+	// Flushed to the kernel on every record, so a crash of the process loses nothing.
+	// Surviving a power loss takes the sync, which is batched unless the interval is 0.
+	fflush(mJournal);
+	mDirty = true;
+	if (mSyncInterval==0) syncLocked();
+	mJournalRecords++;
+	// Compacting when the journal outgrows the table keeps the
+	// amortized cost of a change constant and bounds the replay at load.
+	if (mJournalRecords > mMap.size()+minCompaction) compactLocked();
+}
+
+
+bool TMSITable::writeSnapshotLocked(const char* filename) const
+{
+	string temp = string(filename) + ".tmp";
+	FILE* fp = fopen(temp.c_str(),"w");
+	if (!fp) {
+		LOG(ALARM) << "TMSITable cannot open " << temp << " for writing";
+		return false;
+	}
+	static char buffer[1<<16];
+	setvbuf(fp,buffer,_IOFBF,sizeof(buffer));
+	TMSIMap::const_iterator tp = mMap.begin();
+	while (tp != mMap.end()) {
+		tp->second.save(tp->first,fp);
+		++tp;
+	}
+	bool ok = (fflush(fp)==0) && (fsync(fileno(fp))==0);
+	ok = (fclose(fp)==0) && ok;
+	// The rename is atomic, so the snapshot is always either the old one or the new one.
+	if (!ok || rename(temp.c_str(),filename)!=0) {
+		LOG(ALARM) << "TMSITable cannot write " << filename;
+		unlink(temp.c_str());
+		return false;
+	}
+	return true;
+}
+
+
+void TMSITable::compactLocked()
+{
+	if (mPath.empty()) return;
+	LOG(INFO) << "compacting TMSI table to " << mPath << ", " << mMap.size() << " entries, " << mJournalRecords << " journal records";
+	// If this fails, keep appending to the old journal.
+	if (!writeSnapshotLocked(mPath.c_str())) return;
+	// A crash before this truncation only means replaying records the snapshot already has.
+	// The snapshot was synced and holds every journaled change.
+	if (mJournal) fclose(mJournal);
+	mDirty = false;
+	mJournal = fopen(journalPath(mPath).c_str(),"w");
+	if (!mJournal) LOG(ALARM) << "TMSITable cannot open " << journalPath(mPath) << " for writing";
+	mJournalRecords = 0;
+}
+
+
+void TMSITable::replayLocked(char* line)
+{
+	char op = line[0];
+	char* end;
+	unsigned TMSI = strtoul(line+1,&end,10);
+	switch (op) {
+		case 'A': {
+			TMSIRecord rec;
+			if (rec.parse(line+1)) {
+				insertLocked(TMSI,rec);
+				return;
+			}
+			break;
+		}
+		case 'E': {
+			TMSIMap::iterator itr = mMap.find(TMSI);
+			if (itr!=mMap.end()) eraseLocked(itr);
+			return;
+		}
+		case 'I': {
+			TMSIMap::iterator itr = mMap.find(TMSI);
+			while (isspace(*end)) end++;
+			char* imei = end;
+			while (*end && !isspace(*end)) end++;
+			*end = '\0';
+			if (itr!=mMap.end()) itr->second.IMEI(imei);
+			return;
+		}
+		case 'C':
+			clearLocked();
+			return;
+	}
+	LOG(ALARM) << "corrupt TMSI journal record: " << line;
+}
+
+
+
+unsigned TMSITable::assign(const char* IMSI, const char* IMEI)
+{
+	purge();
+	mLock.lock();
+	// Is this IMSI already in here?
+	unsigned oldTMSI = TMSI(IMSI);
+	if (oldTMSI) {
+		mLock.unlock();
+		return oldTMSI;
+	}
+	unsigned TMSI = mCounter++;
+	TMSIRecord rec(IMSI, IMEI);
+	insertLocked(TMSI,rec);
+	journalLocked(TMSI,rec);
+	mLock.unlock();
+	return TMSI;
+}
+
+
+bool TMSITable::setIMEI(unsigned TMSI, const std::string& IMEI)
+{
+	mLock.lock();
+	TMSIMap::iterator iter = mMap.find(TMSI);
+	if (iter==mMap.end()) {
+		mLock.unlock();
+		return false;
+	}
+	iter->second.IMEI(IMEI);
+	iter->second.touch();
+	journalLocked('I',TMSI,IMEI.c_str());
+	mLock.unlock();
+	return true;
+}
+
+
+bool TMSITable::find(unsigned TMSI, TMSIRecord& target)
+{
+	mLock.lock();
+	TMSIMap::iterator iter = mMap.find(TMSI);
+	if (iter==mMap.end()) {
+		mLock.unlock();
+		return false;
+	}
+	target = iter->second;
+	// Is it too old?
+	if (target.age() > 3600*gConfig.getNum("Control.TMSITable.MaxAge")) {
+		eraseLocked(iter);
+		journalLocked('E',TMSI);
+		mLock.unlock();
+		return false;
+	}
+	iter->second.touch();
+	mLock.unlock();
+	return true;
+}
+
+const char* TMSITable::IMSI(unsigned TMSI) const
+{
+	mLock.lock();
+	TMSIMap::const_iterator iter = mMap.find(TMSI);
+	mLock.unlock();
+	if (iter==mMap.end()) return NULL;
+	iter->second.touch();
+	return iter->second.IMSI();
+}
+
+unsigned TMSITable::TMSI(const char* IMSI) const
+{
+	unsigned TMSI = 0;
+	mLock.lock();
+	unsigned candidate = indexFindLocked(IMSI);
+	if (candidate) {
+		TMSIMap::const_iterator itr = mMap.find(candidate);
+		if (itr!=mMap.end()) {
+			TMSI = itr->first;
+			itr->second.touch();
+		}
+	}
+	mLock.unlock();
+	return TMSI;
+}
+
+
+
+
+void TMSITable::erase(unsigned TMSI)
+{
+	mLock.lock();
+	TMSIMap::iterator iter = mMap.find(TMSI);
+	if (iter!=mMap.end()) {
+		eraseLocked(iter);
+		journalLocked('E',TMSI);
+	}
+	mLock.unlock();
+}
+
+
+void TMSITable::clear()
+{
+	mLock.lock();
+	clearLocked();
+	journalLocked('C',0);
+	mLock.unlock();
+}
+
+
+
+
+size_t TMSITable::size() const {
+	mLock.lock();
+	size_t retVal = mMap.size();
+	mLock.unlock();
+	return retVal;
+}
+
+
+void TMSITable::purge()
+{
+	mLock.lock();
+	// We rely on the fact the TMSIs are assigned in numeric order
+	// to erase the oldest first.
+	size_t maxSize = gConfig.getNum("Control.TMSITable.MaxSize");
+	while (mMap.size()>maxSize) {
+		unsigned TMSI = mMap.begin()->first;
+		eraseLocked(mMap.begin());
+		journalLocked('E',TMSI);
+	}
+	mLock.unlock();
+}
+
+
+
+size_t printAge(unsigned seconds, char *buf)
+{
+	static const unsigned k=5;
+	if (seconds<k*60) return sprintf(buf,"%4us",seconds);
+	unsigned minutes = (seconds+30) / 60;
+	if (minutes<k*60) return sprintf(buf,"%4um",minutes);
+	unsigned hours = (minutes+30) / 60;
+	if (hours<k*24) return sprintf(buf,"%4uh", hours);
+	return sprintf(buf,"%4ud",(hours+12)/24);
+}
+
+ostream& Control::operator<<(ostream& os, const TMSIRecord& rec)
+{
+	char buf[100];
+	char ageStr[10];
+	printAge(rec.age(),ageStr);
+	char touchedStr[10];
+	printAge(rec.touched(),touchedStr);
+	sprintf(buf,"%15s %15s %s %s", rec.IMSI(), rec.IMEI(), ageStr, touchedStr);
+	os << buf;
+	return os;
+}
+
+
+void TMSITable::dump(ostream& os) const
+{
+	mLock.lock();
+	TMSIMap::const_iterator tp = mMap.begin();
+	while (tp != mMap.end()) {
+		os << hex << "0x" << tp->first << " " << dec << tp->second << endl;
+		++tp;
+	}
+	mLock.unlock();
+}
+
+
+void TMSITable::syncLocked()
+{
+	if (!mDirty || !mJournal) return;
+	mDirty = false;
+	if (fdatasync(fileno(mJournal))!=0) LOG(ALARM) << "TMSITable cannot sync " << journalPath(mPath);
+}
+
+
+void TMSITable::syncLoop()
+{
+	mLock.lock();
+	while (!mStopping) {
+		// With an interval of 0 the writers sync, so just idle.
+		mSyncSignal.wait(mLock,mSyncInterval ? mSyncInterval : 1000);
+		if (!mDirty || !mJournal) continue;
+		// Sync a duplicate outside the lock, so changes are not held up by the disk
+		// and a compaction can replace the journal meanwhile.
+		int fd = dup(fileno(mJournal));
+		mDirty = false;
+		mLock.unlock();
+		if ((fd<0) || (fdatasync(fd)!=0)) LOG(ALARM) << "TMSITable cannot sync " << journalPath(mPath);
+		if (fd>=0) close(fd);
+		mLock.lock();
+	}
+	mLock.unlock();
+}
+
+
+static void* TMSITableSyncLoop(TMSITable* table)
+{
+	table->syncLoop();
+	return NULL;
+}
+
+
+void TMSITable::save(const char* filename)
+{
+	LOG(INFO) << "saving TMSI table to " << filename;
+	mLock.lock();
+	if (mPath==filename) compactLocked();
+	else writeSnapshotLocked(filename);
+	mLock.unlock();
+}
+
+
+void TMSITable::load(const char* filename)
+{
+	mLock.lock();
+	clearLocked();
+	syncLocked();
+	if (mJournal) fclose(mJournal);
+	mJournal = NULL;
+	mJournalRecords = 0;
+	mPath = filename;
+
+	FILE* fp = fopen(filename,"r");
+	if (!fp) {
+		LOG(ALARM) << "TMSITable cannot open " << filename << " for reading";
+	} else {
+		LOG(INFO) << "loading TMSI table from " << filename;
+		// Size the index for the file, about 60 bytes a record, to avoid rehashing.
+		struct stat st;
+		if (fstat(fileno(fp),&st)==0) mIndex.rehash(st.st_size/60 + 1);
+		LineReader reader(fp);
+		while (char* line = reader.next()) {
+			if (line[0]=='\0') continue;
+			TMSIRecord val;
+			unsigned key = val.parse(line);
+			if (!key) {
+				LOG(ALARM) << "corrupt TMSI file";
+				break;
+			}
+			insertLocked(key,val);
+		}
+		fclose(fp);
+	}
+
+	string journal = journalPath(mPath);
+	fp = fopen(journal.c_str(),"r");
+	if (fp) {
+		LineReader reader(fp);
+		while (char* line = reader.next()) {
+			if (line[0]=='\0') continue;
+			replayLocked(line);
+			mJournalRecords++;
+		}
+		fclose(fp);
+		LOG(INFO) << "replayed " << mJournalRecords << " TMSI journal records from " << journal;
+	}
+	mJournal = fopen(journal.c_str(),"a");
+	if (!mJournal) LOG(ALARM) << "TMSITable cannot open " << journal << " for writing";
+	mDirty = false;
+	mSyncInterval = 1000;
+	if (gConfig.defines("Control.TMSITable.SyncInterval")) mSyncInterval = gConfig.getNum("Control.TMSITable.SyncInterval");
+	if (mSyncInterval && !mSyncThread) {
+		mSyncThread = new Thread;
+		mSyncThread->start((void*(*)(void*))TMSITableSyncLoop,this,"tmsi");
+	}
+
+	// Resume numbering after the loaded entries.
+	if (mMap.size() && mMap.rbegin()->first >= mCounter) mCounter = mMap.rbegin()->first + 1;
+	mLock.unlock();
+}
+
+
+// vim: ts=4 sw=4
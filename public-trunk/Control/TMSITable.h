@@ -0,0 +1,279 @@
+/**@file TMSI table, with its IMSI index and journaled persistence. */
+/*
+* Copyright 2008, 2009, 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#ifndef TMSITABLE_H
+#define TMSITABLE_H
+
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <stdint.h>
+#include <tr1/unordered_map>
+
+#include <Threads.h>
+#include <Timeval.h>
+
+
+namespace Control {
+
+
+/**@ TMSI mechanisms */
+//@{
+
+class TMSIRecord {
+
+	private:
+
+	std::string mIMSI;
+	std::string mIMEI;
+	Timeval mCreated;				///< Time when this TMSI was created.
+	mutable Timeval mTouched;		///< Time when this TMSI was last accessed.
+
+	public:
+
+	/** An empty record, to be filled by load() or parse(); it does not read the clock. */
+	TMSIRecord():mCreated(0,0),mTouched(0,0) {}
+	
+	TMSIRecord(const char* wIMSI, const char* wIMEI = NULL):
+		mIMSI(wIMSI), mIMEI(wIMEI!=NULL?wIMEI:"?")
+	{ }
+
+	const char* IMSI() const { return mIMSI.c_str(); }
+	const char* IMEI() const { return mIMEI.c_str(); }
+	void IMEI(const std::string &imei) { mIMEI = imei; }
+	void touch() const { mTouched.now(); }
+
+	/** Record age in seconds. */
+	unsigned age() const { return mCreated.elapsed()/1000; }
+
+	/** Time since last access in seconds. */
+	unsigned touched() const { return mTouched.elapsed()/1000; }
+
+	void save(unsigned TMSI, FILE*) const;
+
+	/**
+		Load a TMSI record from a file.
+		@return TMSI or 0 on read failure.
+	*/
+	unsigned load(FILE*);
+
+	/**
+		Parse a TMSI record from one line in the save() format.
+		@return TMSI or 0 on a malformed line.
+	*/
+	unsigned parse(const char* line);
+
+};
+
+std::ostream& operator<<(std::ostream&, const TMSIRecord&);
+
+typedef std::map<unsigned,TMSIRecord> TMSIMap;
+
+/**
+	The reverse index, IMSI to TMSI.
+	IMSIs are keyed as their digits packed with their length, so leading zeros count;
+	hashing an integer, with no string to copy, keeps loading a large table fast.
+*/
+typedef std::tr1::unordered_map<uint64_t,unsigned> IMSIIndex;
+
+
+/**
+	The TMSI table.
+	Entries are ordered by TMSI, which is also assignment order, and indexed
+	by IMSI in a hash table, so lookups in both directions are cheap.
+
+	Persistence is a snapshot file plus a journal of changes appended beside
+	it (the snapshot path with ".journal" added).  Each change appends one
+	line to the journal; when the journal outgrows the table it is compacted
+	into a new snapshot, written to a temporary file and renamed into place,
+	so a crash leaves either the old or the new snapshot intact.  Journal
+	records set state rather than modify it, so replaying a journal over a
+	snapshot that already includes some of it is harmless.
+
+	Each journal record is flushed to the kernel as it is written, so a
+	crash of the process loses nothing.  The fdatasync that makes records
+	survive a power loss is batched: a sync thread runs it at most every
+	Control.TMSITable.SyncInterval ms, so a power loss can lose the changes
+	of that last interval.  An interval of 0 syncs every record instead.
+*/
+class TMSITable {
+
+	private:
+
+	TMSIMap mMap;							///< IMSI/TMSI mapping
+	IMSIIndex mIndex;						///< IMSI to TMSI, for all-digit IMSIs
+	std::map<std::string,unsigned> mOddIndex;	///< IMSI to TMSI, for anything else
+	unsigned mCounter;						///< a counter to generate new TMSIs
+	mutable Mutex mLock;					///< concurrency control
+
+	/**@name Persistence. */
+	//@{
+	std::string mPath;						///< snapshot path, empty if not persistent
+	FILE* mJournal;							///< open journal, or NULL
+	unsigned mJournalRecords;				///< records in the journal since the last snapshot
+	unsigned mSyncInterval;					///< ms between journal syncs, 0 to sync every record
+	bool mDirty;							///< journal records not yet synced
+	bool mStopping;							///< tells the sync thread to exit
+	Signal mSyncSignal;						///< wakes the sync thread to exit
+	Thread* mSyncThread;					///< batches the journal syncs, or NULL
+	//@}
+
+
+	public:
+
+	TMSITable()
+		:mCounter(time(NULL)),
+		mJournal(NULL),
+		mJournalRecords(0),
+		mSyncInterval(0),
+		mDirty(false),
+		mStopping(false),
+		mSyncThread(NULL)
+	{}
+
+	~TMSITable();
+
+	/**
+		Create a new entry in the table.
+		@param IMSI	The IMSI to create an entry for.
+		@return The assigned TMSI.
+	*/
+	unsigned assign(const char* IMSI, const char* IMEI = NULL);
+
+	/**
+		Set IMEI for a selected TMSI.
+		@param TMSI	The TMSI to set IMEI for
+		@param IMEI	The IMEI to set.
+		@return true if the TMSI exists and we've set IMEI for it.
+	*/
+	bool setIMEI(unsigned TMSI, const std::string& IMEI);
+
+	/**
+		Find an IMSI in the table.
+		This is a log-time operation.
+		@param TMSI The TMSI to find.post to
+		@return Pointer to c-string IMSI or NULL.
+	*/
+	const char* IMSI(unsigned TMSI) const;
+
+
+	/**
+		Find an entry in the table.
+		This is a log-time operation.
+		@param TMSI The TMSI to find.
+		@param target A TMSI record to catch the result.
+		@return true if the TMSI was found.
+	*/
+	bool find(unsigned TMSI, TMSIRecord& target);
+
+	/**
+		Find a TMSI in the table.
+		This is a constant-time operation.
+		@param IMSI The IMSI to mach.
+		@return A TMSI value or zero on failure.
+	*/
+	unsigned TMSI(const char* IMSI) const;
+
+	/**
+		Update the record's timestamp.
+	*/
+	void touch(unsigned TMSI) const;
+
+	/**
+		Remove an entry from the table.
+		@param TMSI The TMSI to remove.
+	*/
+	void erase(unsigned TMSI);
+
+	/** Write entries as text to a stream. */
+	void dump(std::ostream&) const;
+	
+	/**
+		Save the table to a file, atomically.
+		Saving to the table's own snapshot path also empties its journal.
+	*/
+	void save(const char* filename);
+
+	/**
+		Load the table from a snapshot file and replay its journal.
+		The table then journals its changes there until the next load.
+	*/
+	void load(const char*filename);
+
+	/** Clear the table completely. */
+	void clear();
+
+	/** Sync thread loop; returns when the table is destroyed. */
+	void syncLoop();
+
+	size_t size() const;
+
+	// FIXME -- These are not thread safe and should be removed.
+	TMSIMap::const_iterator begin() const { return mMap.begin(); }
+	TMSIMap::const_iterator end() const { return mMap.end(); }
+
+	private:
+
+	/** Erase entries, oldest first, to limit the table size. */
+	void purge();
+
+	/**@name Table updates; caller holds mLock. */
+	//@{
+	unsigned indexFindLocked(const char* IMSI) const;
+	void indexEraseLocked(const char* IMSI, unsigned TMSI);
+	void insertLocked(unsigned TMSI, const TMSIRecord&);
+	void eraseLocked(TMSIMap::iterator);
+	void clearLocked();
+	//@}
+
+	/**@name Persistence; caller holds mLock. */
+	//@{
+	/** Journal an erase ('E'), IMEI update ('I') or clear ('C'). */
+	void journalLocked(char op, unsigned TMSI, const char* arg=NULL);
+	/** Journal an assignment. */
+	void journalLocked(unsigned TMSI, const TMSIRecord&);
+	/** Count a journal record, then compact if the journal has outgrown the table. */
+	void journaledLocked();
+	/** Write the snapshot; return false on failure. */
+	bool writeSnapshotLocked(const char* filename) const;
+	/** Snapshot to mPath and start an empty journal. */
+	void compactLocked();
+	/** Apply one journal line. */
+	void replayLocked(char* line);
+	/** Sync the journal to disk if it has unsynced records. */
+	void syncLocked();
+	//@}
+
+};
+
+//@}
+
+};	// namespace Control
+
+
+#endif
+// vim: ts=4 sw=4
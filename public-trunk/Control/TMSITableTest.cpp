@@ -0,0 +1,152 @@
+/*
+* Copyright 2008, 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+
+#include "TMSITable.h"
+#include <Logger.h>
+#include <iostream>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+ConfigurationTable gConfig;
+
+using namespace std;
+using namespace Control;
+
+
+static const char* gPath = "TMSITableTest.txt";
+static const char* gJournal = "TMSITableTest.txt.journal";
+
+
+static double now()
+{
+	struct timeval tv;
+	gettimeofday(&tv,NULL);
+	return tv.tv_sec + tv.tv_usec*1e-6;
+}
+
+
+static const char* imsi(unsigned i)
+{
+	static char buf[16];
+	sprintf(buf,"00101%010u",i);
+	return buf;
+}
+
+
+static void fresh()
+{
+	unlink(gPath);
+	unlink(gJournal);
+}
+
+
+/** Changes made through the journal come back on load. */
+static void testJournal()
+{
+	fresh();
+	unsigned a, b, c;
+	{
+		TMSITable table;
+		table.load(gPath);
+		a = table.assign(imsi(1));
+		b = table.assign(imsi(2),"123456789012345");
+		c = table.assign(imsi(3));
+		table.setIMEI(a,"490154203237518");
+		table.erase(b);
+	}
+	TMSITable table;
+	table.load(gPath);
+	cout << "reloaded " << table.size() << " entries (expect 2)" << endl;
+	TMSIRecord rec;
+	cout << "a " << (table.find(a,rec) ? rec.IMEI() : "missing") << " (expect 490154203237518)" << endl;
+	cout << "b " << (table.find(b,rec) ? "present" : "missing") << " (expect missing)" << endl;
+	cout << "c by IMSI " << (table.TMSI(imsi(3))==c ? "ok" : "wrong") << endl;
+	cout << "re-assign " << (table.assign(imsi(1))==a ? "keeps TMSI" : "new TMSI") << endl;
+	unsigned d = table.assign(imsi(4));
+	cout << "new TMSI " << (d>c ? "after" : "before") << " loaded ones" << endl;
+}
+
+
+/** Throughput of assign with 100k entries, against one full rewrite as before. */
+static void benchAssign()
+{
+	static const unsigned n = 100000;
+	fresh();
+	TMSITable table;
+	table.load(gPath);
+	double start = now();
+	for (unsigned i=0; i<n; i++) table.assign(imsi(i));
+	double fill = now()-start;
+	start = now();
+	for (unsigned i=0; i<n; i++) table.assign(imsi(i));
+	double again = now()-start;
+	start = now();
+	table.save(gPath);
+	double rewrite = now()-start;
+	cout << "assign new: " << (unsigned)(n/fill) << "/s" << endl;
+	cout << "assign existing: " << (unsigned)(n/again) << "/s" << endl;
+	cout << "full rewrite at " << n << " entries: " << rewrite*1000 << " ms, which every assign used to pay" << endl;
+}
+
+
+/** Load time for a million entries. */
+static void benchLoad()
+{
+	static const unsigned n = 1000000;
+	fresh();
+	{
+		TMSITable table;
+		for (unsigned i=0; i<n; i++) table.assign(imsi(i));
+		table.save(gPath);
+	}
+	TMSITable table;
+	double start = now();
+	table.load(gPath);
+	double load = now()-start;
+	cout << "load " << table.size() << " entries: " << load*1000 << " ms" << endl;
+	start = now();
+	unsigned found = 0;
+	for (unsigned i=0; i<n; i+=7) if (table.TMSI(imsi(i))) found++;
+	cout << "IMSI lookups: " << (unsigned)(found/(now()-start)) << "/s" << endl;
+}
+
+
+int main(int argc, char *argv[])
+{
+	gConfig.set("Control.TMSITable.MaxSize","2000000");
+	gConfig.set("Control.TMSITable.MaxAge","72");
+	gLogInit("WARN");
+
+	testJournal();
+	benchAssign();
+	benchLoad();
+	fresh();
+	return 0;
+}
+
+// vim: ts=4 sw=4
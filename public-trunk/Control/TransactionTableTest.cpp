@@ -0,0 +1,209 @@
+/*
+* Copyright 2008, 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+
+#include "TMSITable.h"
+/*
+	Load test for the TransactionTable.
+	Several threads each hold a block of concurrent transactions and look
+	them up by ID, by IMSI and by SIP call ID, as the call threads do.
+	The entries need the usual globals, so run this from a directory with an
+	OpenBTS.config.  SIP is the in-process stand-in, so no ports get bound
+	and OpenBTS may keep running.
+*/
+
+#include "ControlCommon.h"
+#include <GSMConfig.h>
+#include <SIPInterface.h>
+#include <TRXManager.h>
+#include <Logger.h>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+using namespace std;
+using namespace GSM;
+using namespace Control;
+
+
+ConfigurationTable gConfig("OpenBTS.config");
+SIP::SIPInterface gSIPInterface;
+GSMConfig gBTS;
+TransceiverManager gTRX(1, gConfig.getStr("TRX.IP"), gConfig.getNum("TRX.Port"));
+
+void shutdownOpenbts()
+{
+	kill(getpid(),SIGTERM);
+}
+
+
+static const unsigned numThreads = 8;
+static const unsigned perThread = 500;
+static const unsigned lookupPasses = 20;
+
+
+static double now()
+{
+	struct timeval tv;
+	gettimeofday(&tv,NULL);
+	return tv.tv_sec + tv.tv_usec*1e-6;
+}
+
+
+/** One thread's block of transactions. */
+struct Worker {
+	unsigned mBase;
+	unsigned mIDs[perThread];
+	unsigned mMisses;
+};
+
+static Worker gWorkers[numThreads];
+
+
+static void imsi(unsigned i, char* buf)
+{
+	sprintf(buf,"00101%010u",i);
+}
+
+static void callID(unsigned i, char* buf)
+{
+	sprintf(buf,"%u@loadtest",i);
+}
+
+
+void* adder(Worker* w)
+{
+	char IMSI[20], ID[32];
+	for (unsigned i=0; i<perThread; i++) {
+		imsi(w->mBase+i,IMSI);
+		callID(w->mBase+i,ID);
+		TransactionEntry transaction(L3MobileIdentity(IMSI),
+			L3CMServiceType::MobileTerminatedCall,
+			L3CallingPartyBCDNumber("5551212"));
+		transaction.SIP().User(ID,IMSI,"5551212","127.0.0.1");
+		transaction.Q931State(TransactionEntry::MTCConfirmed);
+		w->mIDs[i] = transaction.ID();
+		gTransactionTable.add(transaction);
+	}
+	return NULL;
+}
+
+
+void* finder(Worker* w)
+{
+	char IMSI[20], ID[32];
+	TransactionEntry transaction;
+	for (unsigned pass=0; pass<lookupPasses; pass++) {
+		for (unsigned i=0; i<perThread; i++) {
+			imsi(w->mBase+i,IMSI);
+			callID(w->mBase+i,ID);
+			if (!gTransactionTable.find(w->mIDs[i],transaction)) w->mMisses++;
+			if (!gTransactionTable.find(L3MobileIdentity(IMSI),transaction)) w->mMisses++;
+			else if (transaction.ID()!=w->mIDs[i]) w->mMisses++;
+			if (!gTransactionTable.findByCallID(ID,transaction)) w->mMisses++;
+			else if (transaction.ID()!=w->mIDs[i]) w->mMisses++;
+		}
+	}
+	return NULL;
+}
+
+
+void* updater(Worker* w)
+{
+	TransactionEntry transaction;
+	for (unsigned i=0; i<perThread; i++) {
+		if (!gTransactionTable.find(w->mIDs[i],transaction)) { w->mMisses++; continue; }
+		transaction.Q931State(TransactionEntry::Active);
+		gTransactionTable.update(transaction);
+		if (!gTransactionTable.find(w->mIDs[i],transaction)) { w->mMisses++; continue; }
+		transaction.Q931State(TransactionEntry::NullState);
+		gTransactionTable.update(transaction);
+	}
+	return NULL;
+}
+
+
+static double runAll(void*(*task)(Worker*))
+{
+	Thread threads[numThreads];
+	double start = now();
+	for (unsigned t=0; t<numThreads; t++) {
+		threads[t].start((void*(*)(void*))task,&gWorkers[t]);
+	}
+	for (unsigned t=0; t<numThreads; t++) threads[t].join();
+	return now() - start;
+}
+
+
+static unsigned misses()
+{
+	unsigned total = 0;
+	for (unsigned t=0; t<numThreads; t++) {
+		total += gWorkers[t].mMisses;
+		gWorkers[t].mMisses = 0;
+	}
+	return total;
+}
+
+
+int main(int argc, char *argv[])
+{
+	gLogInit("WARN");
+	const unsigned total = numThreads*perThread;
+
+	for (unsigned t=0; t<numThreads; t++) {
+		gWorkers[t].mBase = t*perThread;
+		gWorkers[t].mMisses = 0;
+	}
+
+	double dt = runAll(adder);
+	cout << total << " transactions added by " << numThreads << " threads in " << dt << " s, "
+		<< total/dt << "/s" << endl;
+	cout << "table size " << gTransactionTable.size() << ", misses " << misses() << endl;
+
+	dt = runAll(finder);
+	unsigned lookups = 3*total*lookupPasses;
+	cout << lookups << " lookups by ID, IMSI and call ID in " << dt << " s, "
+		<< lookups/dt << "/s, misses " << misses() << endl;
+
+	dt = runAll(updater);
+	cout << 2*total << " updates in " << dt << " s, " << 2*total/dt << "/s, misses " << misses() << endl;
+
+	// The entries are all dead now; lookups must miss and erase them as they go.
+	TransactionEntry transaction;
+	char IMSI[20];
+	unsigned found = 0;
+	for (unsigned i=0; i<total; i+=2) {
+		imsi(i,IMSI);
+		if (gTransactionTable.find(L3MobileIdentity(IMSI),transaction)) found++;
+	}
+	cout << "dead entries found " << found << ", table size " << gTransactionTable.size() << endl;
+	gTransactionTable.clearDeadEntries();
+	cout << "after sweep, table size " << gTransactionTable.size() << endl;
+}
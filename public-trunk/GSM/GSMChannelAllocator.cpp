@@ -0,0 +1,267 @@
+/*
+* Copyright 2008, 2009, 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "GSMChannelAllocator.h"
+#include "GSMLogicalChannel.h"
+#include <Logger.h>
+
+
+using namespace std;
+using namespace GSM;
+
+
+
+void ChannelWatch::expire()
+{
+	mAllocator->check(this);
+}
+
+
+
+const ChannelPolicy* ChannelPolicy::find(const string& name)
+{
+	static const PackPolicy pack;
+	static const SpreadPolicy spread;
+	static const QualityPolicy quality;
+	if (name=="pack") return &pack;
+	if (name=="spread") return &spread;
+	if (name=="quality") return &quality;
+	return NULL;
+}
+
+
+bool PackPolicy::better(const ChannelAllocator&, const ChannelGroup& a, const ChannelGroup& b) const
+{
+	if (a.mBusy!=b.mBusy) return a.mBusy > b.mBusy;
+	return a.mIndex < b.mIndex;
+}
+
+
+bool SpreadPolicy::better(const ChannelAllocator& allocator, const ChannelGroup& a, const ChannelGroup& b) const
+{
+	if (a.mARFCN!=b.mARFCN) {
+		unsigned aBusy = allocator.ARFCNBusy(a.mARFCN);
+		unsigned bBusy = allocator.ARFCNBusy(b.mARFCN);
+		if (aBusy!=bBusy) return aBusy < bBusy;
+	}
+	if (a.mBusy!=b.mBusy) return a.mBusy < b.mBusy;
+	return a.mIndex < b.mIndex;
+}
+
+
+bool QualityPolicy::better(const ChannelAllocator& allocator, const ChannelGroup& a, const ChannelGroup& b) const
+{
+	if (a.mFER!=b.mFER) return a.mFER < b.mFER;
+	static const PackPolicy pack;
+	return pack.better(allocator,a,b);
+}
+
+
+
+ChannelAllocator::ChannelAllocator(const char* wName)
+	:mName(wName),mFree(0),
+	mPolicy(ChannelPolicy::find("pack")),
+	mAllocations(0),mBlocked(0),mStale(0),mHoldTime(0.0F)
+{}
+
+
+void ChannelAllocator::add(LogicalChannel* chan)
+{
+	mLock.lock();
+	unsigned ARFCN = chan->ARFCN();
+	unsigned TN = chan->TN();
+	ChannelGroup* group = NULL;
+	for (unsigned i=0; i<mGroups.size(); i++) {
+		if ((mGroups[i]->mARFCN!=ARFCN) || (mGroups[i]->mTN!=TN)) continue;
+		group = mGroups[i];
+		break;
+	}
+	if (!group) {
+		group = new ChannelGroup(ARFCN,TN,mGroups.size());
+		mGroups.push_back(group);
+	}
+	ChannelWatch* watch = new ChannelWatch(chan,this,group);
+	mChannels.push_back(watch);
+	// Start out busy; the watch frees the channel when its timers say so.
+	group->mBusy++;
+	mARFCNBusy[ARFCN]++;
+	chan->recycleWatch(watch);
+	if (chan->recyclable()) release(watch);
+	else this->watch(watch);
+	mLock.unlock();
+}
+
+
+void ChannelAllocator::policy(const ChannelPolicy* wPolicy)
+{
+	assert(wPolicy);
+	mLock.lock();
+	mPolicy = wPolicy;
+	mLock.unlock();
+	LOG(INFO) << mName << " allocation policy " << wPolicy->name();
+}
+
+
+LogicalChannel* ChannelAllocator::allocate()
+{
+	mLock.lock();
+	while (true) {
+		ChannelGroup* best = NULL;
+		for (unsigned i=0; i<mGroups.size(); i++) {
+			ChannelGroup* group = mGroups[i];
+			if (group->mFree.empty()) continue;
+			if (!best || mPolicy->better(*this,*group,*best)) best = group;
+		}
+		if (!best) {
+			mBlocked++;
+			mLock.unlock();
+			return NULL;
+		}
+		ChannelWatch* watch = best->mFree.back();
+		take(watch);
+		LogicalChannel* chan = watch->mChan;
+		// Uplink traffic on a channel no one holds can restart its timers.
+		if (!chan->recyclable()) {
+			mStale++;
+			this->watch(watch);
+			continue;
+		}
+		chan->open();
+		watch->mHeld = true;
+		watch->mAllocated.now();
+		// T3101 now runs; the watch frees the channel if the handset never comes.
+		this->watch(watch);
+		mAllocations++;
+		mLock.unlock();
+		return chan;
+	}
+}
+
+
+unsigned ChannelAllocator::available() const
+{
+	mLock.lock();
+	unsigned retVal = mFree;
+	mLock.unlock();
+	return retVal;
+}
+
+
+unsigned ChannelAllocator::holdTime() const
+{
+	mLock.lock();
+	unsigned retVal = (unsigned)(mHoldTime + 0.5F);
+	mLock.unlock();
+	return retVal;
+}
+
+
+unsigned ChannelAllocator::ARFCNBusy(unsigned ARFCN) const
+{
+	map<unsigned,unsigned>::const_iterator itr = mARFCNBusy.find(ARFCN);
+	if (itr==mARFCNBusy.end()) return 0;
+	return itr->second;
+}
+
+
+void ChannelAllocator::check(ChannelWatch* watch)
+{
+	mLock.lock();
+	if (!watch->mFree) {
+		if (watch->mChan->recyclable()) release(watch);
+		else this->watch(watch);
+	}
+	mLock.unlock();
+}
+
+
+void ChannelAllocator::take(ChannelWatch* watch)
+{
+	assert(watch->mFree);
+	ChannelGroup* group = watch->mGroup;
+	// Usually the top of the stack.
+	for (unsigned i=group->mFree.size(); i>0; i--) {
+		if (group->mFree[i-1]!=watch) continue;
+		group->mFree.erase(group->mFree.begin()+(i-1));
+		break;
+	}
+	watch->mFree = false;
+	group->mBusy++;
+	mARFCNBusy[group->mARFCN]++;
+	mFree--;
+}
+
+
+void ChannelAllocator::release(ChannelWatch* watch)
+{
+	assert(!watch->mFree);
+	ChannelGroup* group = watch->mGroup;
+	group->mFree.push_back(watch);
+	watch->mFree = true;
+	group->mBusy--;
+	mARFCNBusy[group->mARFCN]--;
+	mFree++;
+	// Remember how the slot did, for QualityPolicy.
+	group->mFER = 0.75F*group->mFER + 0.25F*watch->mChan->FER();
+	// And how long the channel was held, for admission control.
+	if (watch->mHeld) {
+		float held = watch->mAllocated.elapsed();
+		if (mHoldTime==0.0F) mHoldTime = held;
+		else mHoldTime = 0.9F*mHoldTime + 0.1F*held;
+		watch->mHeld = false;
+	}
+}
+
+
+void ChannelAllocator::watch(ChannelWatch* watch)
+{
+	long remaining = watch->mChan->recycleRemaining();
+	// No timer running: only close() can free it, and close() arms the watch.
+	if (remaining<0) return;
+	// Due now but not yet seen as expired; look again on the next tick.
+	if (remaining==0) remaining = 1;
+	gTimerWheel.arm(watch,remaining);
+}
+
+
+void ChannelAllocator::dump(ostream& os) const
+{
+	mLock.lock();
+	os << mName << " policy=" << mPolicy->name();
+	os << " free=" << mFree << "/" << mChannels.size();
+	os << " allocations=" << mAllocations << " blocked=" << mBlocked << " stale=" << mStale;
+	os << " hold=" << (unsigned)(mHoldTime + 0.5F) << "ms" << endl;
+	for (unsigned i=0; i<mGroups.size(); i++) {
+		const ChannelGroup* group = mGroups[i];
+		os << "  ARFCN=" << group->mARFCN << " TN=" << group->mTN;
+		os << " busy=" << group->mBusy << " free=" << group->mFree.size();
+		os << " FER=" << group->mFER << endl;
+	}
+	mLock.unlock();
+}
+
+
+
+// vim: ts=4 sw=4
@@ -0,0 +1,247 @@
+/*
+* Copyright 2008, 2009, 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#ifndef GSMCHANNELALLOCATOR_H
+#define GSMCHANNELALLOCATOR_H
+
+#include <vector>
+#include <map>
+#include <string>
+#include <ostream>
+
+#include <Threads.h>
+#include <Timeval.h>
+#include <TimerWheel.h>
+
+
+namespace GSM {
+
+
+class LogicalChannel;
+class ChannelAllocator;
+class ChannelWatch;
+
+
+/**
+	The channels of one type on one timeslot of one carrier:
+	a TCH/F, or the SDCCHs of an SDCCH/4 or SDCCH/8.
+	Protected by the allocator's lock.
+*/
+class ChannelGroup {
+
+	public:
+
+	unsigned mARFCN;
+	unsigned mTN;
+	unsigned mIndex;					///< order of creation, the tie-breaker
+	std::vector<ChannelWatch*> mFree;	///< free channels, used as a stack
+	unsigned mBusy;						///< channels not free
+	float mFER;							///< recent uplink FER of released channels
+
+	ChannelGroup(unsigned wARFCN, unsigned wTN, unsigned wIndex)
+		:mARFCN(wARFCN),mTN(wTN),mIndex(wIndex),mBusy(0),mFER(0.0F)
+	{}
+};
+
+
+/**
+	Follows one channel for its allocator.
+	It is armed on gTimerWheel for whichever of T3101, T3109 or T3111 would
+	make the channel recyclable next, and re-armed if uplink traffic pushed
+	that back, so channels return to the free list without any scan.
+*/
+class ChannelWatch : public TimerEntry {
+
+	public:
+
+	LogicalChannel* mChan;
+	ChannelAllocator* mAllocator;
+	ChannelGroup* mGroup;
+	bool mFree;							///< in mGroup->mFree; allocator lock
+	bool mHeld;							///< handed out by allocate(); allocator lock
+	Timeval mAllocated;					///< when it was handed out
+
+	ChannelWatch(LogicalChannel* wChan, ChannelAllocator* wAllocator, ChannelGroup* wGroup)
+		:mChan(wChan),mAllocator(wAllocator),mGroup(wGroup),mFree(false),mHeld(false)
+	{}
+
+	void expire();
+};
+
+
+
+/**
+	Chooses the group a channel is allocated from.
+	Policies are stateless and called with the allocator locked.
+*/
+class ChannelPolicy {
+
+	public:
+
+	virtual ~ChannelPolicy() {}
+
+	virtual const char* name() const =0;
+
+	/** Return true if a channel should come from group a rather than group b. */
+	virtual bool better(const ChannelAllocator& allocator, const ChannelGroup& a, const ChannelGroup& b) const =0;
+
+	/**
+		Look up a policy by name: "pack", "spread" or "quality".
+		@return A shared instance, or NULL if the name is unknown.
+	*/
+	static const ChannelPolicy* find(const std::string& name);
+};
+
+
+/** Fill the busiest timeslot first, keeping whole timeslots idle; in order otherwise. */
+class PackPolicy : public ChannelPolicy {
+
+	public:
+
+	const char* name() const { return "pack"; }
+
+	bool better(const ChannelAllocator&, const ChannelGroup& a, const ChannelGroup& b) const;
+};
+
+
+/** Take the carrier with the fewest busy channels, to balance the transceivers. */
+class SpreadPolicy : public ChannelPolicy {
+
+	public:
+
+	const char* name() const { return "spread"; }
+
+	bool better(const ChannelAllocator& allocator, const ChannelGroup& a, const ChannelGroup& b) const;
+};
+
+
+/** Take the timeslot whose recent calls saw the lowest uplink FER. */
+class QualityPolicy : public ChannelPolicy {
+
+	public:
+
+	const char* name() const { return "quality"; }
+
+	bool better(const ChannelAllocator& allocator, const ChannelGroup& a, const ChannelGroup& b) const;
+};
+
+
+
+/**
+	Allocates channels of one type from per-timeslot free lists.
+	Channels are put back by their ChannelWatch when they become recyclable,
+	so allocation costs one pass over the timeslots, not the channels,
+	and the availability counts cost nothing.
+	It has a lock of its own, apart from GSMConfig's.
+*/
+class ChannelAllocator {
+
+	private:
+
+	mutable Mutex mLock;
+	const char* mName;						///< channel type, for the logs
+	std::vector<ChannelGroup*> mGroups;
+	std::vector<ChannelWatch*> mChannels;
+	std::map<unsigned,unsigned> mARFCNBusy;	///< busy channels by carrier
+	unsigned mFree;							///< free channels
+	const ChannelPolicy* mPolicy;
+
+	/**@name Statistics. */
+	//@{
+	unsigned long mAllocations;			///< channels handed out
+	unsigned long mBlocked;				///< requests with nothing free
+	unsigned long mStale;				///< free channels found in use again
+	float mHoldTime;					///< mean ms from allocation to recyclable
+	//@}
+
+	public:
+
+	/** @param wName The channel type, for the logs. */
+	ChannelAllocator(const char* wName);
+
+	/**
+		Add a channel.  Only during initialization.
+		The channel must already be connected to its radio.
+	*/
+	void add(LogicalChannel* chan);
+
+	/** Set the allocation policy. */
+	void policy(const ChannelPolicy* wPolicy);
+
+	const ChannelPolicy* policy() const { return mPolicy; }
+
+	/**
+		Open and return a free channel.
+		@return The channel, or NULL if none is free.
+	*/
+	LogicalChannel* allocate();
+
+	/** Number of free channels. */
+	unsigned available() const;
+
+	/** Number of channels. */
+	unsigned total() const { return mChannels.size(); }
+
+	/** Number of channels not free. */
+	unsigned active() const { return total() - available(); }
+
+	/**
+		Mean time from allocation until a channel is recyclable again, in ms,
+		including the release timers.
+		@return The mean, or 0 if no channel has been released yet.
+	*/
+	unsigned holdTime() const;
+
+	/** Busy channels on a carrier.  Caller holds the lock; for policies. */
+	unsigned ARFCNBusy(unsigned ARFCN) const;
+
+	void dump(std::ostream& os) const;
+
+	private:
+
+	friend class ChannelWatch;
+
+	/** Put a channel back if it is recyclable, else re-arm its watch. */
+	void check(ChannelWatch* watch);
+
+	/** Move a channel out of its free list.  Caller holds the lock. */
+	void take(ChannelWatch* watch);
+
+	/** Put a channel on its free list.  Caller holds the lock. */
+	void release(ChannelWatch* watch);
+
+	/** Arm a watch for the channel's next possible recycling.  Caller holds the lock. */
+	void watch(ChannelWatch* watch);
+};
+
+
+
+};	// namespace GSM
+
+
+#endif
+
+// vim: ts=4 sw=4
@@ -24,6 +24,8 @@
 
 
 #include "GSMCommon.h"
+#include <time.h>
+#include <errno.h>
 
 using namespace GSM;
 using namespace std;
@@ -187,38 +189,151 @@ ostream& GSM::operator<<(ostream& os, const Time& t)
 
 
 
+/** The CLOCK_MONOTONIC time in nanoseconds. */
+static int64_t monotonicNs()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return 1000000000LL*now.tv_sec + now.tv_nsec;
+}
+
+/** Sleep until a CLOCK_MONOTONIC time in nanoseconds. */
+static void sleepUntilNs(int64_t deadline)
+{
+	struct timespec when;
+	when.tv_sec = deadline / 1000000000LL;
+	when.tv_nsec = deadline % 1000000000LL;
+	while (clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&when,NULL)==EINTR) {}
+}
+
+/** Whole frames in a time, at exactly 60/13 ms per frame. */
+static inline int64_t nsToFrames(int64_t ns) { return ns*13 / 60000000LL; }
+
+/** The start of a frame, rounded up to the nanosecond. */
+static inline int64_t framesToNs(int64_t frames) { return (frames*60000000LL + 12) / 13; }
+
+
+
+Clock::Clock(const Time& when)
+	:mSeq(0),mBaseFN(when.FN()),mBaseNs(monotonicNs()),
+	mDisciplined(false),mLastDriftUs(0)
+{
+	for (unsigned i=0; i<mHistogramBins; i++) {
+		mDrift[i] = 0;
+		mLateness[i] = 0;
+	}
+}
+
+
+void Clock::base(int32_t& baseFN, int64_t& baseNs) const
+{
+	uint32_t seq;
+	do {
+		seq = mSeq;
+		__sync_synchronize();
+		baseFN = mBaseFN;
+		baseNs = mBaseNs;
+		__sync_synchronize();
+	} while ((seq & 1) || seq!=mSeq);
+}
+
+
+void Clock::record(volatile unsigned* histogram, int64_t ns)
+{
+	if (ns<0) ns = -ns;
+	int64_t us = ns/1000;
+	unsigned bin = 0;
+	while (us>0 && bin<mHistogramBins-1) {
+		us >>= 1;
+		bin++;
+	}
+	__sync_fetch_and_add(&histogram[bin],1);
+}
+
+
 void Clock::set(const Time& when)
 {
 	mLock.lock();
-	mBaseTime = Timeval(0);
+	int64_t now = monotonicNs();
+	if (mDisciplined) {
+		// How far the free-running clock had drifted from the radio.
+		int64_t elapsed = now - mBaseNs;
+		int64_t frames = nsToFrames(elapsed);
+		int32_t ours = (mBaseFN + frames) % gHyperframe;
+		int64_t theirs = frames + FNDelta(when.FN(),ours);
+		int64_t drift = elapsed - framesToNs(theirs);
+		mLastDriftUs = drift/1000;
+		record(mDrift,drift);
+	}
+	mDisciplined = true;
+	mSeq++;
+	__sync_synchronize();
+	mBaseNs = now;
 	mBaseFN = when.FN();
+	__sync_synchronize();
+	mSeq++;
 	mLock.unlock();
 }
 
 
 int32_t Clock::FN() const
 {
-	mLock.lock();
-	Timeval now;
-	int32_t deltaSec = now.sec() - mBaseTime.sec();
-	int32_t deltaUSec = now.usec() - mBaseTime.usec();
-	int64_t elapsedUSec = 1000000LL*deltaSec + deltaUSec;
-	int64_t elapsedFrames = elapsedUSec / gFrameMicroseconds;
-	int32_t currentFN = (mBaseFN + elapsedFrames) % gHyperframe;
-	mLock.unlock();
-	return currentFN;
+	int32_t baseFN;
+	int64_t baseNs;
+	base(baseFN,baseNs);
+	int64_t elapsed = monotonicNs() - baseNs;
+	if (elapsed<0) elapsed = 0;
+	return (baseFN + nsToFrames(elapsed)) % gHyperframe;
 }
 
 
 void Clock::wait(const Time& when) const
 {
-	int32_t now = FN();
-	int32_t target = when.FN();
-	int32_t delta = FNDelta(target,now);
+	int32_t baseFN;
+	int64_t baseNs;
+	base(baseFN,baseNs);
+	int64_t elapsed = monotonicNs() - baseNs;
+	if (elapsed<0) elapsed = 0;
+	int64_t frames = nsToFrames(elapsed);
+	int32_t now = (baseFN + frames) % gHyperframe;
+	int32_t delta = FNDelta(when.FN(),now);
 	if (delta<1) return;
 	static const int32_t maxSleep = 51*26;
 	if (delta>maxSleep) delta=maxSleep;
-	sleepFrames(delta);
+	int64_t deadline = baseNs + framesToNs(frames+delta);
+	sleepUntilNs(deadline);
+	record(mLateness,monotonicNs()-deadline);
+}
+
+
+void Clock::waitNextFrame() const
+{
+	int32_t baseFN;
+	int64_t baseNs;
+	base(baseFN,baseNs);
+	int64_t elapsed = monotonicNs() - baseNs;
+	if (elapsed<0) elapsed = 0;
+	int64_t deadline = baseNs + framesToNs(nsToFrames(elapsed)+1);
+	sleepUntilNs(deadline);
+	record(mLateness,monotonicNs()-deadline);
+}
+
+
+void Clock::dumpStats(ostream& os) const
+{
+	os << "last drift " << mLastDriftUs << " us" << endl;
+	const volatile unsigned* histograms[2] = { mDrift, mLateness };
+	const char* names[2] = { "drift at IND CLOCK", "wake lateness" };
+	for (unsigned h=0; h<2; h++) {
+		os << names[h] << ":";
+		for (unsigned i=0; i<mHistogramBins; i++) {
+			if (!histograms[h][i]) continue;
+			if (i==mHistogramBins-1) os << " >=" << (1<<(i-1));
+			else os << " <" << (1<<i);
+			os << "us:" << histograms[h][i];
+		}
+		os << endl;
+	}
 }
 
 
@@ -331,8 +446,15 @@ void Z100Timer::set()
 {
 	mEndTime = Timeval(mLimitTime);
 	mActive=true;
+	if (mAlarm) gTimerWheel.arm(mAlarm,mLimitTime);
 } 
 
+void Z100Timer::reset()
+{
+	mActive = false;
+	if (mAlarm) gTimerWheel.cancel(mAlarm);
+}
+
 void Z100Timer::set(long wLimitTime)
 {
 	mLimitTime = wLimitTime;
@@ -35,6 +35,7 @@
 
 #include <Threads.h>
 #include <Timeval.h>
+#include <TimerWheel.h>
 #include <BitVector.h>
 
 
@@ -492,20 +493,42 @@ std::ostream& operator<<(std::ostream& os, const Time& ts);
 /**
 	A class for calculating the current GSM frame number.
 	Has built-in concurrency protections.
+
+	The clock runs on CLOCK_MONOTONIC at the exact GSM frame rate, 60/13 ms,
+	and is disciplined by set() from the transceiver's IND CLOCK messages.
+	Reads are lock-free under a sequence lock.  Waits sleep to an absolute
+	deadline, so they neither drift nor accumulate oversleep.
 */
 class Clock {
 
+	public:
+
+	static const unsigned mHistogramBins = 16;	///< power-of-two microsecond bins
+
 	private:
 
-	mutable Mutex mLock;
+	Mutex mLock;					///< serializes set()
+	volatile uint32_t mSeq;			///< sequence lock, odd while set() is writing
 	int32_t mBaseFN;
-	Timeval mBaseTime;
+	int64_t mBaseNs;				///< CLOCK_MONOTONIC time at the start of mBaseFN
+	bool mDisciplined;				///< true after the first set()
+
+	/**@name Statistics */
+	//@{
+	int32_t mLastDriftUs;									///< signed error found by the last set()
+	volatile unsigned mDrift[mHistogramBins];				///< size of the error found by each set()
+	mutable volatile unsigned mLateness[mHistogramBins];	///< how late each wait woke
+	//@}
+
+	/** Read the base consistently, without locking. */
+	void base(int32_t& baseFN, int64_t& baseNs) const;
+
+	/** Count a time in a histogram. */
+	static void record(volatile unsigned* histogram, int64_t ns);
 
 	public:
 
-	Clock(const Time& when = Time(0))
-		:mBaseFN(when.FN())
-	{}
+	Clock(const Time& when = Time(0));
 
 	/** Set the clock to a value. */
 	void set(const Time&);
@@ -518,6 +541,16 @@ class Clock {
 
 	/** Block until the clock passes a given time. */
 	void wait(const Time&) const;
+
+	/**
+		Block until the next frame boundary.
+		The boundary is reckoned from the last set(), not from the
+		previous wait, so repeated calls do not accumulate sleep error.
+	*/
+	void waitNextFrame() const;
+
+	/** Print the drift and wake lateness histograms. */
+	void dumpStats(std::ostream&) const;
 };
 
 
@@ -530,6 +563,8 @@ class Clock {
 /**
 	CCITT Z.100 activity timer, as described in GSM 04.06 5.1.
 	All times are in milliseconds.
+	The timer can be polled, or given an alarm to be run
+	from gTimerWheel on expiration.
 */
 class Z100Timer {
 
@@ -538,15 +573,25 @@ class Z100Timer {
 	Timeval mEndTime;		///< the time at which this timer will expire
 	long mLimitTime;		///< timeout in milliseconds
 	bool mActive;			///< true if timer is active
+	TimerEntry* mAlarm;		///< optional expiration alarm, not owned; shared by copies
 
 	public:
 
 	/** Create a timer with a given timeout in milliseconds. */
 	Z100Timer(long wLimitTime)
 		:mLimitTime(wLimitTime),
-		mActive(false)
+		mActive(false),
+		mAlarm(NULL)
 	{}
 
+	/**
+		Have gTimerWheel run an alarm each time this timer expires.
+		The alarm is armed by set() and cancelled by reset().
+		It may run just after a reset() on another thread,
+		so it should check expired() or leave that to the thread it wakes.
+	*/
+	void alarm(TimerEntry* wAlarm) { mAlarm = wAlarm; }
+
 	/** True if the timer is active and expired. */
 	bool expired() const;
 
@@ -557,7 +602,7 @@ class Z100Timer {
 	void set(long wLimitTime);
 
 	/** Stop the timer. */
-	void reset() { mActive = false; }
+	void reset();
 
 	/** Returns true if the timer is active. */
 	bool active() const { return mActive; }
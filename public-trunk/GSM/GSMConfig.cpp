@@ -36,11 +36,23 @@ using namespace GSM;
 
 
 GSMConfig::GSMConfig()
-	:mBand((GSMBand)gConfig.getNum("GSM.Band")),
+	:mSDCCHAllocator("SDCCH"),mTCHAllocator("TCH/F"),
+	mBand((GSMBand)gConfig.getNum("GSM.Band")),
+	mScheduler(mClock),
 	mSI5Frame(UNIT_DATA),mSI6Frame(UNIT_DATA),
 	mT3122(gConfig.getNum("GSM.T3122Min")),
 	mStartTime(::time(NULL))
 {
+	if (gConfig.defines("GSM.Channels.Policy")) {
+		const char* name = gConfig.getStr("GSM.Channels.Policy");
+		const ChannelPolicy* policy = ChannelPolicy::find(name);
+		if (policy) {
+			mSDCCHAllocator.policy(policy);
+			mTCHAllocator.policy(policy);
+		} else {
+			LOG(ALARM) << "unknown GSM.Channels.Policy " << name << ", using pack";
+		}
+	}
 	regenerateBeacon();
 }
 
@@ -117,6 +129,9 @@ void GSMConfig::regenerateBeacon()
 	SI6.write(mSI6Frame);
 	LOG(DEBUG) "mSI6Frame " << mSI6Frame;
 
+	// Flush any cached encodings of the old messages.
+	EncodedBlockCache::invalidateAll();
+
 }
 
 
@@ -146,72 +161,40 @@ CCCHLogicalChannel* GSMConfig::minimumLoad(CCCHList &chanList)
 
 
 
-template <class ChanType> ChanType* getChan(vector<ChanType*>& chanList)
+void GSMConfig::addSDCCH(SDCCHLogicalChannel *wSDCCH)
 {
-	const unsigned sz = chanList.size();
-	if (sz==0) return NULL;
-	// Start the search from a random point in the list.
-	//unsigned pos = random() % sz;
-	// HACK -- Try in-order allocation for debugging.
-	for (unsigned i=0; i<sz; i++) {
-		ChanType *chan = chanList[i];
-		//ChanType *chan = chanList[pos];
-		if (chan->recyclable()) return chan;
-		//pos = (pos+1) % sz;
-	}
-	return NULL;
+	mSDCCHPool.push_back(wSDCCH);
+	mSDCCHAllocator.add(wSDCCH);
 }
 
 
-
-
-
-SDCCHLogicalChannel *GSMConfig::getSDCCH()
+void GSMConfig::addTCH(TCHFACCHLogicalChannel *wTCH)
 {
-	mLock.lock();
-	SDCCHLogicalChannel *chan = getChan<SDCCHLogicalChannel>(mSDCCHPool);
-	if (chan) chan->open();
-	mLock.unlock();
-	return chan;
+	mTCHPool.push_back(wTCH);
+	mTCHAllocator.add(wTCH);
 }
 
 
-TCHFACCHLogicalChannel *GSMConfig::getTCH()
+SDCCHLogicalChannel *GSMConfig::getSDCCH()
 {
-	mLock.lock();
-	TCHFACCHLogicalChannel *chan = getChan<TCHFACCHLogicalChannel>(mTCHPool);
-	if (chan) chan->open();
-	mLock.unlock();
-	return chan;
+	return (SDCCHLogicalChannel*)mSDCCHAllocator.allocate();
 }
 
 
-
-template <class ChanType> size_t chanAvailable(const vector<ChanType*>& chanList)
+TCHFACCHLogicalChannel *GSMConfig::getTCH()
 {
-	size_t count = 0;
-	for (unsigned i=0; i<chanList.size(); i++) {
-		if (chanList[i]->recyclable()) count++;
-	}
-	return count;
+	return (TCHFACCHLogicalChannel*)mTCHAllocator.allocate();
 }
 
 
-
 size_t GSMConfig::SDCCHAvailable() const
 {
-	mLock.lock();
-	size_t retVal = chanAvailable<SDCCHLogicalChannel>(mSDCCHPool);
-	mLock.unlock();
-	return retVal;
+	return mSDCCHAllocator.available();
 }
 
 size_t GSMConfig::TCHAvailable() const
 {
-	mLock.lock();
-	size_t retVal = chanAvailable<TCHFACCHLogicalChannel>(mTCHPool);
-	mLock.unlock();
-	return retVal;
+	return mTCHAllocator.available();
 }
 
 
@@ -226,29 +209,6 @@ size_t GSMConfig::totalLoad(const CCCHList& chanList) const
 
 
 
-template <class ChanType> unsigned countActive(const vector<ChanType*>& chanList)
-{
-	unsigned active = 0;
-	const unsigned sz = chanList.size();
-	// Start the search from a random point in the list.
-	for (unsigned i=0; i<sz; i++) {
-		if (!chanList[i]->recyclable()) active++;
-	}
-	return active;
-}
-
-
-unsigned GSMConfig::SDCCHActive() const
-{
-	return countActive(mSDCCHPool);
-}
-
-unsigned GSMConfig::TCHActive() const
-{
-	return countActive(mTCHPool);
-}
-
-
 unsigned GSMConfig::T3122() const
 {
 	mLock.lock();
@@ -257,6 +217,18 @@ unsigned GSMConfig::T3122() const
 	return retVal;
 }
 
+unsigned GSMConfig::T3122(unsigned wT3122)
+{
+	unsigned min = gConfig.getNum("GSM.T3122Min");
+	unsigned max = gConfig.getNum("GSM.T3122Max");
+	if (wT3122<min) wT3122=min;
+	if (wT3122>max) wT3122=max;
+	mLock.lock();
+	mT3122 = wT3122;
+	mLock.unlock();
+	return wT3122;
+}
+
 unsigned GSMConfig::growT3122()
 {
 	unsigned max = gConfig.getNum("GSM.T3122Max");
@@ -303,9 +275,8 @@ void GSMConfig::createCombinationI(TransceiverManager& TRX, unsigned CN, unsigne
 	radio->setSlot(TN,1);
 	TCHFACCHLogicalChannel* chan = new TCHFACCHLogicalChannel(TN,gTCHF_T[TN]);
 	chan->downstream(radio);
-	Thread* thread = new Thread;
-	thread->start((void*(*)(void*))Control::DCCHDispatcher,chan);
 	chan->open();
+	gDCCHPool.add(chan);
 	gBTS.addTCH(chan);
 
 }
@@ -320,9 +291,8 @@ void GSMConfig::createCombinationVII(TransceiverManager& TRX, unsigned CN, unsig
 	for (int i=0; i<8; i++) {
 		SDCCHLogicalChannel* chan = new SDCCHLogicalChannel(TN,gSDCCH8[i]);
 		chan->downstream(radio);
-		Thread* thread = new Thread;
-		thread->start((void*(*)(void*))Control::DCCHDispatcher,chan);
 		chan->open();
+		gDCCHPool.add(chan);
 		gBTS.addSDCCH(chan);
 	}
 }
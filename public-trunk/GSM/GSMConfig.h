@@ -37,6 +37,8 @@
 #include "GSML3RRMessages.h"
 
 #include "TRXManager.h"
+#include "GSMTDMAScheduler.h"
+#include "GSMChannelAllocator.h"
 
 
 namespace GSM {
@@ -75,6 +77,8 @@ class GSMConfig {
 	//@{
 	SDCCHList mSDCCHPool;
 	TCHList mTCHPool;
+	ChannelAllocator mSDCCHAllocator;
+	ChannelAllocator mTCHAllocator;
 	//@}
 
 	/**@name BSIC. */
@@ -87,6 +91,8 @@ class GSMConfig {
 
 	Clock mClock;		///< local copy of BTS master clock
 
+	TDMAScheduler mScheduler;	///< runs the periodic L1 encoders off mClock
+
 	/**@name Encoded L2 frames to be sent on the BCCH. */
 	//@{
 	L2Frame mSI1Frame;
@@ -142,6 +148,9 @@ class GSMConfig {
 	unsigned BCC() const { return mBCC; }
 	unsigned NCC() const { return mNCC; }
 	GSM::Clock& clock() { return mClock; }
+
+	/** The TDMA frame scheduler. */
+	TDMAScheduler& scheduler() { return mScheduler; }
 	const L3LocationAreaIdentity& LAI() const { return mLAI; }
 	//@}
 
@@ -196,13 +205,14 @@ class GSMConfig {
 		return mPCHPool[index];
 	}
 	unsigned numAGCHs() const { return mAGCHPool.size(); }
+	unsigned numPCHs() const { return mPCHPool.size(); }
 	//@}
 
 
 	/**@name Manage SDCCH Pool. */
 	//@{
 	/** The add method is not mutex protected and should only be used during initialization. */
-	void addSDCCH(SDCCHLogicalChannel *wSDCCH) { mSDCCHPool.push_back(wSDCCH); }
+	void addSDCCH(SDCCHLogicalChannel *wSDCCH);
 	/** Return a pointer to a usable channel. */
 	SDCCHLogicalChannel *getSDCCH();
 	/** Return true if an SDCCH is available, but do not allocate it. */
@@ -210,7 +220,9 @@ class GSMConfig {
 	/** Return number of total SDCCH. */
 	unsigned SDCCHTotal() const { return mSDCCHPool.size(); }
 	/** Return number of active SDCCH. */
-	unsigned SDCCHActive() const;
+	unsigned SDCCHActive() const { return mSDCCHAllocator.active(); }
+	/** Return the mean SDCCH holding time in ms, 0 if not yet measured. */
+	unsigned SDCCHHoldTime() const { return mSDCCHAllocator.holdTime(); }
 	/** Just a reference to the SDCCH pool. */
 	const SDCCHList& SDCCHPool() const { return mSDCCHPool; }
 	//@}
@@ -218,7 +230,7 @@ class GSMConfig {
 	/**@name Manage TCH pool. */
 	//@{
 	/** The add method is not mutex protected and should only be used during initialization. */
-	void addTCH(TCHFACCHLogicalChannel *wTCH) { mTCHPool.push_back(wTCH); }
+	void addTCH(TCHFACCHLogicalChannel *wTCH);
 	/** Return a pointer to a usable channel. */
 	TCHFACCHLogicalChannel *getTCH();
 	/** Return true if an TCH is available, but do not allocate it. */
@@ -226,14 +238,25 @@ class GSMConfig {
 	/** Return number of total TCH. */
 	unsigned TCHTotal() const { return mTCHPool.size(); }
 	/** Return number of active TCH. */
-	unsigned TCHActive() const;
+	unsigned TCHActive() const { return mTCHAllocator.active(); }
+	/** Return the mean TCH holding time in ms, 0 if not yet measured. */
+	unsigned TCHHoldTime() const { return mTCHAllocator.holdTime(); }
 	/** Just a reference to the TCH pool. */
 	const TCHList& TCHPool() const { return mTCHPool; }
 	//@}
 
+	/** Dump the SDCCH and TCH allocators. */
+	void dumpAllocators(std::ostream& os) const
+		{ mSDCCHAllocator.dump(os); mTCHAllocator.dump(os); }
+
 	/**@name T3122 management */
 	//@{
 	unsigned T3122() const;
+	/**
+		Set T3122, limited to GSM.T3122Min..GSM.T3122Max.
+		@return The value set, in ms.
+	*/
+	unsigned T3122(unsigned wT3122);
 	unsigned growT3122();
 	unsigned shrinkT3122();
 	//@}
@@ -0,0 +1,162 @@
+/*
+* Copyright 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#include "GSML1Codec.h"
+#include <assert.h>
+
+
+using namespace GSM;
+
+
+
+
+void XCCHCodec::encode(BitVector& u, BitVector& c)
+{
+	assert(u.size()==228);
+	assert(c.size()==456);
+	// GSM 05.03 4.1.2
+	// Generate the parity bits.
+	BitVector d(u.head(184));
+	BitVector p(u.segment(184,40));
+	mBlockCoder.writeParityWord(d,p);
+	// GSM 05.03 4.1.3
+	// Apply the convolutional encoder.
+	u.encode(mVCoder,c);
+}
+
+
+
+bool XCCHCodec::decode(const SoftVector& c, BitVector& u)
+{
+	assert(u.size()==228);
+	// Convolutional decoding c[] to u[].
+	// GSM 05.03 4.1.3
+	c.decode(mVCoder,u);
+	// The GSM L1 u-frame has a 40-bit parity field.
+	// False detections are EXTREMELY rare.
+	// Parity check of u[].
+	// GSM 05.03 4.1.2.
+	BitVector p(u.segment(184,40));
+	p.invert();							// parity is inverted
+	// The syndrome should be zero.
+	return mBlockCoder.syndrome(u.head(224))==0;
+}
+
+
+
+void XCCHCodec::interleave(const BitVector& c, BitVector* i, unsigned depth, unsigned blockOffset)
+{
+	// GSM 05.03, 4.1.4 and 3.1.3.  Verbatim.
+	for (int k=0; k<456; k++) {
+		int B = (k + blockOffset) % depth;
+		int j = 2*((49*k) % 57) + ((k%8)/4);
+		i[B][j] = c[k];
+	}
+}
+
+
+
+void XCCHCodec::deinterleave(SoftVector* i, SoftVector& c, unsigned depth, unsigned blockOffset)
+{
+	// This comes directly from GSM 05.03, 4.1.4 and 3.1.3.
+	for (int k=0; k<456; k++) {
+		int B = (k + blockOffset) % depth;
+		int j = 2*((49*k) % 57) + ((k%8)/4);
+		c[k] = i[B][j];
+		// Mark this i[][] bit as unknown now.
+		// This makes it possible for the soft decoder to work around
+		// a missing burst.
+		i[B][j] = 0.5F;
+	}
+}
+
+
+
+
+void SCHCodec::encode(BitVector& u, BitVector& e)
+{
+	assert(u.size()==25+10+4);
+	assert(e.size()==78);
+	// Parity
+	BitVector d(u.head(25));
+	BitVector p(u.segment(25,10));
+	mBlockCoder.writeParityWord(d,p);
+	// Convolutional encoding
+	u.encode(mVCoder,e);
+}
+
+
+
+bool SCHCodec::decode(const SoftVector& e, BitVector& u)
+{
+	assert(u.size()==25+10+4);
+	e.decode(mVCoder,u);
+	BitVector p(u.segment(25,10));
+	p.invert();
+	return mBlockCoder.syndrome(u.head(35))==0;
+}
+
+
+
+
+bool RACHCodec::decode(const SoftVector& e, unsigned BSIC, unsigned& RA)
+{
+	assert(e.size()==36);
+	e.decode(mVCoder,mU);
+
+	// Check the tail bits -- should all the zero.
+	if (mU.peekField(14,4)) return false;
+
+	// Check the parity.
+	// The parity word is XOR'd with the BSIC. (GSM 05.03 4.6.)
+	unsigned sentParity = ~mU.peekField(8,6);
+	unsigned checkParity = mD.parity(mParity);
+	unsigned encodedBSIC = (sentParity ^ checkParity) & 0x03f;
+	if (encodedBSIC != BSIC) return false;
+
+	// The "payload" is an 8-bit field, "RA", defined in GSM 04.08 9.1.8.
+	mD.LSB8MSB();
+	RA = mD.peekField(0,8);
+	return true;
+}
+
+
+
+void RACHCodec::encode(unsigned RA, unsigned BSIC, BitVector& e)
+{
+	assert(e.size()==36);
+	mD.fillField(0,RA,8);
+	mD.LSB8MSB();
+	// The parity word is XOR'd with the BSIC and inverted.
+	unsigned parity = mD.parity(mParity);
+	mU.fillField(8,(~(parity ^ BSIC)) & 0x03f,6);
+	mU.fillField(14,0,4);
+	mU.encode(mVCoder,e);
+}
+
+
+
+// vim: ts=4 sw=4
@@ -0,0 +1,169 @@
+/*
+* Copyright 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#ifndef GSML1CODEC_H
+#define GSML1CODEC_H
+
+#include "BitVector.h"
+
+
+namespace GSM {
+
+
+/**
+	Channel coder for the xCCHs and FACCHs, GSM 05.03 4.1 and 4.2.
+
+	This is the coding core of XCCHL1Encoder, XCCHL1Decoder and the TCH/F
+	FACCH, with no channel, radio or clock attached, so it can be driven
+	directly by tests and benchmarks.
+	The caller owns u[], so the L1 classes keep their header and payload
+	aliases into it.
+*/
+class XCCHCodec {
+
+	private:
+
+	ViterbiR2O4 mVCoder;	///< the GSM rate 1/2 convolutional code
+	Parity mBlockCoder;		///< the 40-bit fire code of GSM 05.03 4.1.2
+
+	public:
+
+	XCCHCodec()
+		:mBlockCoder(0x10004820009ULL, 40, 224)
+	{ }
+
+	/**
+		Add parity and apply the convolutional code, GSM 05.03 4.1.2 and 4.1.3.
+		@param u The 228-bit u[], with d[] already in place and the tail bits zero.
+			The parity bits p[] are written into it.
+		@param c The 456-bit c[].
+	*/
+	void encode(BitVector& u, BitVector& c);
+
+	/**
+		Undo the convolutional code and check the parity.
+		@param c The 456 soft bits of c[].
+		@param u The 228-bit u[] for the result.
+		@return true if the syndrome is zero.
+	*/
+	bool decode(const SoftVector& c, BitVector& u);
+
+	/**
+		Interleave c[] into i[][].
+		Block interleaving, GSM 05.03 4.1.4, is a depth of 4 with no offset.
+		The diagonal TCH/F interleaving of 05.03 3.1.3 is a depth of 8
+		with a block offset of 0 or 4.
+		@param c The 456 bits of c[].
+		@param i An array of depth 114-bit i[B][].
+	*/
+	static void interleave(const BitVector& c, BitVector* i, unsigned depth=4, unsigned blockOffset=0);
+
+	/**
+		Deinterleave i[][] into c[], the inverse of interleave().
+		Each bit taken is marked unknown in i[][], so that the soft decoder
+		can work around a missing burst.
+	*/
+	static void deinterleave(SoftVector* i, SoftVector& c, unsigned depth=4, unsigned blockOffset=0);
+};
+
+
+
+/** Channel coder for the SCH, GSM 05.03 4.7. */
+class SCHCodec {
+
+	private:
+
+	ViterbiR2O4 mVCoder;	///< the GSM rate 1/2 convolutional code
+	Parity mBlockCoder;		///< the 10-bit block code of GSM 05.03 4.7
+
+	public:
+
+	SCHCodec()
+		:mBlockCoder(0x0575,10,25)
+	{ }
+
+	/**
+		Add parity and apply the convolutional code.
+		@param u The 39-bit u[], with d[] in place and the tail bits zero.
+		@param e The 78-bit e[].
+	*/
+	void encode(BitVector& u, BitVector& e);
+
+	/**
+		Decode the SCH, as the MS does it.  Mostly for testing.
+		@param e The 78 soft bits of e[].
+		@param u The 39-bit u[] for the result.
+		@return true if the syndrome is zero.
+	*/
+	bool decode(const SoftVector& e, BitVector& u);
+};
+
+
+
+/** Channel coder for the RACH, GSM 05.03 4.6. */
+class RACHCodec {
+
+	private:
+
+	ViterbiR2O4 mVCoder;	///< the GSM rate 1/2 convolutional code
+	Parity mParity;			///< the 6-bit block code of GSM 05.03 4.6
+	BitVector mU;			///< u[], as per GSM 05.03 2.2
+	BitVector mD;			///< d[], as per GSM 05.03 2.2
+
+	public:
+
+	RACHCodec()
+		:mParity(0x06f,6,8),mU(18),mD(mU.head(8))
+	{ }
+
+	/**
+		Decode a RACH burst.
+		To check validity, we have 4 tail bits and 6 parity bits,
+		so the false alarm rate for random inputs is 1/1024.
+		@param e The 36 soft bits of e[].
+		@param BSIC The BSIC that the parity word must be XOR'd with.
+		@param RA The 8-bit RA field of GSM 04.08 9.1.8, written only on success.
+		@return true if the tail bits and parity check out.
+	*/
+	bool decode(const SoftVector& e, unsigned BSIC, unsigned& RA);
+
+	/**
+		Encode a RACH burst, as the MS does it.  Mostly for testing.
+		@param RA The 8-bit RA field.
+		@param BSIC The BSIC of the target cell.
+		@param e The 36-bit e[].
+	*/
+	void encode(unsigned RA, unsigned BSIC, BitVector& e);
+};
+
+
+
+}; 	// namespace GSM
+
+
+#endif
+
+// vim: ts=4 sw=4
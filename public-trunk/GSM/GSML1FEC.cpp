@@ -41,6 +41,10 @@ using namespace std;
 using namespace GSM;
 
 
+/** Speech queue limit, read every 20 ms by each traffic channel. */
+static ConfigurationNum gMaxSpeechLatency(gConfig,"GSM.MaxSpeechLatency");
+
+
 /*
 
 	Notes on reading the GSM specifications.
@@ -291,6 +295,25 @@ void L1Encoder::waitToSend() const
 }
 
 
+bool L1Encoder::readyToSend() const
+{
+	// The non-blocking version of waitToSend.
+	return FNDelta(mPrevWriteTime.FN(),gBTS.time().FN()) < 1;
+}
+
+
+Time L1Encoder::nextWriteTime() const
+{
+	Time now = gBTS.time();
+	int32_t delta = mNextWriteTime-now;
+	if ((delta>=0) && (delta<=(51*26))) return mNextWriteTime;
+	Time next = now;
+	next.TN(mTN);
+	next.rollForward(mMapping.frameMapping(mTotalBursts),mMapping.repeatLength());
+	return next;
+}
+
+
 void L1Encoder::sendIdleFill()
 {
 	// Send the L1 idle filling pattern, if any.
@@ -341,7 +364,10 @@ void L1Decoder::close()
 	mT3109.reset();
 	mT3111.set();
 	mActive = false;
+	TimerEntry* watch = mRecycleWatch;
+	long remaining = mT3111.remaining();
 	mLock.unlock();
+	if (watch) gTimerWheel.arm(watch,remaining);
 }
 
 bool L1Decoder::active() const
@@ -362,6 +388,32 @@ bool L1Decoder::recyclable() const
 }
 
 
+long L1Decoder::recycleRemaining() const
+{
+	mLock.lock();
+	long retVal = -1;
+	if (mT3101.expired() || mT3109.expired() || mT3111.expired()) retVal = 0;
+	else {
+		const Z100Timer* timers[3] = { &mT3101, &mT3109, &mT3111 };
+		for (int i=0; i<3; i++) {
+			if (!timers[i]->active()) continue;
+			long remaining = timers[i]->remaining();
+			if ((retVal<0) || (remaining<retVal)) retVal = remaining;
+		}
+	}
+	mLock.unlock();
+	return retVal;
+}
+
+
+void L1Decoder::recycleWatch(TimerEntry* wWatch)
+{
+	mLock.lock();
+	mRecycleWatch = wWatch;
+	mLock.unlock();
+}
+
+
 L1Encoder* L1Decoder::sibling()
 {
 	if (!mParent) return NULL;
@@ -428,6 +480,65 @@ bool L1FEC::active() const
 
 
 
+void SimL1Encoder::writeHighSide(const L2Frame& frame)
+{
+	switch (frame.primitive()) {
+		case DATA:
+			// Take the next block, wait for its last burst to go by,
+			// then hand the whole frame to the far end.
+			OBJLOG(DEEPDEBUG) << "SimL1Encoder " << frame;
+			resync();
+			for (unsigned i=0; i<4; i++) rollForward();
+			waitToSend();
+			if (mPeer) mPeer->writeFrame(frame);
+			break;
+		case ESTABLISH:
+			open();
+			if (sibling()) sibling()->open();
+			return;
+		case RELEASE:
+			close();
+			if (sibling()) sibling()->close();
+			break;
+		case ERROR:
+			close();
+			break;
+		default:
+			LOG(ERROR) << "unhandled primitive " << frame.primitive() << " in L2->L1";
+			assert(0);
+	}
+}
+
+
+void SimL1Decoder::writeFrame(const L2Frame& frame)
+{
+	mLock.lock();
+	if (!mActive) {
+		mLock.unlock();
+		return;
+	}
+	// Same timer handling as XCCHL1Decoder::handleGoodFrame.
+	mT3109.set();
+	if (mT3101.active()) {
+		mT3101.reset();
+		if (mUpstream!=NULL) mUpstream->writeLowSide(L2Frame(ESTABLISH));
+	}
+	mLock.unlock();
+	countGoodFrame();
+	if (mUpstream!=NULL) mUpstream->writeLowSide(frame);
+}
+
+
+void SimL1FEC::peer(SimL1FEC& other)
+{
+	assert(mDecoder && other.mDecoder);
+	((SimL1Encoder*)mEncoder)->peer((SimL1Decoder*)other.mDecoder);
+	((SimL1Encoder*)other.mEncoder)->peer((SimL1Decoder*)mDecoder);
+}
+
+
+
+
 void RACHL1Decoder::serviceLoop()
 {
 	// The service loop pulls RACH bursts from a FIFO
@@ -457,7 +568,7 @@ void RACHL1Decoder::start()
 {
 	// Start the processing thread.
 	L1Decoder::start();
-	mServiceThread.start((void*(*)(void*))RACHL1DecoderServiceLoopAdapter,this);
+	mServiceThread.start((void*(*)(void*))RACHL1DecoderServiceLoopAdapter,this,"rach");
 }
 
 
@@ -466,25 +577,10 @@ void RACHL1Decoder::writeLowSide(const RxBurst& burst)
 {
 	// The L1 FEC for the RACH is defined in GSM 05.03 4.6.
 
-	// Decode the burst.
+	// Decode the burst and check the tail bits and the BSIC-coded parity.
 	const SoftVector e(burst.segment(49,36));
-	e.decode(mVCoder,mU);
-
-	// To check validity, we have 4 tail bits and 6 parity bits.
-	// False alarm rate for random inputs is 1/1024.
-
-	// Check the tail bits -- should all the zero.
-	if (mU.peekField(14,4)) {
-		countBadFrame();
-		return;
-	}
-
-	// Check the parity.
-	// The parity word is XOR'd with the BSIC. (GSM 05.03 4.6.)
-	unsigned sentParity = ~mU.peekField(8,6);
-	unsigned checkParity = mD.parity(mParity);
-	unsigned encodedBSIC = (sentParity ^ checkParity) & 0x03f;
-	if (encodedBSIC != gBTS.BSIC()) {
+	unsigned RA;
+	if (!mCodec.decode(e,gBTS.BSIC(),RA)) {
 		countBadFrame();
 		return;
 	}
@@ -497,8 +593,6 @@ void RACHL1Decoder::writeLowSide(const RxBurst& burst)
 	// Just pass the required information directly to the control layer.
 
 	countGoodFrame();
-	mD.LSB8MSB();
-	unsigned RA = mD.peekField(0,8);
 	OBJLOG(INFO) <<"RACHL1Decoder received RA=" << RA << " at time " << burst.time()
 		<< " with RSSI=" << burst.RSSI() << " timingError=" << burst.timingError();
 	Control::AccessGrantResponder(RA,burst.time(),burst.RSSI(),burst.timingError());
@@ -525,9 +619,8 @@ XCCHL1Decoder::XCCHL1Decoder(
 		const TDMAMapping& wMapping,
 		L1FEC *wParent)
 	:L1Decoder(wTN,wMapping,wParent),
-	mBlockCoder(0x10004820009ULL, 40, 224),
 	mC(456), mU(228),
-	mP(mU.segment(184,40)),mDP(mU.head(224)),mD(mU.head(184))
+	mD(mU.head(184))
 {
 	for (int i=0; i<4; i++) {
 		mI[i] = SoftVector(114);
@@ -601,17 +694,8 @@ bool XCCHL1Decoder::processBurst(const RxBurst& inBurst)
 
 void XCCHL1Decoder::deinterleave()
 {
-	// Deinterleave i[][] to c[].
-	// This comes directly from GSM 05.03, 4.1.4.
-	for (int k=0; k<456; k++) {
-		int B = k%4;
-		int j = 2*((49*k) % 57) + ((k%8)/4);
-		mC[k] = mI[B][j];
-		// Mark this i[][] bit as unknown now.
-		// This makes it possible for the soft decoder to work around
-		// a missing burst.
-		mI[B][j] = 0.5F;
-	}
+	// Deinterleave i[][] to c[], GSM 05.03, 4.1.4.
+	XCCHCodec::deinterleave(mI,mC);
 }
 
 
@@ -620,22 +704,12 @@ bool XCCHL1Decoder::decode()
 	// Apply the convolutional decoder and parity check.
 	// Return true if we recovered a good L2 frame.
 
-	// Convolutional decoding c[] to u[].
-	// GSM 05.03 4.1.3
-	OBJLOG(DEEPDEBUG) <<"XCCHL1Decoder << mC";
-	mC.decode(mVCoder,mU);
-	OBJLOG(DEEPDEBUG) <<"XCCHL1Decoder << mU";
-
-	// The GSM L1 u-frame has a 40-bit parity field.
-	// False detections are EXTREMELY rare.
-	// Parity check of u[].
-	// GSM 05.03 4.1.2.
-	mP.invert();							// parity is inverted
-	// The syndrome should be zero.
-	OBJLOG(DEEPDEBUG) <<"XCCHL1Decoder d[]:p[]=" << mDP;
-	unsigned syndrome = mBlockCoder.syndrome(mDP);
-	OBJLOG(DEEPDEBUG) <<"XCCHL1Decoder syndrome=" << hex << syndrome << dec;
-	return (syndrome==0);
+	// Convolutional decoding c[] to u[] and parity check of u[].
+	// GSM 05.03 4.1.3 and 4.1.2.
+	OBJLOG(DEEPDEBUG) <<"XCCHL1Decoder c[]=" << mC;
+	bool good = mCodec.decode(mC,mU);
+	OBJLOG(DEEPDEBUG) <<"XCCHL1Decoder u[]=" << mU << " good=" << good;
+	return good;
 }
 
 
@@ -732,14 +806,59 @@ void SACCHL1Decoder::handleGoodFrame()
 
 
 
+volatile unsigned EncodedBlockCache::sGeneration = 0;
+
+
+EncodedBlockCache::EncodedBlockCache()
+	:mSize(0),mNext(0),mGeneration(sGeneration),
+	mHits(0),mMisses(0)
+{
+	for (unsigned i=0; i<mMaxEntries; i++) mBlocks[i] = BitVector(4*114);
+}
+
+
+bool EncodedBlockCache::lookup(const BitVector& d, BitVector* i)
+{
+	assert(d.size()==8*mKeyBytes);
+	// Empty out after a beacon change.
+	unsigned generation = sGeneration;
+	if (generation!=mGeneration) {
+		mSize = 0;
+		mNext = 0;
+		mGeneration = generation;
+	}
+	d.pack(mKey);
+	for (unsigned e=0; e<mSize; e++) {
+		if (memcmp(mKey,mKeys[e],mKeyBytes)) continue;
+		for (unsigned B=0; B<4; B++) mBlocks[e].segment(B*114,114).copyTo(i[B]);
+		mHits++;
+		return true;
+	}
+	mMisses++;
+	return false;
+}
+
+
+void EncodedBlockCache::insert(const BitVector* i)
+{
+	unsigned e = mNext;
+	mNext = (mNext+1) % mMaxEntries;
+	if (mSize<mMaxEntries) mSize++;
+	memcpy(mKeys[e],mKey,mKeyBytes);
+	for (unsigned B=0; B<4; B++) i[B].copyToSegment(mBlocks[e],B*114);
+}
+
+
+
+
 XCCHL1Encoder::XCCHL1Encoder(
 		unsigned wTN,
 		const TDMAMapping& wMapping,
 		L1FEC* wParent)
 	:L1Encoder(wTN,wMapping,wParent),
-	mBlockCoder(0x10004820009ULL, 40, 224),
 	mC(456), mU(228),
-	mD(mU.head(184)),mP(mU.segment(184,40))
+	mD(mU.head(184)),
+	mCache(NULL)
 {
 	// Set up the interleaving buffers.
 	for(int k = 0; k<4; k++) {
@@ -823,8 +942,13 @@ void XCCHL1Encoder::sendFrame(const L2Frame& frame)
 	OBJLOG(DEEPDEBUG) << "XCCHL1Encoder d[]=" << mD;
 	mD.LSB8MSB();
 	OBJLOG(DEEPDEBUG) << "XCCHL1Encoder d[]=" << mD;
-	encode();			// Encode u[] to c[], GSM 05.03 4.1.2 and 4.1.3.
-	interleave();		// Interleave c[] to i[][], GSM 05.03 4.1.4.
+	if (mCache && mCache->lookup(mD,mI)) {
+		OBJLOG(DEEPDEBUG) << "XCCHL1Encoder cached block";
+	} else {
+		encode();			// Encode u[] to c[], GSM 05.03 4.1.2 and 4.1.3.
+		interleave();		// Interleave c[] to i[][], GSM 05.03 4.1.4.
+		if (mCache) mCache->insert(mI);
+	}
 	transmit();			// Send the bursts to the radio, GSM 05.03 4.1.5.
 }
 
@@ -833,14 +957,8 @@ void XCCHL1Encoder::sendFrame(const L2Frame& frame)
 void XCCHL1Encoder::encode()
 {
 	// Perform the FEC encoding of GSM 05.03 4.1.2 and 4.1.3
-
-	// GSM 05.03 4.1.2
-	// Generate the parity bits.
-	mBlockCoder.writeParityWord(mD,mP);
+	mCodec.encode(mU,mC);
 	OBJLOG(DEEPDEBUG) << "XCCHL1Encoder u[]=" << mU;
-	// GSM 05.03 4.1.3
-	// Apply the convolutional encoder.
-	mU.encode(mVCoder,mC);
 	OBJLOG(DEEPDEBUG) << "XCCHL1Encoder c[]=" << mC;
 }
 
@@ -848,12 +966,8 @@ void XCCHL1Encoder::encode()
 
 void XCCHL1Encoder::interleave()
 {
-	// GSM 05.03, 4.1.4.  Verbatim.
-	for (int k=0; k<456; k++) {
-		int B = k%4;
-		int j = 2*((49*k) % 57) + ((k%8)/4);
-		mI[B][j] = mC[k];
-	}
+	// GSM 05.03, 4.1.4.
+	XCCHCodec::interleave(mC,mI);
 }
 
 
@@ -891,25 +1005,17 @@ void XCCHL1Encoder::transmit()
 void GeneratorL1Encoder::start()
 {
 	L1Encoder::start();
-	mSendThread.start((void*(*)(void*))GeneratorL1EncoderServiceLoopAdapter,(void*)this);
+	gBTS.scheduler().schedule(this,gBTS.time().FN(),mTN);
 }
 
 
-
-void *GSM::GeneratorL1EncoderServiceLoopAdapter(GeneratorL1Encoder* gen)
-{
-	gen->serviceLoop();
-	// DONTREACH
-	return NULL;
-}
-
-void GeneratorL1Encoder::serviceLoop()
+int32_t GeneratorL1Encoder::runTask(int32_t FN)
 {
-	while (mRunning) {
-		resync();
-		waitToSend();
-		generate();
-	}
+	if (!mRunning) return -1;
+	resync();
+	// The clock may have moved since this was scheduled.
+	if (readyToSend()) generate();
+	return prevWriteFN();
 }
 
 
@@ -917,9 +1023,8 @@ void GeneratorL1Encoder::serviceLoop()
 
 SCHL1Encoder::SCHL1Encoder(L1FEC* wParent)
 	:GeneratorL1Encoder(0,gSCHMapping,wParent),
-	mBlockCoder(0x0575,10,25),
 	mU(25+10+4), mE(78),
-	mD(mU.head(25)),mP(mU.segment(25,10)),
+	mD(mU.head(25)),
 	mE1(mE.segment(0,39)),mE2(mE.segment(39,39))
 {
 	// The SCH extended training sequence.
@@ -944,10 +1049,7 @@ void SCHL1Encoder::generate()
 	mD.writeField(wp,mNextWriteTime.T3p(),3);
 	mD.LSB8MSB();
 	// Encoding, GSM 05.03 4.7
-	// Parity
-	mBlockCoder.writeParityWord(mD,mP);
-	// Convolutional encoding
-	mU.encode(mVCoder,mE);
+	mCodec.encode(mU,mE);
 	// Mapping onto a burst, GSM 05.02 5.2.5.
 	mBurst.time(mNextWriteTime);
 	mE1.copyToSegment(mBurst,3);
@@ -980,38 +1082,37 @@ void FCCHL1Encoder::generate()
 		mDownstream->writeHighSide(mBurst);
 		rollForward();
 	}
-	sleep(1);
 }
 
 
-
-
-void NDCCHL1Encoder::start()
+int32_t FCCHL1Encoder::runTask(int32_t FN)
 {
-	L1Encoder::start();
-	mSendThread.start((void*(*)(void*))NDCCHL1EncoderServiceLoopAdapter,(void*)this);
+	if (GeneratorL1Encoder::runTask(FN)<0) return -1;
+	return (FN+217) % gHyperframe;
 }
 
 
 
-void *GSM::NDCCHL1EncoderServiceLoopAdapter(NDCCHL1Encoder* gen)
+
+void NDCCHL1Encoder::start()
 {
-	gen->serviceLoop();
-	// DONTREACH
-	return NULL;
+	L1Encoder::start();
+	gBTS.scheduler().schedule(this,gBTS.time().FN(),mTN);
 }
 
-void NDCCHL1Encoder::serviceLoop()
+
+int32_t NDCCHL1Encoder::runTask(int32_t FN)
 {
-	while (mRunning) {
-		generate();
-	}
+	if (!mRunning) return -1;
+	resync();
+	// The clock may have moved since this was scheduled.
+	if (readyToSend()) generate();
+	return prevWriteFN();
 }
 
 
 
 
-
 void BCCHL1Encoder::generate()
 {
 	OBJLOG(DEEPDEBUG) << "BCCHL1Encoder " << mNextWriteTime;
@@ -1037,10 +1138,7 @@ TCHFACCHL1Decoder::TCHFACCHL1Decoder(
 	unsigned wTN,
 	const TDMAMapping& wMapping,
 	L1FEC *wParent)
-	:XCCHL1Decoder(wTN, wMapping, wParent),
-	mTCHU(189),mTCHD(260),
-	mClass1_c(mC.head(378)),mClass1A_d(mTCHD.head(50)),mClass2_c(mC.segment(378,78)),
-	mTCHParity(0x0b,3,50)
+	:XCCHL1Decoder(wTN, wMapping, wParent)
 {
 	for (int i=0; i<8; i++) {
 		mI[i] = SoftVector(114);
@@ -1135,12 +1233,7 @@ bool TCHFACCHL1Decoder::processBurst( const RxBurst& inBurst)
 void TCHFACCHL1Decoder::deinterleave(int blockOffset )
 {
 	OBJLOG(DEEPDEBUG) <<"TCHFACCHL1Decoder blockOffset=" << blockOffset;
-	for (int k=0; k<456; k++) {
-		int B = ( k + blockOffset ) % 8;
-		int j = 2*((49*k) % 57) + ((k%8)/4);
-		mC[k] = mI[B][j];
-		mI[B][j] = 0.5F;
-	}
+	XCCHCodec::deinterleave(mI,mC,8,blockOffset);
 }
 
 
@@ -1155,50 +1248,18 @@ bool TCHFACCHL1Decoder::decodeTCH(bool stolen)
 	bool good = !stolen;
 
 	// Good or bad, we will be sending *something* to the speech channel.
-	// Allocate it in this scope.
-	unsigned char * newFrame = new unsigned char[33];
+	// Take a buffer from the pool in this scope.
+	unsigned char * newFrame = mSpeechPool.get();
 
 	if (!stolen) {
-
-		// 3.1.2.2
-		// decode from c[] to u[]
-		mClass1_c.decode(mVCoder,mTCHU);
-	
-		// 3.1.2.2
-		// copy class 2 bits c[] to d[]
-		mClass2_c.sliced().copyToSegment(mTCHD,182);
-	
-		// 3.1.2.1
-		// copy class 1 bits u[] to d[]
-		for (unsigned k=0; k<=90; k++) {
-			mTCHD[2*k] = mTCHU[k];
-			mTCHD[2*k+1] = mTCHU[184-k];
-		}
-	
-		// 3.1.2.1
-		// check parity of class 1A
-		unsigned sentParity = (~mTCHU.peekField(91,3)) & 0x07;
-		unsigned calcParity = mClass1A_d.parity(mTCHParity) & 0x07;
-
-		// 3.1.2.2
-		// Check the tail bits, too.
-		unsigned tail = mTCHU.peekField(185,4);
-	
+		// Decode c[] straight into a packed frame,
+		// checking the class 1A parity and tail bits.
+		// See GSM 05.03 3.1 and Table 2.
 		OBJLOG(DEEPDEBUG) <<"TCHFACCHL1Decoder c[]=" << mC;
-		OBJLOG(DEEPDEBUG) <<"TCHFACCHL1Decoder u[]=" << mTCHU;
-		OBJLOG(DEEPDEBUG) <<"TCHFACCHL1Decoder d[]=" << mTCHD;
-		OBJLOG(DEEPDEBUG) <<"TCHFACCHL1Decoder sentParity=" << sentParity
-			<< " calcParity=" << calcParity << " tail=" << tail;
-		good = (sentParity==calcParity) && (tail==0);
-		if (good) {
-			// Undo Um's importance-sorted bit ordering.
-			// See GSM 05.03 3.1 and Table 2.
-			BitVector payload = mVFrame.payload();
-			mTCHD.unmap(g610BitOrder,260,payload);
-			mVFrame.pack(newFrame);
-			// Save a copy for bad frame processing.
-			memcpy(mPrevGoodFrame,newFrame,33);
-		}
+		good = mTCHCodec.decode(mC,newFrame);
+		OBJLOG(DEEPDEBUG) <<"TCHFACCHL1Decoder good=" << good;
+		// Save a copy for bad frame processing.
+		if (good) memcpy(mPrevGoodFrame,newFrame,33);
 	}
 
 	if (!good) {
@@ -1229,25 +1290,12 @@ bool TCHFACCHL1Decoder::decodeTCH(bool stolen)
 
 
 
-void GSM::TCHFACCHL1EncoderRoutine( TCHFACCHL1Encoder * encoder )
-{
-	while (1) {
-		encoder->dispatch();
-	}
-}
-
-
-
-
 TCHFACCHL1Encoder::TCHFACCHL1Encoder(
 	unsigned wTN,
 	const TDMAMapping& wMapping,
 	L1FEC *wParent)
 	:XCCHL1Encoder(wTN, wMapping, wParent), 
-	mPreviousFACCH(false),mOffset(0),
-	mTCHU(189),mTCHD(260),
-	mClass1_c(mC.head(378)),mClass1A_d(mTCHD.head(50)),mClass2_d(mTCHD.segment(182,78)),
-	mTCHParity(0x0b,3,50)
+	mPreviousFACCH(false),mOffset(0)
 {
 	for(int k = 0; k<8; k++) {
 		mI[k] = BitVector(114);
@@ -1263,7 +1311,7 @@ void TCHFACCHL1Encoder::start()
 {
 	L1Encoder::start();
 	OBJLOG(DEBUG) <<"TCHFACCHL1Encoder";
-	mEncoderThread.start((void*(*)(void*))TCHFACCHL1EncoderRoutine,(void*)this);
+	gBTS.scheduler().schedule(this,gBTS.time().FN(),mTN);
 }
 
 
@@ -1277,34 +1325,24 @@ void TCHFACCHL1Encoder::open()
 }
 
 
-void TCHFACCHL1Encoder::encodeTCH(const VocoderFrame& vFrame)
+void TCHFACCHL1Encoder::sendTCH(const unsigned char *frame)
+{
+	unsigned char *copy = mSpeechPool.get();
+	memcpy(copy,frame,gTCHFSFrameBytes);
+	mSpeechQ.write(copy);
+}
+
+
+
+void TCHFACCHL1Encoder::encodeTCH(const unsigned char* frame)
 {	
 	// GSM 05.02 3.1.2
 	OBJLOG(DEEPDEBUG) <<"TCHFACCHL1Encoder";
 
-	// Reorder bits by importance.
+	// Reorder bits by importance, add parity and tail,
+	// encode class 1 and copy class 2, all into c[].
 	// See GSM 05.03 3.1 and Table 2.
-	vFrame.payload().map(g610BitOrder,260,mTCHD);
-
-	// 3.1.2.1 -- parity bits
-	BitVector p = mTCHU.segment(91,3);
-   	mTCHParity.writeParityWord(mClass1A_d,p);
-
-	// 3.1.2.1 -- copy class 1 bits d[] to u[]
-	for (unsigned k=0; k<=90; k++) {
-		mTCHU[k] = mTCHD[2*k];
-		mTCHU[184-k] = mTCHD[2*k+1];
-	}
-
-	// 3.1.2.1 -- tail bits in u[]
-	// TODO -- This should only be needed once, in the constructor.
-	for (unsigned k=185; k<=188; k++) mTCHU[k]=0;
-
-	// 3.1.2.2 -- encode u[] to c[] for class 1
-	mTCHU.encode(mVCoder,mClass1_c);
-
-	// 3.1.2.2 -- copy class 2 d[] to c[]
-	mClass2_d.copyToSegment(mC,378);
+	mTCHCodec.encode(frame,mC);
 
 	// So the encoded speech frame is now in c[]
 	// and ready for the interleaver.
@@ -1322,36 +1360,39 @@ void TCHFACCHL1Encoder::sendFrame( const L2Frame& frame )
 
 
 
-void TCHFACCHL1Encoder::dispatch()
+int32_t TCHFACCHL1Encoder::runTask(int32_t FN)
 {
-
 	// No downstream?  That's a problem.
 	assert(mDownstream);
 
 	// Get right with the system clock.
 	resync();
 
-	// If the channel is not active, wait for a multiframe and return.
+	// If the channel is not active, check back in a multiframe.
 	// Most channels do not need this, becuase they are entirely data-driven
 	// from above.  TCH/FACCH, however, must feed the interleaver on time.
 	if (!active()) {
 		mNextWriteTime += 26;
-		gBTS.clock().wait(mNextWriteTime);
-		return;
+		return mNextWriteTime.FN();
 	}
 
 	// Let previous data get transmitted.
-	resync();
-	waitToSend();
-	
+	if (readyToSend()) dispatch();
+	return prevWriteFN();
+}
+
+
+
+void TCHFACCHL1Encoder::dispatch()
+{
 	// flag to control stealing bits
 	bool currentFACCH = false; 
 	
 	// Speech latency control.
 	// Since Asterisk is local, latency should be small.
 	OBJLOG(DEBUG) <<"TCHFACCHL1Encoder speechQ.size=" << mSpeechQ.size();
-	int maxQ = gConfig.getNum("GSM.MaxSpeechLatency");
-	while (mSpeechQ.size() > maxQ) delete mSpeechQ.read();
+	int maxQ = gMaxSpeechLatency;
+	while (mSpeechQ.size() > maxQ) mSpeechPool.release(mSpeechQ.read());
 
 	// Send, by priority: (1) FACCH, (2) TCH, (3) filler.
 	if (L2Frame *fFrame = mL2Q.readNoBlock()) {
@@ -1366,12 +1407,12 @@ void TCHFACCHL1Encoder::dispatch()
 		delete fFrame;
 		OBJLOG(DEEPDEBUG) <<"TCHFACCHL1Encoder FACCH c[]=" << mC;
 		// Flush the vocoder FIFO to limit latency.
-		while (mSpeechQ.size()>0) delete mSpeechQ.read();
-	} else if (VocoderFrame *tFrame = mSpeechQ.readNoBlock()) {
-		OBJLOG(DEEPDEBUG) <<"TCHFACCHL1Encoder TCH " << *tFrame;
+		while (mSpeechQ.size()>0) mSpeechPool.release(mSpeechQ.read());
+	} else if (unsigned char *tFrame = mSpeechQ.readNoBlock()) {
+		OBJLOG(DEEPDEBUG) <<"TCHFACCHL1Encoder TCH";
 		// Encode the speech frame into c[] as per GSM 05.03 3.1.2.
-		encodeTCH(*tFrame);
-		delete tFrame;
+		encodeTCH(tFrame);
+		mSpeechPool.release(tFrame);
 		OBJLOG(DEEPDEBUG) <<"TCHFACCHL1Encoder TCH c[]=" << mC;
 	} else {
 		// We have no ready data but must send SOMETHING.
@@ -1415,11 +1456,7 @@ void TCHFACCHL1Encoder::dispatch()
 void TCHFACCHL1Encoder::interleave(int blockOffset)
 {
 	// GSM 05.03, 3.1.3
-	for (int k=0; k<456; k++) {
-		int B = ( k + blockOffset ) % 8;
-		int j = 2*((49*k) % 57) + ((k%8)/4);
-		mI[B][j] = mC[k];
-	}
+	XCCHCodec::interleave(mC,mI,8,blockOffset);
 }
 
 
@@ -1432,6 +1469,15 @@ bool TCHFACCHL1Decoder::uplinkLost() const
 }
 
 
+long TCHFACCHL1Decoder::uplinkRemaining() const
+{
+	mLock.lock();
+	long retVal = mT3109.active() ? mT3109.remaining() : -1;
+	mLock.unlock();
+	return retVal;
+}
+
+
 
 void SACCHL1FEC::setPhy(const SACCHL1FEC& other)
 {
@@ -36,6 +36,9 @@
 #include "GSMTDMA.h"
 
 #include "GSM610Tables.h"
+#include "GSMTCHCodec.h"
+#include "GSML1Codec.h"
+#include "GSMTDMAScheduler.h"
 
 
 class ARFCNManager;
@@ -108,8 +111,6 @@ class L1Encoder {
 	bool mActive;					///< true between open() and close()
 	//@}
 
-	ViterbiR2O4 mVCoder;	///< nearly all GSM channels use the same convolutional code
-
 
 	public:
 
@@ -137,7 +138,7 @@ class L1Encoder {
 	//@{
 	unsigned TN() const { return mTN; }
 	unsigned TSC() const { return mTSC; }
-	unsigned ARFCN() const;						///< this comes from mDownstream
+	virtual unsigned ARFCN() const;				///< this comes from mDownstream
 	TypeAndOffset typeAndOffset() const;	///< this comes from mMapping
 	//@}
 	//@}
@@ -162,9 +163,21 @@ class L1Encoder {
 	*/
 	virtual void writeHighSide(const L2Frame&) { assert(0); }
 
-	/** Start the service loop thread, if there is one.  */
+	/** Start the service loop thread or scheduled task, if there is one.  */
 	virtual void start() { mRunning=true; }
 
+	/** True if the clock has reached the last burst written, so it is time for more. */
+	bool readyToSend() const;
+
+	/**
+		The time of the next burst that a frame sent now would go into.
+		This is the time resync() would settle on, without changing anything.
+	*/
+	GSM::Time nextWriteTime() const;
+
+	/** Frame number of the last burst written. */
+	int32_t prevWriteFN() const { return mPrevWriteTime.FN(); }
+
 	protected:
 
 	/** Roll write times forward to the next positions. */
@@ -213,6 +226,7 @@ class L1Decoder {
 	Z100Timer mT3111;					///< timer for reuse of a closed channel
 	//@}
 	bool mActive;						///< true between open() and close()
+	TimerEntry* mRecycleWatch;			///< armed by close(), see recycleWatch()
 	//@}
 
 	/**@name Atomic volatiles, no mutex. */
@@ -230,8 +244,6 @@ class L1Decoder {
 	L1FEC* mParent;			///< a containing L1 processor, if any
 	//@}
 
-	ViterbiR2O4 mVCoder;	///< nearly all GSM channels use the same convolutional code
-
 
 	public:
 
@@ -244,7 +256,7 @@ class L1Decoder {
 	L1Decoder(unsigned wTN, const TDMAMapping& wMapping, L1FEC* wParent)
 			:mUpstream(NULL),
 			mT3101(T3101ms),mT3109(T3109ms),mT3111(T3111ms),
-			mActive(false),
+			mActive(false),mRecycleWatch(NULL),
 			mRunning(false),
 			mFER(0.0F),
 			mTN(wTN),mMapping(wMapping),mParent(wParent)
@@ -279,6 +291,20 @@ class L1Decoder {
 	/** Return true if any timer is expired. */
 	bool recyclable() const;
 
+	/**
+		Time until recyclable() could next become true, in ms.
+		Zero if it is true now, -1 if no timer is running.
+		Uplink traffic can push this back.
+	*/
+	long recycleRemaining() const;
+
+	/**
+		Have close() arm an entry on gTimerWheel for when T3111 expires,
+		so a channel allocator learns of the release without polling.
+		The entry is not owned.
+	*/
+	void recycleWatch(TimerEntry* wWatch);
+
 	/** Connect the upstream SAPMux and L2.  */
 	void upstream(SAPMux * wUpstream)
 	{
@@ -388,6 +414,12 @@ class L1FEC {
 	bool recyclable() const
 		{ assert(mDecoder); return mDecoder->recyclable(); }
 
+	long recycleRemaining() const
+		{ assert(mDecoder); return mDecoder->recycleRemaining(); }
+
+	void recycleWatch(TimerEntry* wWatch)
+		{ assert(mDecoder); mDecoder->recycleWatch(wWatch); }
+
 	bool active() const;
 
 	const TDMAMapping& txMapping() const
@@ -425,6 +457,100 @@ class TestL1FEC : public L1FEC {
 };
 
 
+
+/**@name Simulated L1, for load testing above L1 without a radio. */
+//@{
+
+class SimL1Decoder;
+
+/**
+	An encoder that hands each L2 frame whole to a peer SimL1Decoder.
+	It keeps the block timing of its mapping, so L2 and L3 run at air speed.
+*/
+class SimL1Encoder : public L1Encoder {
+
+	private:
+
+	SimL1Decoder* mPeer;			///< the far end, if any
+	unsigned mARFCN;				///< stands in for the radio's
+
+	public:
+
+	SimL1Encoder(unsigned wTN, const TDMAMapping& wMapping, unsigned wARFCN, L1FEC* wParent)
+		:L1Encoder(wTN,wMapping,wParent),
+		mPeer(NULL),mARFCN(wARFCN)
+	{}
+
+	/** Set the decoder that receives our frames. */
+	void peer(SimL1Decoder* wPeer) { mPeer=wPeer; }
+
+	unsigned ARFCN() const { return mARFCN; }
+
+	/** Deliver DATA a block at a time; other primitives act as in XCCHL1Encoder. */
+	void writeHighSide(const L2Frame&);
+
+	protected:
+
+	/** There is no idle pattern without a radio. */
+	void sendIdleFill() {}
+};
+
+
+/** A decoder fed whole frames by a peer SimL1Encoder. */
+class SimL1Decoder : public L1Decoder {
+
+	public:
+
+	SimL1Decoder(unsigned wTN, const TDMAMapping& wMapping, L1FEC* wParent)
+		:L1Decoder(wTN,wMapping,wParent)
+	{}
+
+	/** There are no bursts. */
+	void writeLowSide(const RxBurst&) { assert(0); }
+
+	/**
+		Accept a frame as if decoded from the air.
+		It is dropped while the decoder is closed.
+	*/
+	void writeFrame(const L2Frame&);
+};
+
+
+/**
+	An L1FEC on the simulated L1.
+	Two of these are cross-connected with peer() to make a channel;
+	a bare decoder can listen to a broadcast one.
+*/
+class SimL1FEC : public L1FEC {
+
+	public:
+
+	/** A dedicated channel, sending with one mapping and receiving with the other. */
+	SimL1FEC(unsigned wTN, const TDMAMapping& wSend, const TDMAMapping& wReceive, unsigned wARFCN)
+		:L1FEC()
+	{
+		mEncoder = new SimL1Encoder(wTN,wSend,wARFCN,this);
+		mDecoder = new SimL1Decoder(wTN,wReceive,this);
+	}
+
+	/** A broadcast channel, encoder only. */
+	SimL1FEC(unsigned wTN, const TDMAMapping& wMapping, unsigned wARFCN)
+		:L1FEC()
+	{
+		mEncoder = new SimL1Encoder(wTN,wMapping,wARFCN,this);
+	}
+
+	/** Cross-connect with the far end. */
+	void peer(SimL1FEC& other);
+
+	/** Send our frames to a decoder that is not part of an L1FEC. */
+	void peer(SimL1Decoder* decoder)
+		{ ((SimL1Encoder*)mEncoder)->peer(decoder); }
+};
+
+//@}
+
+
 /** L1 decoder for Random Access (RACH). */
 class RACHL1Decoder : public L1Decoder {
 
@@ -432,9 +558,7 @@ class RACHL1Decoder : public L1Decoder {
 
 	/**@name FEC state. */
 	//@{
-	Parity mParity;					///< block coder
-	BitVector mU;					///< u[], as per GSM 05.03 2.2
-	BitVector mD;					///< d[], as per GSM 05.03 2.2
+	RACHCodec mCodec;				///< channel coder, GSM 05.03 4.6
 	//@}
 
 	// The RACH channel uses an internal FIFO,
@@ -449,8 +573,7 @@ class RACHL1Decoder : public L1Decoder {
 
 	RACHL1Decoder(const TDMAMapping &wMapping,
 		L1FEC *wParent)
-		:L1Decoder(0,wMapping,wParent),
-		mParity(0x06f,6,8),mU(18),mD(mU.head(8))
+		:L1Decoder(0,wMapping,wParent)
 	{ }
 
 	/** Start the service thread. */
@@ -477,12 +600,10 @@ class XCCHL1Decoder : public L1Decoder {
 
 	/**@name FEC state. */
 	//@{
-	Parity mBlockCoder;
+	XCCHCodec mCodec;			///< channel coder, GSM 05.03 4.1
 	SoftVector mI[4];			///< i[][], as per GSM 05.03 2.2
 	SoftVector mC;				///< c[], as per GSM 05.03 2.2
 	BitVector mU;				///< u[], as per GSM 05.03 2.2
-	BitVector mP;				///< p[], as per GSM 05.03 2.2
-	BitVector mDP;				///< d[]:p[] (data & parity)
 	BitVector mD;				///< d[], as per GSM 05.03 2.2
 	//@}
 
@@ -630,6 +751,55 @@ class SACCHL1Decoder : public XCCHL1Decoder {
 
 
 
+/**
+	A small cache of interleaved xCCH blocks, keyed by d[].
+	This is for channels that send the same few frames over and over,
+	like the BCCH and idle CCCH, so that a repeat is a lookup instead of
+	parity, convolutional coding and interleaving.
+	A cache belongs to a single encoder thread, so there is no locking.
+	Every cache empties itself after invalidateAll(), which GSMConfig::regenerateBeacon calls.
+*/
+class EncodedBlockCache {
+
+	private:
+
+	static const unsigned mMaxEntries = 16;
+	static const unsigned mKeyBytes = 23;	///< 184 bits of d[], packed
+	static volatile unsigned sGeneration;	///< bumped by invalidateAll
+
+	unsigned char mKeys[mMaxEntries][mKeyBytes];
+	BitVector mBlocks[mMaxEntries];		///< i[0..3] of each entry, back to back
+	unsigned mSize;						///< number of valid entries
+	unsigned mNext;						///< next entry to replace when full
+	unsigned mGeneration;				///< sGeneration when the entries were made
+	unsigned char mKey[mKeyBytes];		///< key of the last lookup
+	unsigned mHits;
+	unsigned mMisses;
+
+	public:
+
+	EncodedBlockCache();
+
+	/**
+		Look up d[] and copy the cached interleaved block into i[] on a hit.
+		@param d The 184 bits of d[].
+		@param i The 4 x 114 bits of i[][].
+		@return true on a hit.
+	*/
+	bool lookup(const BitVector& d, BitVector* i);
+
+	/** Add i[] for the d[] of the last failed lookup. */
+	void insert(const BitVector* i);
+
+	/** Invalidate every cache, as when the system information changes. */
+	static void invalidateAll() { sGeneration++; }
+
+	unsigned hits() const { return mHits; }
+	unsigned misses() const { return mMisses; }
+};
+
+
+
 /** L1 encoder used for many control channels -- mostly from GSM 05.03 4.1 */
 class XCCHL1Encoder : public L1Encoder {
 
@@ -637,14 +807,15 @@ class XCCHL1Encoder : public L1Encoder {
 
 	/**@name FEC signal processing state.  */
 	//@{
-	Parity mBlockCoder;			///< block coder for this channel
+	XCCHCodec mCodec;			///< channel coder for this channel
 	BitVector mI[4];			///< i[][], as per GSM 05.03 2.2
 	BitVector mC;				///< c[], as per GSM 05.03 2.2
 	BitVector mU;				///< u[], as per GSM 05.03 2.2
 	BitVector mD;				///< d[], as per GSM 05.03 2.2
-	BitVector mP;				///< p[], as per GSM 05.03 2.2
 	//@}
 
+	EncodedBlockCache *mCache;	///< encoded block cache for repetitive channels, or NULL
+
 	public:
 
 	XCCHL1Encoder(
@@ -652,6 +823,8 @@ class XCCHL1Encoder : public L1Encoder {
 		const TDMAMapping& wMapping,
 		L1FEC* wParent);
 
+	virtual ~XCCHL1Encoder() { delete mCache; }
+
 	protected:
 
 	/** Process pending incoming messages. */
@@ -688,7 +861,7 @@ class XCCHL1Encoder : public L1Encoder {
 
 
 /** L1 encoder used for full rate TCH and FACCH -- mostry from GSM 05.03 3.1 and 4.2 */
-class TCHFACCHL1Encoder : public XCCHL1Encoder {
+class TCHFACCHL1Encoder : public XCCHL1Encoder, public TDMATask {
 
 private:
 
@@ -696,23 +869,16 @@ private:
 	size_t mOffset;			///< Current deinterleaving offset.
 
 	BitVector mI[8];			///< deinterleaving history, 8 blocks instead of 4
-	BitVector mTCHU;				///< u[], but for traffic
-	BitVector mTCHD;				///< d[], but for traffic
-	BitVector mClass1_c;			///< the class 1 part of taffic c[]
-	BitVector mClass1A_d;			///< the class 1A part of taffic d[]
-	BitVector mClass2_d;			///< the class 2 part of d[]
 
 	BitVector mFillerC;				///< copy of previous c[] for filling dead time
 
-	Parity mTCHParity;
+	TCHFSCodec mTCHCodec;			///< speech channel coder, GSM 05.03 3.1
 
-	VocoderFrameFIFO mSpeechQ;		///< input queue for speech frames
+	SpeechFramePool mSpeechPool;	///< recycled buffers for mSpeechQ
+	InterthreadQueue<unsigned char> mSpeechQ;		///< input queue for packed speech frames
 
 	L2FrameFIFO mL2Q;				///< input queue for L2 FACCH frames
 
-	Thread mEncoderThread;
-	friend void TCHFACCHL1EncoderRoutine( TCHFACCHL1Encoder * encoder );	
-
 public:
 
 	TCHFACCHL1Encoder(unsigned wTN, 
@@ -720,8 +886,7 @@ public:
 			  L1FEC* wParent);
 
 	/** Enqueue a traffic frame for transmission. */
-	void sendTCH(const unsigned char *frame)
-		{ mSpeechQ.write(new VocoderFrame(frame)); }
+	void sendTCH(const unsigned char *frame);
 
 	/** Extend open() to set up semaphores. */
 	void open();
@@ -735,23 +900,23 @@ protected:
 	void sendFrame(const L2Frame&);
 
 	/**
-		dispatch called in a while loop.
-		process reading transcoder and fifo to 
-		interleave and send.
+		Process reading transcoder and fifo to
+		interleave and send one block.
 	*/
 	void dispatch();
 
-	/** Will start the dispatch thread. */
+	/** Scheduled once per block to call dispatch. */
+	int32_t runTask(int32_t FN);
+
+	/** Will start the scheduled task. */
 	void start();
 
-	/** Encode a vocoder frame into c[]. */
-	void encodeTCH(const VocoderFrame& vFrame);
+	/** Encode a packed vocoder frame into c[]. */
+	void encodeTCH(const unsigned char* frame);
 
 };
 
 
-/** The C adapter for pthreads. */
-void TCHFACCHL1EncoderRoutine( TCHFACCHL1Encoder * encoder );
 
 /** L1 decoder used for full rate TCH and FACCH -- mostly from GSM 05.03 3.1 and 4.2 */
 class TCHFACCHL1Decoder : public XCCHL1Decoder {
@@ -759,17 +924,11 @@ class TCHFACCHL1Decoder : public XCCHL1Decoder {
 	protected:
 
 	SoftVector mI[8];	///< deinterleaving history, 8 blocks instead of 4
-	BitVector mTCHU;					///< u[] (uncoded) in the spec
-	BitVector mTCHD;					///< d[] (data) in the spec
-	SoftVector mClass1_c;				///< the class 1 part of c[]
-	BitVector mClass1A_d;				///< the class 1A part of d[]
-	SoftVector mClass2_c;				///< the class 2 part of c[]
 
-	VocoderFrame mVFrame;				///< unpacking buffer for vocoder frame
+	TCHFSCodec mTCHCodec;				///< speech channel decoder, GSM 05.03 3.1
 	unsigned char mPrevGoodFrame[33];	///< previous good frame.
 
-	Parity mTCHParity;
-
+	SpeechFramePool mSpeechPool;		///< recycled buffers for mSpeechQ
 	InterthreadQueue<unsigned char> mSpeechQ;					///< output queue for speech frames
 
 
@@ -805,15 +964,24 @@ class TCHFACCHL1Decoder : public XCCHL1Decoder {
 	/**
 		Receive a traffic frame.
 		Non-blocking.  Returns NULL if queue is dry.
-		Caller is responsible for deleting the returned array.
+		Caller should return the array with releaseTCH (or delete[] it).
 	*/
 	unsigned char *recvTCH() { return mSpeechQ.read(0); }
 
+	/** Recycle a frame returned by recvTCH. */
+	void releaseTCH(unsigned char *frame) { mSpeechPool.release(frame); }
+
 	/** Return count of internally-queued traffic frames. */
 	unsigned queueSize() const { return mSpeechQ.size(); }
 
+	/** Set or clear a listener for writes to the speech queue. */
+	void speechListener(QueueListener* wListener) { mSpeechQ.listener(wListener); }
+
 	/** Return true if the uplink is dead. */
 	bool uplinkLost() const;
+
+	/** Time until the uplink is declared dead, in ms, or -1 if not timing. */
+	long uplinkRemaining() const;
 };
 
 
@@ -822,11 +990,7 @@ class TCHFACCHL1Decoder : public XCCHL1Decoder {
 	This is base class for output-only encoders.
 	These all have very thin L2/L3 and are driven by a clock instead of a FIFO.
 */
-class GeneratorL1Encoder : public L1Encoder {
-
-	private:
-
-	Thread mSendThread;
+class GeneratorL1Encoder : public L1Encoder, public TDMATask {
 
 	public:
 
@@ -844,18 +1008,12 @@ class GeneratorL1Encoder : public L1Encoder {
 	/** The generate method actually produces output bursts. */
 	virtual void generate() =0;
 
-	/** The core service loop calls generate repeatedly. */
-	void serviceLoop();
-
-	/** Provide a C interface for pthreads. */
-	friend void *GeneratorL1EncoderServiceLoopAdapter(GeneratorL1Encoder*);
+	/** The scheduled task calls generate each time the clock catches up. */
+	int32_t runTask(int32_t FN);
 
 };
 
 
-void *GeneratorL1EncoderServiceLoopAdapter(GeneratorL1Encoder*);
-
-
 /**
 	The L1 encoder for the sync channel (SCH).
 	The SCH sends out an encoding of the current BTS clock.
@@ -865,11 +1023,10 @@ class SCHL1Encoder : public GeneratorL1Encoder {
 
 	private:
 
-	Parity mBlockCoder;			///< block parity coder
+	SCHCodec mCodec;			///< channel coder, GSM 05.03 4.7
 	BitVector mU;				///< u[], as per GSM 05.03 2.2
 	BitVector mE;				///< e[], as per GSM 05.03 2.2
 	BitVector mD;				///< d[], as per GSM 05.03 2.2 
-	BitVector mP;				///< p[], as per GSM 05.03 2.2
 	BitVector mE1;				///< first half of e[]
 	BitVector mE2;				///< second half of e[]
 
@@ -900,6 +1057,9 @@ class FCCHL1Encoder : public GeneratorL1Encoder {
 	protected:
 
 	void generate();
+
+	/** The transceiver repeats the FCCH, so refresh it about once a second. */
+	int32_t runTask(int32_t FN);
 };
 
 
@@ -909,11 +1069,7 @@ class FCCHL1Encoder : public GeneratorL1Encoder {
 	L1 encoder for repeating non-dedicated control channels (BCCH).
 	This have generator-like drive loops, but xCCH-like FEC.
 */
-class NDCCHL1Encoder : public XCCHL1Encoder {
-
-	protected:
-
-	Thread mSendThread;
+class NDCCHL1Encoder : public XCCHL1Encoder, public TDMATask {
 
 	public:
 
@@ -931,13 +1087,10 @@ class NDCCHL1Encoder : public XCCHL1Encoder {
 
 	virtual void generate() =0;
 
-	/** The core service loop. */
-	void serviceLoop();
-
-	friend void *NDCCHL1EncoderServiceLoopAdapter(NDCCHL1Encoder*);
+	/** The scheduled task calls generate each time the clock catches up. */
+	int32_t runTask(int32_t FN);
 };
 
-void *NDCCHL1EncoderServiceLoopAdapter(NDCCHL1Encoder*);
 
 
 
@@ -950,7 +1103,7 @@ class BCCHL1Encoder : public NDCCHL1Encoder {
 
 	BCCHL1Encoder(L1FEC *wParent)
 		:NDCCHL1Encoder(0,gBCCHMapping,wParent)
-	{}
+	{ mCache = new EncodedBlockCache; }
 
 	private:
 
@@ -1016,7 +1169,7 @@ class CCCHL1Encoder : public XCCHL1Encoder {
 	CCCHL1Encoder(const TDMAMapping& wMapping,
 			L1FEC* wParent)
 		:XCCHL1Encoder(0,wMapping,wParent)
-	{}
+	{ mCache = new EncodedBlockCache; }
 
 };
 
@@ -1077,18 +1230,28 @@ public:
 
 	/**
 		Receive a traffic frame.
-		Returns a pointer that must be deleted by calls.
+		Returns a pointer that must be released by the caller with releaseTCH.
 		Non-blocking.
 		Returns NULL is no data available.
 	*/
 	unsigned char* recvTCH()
 		{ assert(mTCHDecoder); return mTCHDecoder->recvTCH(); }
 
+	/** Recycle a frame returned by recvTCH. */
+	void releaseTCH(unsigned char* frame)
+		{ assert(mTCHDecoder); mTCHDecoder->releaseTCH(frame); }
+
 	unsigned queueSize() const
 		{ assert(mTCHDecoder); return mTCHDecoder->queueSize(); }
 
+	void speechListener(QueueListener* wListener)
+		{ assert(mTCHDecoder); mTCHDecoder->speechListener(wListener); }
+
 	bool radioFailure() const
 		{ assert(mTCHDecoder); return mTCHDecoder->uplinkLost(); }
+
+	long radioRemaining() const
+		{ assert(mTCHDecoder); return mTCHDecoder->uplinkRemaining(); }
 };
 
 
@@ -0,0 +1,421 @@
+/*
+* Copyright 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+/*
+	An offline bench for the L1 FEC chains of GSML1FEC.cpp.
+
+	The L1Encoder and L1Decoder objects are bound to gBTS and an ARFCNManager,
+	so this bench drives the coders they delegate to, XCCHCodec, SCHCodec,
+	RACHCodec and TCHFSCodec, on bursts that go through a soft-bit channel
+	instead of a radio.  Only the copying of i[][] into bursts is done here.
+
+	Usage: GSML1FECTest [blocks per point] [burst erasure probability]
+*/
+
+
+#include "GSMTCHCodec.h"
+#include "GSML1Codec.h"
+#include "Timeval.h"
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <string.h>
+
+using namespace std;
+using namespace GSM;
+
+
+
+/**
+	BPSK on an AWGN channel with optional whole-burst erasures.
+	Output soft bits are P(bit==1), as the demodulator produces them.
+*/
+class SoftChannel {
+
+	private:
+
+	float mSigma;			///< noise standard deviation for unit symbol energy
+	float mErasure;			///< probability that a whole burst is lost
+
+	public:
+
+	/**
+		@param EbN0 Eb/N0 in dB, per information bit.
+		@param rate Code rate, information bits per channel bit.
+		@param erasure Burst erasure probability.
+	*/
+	SoftChannel(float EbN0, float rate, float erasure)
+		:mSigma(sqrtf(1.0F/(2.0F*rate*powf(10.0F,EbN0/10.0F)))),
+		mErasure(erasure)
+	{ }
+
+	/** Transmit e[], which holds its bursts back to back, through the channel. */
+	void apply(const BitVector& e, SoftVector& r, unsigned bursts) const
+	{
+		const unsigned burstBits = e.size()/bursts;
+		const float scale = 2.0F/(mSigma*mSigma);
+		for (unsigned B=0; B<bursts; B++) {
+			bool erased = random() < mErasure*RAND_MAX;
+			for (unsigned i=B*burstBits; i<(B+1)*burstBits; i++) {
+				if (erased) {
+					r[i] = 0.5F;
+					continue;
+				}
+				float y = (e.bit(i) ? 1.0F : -1.0F) + mSigma*gaussian();
+				r[i] = 1.0F/(1.0F+expf(-scale*y));
+			}
+		}
+	}
+
+	private:
+
+	/** Box-Muller. */
+	static float gaussian()
+	{
+		float u1 = (random()+1.0F)/(RAND_MAX+2.0F);
+		float u2 = (float)random()/RAND_MAX;
+		return sqrtf(-2.0F*logf(u1))*cosf(2.0F*M_PI*u2);
+	}
+};
+
+
+
+/** One L1 coding chain, d[] in, bursts out, and back again. */
+class Chain {
+
+	public:
+
+	virtual ~Chain() {}
+
+	virtual const char* name() const = 0;
+
+	/** Information bits, for the code rate. */
+	virtual unsigned dataBits() const = 0;
+
+	/** Size of d[] as passed to encode and decode. */
+	virtual unsigned frameBits() const { return dataBits(); }
+
+	/** Coded bits of this block, for the code rate. */
+	virtual unsigned codedBits() const = 0;
+
+	/** Size of e[], all bursts, which may carry bits of other blocks. */
+	virtual unsigned channelBits() const { return codedBits(); }
+
+	/** Number of bursts the coded bits are spread across. */
+	virtual unsigned bursts() const = 0;
+
+	/** Fill d[] with a valid random payload. */
+	virtual void randomize(BitVector& d) const
+		{ for (unsigned i=0; i<d.size(); i++) d[i] = random() & 0x01; }
+
+	/** Encode d[] into e[], the bits of each burst back to back. */
+	virtual void encode(const BitVector& d, BitVector& e) = 0;
+
+	/** Decode e[] into d[]; return true if the decoder accepts the block. */
+	virtual bool decode(const SoftVector& e, BitVector& d) = 0;
+
+	/** Compare a sent and a received d[]. */
+	virtual bool same(const BitVector& sent, const BitVector& received) const
+		{ return memcmp(sent.begin(),received.begin(),sent.size())==0; }
+};
+
+
+
+/**
+	The xCCH chain: XCCHL1Encoder and XCCHL1Decoder, GSM 05.03 4.1.
+	The SACCH differs only by its 2-octet L1 header.
+	FACCH/F uses the same code with the diagonal TCH/F interleaving, 05.03 4.2.
+	For FACCH/F, half of each i[B][] belongs to the neighboring blocks,
+	so it goes over the channel but is not part of this block.
+*/
+class XCCHChain : public Chain {
+
+	private:
+
+	const char* mName;
+	unsigned mHeaderBits;
+	unsigned mDepth;
+	XCCHCodec mCodec;
+	BitVector mU;
+	BitVector mD;
+	BitVector mC;
+	SoftVector mSoftC;
+	BitVector mI[8];
+	SoftVector mSoftI[8];
+
+	public:
+
+	XCCHChain(const char* wName, unsigned wHeaderBits, bool wDiagonal)
+		:mName(wName),mHeaderBits(wHeaderBits),mDepth(wDiagonal ? 8 : 4),
+		mU(228),mD(mU.head(184)),mC(456),mSoftC(456)
+	{
+		mU.zero();
+		for (unsigned B=0; B<8; B++) {
+			mI[B] = BitVector(114);
+			mI[B].zero();
+			mSoftI[B] = SoftVector(114);
+			mSoftI[B].fill(0.5F);
+		}
+	}
+
+	const char* name() const { return mName; }
+	unsigned dataBits() const { return 184; }
+	unsigned codedBits() const { return 456; }
+	unsigned channelBits() const { return mDepth*114; }
+	unsigned bursts() const { return mDepth; }
+
+	void randomize(BitVector& d) const
+	{
+		Chain::randomize(d);
+		// Ordered MS power and timing advance, GSM 04.04 7.1.
+		if (mHeaderBits) {
+			d.fillField(0,5,8);
+			d.fillField(8,1,8);
+		}
+	}
+
+	/** As in XCCHL1Encoder::sendFrame and TCHFACCHL1Encoder::dispatch. */
+	void encode(const BitVector& d, BitVector& e)
+	{
+		d.copyTo(mD);
+		mD.LSB8MSB();
+		mCodec.encode(mU,mC);
+		XCCHCodec::interleave(mC,mI,mDepth);
+		for (unsigned B=0; B<mDepth; B++) mI[B].copyToSegment(e,B*114);
+	}
+
+	/** As in XCCHL1Decoder::writeLowSide and TCHFACCHL1Decoder::processBurst. */
+	bool decode(const SoftVector& e, BitVector& d)
+	{
+		for (unsigned B=0; B<mDepth; B++) e.segmentCopyTo(mSoftI[B],B*114,114);
+		XCCHCodec::deinterleave(mSoftI,mSoftC,mDepth);
+		if (!mCodec.decode(mSoftC,mU)) return false;
+		mD.LSB8MSB();
+		mD.copyTo(d);
+		return true;
+	}
+};
+
+
+
+/**
+	TCH/FS speech, TCHFACCHL1Encoder::encodeTCH and TCHFACCHL1Decoder::decodeTCH.
+	The frame error rate here is the bad frame indication rate; class 2 is uncoded.
+*/
+class TCHFSChain : public Chain {
+
+	private:
+
+	TCHFSCodec mCodec;
+	unsigned char mFrame[gTCHFSFrameBytes];
+	BitVector mC;
+	SoftVector mSoftC;
+	BitVector mI[8];
+	SoftVector mSoftI[8];
+
+	public:
+
+	TCHFSChain()
+		:mC(456),mSoftC(456)
+	{
+		for (unsigned B=0; B<8; B++) {
+			mI[B] = BitVector(114);
+			mI[B].zero();
+			mSoftI[B] = SoftVector(114);
+			mSoftI[B].fill(0.5F);
+		}
+	}
+
+	const char* name() const { return "TCH/FS"; }
+	unsigned dataBits() const { return 260; }
+	unsigned frameBits() const { return 8*gTCHFSFrameBytes; }
+	unsigned codedBits() const { return 456; }
+	unsigned channelBits() const { return 8*114; }
+	unsigned bursts() const { return 8; }
+
+	void randomize(BitVector& d) const
+	{
+		Chain::randomize(d);
+		// RFC 3551 GSM signature.
+		d.fillField(0,0x0d,4);
+	}
+
+	void encode(const BitVector& d, BitVector& e)
+	{
+		d.pack(mFrame);
+		mCodec.encode(mFrame,mC);
+		XCCHCodec::interleave(mC,mI,8);
+		for (unsigned B=0; B<8; B++) mI[B].copyToSegment(e,B*114);
+	}
+
+	bool decode(const SoftVector& e, BitVector& d)
+	{
+		for (unsigned B=0; B<8; B++) e.segmentCopyTo(mSoftI[B],B*114,114);
+		XCCHCodec::deinterleave(mSoftI,mSoftC,8);
+		if (!mCodec.decode(mSoftC,mFrame)) return false;
+		d.unpack(mFrame);
+		return true;
+	}
+
+	bool same(const BitVector&, const BitVector&) const { return true; }
+};
+
+
+
+/** The SCH, as SCHL1Encoder sends it and the MS decodes it, GSM 05.03 4.7. */
+class SCHChain : public Chain {
+
+	private:
+
+	SCHCodec mCodec;
+	BitVector mU;
+	BitVector mD;
+
+	public:
+
+	SCHChain()
+		:mU(25+10+4),mD(mU.head(25))
+	{
+		mU.zero();
+	}
+
+	const char* name() const { return "SCH"; }
+	unsigned dataBits() const { return 25; }
+	unsigned codedBits() const { return 78; }
+	unsigned bursts() const { return 1; }
+
+	void encode(const BitVector& d, BitVector& e)
+	{
+		d.copyTo(mD);
+		mCodec.encode(mU,e);
+	}
+
+	bool decode(const SoftVector& e, BitVector& d)
+	{
+		if (!mCodec.decode(e,mU)) return false;
+		mD.copyTo(d);
+		return true;
+	}
+};
+
+
+
+/** The RACH, as the MS sends it and RACHL1Decoder checks it, GSM 05.03 4.6. */
+class RACHChain : public Chain {
+
+	private:
+
+	static const unsigned sBSIC = 2;
+	RACHCodec mCodec;
+
+	public:
+
+	const char* name() const { return "RACH"; }
+	unsigned dataBits() const { return 8; }
+	unsigned codedBits() const { return 36; }
+	unsigned bursts() const { return 1; }
+
+	void encode(const BitVector& d, BitVector& e)
+	{
+		mCodec.encode(d.peekField(0,8),sBSIC,e);
+	}
+
+	bool decode(const SoftVector& e, BitVector& d)
+	{
+		unsigned RA;
+		if (!mCodec.decode(e,sBSIC,RA)) return false;
+		d.fillField(0,RA,8);
+		return true;
+	}
+};
+
+
+
+/** Report throughput and FER versus Eb/N0 for one chain. */
+void bench(Chain& chain, unsigned count, float erasure)
+{
+	static const float EbN0s[] = { 0.0F, 2.0F, 4.0F, 6.0F, 8.0F };
+	BitVector d(chain.frameBits());
+	BitVector d2(chain.frameBits());
+	BitVector e(chain.channelBits());
+	SoftVector r(chain.channelBits());
+	const float rate = (float)chain.dataBits() / chain.codedBits();
+
+	// Throughput on one core.
+	chain.randomize(d);
+	Timeval start;
+	for (unsigned i=0; i<count; i++) chain.encode(d,e);
+	long encodeMs = start.elapsed();
+	SoftVector clean(e);
+	start.now();
+	for (unsigned i=0; i<count; i++) chain.decode(clean,d2);
+	long decodeMs = start.elapsed();
+	if (encodeMs<1) encodeMs=1;
+	if (decodeMs<1) decodeMs=1;
+	cout << chain.name() << " encode: " << (1000.0*count/encodeMs) << " blocks/s, "
+		<< "decode: " << (1000.0*count/decodeMs) << " blocks/s per core" << endl;
+
+	// FER versus Eb/N0.
+	cout << chain.name() << " FER:";
+	for (unsigned s=0; s<sizeof(EbN0s)/sizeof(float); s++) {
+		SoftChannel channel(EbN0s[s],rate,erasure);
+		unsigned errors = 0;
+		for (unsigned i=0; i<count; i++) {
+			chain.randomize(d);
+			chain.encode(d,e);
+			channel.apply(e,r,chain.bursts());
+			if (!chain.decode(r,d2) || !chain.same(d,d2)) errors++;
+		}
+		cout << " " << EbN0s[s] << "dB:" << ((float)errors/count);
+	}
+	cout << endl;
+}
+
+
+
+int main(int argc, char *argv[])
+{
+	const unsigned count = (argc>1) ? atoi(argv[1]) : 2000;
+	const float erasure = (argc>2) ? atof(argv[2]) : 0.0F;
+
+	cout << count << " blocks per point, burst erasure probability " << erasure << endl;
+
+	XCCHChain xcch("XCCH",0,false);
+	XCCHChain sacch("SACCH",16,false);
+	XCCHChain facch("FACCH/F",0,true);
+	TCHFSChain tch;
+	SCHChain sch;
+	RACHChain rach;
+
+	bench(xcch,count,erasure);
+	bench(sacch,count,erasure);
+	bench(facch,count,erasure);
+	bench(tch,count,erasure);
+	bench(sch,count,erasure);
+	bench(rach,count,erasure);
+}
+
+
+// vim: ts=4 sw=4
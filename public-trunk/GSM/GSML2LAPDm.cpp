@@ -81,7 +81,8 @@ void CCCHL2::writeHighSide(const GSM::L3Frame& l3)
 L2LAPDm::L2LAPDm(unsigned wC, unsigned wSAPI)
 	:mRunning(false),
 	mC(wC),mR(1-wC),mSAPI(wSAPI),
-	mMaster(NULL),
+	mMaster(NULL),mSlave(NULL),
+	mT200Alarm(mL1In),
 	mT200(T200ms),
 	mIdleFrame(DATA)
 {
@@ -89,6 +90,8 @@ L2LAPDm::L2LAPDm(unsigned wC, unsigned wSAPI)
 	assert(mC<2);
 	assert(mSAPI<4);
 
+	mT200.alarm(&mT200Alarm);
+
 	clearState();
 
 	// Set the idle frame as per GSM 04.06 5.4.2.3.
@@ -156,6 +159,16 @@ void L2LAPDm::releaseLink()
 	mAckSignal.signal();
 	if (mSAPI==0) writeL1(RELEASE);
 	mL3Out.write(new L3Frame(RELEASE));
+	wakeSlave();
+}
+
+
+void L2LAPDm::wakeSlave()
+{
+	// The slave's service loop blocks with no timeout once it is idle,
+	// so it would not see our release until its next frame.
+	// A NULL frame wakes it, as the T200 alarm does.
+	if (mSlave) mSlave->mL1In.write(NULL);
 }
 
 
@@ -294,13 +307,14 @@ void L2LAPDm::open()
 		// since N201 may not be defined yet.
 		mMaxIPayloadBits = 8*N201(L2Control::IFormat);
 		mRunning = true;
-		mUpstreamThread.start((void *(*)(void*))LAPDmServiceLoopAdapter,this);
+		mUpstreamThread.start((void *(*)(void*))LAPDmServiceLoopAdapter,this,"lapdm");
 	}
 	mL3Out.clear();
 	mL1In.clear();
 	clearCounters();
 	mState = LinkReleased;
 	mAckSignal.signal();
+	wakeSlave();
 	mLock.unlock();
 	if (mSAPI==0) sendIdle();
 }
@@ -390,23 +404,17 @@ void L2LAPDm::serviceLoop()
 {
 	mLock.lock();
 	while (mRunning) {
-		// Block for up to T200 expiration, then check T200.
+		// Block until a frame arrives, T200 expires or our master releases.
+		// The T200 alarm and the master wake us with a NULL frame, so there is no polling.
 		// Allow other threads to modify state while blocked.
-		// Add 2 ms to prevent race condition due to roundoff error.
-		unsigned timeout = mT200.remaining() + 2;
+		OBJLOG(DEBUG) << "read blocking, state=" << mState;
+		mLock.unlock();
+		L2Frame* frame = mL1In.read(3600000);
+		mLock.lock();
 		// If SAP0 is released, other SAPs need to release also.
 		if (mMaster) {
 			if (mMaster->mState==LinkReleased) mState=LinkReleased;
 		}
-		if (!mT200.active()) {
-			if (mState==LinkReleased) timeout=3600000;
-			else timeout = T200();
-		}
-		OBJLOG(DEBUG) << "read blocking up to " << timeout << " ms, state=" << mState;
-		mLock.unlock();
-		// FIXME -- If the link is released, there should be no timeout at all.
-		L2Frame* frame = mL1In.read(timeout);
-		mLock.lock();
 		if (frame!=NULL) {
 			OBJLOG(DEBUG) << "state=" << mState << " received " << *frame;
 			receiveFrame(*frame);
@@ -106,6 +106,9 @@ class L2DL {
 	/** The L2->L3 interface. */
 	virtual L3Frame* readHighSide(unsigned timeout=3600000) = 0;
 
+	/** Set or clear a listener for writes to the L2->L3 interface. */
+	virtual void listener(QueueListener*) {}
+
 };
 
 
@@ -142,6 +145,25 @@ class CCCHL2 : public L2DL {
 
 
 
+/**
+	The T200 alarm of an L2LAPDm.
+	It writes a NULL frame into the L1->L2 FIFO, which just wakes the service loop.
+*/
+class T200Alarm : public TimerEntry {
+
+	private:
+
+	L2FrameFIFO& mFIFO;
+
+	public:
+
+	T200Alarm(L2FrameFIFO& wFIFO):mFIFO(wFIFO) {}
+
+	void expire() { mFIFO.write(NULL); }
+};
+
+
+
 /**
 	LAPDm transceiver, GSM 04.06, borrows from ITU-T Q.921 (LAPD) and ISO-13239 (HDLC).
 	Dedicated control channels need full-blown LAPDm.
@@ -194,6 +216,7 @@ class L2LAPDm : public L2DL {
 	unsigned mSAPI;			///< the service access point indicator for this L2
 
 	L2LAPDm *mMaster;		///< This points to the SAP0 LAPDm on this channel.
+	L2LAPDm *mSlave;		///< On SAP0, the SAP3 LAPDm whose service loop must see our release.
 
 
 
@@ -216,6 +239,7 @@ class L2LAPDm : public L2DL {
 	bool mDiscardIQueue;		///< a flag used to abort I-frame sending
 	unsigned mContentionCheck;	///< checksum used for contention resolution, GSM 04.06 5.4.1.4.
 	unsigned mRC;				///< retransmission counter, GSM 04.06 5.4.1-5.4.4
+	T200Alarm mT200Alarm;		///< wakes the service loop when T200 expires
 	Z100Timer mT200;			///< retransmission timer, GSM 04.06 5.8.1
 	size_t mMaxIPayloadBits;	///< N201*8 for the I-frame
 	//@}
@@ -257,6 +281,8 @@ class L2LAPDm : public L2DL {
 	L3Frame* readHighSide(unsigned timeout=3600000)
 		{ return mL3Out.read(timeout); }
 
+	void listener(QueueListener* wListener) { mL3Out.listener(wListener); }
+
 	/**
 		Process a downlink L3 frame.
 		This is a blocking call and does not return until
@@ -275,7 +301,7 @@ class L2LAPDm : public L2DL {
 
 	/** Set the "master" SAP, SAP0; should be called no more than once. */
 	void master(L2LAPDm* wMaster)
-		{ assert(!mMaster); mMaster=wMaster; }
+		{ assert(!mMaster); assert(!wMaster->mSlave); mMaster=wMaster; wMaster->mSlave=this; }
 
 
 	protected:
@@ -297,6 +323,9 @@ class L2LAPDm : public L2DL {
 
 	/** Go to the "link released" state. */
 	void releaseLink();
+
+	/** Wake the slave's service loop so it sees our release.  Caller should hold mLock. */
+	void wakeSlave();
 	
 	/** We go here when something goes really wrong. */
 	void abnormalRelease();
@@ -118,6 +118,17 @@ void L3ControlChannelDescription::writeV(L3Frame& dest, size_t &wp) const
 
 
 
+unsigned L3ControlChannelDescription::pagingBlocks() const
+{
+	// GSM 05.02 Table 5 and 6.5.1.
+	// A CCCH combined with SDCCHs (CCCH_CONF=1) has 3 blocks, the others 9.
+	unsigned blocks = (mCCCH_CONF==1) ? 3 : 9;
+	if (mBS_AG_BLKS_RES>=blocks) return 1;
+	return blocks - mBS_AG_BLKS_RES;
+}
+
+
+
 void L3ControlChannelDescription::text(ostream& os) const
 {
 	os << "ATT=" << mATT;
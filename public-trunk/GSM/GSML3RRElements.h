@@ -165,6 +165,17 @@ class L3ControlChannelDescription : public L3ProtocolElement {
 		mT3212=gConfig.getNum("GSM.T3212")/6;
 	}
 
+	/**@name Paging configuration, GSM 05.02 6.5. */
+	//@{
+	unsigned BS_AG_BLKS_RES() const { return mBS_AG_BLKS_RES; }
+	/** The multiframe period of the paging groups; the coded field is this minus 2. */
+	unsigned BS_PA_MFRMS() const { return mBS_PA_MFRMS+2; }
+	/** Paging blocks in each 51-multiframe. */
+	unsigned pagingBlocks() const;
+	/** N, the number of paging groups on the CCCH. */
+	unsigned pagingGroups() const { return pagingBlocks()*BS_PA_MFRMS(); }
+	//@}
+
 	size_t lengthV() const { return 3; }
 	void writeV(L3Frame& dest, size_t &wp) const;
 	void parseV(const L3Frame&, size_t&) { assert(0); }
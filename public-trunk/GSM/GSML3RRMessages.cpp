@@ -236,6 +236,74 @@ void L3PagingRequestType1::text(ostream& os) const
 }
 
 
+size_t L3PagingRequestType2::bodyLength() const
+{
+	size_t sum = 1 + 4 + 4;
+	if (mMobileIDs.size()>2) sum += mMobileIDs[2].lengthTLV();
+	return sum;
+}
+
+
+void L3PagingRequestType2::writeBody(L3Frame& dest, size_t &wp) const
+{
+	// See GSM 04.08 9.1.23.
+	// Page Mode M V 1/2 10.5.2.26
+	// Channels Needed M V 1/2
+	// TMSI 1 M V 4 10.5.2.42
+	// TMSI 2 M V 4 10.5.2.42
+	// 0x17 Mobile Identity 3 O TLV 3-10 10.5.1.4
+	dest.writeField(wp,channelNeededCode(mChannelsNeeded[1]),2);
+	dest.writeField(wp,channelNeededCode(mChannelsNeeded[0]),2);
+	// "normal paging", GSM 04.08 Table 10.5.63
+	dest.writeField(wp,0x0,4);
+	dest.writeField(wp,mMobileIDs[0].TMSI(),32);
+	dest.writeField(wp,mMobileIDs[1].TMSI(),32);
+	if (mMobileIDs.size()>2) mMobileIDs[2].writeTLV(0x17,dest,wp);
+}
+
+
+void L3PagingRequestType2::text(ostream& os) const
+{
+	L3RRMessage::text(os);
+	os << " mobileIDs=(";
+	for (unsigned i=0; i<mMobileIDs.size(); i++) {
+		os << "(" << mMobileIDs[i];
+		if (i<2) os << "," << mChannelsNeeded[i];
+		os << "),";
+	}
+	os << ")";
+}
+
+
+
+void L3PagingRequestType3::writeBody(L3Frame& dest, size_t &wp) const
+{
+	// See GSM 04.08 9.1.24.
+	// Page Mode M V 1/2 10.5.2.26
+	// Channels Needed M V 1/2
+	// TMSI 1-4 M V 4 each 10.5.2.42
+	dest.writeField(wp,channelNeededCode(mChannelsNeeded[1]),2);
+	dest.writeField(wp,channelNeededCode(mChannelsNeeded[0]),2);
+	// "normal paging", GSM 04.08 Table 10.5.63
+	dest.writeField(wp,0x0,4);
+	for (unsigned i=0; i<4; i++) dest.writeField(wp,mTMSIs[i],32);
+}
+
+
+void L3PagingRequestType3::text(ostream& os) const
+{
+	L3RRMessage::text(os);
+	os << " TMSIs=(";
+	for (unsigned i=0; i<4; i++) {
+		os << hex << "0x" << mTMSIs[i] << dec;
+		if (i<2) os << "," << mChannelsNeeded[i];
+		os << " ";
+	}
+	os << ")";
+}
+
+
+
 size_t L3PagingResponse::bodyLength() const
 {
 	return 1 + mClassmark.lengthLV() + mMobileID.lengthLV();
@@ -442,6 +510,47 @@ void L3ImmediateAssignment::text(ostream& os) const
 }
 
 
+void L3ImmediateAssignmentExtended::writeBody( L3Frame &dest, size_t &wp ) const
+{
+/*
+- Page Mode 10.5.2.26 M V 1/2 
+- Spare Half Octet M V 1/2 
+- Channel Description 1 10.5.2.5 M V 3 
+- Request Reference 1 10.5.2.30 M V 3 
+- Timing Advance 1 10.5.2.40 M V 1 
+- Channel Description 2 10.5.2.5 M V 3 
+- Request Reference 2 10.5.2.30 M V 3 
+- Timing Advance 2 10.5.2.40 M V 1 
+- Mobile Allocation 10.5.2.21 M LV 1-5 
+(ignoring optional elements)
+*/
+	// reverse order of 1/2-octet fields
+	dest.writeField(wp,0,4);		// spare 1/2 octet
+	mPageMode.writeV(dest, wp);
+	mChannelDescription1.writeV(dest, wp);
+	mRequestReference1.writeV(dest, wp);
+	mTimingAdvance1.writeV(dest, wp);
+	mChannelDescription2.writeV(dest, wp);
+	mRequestReference2.writeV(dest, wp);
+	mTimingAdvance2.writeV(dest, wp);
+	// No mobile allocation in non-hopping systems.
+	// A zero-length LV.  Just write L=0.
+	dest.writeField(wp,0,8);
+}
+
+
+void L3ImmediateAssignmentExtended::text(ostream& os) const
+{
+	os << "PageMode=("<<mPageMode<<")";
+	os << " ChannelDescription1=("<<mChannelDescription1<<")";
+	os << " RequestReference1=("<<mRequestReference1<<")";
+	os << " TimingAdvance1="<<mTimingAdvance1;
+	os << " ChannelDescription2=("<<mChannelDescription2<<")";
+	os << " RequestReference2=("<<mRequestReference2<<")";
+	os << " TimingAdvance2="<<mTimingAdvance2;
+}
+
+
 void L3ChannelRequest::text(ostream& os) const
 {
 	os << "RA=" << mRA;
@@ -193,6 +193,83 @@ class L3PagingRequestType1 : public L3RRMessage {
 
 
 
+/**
+	Paging Request Type 2, GSM 04.08 9.1.23
+	Two mobiles by TMSI and an optional third by any identity.
+	The third mobile's channel needed goes in the rest octets, which we do not send,
+	so the mobile takes it as "any channel".
+*/
+class L3PagingRequestType2 : public L3RRMessage {
+
+	private:
+
+	std::vector<L3MobileIdentity> mMobileIDs;
+	ChannelType mChannelsNeeded[2];
+
+	public:
+
+	L3PagingRequestType2(const L3MobileIdentity& wId1, ChannelType wType1,
+			const L3MobileIdentity& wId2, ChannelType wType2)
+		:L3RRMessage()
+	{
+		assert(wId1.type()==TMSIType);
+		assert(wId2.type()==TMSIType);
+		mMobileIDs.push_back(wId1);
+		mChannelsNeeded[0]=wType1;
+		mMobileIDs.push_back(wId2);
+		mChannelsNeeded[1]=wType2;
+	}
+
+	/** Add the optional third mobile. */
+	void third(const L3MobileIdentity& wId3)
+		{ assert(mMobileIDs.size()==2); mMobileIDs.push_back(wId3); }
+
+	int MTI() const { return PagingRequestType2; }
+
+	size_t bodyLength() const;
+	void writeBody(L3Frame& dest, size_t& wp) const;
+	void text(std::ostream&) const;
+};
+
+
+
+/**
+	Paging Request Type 3, GSM 04.08 9.1.24
+	Four mobiles by TMSI.
+	As with type 2, the last two take "any channel".
+*/
+class L3PagingRequestType3 : public L3RRMessage {
+
+	private:
+
+	unsigned mTMSIs[4];
+	ChannelType mChannelsNeeded[2];
+
+	public:
+
+	L3PagingRequestType3(const L3MobileIdentity& wId1, ChannelType wType1,
+			const L3MobileIdentity& wId2, ChannelType wType2,
+			const L3MobileIdentity& wId3, const L3MobileIdentity& wId4)
+		:L3RRMessage()
+	{
+		mTMSIs[0]=wId1.TMSI();
+		mTMSIs[1]=wId2.TMSI();
+		mTMSIs[2]=wId3.TMSI();
+		mTMSIs[3]=wId4.TMSI();
+		mChannelsNeeded[0]=wType1;
+		mChannelsNeeded[1]=wType2;
+	}
+
+	int MTI() const { return PagingRequestType3; }
+
+	size_t bodyLength() const { return 1+4*4; }
+	void writeBody(L3Frame& dest, size_t& wp) const;
+	void text(std::ostream&) const;
+};
+
+
+
+
 /** Paging Response, GSM 04.08 9.1.25 */
 class L3PagingResponse : public L3RRMessage {
 
@@ -486,6 +563,50 @@ public:
 
 
 
+/**
+	Immediate Assignment Extended, GSM 04.08 9.1.19.
+	Two assignments in one AGCH block.
+*/
+class L3ImmediateAssignmentExtended : public L3RRMessage {
+
+private:
+
+	L3PageMode mPageMode;
+	L3RequestReference mRequestReference1;
+	L3ChannelDescription mChannelDescription1;
+	L3TimingAdvance mTimingAdvance1;
+	L3RequestReference mRequestReference2;
+	L3ChannelDescription mChannelDescription2;
+	L3TimingAdvance mTimingAdvance2;
+
+public:
+
+	L3ImmediateAssignmentExtended(
+				const L3RequestReference& wRequestReference1,
+				const L3ChannelDescription& wChannelDescription1,
+				const L3TimingAdvance& wTimingAdvance1,
+				const L3RequestReference& wRequestReference2,
+				const L3ChannelDescription& wChannelDescription2,
+				const L3TimingAdvance& wTimingAdvance2)
+		:L3RRMessage(),
+		mRequestReference1(wRequestReference1),
+		mChannelDescription1(wChannelDescription1),
+		mTimingAdvance1(wTimingAdvance1),
+		mRequestReference2(wRequestReference2),
+		mChannelDescription2(wChannelDescription2),
+		mTimingAdvance2(wTimingAdvance2)
+	{}
+
+	int MTI() const { return (int)ImmediateAssignmentExtended; }
+	size_t bodyLength() const { return 16; }
+
+	void writeBody(L3Frame &dest, size_t &wp) const;
+	void text(std::ostream&) const;
+
+};
+
+
+
 /** Immediate Assignment Reject, GSM 04.08 9.1.20 */
 class L3ImmediateAssignmentReject : public L3RRMessage {
 
@@ -503,6 +624,16 @@ public:
 		mWaitIndication(seconds)
 	{ mRequestReference.push_back(wRequestReference); }
 
+	/** Add another request reference, up to 4, with the same wait indication. */
+	void addReference(const L3RequestReference& wRequestReference)
+	{
+		assert(mRequestReference.size()<4);
+		mRequestReference.push_back(wRequestReference);
+	}
+
+	/** Number of request references. */
+	unsigned references() const { return mRequestReference.size(); }
+
 	int MTI() const { return (int)ImmediateAssignmentReject; }
 
 	size_t bodyLength() const { return 17; }
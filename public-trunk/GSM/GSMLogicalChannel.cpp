@@ -41,6 +41,12 @@ void LogicalChannel::open()
 {
 	LOG(INFO);
 	if (mSACCH) mSACCH->open();
+	openLayers();
+}
+
+
+void LogicalChannel::openLayers()
+{
 	if (mL1) mL1->open();
 	for (int s=0; s<4; s++) {
 		if (mL2[s]) mL2[s]->open();
@@ -81,7 +87,8 @@ void LogicalChannel::send(const L3Message& msg,
 
 
 CCCHLogicalChannel::CCCHLogicalChannel(const TDMAMapping& wMapping)
-	:mRunning(false)
+	:mRunning(false),
+	mPagingSource(NULL),mPagingBlock(0)
 {
 	mL1 = new CCCHL1FEC(wMapping);
 	mL2[0] = new CCCHL2;
@@ -89,12 +96,22 @@ CCCHLogicalChannel::CCCHLogicalChannel(const TDMAMapping& wMapping)
 }
 
 
+CCCHLogicalChannel::CCCHLogicalChannel(const TDMAMapping& wMapping, L1FEC* wL1)
+	:mRunning(false),
+	mPagingSource(NULL),mPagingBlock(0)
+{
+	mL1 = wL1;
+	mL2[0] = new CCCHL2;
+	connect();
+}
+
+
 void CCCHLogicalChannel::open()
 {
 	LogicalChannel::open();
 	if (!mRunning) {
 		mRunning=true;
-		mServiceThread.start((void*(*)(void*))CCCHLogicalChannelServiceLoopAdapter,this);
+		mServiceThread.start((void*(*)(void*))CCCHLogicalChannelServiceLoopAdapter,this,"ccch");
 	}
 }
 
@@ -106,17 +123,55 @@ void CCCHLogicalChannel::serviceLoop()
 	static const L3Frame idleFrame(filler,UNIT_DATA);
 	// prime the first idle frame
 	LogicalChannel::send(idleFrame);
+	// Idle frames sent since the last message.
+	// The radio repeats old blocks with a period of up to 2 multiframes,
+	// so it takes 2 idle frames to clear them all.
+	unsigned idles = 2;
 	// run the loop
 	while (true) {
-		L3Frame* frame = mQ.read();
+		PagingSource* source = mPagingSource;
+		if (!source) {
+			L3Frame* frame = mQ.read();
+			if (frame) {
+				LogicalChannel::send(*frame);
+				OBJLOG(DEBUG) << "CCCHLogicalChannel::serviceLoop sending " << *frame;
+				delete frame;
+			}
+			if (mQ.size()==0) {
+				LogicalChannel::send(idleFrame);
+				OBJLOG(DEEPDEBUG) << "CCCHLogicalChannel::serviceLoop sending idle frame";
+			}
+			continue;
+		}
+
+		// With a paging source, decide each block as it comes up:
+		// queued messages first, then pages, then idle frames to
+		// replace whatever the radio would otherwise repeat.
+		Time when = nextWriteTime();
+		L3Frame* frame = mQ.readNoBlock();
+		if (!frame) frame = source->pagingFrame(mPagingBlock,when);
 		if (frame) {
 			LogicalChannel::send(*frame);
 			OBJLOG(DEBUG) << "CCCHLogicalChannel::serviceLoop sending " << *frame;
 			delete frame;
+			idles = 0;
+			continue;
 		}
-		if (mQ.size()==0) {
+		if (idles<2) {
 			LogicalChannel::send(idleFrame);
 			OBJLOG(DEEPDEBUG) << "CCCHLogicalChannel::serviceLoop sending idle frame";
+			idles++;
+			continue;
+		}
+		// Nothing for this block.  Let it go by, unless a message shows up for it.
+		int frames = when - gBTS.time();
+		if (frames<0) frames = 0;
+		frame = mQ.read((frames+1)*gFrameMicroseconds/1000 + 1);
+		if (frame) {
+			LogicalChannel::send(*frame);
+			OBJLOG(DEBUG) << "CCCHLogicalChannel::serviceLoop sending " << *frame;
+			delete frame;
+			idles = 0;
 		}
 	}
 }
@@ -151,7 +206,22 @@ SDCCHLogicalChannel::SDCCHLogicalChannel(
 		unsigned wTN,
 		const CompleteMapping& wMapping)
 {
-	mL1 = new SDCCHL1FEC(wTN,wMapping.LCH());
+	init(wTN,wMapping,new SDCCHL1FEC(wTN,wMapping.LCH()));
+}
+
+
+SDCCHLogicalChannel::SDCCHLogicalChannel(
+		unsigned wTN,
+		const CompleteMapping& wMapping,
+		L1FEC* wL1)
+{
+	init(wTN,wMapping,wL1);
+}
+
+
+void SDCCHLogicalChannel::init(unsigned wTN, const CompleteMapping& wMapping, L1FEC* wL1)
+{
+	mL1 = wL1;
 	// SAP0 is RR/MM/CC, SAP3 is SMS
 	// SAP1 and SAP2 are not used.
 	L2LAPDm *SAP0L2 = new SDCCHL2(1,0);
@@ -171,7 +241,7 @@ SDCCHLogicalChannel::SDCCHLogicalChannel(
 SACCHLogicalChannel::SACCHLogicalChannel(
 		unsigned wTN,
 		const MappingPair& wMapping)
-		: mRunning(false)
+		: mRunning(false),mCount(0)
 {
 	mSACCHL1 = new SACCHL1FEC(wTN,wMapping);
 	mL1 = mSACCHL1;
@@ -189,70 +259,61 @@ void SACCHLogicalChannel::open()
 	LogicalChannel::open();
 	if (!mRunning) {
 		mRunning=true;
-		mServiceThread.start((void*(*)(void*))SACCHLogicalChannelServiceLoopAdapter,this);
+		gBTS.scheduler().schedule(this,gBTS.time().FN(),TN());
 	}
 }
 
 
 
-void SACCHLogicalChannel::serviceLoop()
+int32_t SACCHLogicalChannel::runTask(int32_t FN)
 {
-	// run the loop
 	// For now, just send SI5 and SI6 over and over.
 	// Later, we can add an incoming FIFO from L2.
-	unsigned count = 0;
-	while (true) {
 
-		// Throttle back if not active.
-		if (!active()) {
-			sleepFrames(51);
-			continue;
-		}
+	// Throttle back if not active.
+	if (!active()) return (FN+51) % gHyperframe;
 
-		// Send alternating SI5/SI6.
-		if (count%2) LogicalChannel::send(gBTS.SI5Frame());
-		else LogicalChannel::send(gBTS.SI6Frame());
-		count++;
-
-		// Receive and save measrement reports.
-		// This read loop flushes stray reports quickly.
-		while (true) {
-			L3Frame *report = LogicalChannel::recv(0);
-			if (!report) break;
-			if (report->PD() == 0x1) {
-				// FIXME - getting L1 data in L3Frame.
-				// FIXME -- Why, again, do we need to do this?
-				L3Frame* realframe = new L3Frame(report->segment(24, report->size()-24));
-				delete report;
-				report = realframe;
-			}
-			L3Message* message = parseL3(*report);
-			if (!message) {
-				LOG(NOTICE) << "SACCH sent unparsable L3 frame " << *report;
-				delete report;
-				continue;
-			}
+	// Let the previous block get transmitted.
+	L1Encoder* encoder = mSACCHL1->encoder();
+	if (!encoder->readyToSend()) return encoder->prevWriteFN();
+
+	// Send alternating SI5/SI6.
+	if (mCount%2) LogicalChannel::send(gBTS.SI5Frame());
+	else LogicalChannel::send(gBTS.SI6Frame());
+	mCount++;
+
+	// Receive and save measrement reports.
+	// This read loop flushes stray reports quickly.
+	while (true) {
+		L3Frame *report = LogicalChannel::recv(0);
+		if (!report) break;
+		if (report->PD() == 0x1) {
+			// FIXME - getting L1 data in L3Frame.
+			// FIXME -- Why, again, do we need to do this?
+			L3Frame* realframe = new L3Frame(report->segment(24, report->size()-24));
 			delete report;
-			L3MeasurementReport* measurement = dynamic_cast<L3MeasurementReport*>(message);
-			if (!measurement) {
-				// FIXME -- This should actually go into a LAPDm processor and an L3 state machine for SMS.
-				LOG(NOTICE) << "SACCH sent unaticipated message " << message;
-				delete message;
-				continue;
-			}
-			mMeasurementResults = measurement->results();
+			report = realframe;
+		}
+		L3Message* message = parseL3(*report);
+		if (!message) {
+			LOG(NOTICE) << "SACCH sent unparsable L3 frame " << *report;
+			delete report;
+			continue;
+		}
+		delete report;
+		L3MeasurementReport* measurement = dynamic_cast<L3MeasurementReport*>(message);
+		if (!measurement) {
+			// FIXME -- This should actually go into a LAPDm processor and an L3 state machine for SMS.
+			LOG(NOTICE) << "SACCH sent unaticipated message " << message;
 			delete message;
-			LOG(DEBUG) << "SACCH measurement report " << mMeasurementResults;
+			continue;
 		}
-
+		mMeasurementResults = measurement->results();
+		delete message;
+		LOG(DEBUG) << "SACCH measurement report " << mMeasurementResults;
 	}
-}
-
 
-void *GSM::SACCHLogicalChannelServiceLoopAdapter(SACCHLogicalChannel* chan)
-{
-	chan->serviceLoop();
-	return NULL;
+	return encoder->prevWriteFN();
 }
 
 
@@ -277,7 +338,23 @@ TCHFACCHLogicalChannel::TCHFACCHLogicalChannel(
 		const CompleteMapping& wMapping)
 {
 	mTCHL1 = new TCHFACCHL1FEC(wTN,wMapping.LCH());
-	mL1 = mTCHL1;
+	init(wTN,wMapping,mTCHL1);
+}
+
+
+TCHFACCHLogicalChannel::TCHFACCHLogicalChannel(
+		unsigned wTN,
+		const CompleteMapping& wMapping,
+		L1FEC* wL1)
+{
+	mTCHL1 = dynamic_cast<TCHFACCHL1FEC*>(wL1);
+	init(wTN,wMapping,wL1);
+}
+
+
+void TCHFACCHLogicalChannel::init(unsigned wTN, const CompleteMapping& wMapping, L1FEC* wL1)
+{
+	mL1 = wL1;
 	// SAP0 is RR/MM/CC, SAP3 is SMS
 	// SAP1 and SAP2 are not used.
 	mL2[0] = new FACCHL2(1,0);
@@ -287,5 +364,50 @@ TCHFACCHLogicalChannel::TCHFACCHLogicalChannel(
 }
 
 
+
+
+SimSDCCHLogicalChannel::SimSDCCHLogicalChannel(unsigned wTN, const CompleteMapping& wMapping, unsigned wARFCN)
+	:SDCCHLogicalChannel(wTN,wMapping,
+		new SimL1FEC(wTN,wMapping.LCH().downlink(),wMapping.LCH().uplink(),wARFCN))
+{}
+
+
+SimTCHFACCHLogicalChannel::SimTCHFACCHLogicalChannel(unsigned wTN, const CompleteMapping& wMapping, unsigned wARFCN)
+	:TCHFACCHLogicalChannel(wTN,wMapping,
+		new SimL1FEC(wTN,wMapping.LCH().downlink(),wMapping.LCH().uplink(),wARFCN))
+{}
+
+
+SimCCCHLogicalChannel::SimCCCHLogicalChannel(const TDMAMapping& wMapping, unsigned wARFCN)
+	:CCCHLogicalChannel(wMapping,new SimL1FEC(0,wMapping,wARFCN))
+{}
+
+
+SimMSLogicalChannel::SimMSLogicalChannel(LogicalChannel& network)
+	:mType(network.type())
+{
+	SimL1FEC* far = dynamic_cast<SimL1FEC*>(network.debugGetL1());
+	assert(far);
+	// L1Encoder needs a downlink mapping; the uplink one has the same block rate.
+	SimL1FEC* near = new SimL1FEC(network.TN(),network.txMapping(),network.rcvMapping(),network.ARFCN());
+	near->peer(*far);
+	mL1 = near;
+	// The MS side of LAPDm, C=0.
+	L2LAPDm *SAP0L2, *SAP3L2;
+	if (mType==SDCCHType) {
+		SAP0L2 = new SDCCHL2(0,0);
+		SAP3L2 = new SDCCHL2(0,3);
+	} else {
+		assert(mType==FACCHType);
+		SAP0L2 = new FACCHL2(0,0);
+		SAP3L2 = new FACCHL2(0,3);
+	}
+	SAP3L2->master(SAP0L2);
+	mL2[0] = SAP0L2;
+	mL2[3] = SAP3L2;
+	connect();
+}
+
+
 // vim: ts=4 sw=4
 
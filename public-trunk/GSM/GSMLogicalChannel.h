@@ -129,6 +129,13 @@ public:
 	virtual L3Frame * recv(unsigned timeout_ms = 15000, unsigned SAPI=0)
 		{ assert(mL2[SAPI]); return mL2[SAPI]->readHighSide(timeout_ms); }
 
+	/**
+		Set or clear a listener told of each uplink L3Frame,
+		for a reader that polls recv() with a zero timeout.
+	*/
+	virtual void listener(QueueListener* wListener, unsigned SAPI=0)
+		{ assert(mL2[SAPI]); mL2[SAPI]->listener(wListener); }
+
 	/**
 		Send an L3Frame on downlink.
 		This method will block until the message is transferred to the transceiver.
@@ -173,6 +180,12 @@ public:
 	/** Return true if the channel is active. */
 	bool active() const { assert(mL1); return mL1->active(); }
 
+	/** Time until the channel could next become recyclable, in ms; see L1Decoder::recycleRemaining. */
+	long recycleRemaining() const { assert(mL1); return mL1->recycleRemaining(); }
+
+	/** Have the channel's release arm an entry on gTimerWheel; see L1Decoder::recycleWatch. */
+	void recycleWatch(TimerEntry* wWatch) { assert(mL1); mL1->recycleWatch(wWatch); }
+
 	/** The TDMA parameters for the transmit side. */
 	const TDMAMapping& txMapping() const { assert(mL1); return mL1->txMapping(); }
 
@@ -186,6 +199,8 @@ public:
 	//@{
 	/** Slot number. */
 	unsigned TN() const { assert(mL1); return mL1->TN(); }
+	/** Carrier number. */
+	unsigned ARFCN() const { assert(mL1); return mL1->ARFCN(); }
 	/** Receive FER. */
 	float FER() const { assert(mL1); return mL1->FER(); }
 	/** RSSI wrt full scale. */
@@ -235,6 +250,9 @@ public:
 		the channel components are created.
 	*/
 	virtual void connect();
+
+	/** Open L1 and the L2s, but not the SACCH. */
+	void openLayers();
 };
 
 
@@ -255,6 +273,18 @@ class SDCCHLogicalChannel : public LogicalChannel {
 		const CompleteMapping& wMapping);
 
 	ChannelType type() const { return SDCCHType; }
+
+	protected:
+
+	/** Build the channel on a given L1, which the channel then owns. */
+	SDCCHLogicalChannel(
+		unsigned wTN,
+		const CompleteMapping& wMapping,
+		L1FEC* wL1);
+
+	private:
+
+	void init(unsigned wTN, const CompleteMapping& wMapping, L1FEC* wL1);
 };
 
 
@@ -300,15 +330,15 @@ class NDCCHLogicalChannel : public LogicalChannel {
 	The main role of the SACCH, for now, will be to send SI5 and SI6 messages and
 	to accept uplink mesaurement reports.
 */
-class SACCHLogicalChannel : public LogicalChannel {
+class SACCHLogicalChannel : public LogicalChannel, public TDMATask {
 
 	protected:
 
 	SACCHL1FEC *mSACCHL1;
-	Thread mServiceThread;	///< a thread for the service loop
-	bool mRunning;			///< true is the service loop is started
+	bool mRunning;			///< true is the service task is scheduled
+	unsigned mCount;		///< alternates SI5 and SI6
 
-	/** MeasurementResults from the MS. They are caught in serviceLoop, accessed
+	/** MeasurementResults from the MS. They are caught in runTask, accessed
 	 for recording along with GPS and other data in MobilityManagement.cpp */
 	L3MeasurementResults mMeasurementResults;
 
@@ -322,8 +352,6 @@ class SACCHLogicalChannel : public LogicalChannel {
 
 	void open();
 
-	friend void *SACCHLogicalChannelServiceLoopAdapter(SACCHLogicalChannel*);
-
 	/**@name Pass-through accoessors to L1. */
 	//@{
 	float RSSI() const { return mSACCHL1->RSSI(); }
@@ -341,17 +369,14 @@ class SACCHLogicalChannel : public LogicalChannel {
 
 	protected:
 
-	/** Read and process a measurement report, called from the service loop. */
+	/** Read and process a measurement report, called from the service task. */
 	void getReport();
 
-	/** This is a loop in its own thread that sends SI5 and SI6. */
-	void serviceLoop();
+	/** Send the next SI5 or SI6 and collect reports, once per SACCH block. */
+	int32_t runTask(int32_t FN);
 
 };
 
-/** A C interface for the SACCHLogicalChannel embedded loop. */
-void *SACCHLogicalChannelServiceLoopAdapter(SACCHLogicalChannel*);
-
 
 
 
@@ -377,6 +402,8 @@ class CCCHLogicalChannel : public NDCCHLogicalChannel {
 	Thread mServiceThread;	///< a thread for the service loop
 	L3FrameFIFO mQ;			///< because the CCCH is written by multiple threads
 	bool mRunning;			///< a flag to indication that the service loop is running
+	PagingSource* volatile mPagingSource;	///< fills the paging blocks, if any
+	unsigned mPagingBlock;	///< our index among the paging blocks of a multiframe
 
 	public:
 
@@ -389,16 +416,32 @@ class CCCHLogicalChannel : public NDCCHLogicalChannel {
 
 	void send(const L3Message&) { assert(0); }
 
+	/**
+		Consult a paging source for every block not taken by a queued message.
+		@param wSource The source, or NULL to stop.
+		@param wBlock The index of this channel among the paging blocks of a multiframe.
+	*/
+	void pagingSource(PagingSource* wSource, unsigned wBlock)
+		{ mPagingBlock=wBlock; mPagingSource=wSource; }
+
 	/** This is a loop in its own thread that empties mQ. */
 	void serviceLoop();
 
 	/** Return the number of messages waiting for transmission. */
 	unsigned load() const { return mQ.size(); }
 
+	/** The time of the block that a message sent now, to an idle channel, would go into. */
+	Time nextWriteTime() const { assert(mL1); return mL1->encoder()->nextWriteTime(); }
+
 	ChannelType type() const { return CCCHType; }
 
 	friend void *CCCHLogicalChannelServiceLoopAdapter(CCCHLogicalChannel*);
 
+	protected:
+
+	/** Build the channel on a given L1, which the channel then owns. */
+	CCCHLogicalChannel(const TDMAMapping& wMapping, L1FEC* wL1);
+
 };
 
 /** A C interface for the CCCHLogicalChannel embedded loop. */
@@ -429,17 +472,43 @@ class TCHFACCHLogicalChannel : public LogicalChannel {
 
 	ChannelType type() const { return FACCHType; }
 
-	void sendTCH(const unsigned char* frame)
+	virtual void sendTCH(const unsigned char* frame)
 		{ assert(mTCHL1); mTCHL1->sendTCH(frame); }
 
-	unsigned char* recvTCH()
+	virtual unsigned char* recvTCH()
 		{ assert(mTCHL1); return mTCHL1->recvTCH(); }
 
-	unsigned queueSize() const
+	virtual void releaseTCH(unsigned char* frame)
+		{ assert(mTCHL1); mTCHL1->releaseTCH(frame); }
+
+	virtual unsigned queueSize() const
 		{ assert(mTCHL1); return mTCHL1->queueSize(); }
 
-	bool radioFailure() const
+	/** Set or clear a listener told of each uplink speech frame. */
+	virtual void speechListener(QueueListener* wListener)
+		{ assert(mTCHL1); mTCHL1->speechListener(wListener); }
+
+	virtual bool radioFailure() const
 		{ assert(mTCHL1); return mTCHL1->radioFailure(); }
+
+	/** Time until radioFailure() will be true, in ms, or -1 if the radio link timer is not running. */
+	virtual long radioRemaining() const
+		{ assert(mTCHL1); return mTCHL1->radioRemaining(); }
+
+	protected:
+
+	/**
+		Build the channel on a given L1, which the channel then owns.
+		It has no speech path unless the L1 is a TCHFACCHL1FEC.
+	*/
+	TCHFACCHLogicalChannel(
+		unsigned wTN,
+		const CompleteMapping& wMapping,
+		L1FEC* wL1);
+
+	private:
+
+	void init(unsigned wTN, const CompleteMapping& wMapping, L1FEC* wL1);
 };
 
 
@@ -477,6 +546,10 @@ class L3LoopbackLogicalChannel : public LogicalChannel {
 	L3Frame* recv(unsigned timeout_ms = 15000, unsigned SAPI=0)
 		{ return mL3Q[SAPI].read(timeout_ms); }
 
+	/** L3 Loopback */
+	void listener(QueueListener* wListener, unsigned SAPI=0)
+		{ mL3Q[SAPI].listener(wListener); }
+
 };
 
 
@@ -499,6 +572,82 @@ public:
 
 };   
 
+
+
+/**
+	An SDCCH on the simulated L1, for load testing without a radio.
+	The far end is a SimMSLogicalChannel.
+	The SACCH is built, for setPhy, but never opened.
+*/
+class SimSDCCHLogicalChannel : public SDCCHLogicalChannel {
+
+	public:
+
+	SimSDCCHLogicalChannel(unsigned wTN, const CompleteMapping& wMapping, unsigned wARFCN);
+
+	void open() { openLayers(); }
+};
+
+
+/**
+	A TCH/FACCH on the simulated L1.
+	There is no speech path: frames sent are dropped and none are received.
+*/
+class SimTCHFACCHLogicalChannel : public TCHFACCHLogicalChannel {
+
+	public:
+
+	SimTCHFACCHLogicalChannel(unsigned wTN, const CompleteMapping& wMapping, unsigned wARFCN);
+
+	void open() { openLayers(); }
+
+	/**@name No speech. */
+	//@{
+	void sendTCH(const unsigned char*) {}
+	unsigned char* recvTCH() { return NULL; }
+	void releaseTCH(unsigned char*) {}
+	unsigned queueSize() const { return 0; }
+	void speechListener(QueueListener*) {}
+	bool radioFailure() const { return false; }
+	long radioRemaining() const { return -1; }
+	//@}
+};
+
+
+/** A CCCH on the simulated L1; listen to it with a SimL1Decoder. */
+class SimCCCHLogicalChannel : public CCCHLogicalChannel {
+
+	public:
+
+	SimCCCHLogicalChannel(const TDMAMapping& wMapping, unsigned wARFCN);
+
+	/** Send our frames to a listening decoder. */
+	void peer(SimL1Decoder* decoder) { ((SimL1FEC*)mL1)->peer(decoder); }
+};
+
+
+/**
+	The handset end of a simulated SDCCH or TCH/FACCH.
+	It has the MS side of LAPDm (C=0), so it starts links with SABM.
+*/
+class SimMSLogicalChannel : public LogicalChannel {
+
+	private:
+
+	ChannelType mType;			///< that of the network end
+
+	public:
+
+	/**
+		Build the MS end and cross-connect it with the network end.
+		@param network A SimSDCCHLogicalChannel or SimTCHFACCHLogicalChannel.
+	*/
+	SimMSLogicalChannel(LogicalChannel& network);
+
+	ChannelType type() const { return mType; }
+};
+
+
 //@}
 
 };		// GSM
@@ -30,6 +30,13 @@
 
 UDPSocket GSMTAPSocket;
 
+/**@name Configuration, read for every frame. */
+//@{
+static ConfigurationStr gGSMTAPTargetIP(gConfig,"GSMTAP.TargetIP");
+static ConfigurationNum gGSMTAPTargetPort(gConfig,"GSMTAP.TargetPort",GSMTAP_UDP_PORT);
+static ConfigurationNum gBand(gConfig,"GSM.Band");
+//@}
+
 void gWriteGSMTAP(unsigned ARFCN, unsigned TS, unsigned FN,
                   GSM::TypeAndOffset to, bool is_saach, bool ul_dln,
                   const BitVector& frame)
@@ -38,15 +45,15 @@ void gWriteGSMTAP(unsigned ARFCN, unsigned TS, unsigned FN,
 	int ofs = 0;
 
 	// Check if GSMTap is enabled
-	if (!gConfig.defines("GSMTAP.TargetIP")) return;
-
-	// Port configuration
-	unsigned port = GSMTAP_UDP_PORT;	// default port for GSM-TAP
-	if (gConfig.defines("GSMTAP.TargetPort"))
-		port = gConfig.getNum("GSMTAP.TargetPort");
-
-	// Set socket destination
-	GSMTAPSocket.destination(port,gConfig.getStr("GSMTAP.TargetIP"));
+	if (!gGSMTAPTargetIP.defined()) return;
+
+	// Set socket destination, but only look it up again if the configuration changed.
+	static volatile unsigned destinationGeneration = 0;
+	const unsigned generation = gConfig.generation();
+	if (destinationGeneration!=generation+1) {
+		GSMTAPSocket.destination(gGSMTAPTargetPort,gGSMTAPTargetIP);
+		destinationGeneration = generation+1;
+	}
 
 	// Decode TypeAndOffset
 	uint8_t stype, scn;
@@ -102,7 +109,7 @@ void gWriteGSMTAP(unsigned ARFCN, unsigned TS, unsigned FN,
 		stype |= GSMTAP_CHANNEL_ACCH;
 
 	// Flags in ARFCN
-	if (gConfig.getNum("GSM.Band") == 1900)
+	if (gBand == 1900)
 		ARFCN |= GSMTAP_ARFCN_F_PCS;
 
 	if (ul_dln)
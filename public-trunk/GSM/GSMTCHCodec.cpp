@@ -0,0 +1,223 @@
+/*
+* Copyright 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#include "GSMTCHCodec.h"
+#include "GSM610Tables.h"
+#include <string.h>
+
+
+using namespace GSM;
+
+
+
+/*
+	Bit numbering used in the tables below.
+
+	Frame bits are numbered MSB-first through the packed 33-byte frame.
+	Bits 0..3 are the 0xd signature of RFC 3551, so d[k] of GSM 05.03 3.1
+	is frame bit 4+g610BitOrder[k].
+
+	The u[] positions follow GSM 05.03 3.1.2.1:
+		u[k] = d[2k], u[184-k] = d[2k+1], k=0..90
+		u[91..93] = parity, u[185..188] = tail
+	and the class 2 bits d[182..259] go straight to c[378..455].
+*/
+
+
+/**@name Fused permutation tables, built once from GSM 05.03 Table 2. */
+//@{
+static unsigned short sUFrameBit[185];			///< frame bit for each data position in u[]
+static unsigned short sClass2FrameBit[78];		///< frame bit for each class 2 bit
+static unsigned char sClass1AUIndex[50];		///< u[] position of each class 1A bit of d[]
+static unsigned short sFrameSource[260];		///< source of frame bit 4+j: u[] index, or 189+class 2 index
+//@}
+
+
+/** Build the fused tables at static initialization time. */
+class TCHFSTableBuilder {
+
+	public:
+
+	TCHFSTableBuilder()
+	{
+		for (unsigned k=0; k<260; k++) {
+			unsigned frameBit = 4 + g610BitOrder[k];
+			unsigned source;
+			if (k<182) {
+				// Class 1
+				unsigned uIndex = (k%2==0) ? k/2 : 184-(k/2);
+				sUFrameBit[uIndex] = frameBit;
+				if (k<50) sClass1AUIndex[k] = uIndex;
+				source = uIndex;
+			} else {
+				// Class 2
+				sClass2FrameBit[k-182] = frameBit;
+				source = 189 + (k-182);
+			}
+			sFrameSource[frameBit-4] = source;
+		}
+	}
+};
+
+static TCHFSTableBuilder sTCHFSTableBuilder;
+
+
+/** Pull a single MSB-first bit out of a packed frame. */
+static inline char frameBit(const unsigned char* frame, unsigned index)
+{
+	return (frame[index>>3] >> (7-(index&0x07))) & 0x01;
+}
+
+
+
+
+SpeechFramePool::~SpeechFramePool()
+{
+	while (unsigned char* frame = (unsigned char*)mFree.get()) delete[] frame;
+}
+
+
+unsigned char* SpeechFramePool::get()
+{
+	mLock.lock();
+	unsigned char* retVal = (unsigned char*)mFree.get();
+	if (!retVal) mAllocated++;
+	mLock.unlock();
+	if (!retVal) retVal = new unsigned char[gTCHFSFrameBytes];
+	return retVal;
+}
+
+
+void SpeechFramePool::release(unsigned char* frame)
+{
+	if (!frame) return;
+	mLock.lock();
+	mFree.put(frame);
+	mLock.unlock();
+}
+
+
+
+
+TCHFSCodec::TCHFSCodec()
+	:mParity(0x0b,3,50),
+	mU(189),mClass1A(50),
+	mP(mU.segment(91,3))
+{
+	mU.zero();
+}
+
+
+
+void TCHFSCodec::encode(const unsigned char* frame, BitVector& c)
+{
+	// GSM 05.03 3.1.2
+	assert(c.size()==456);
+
+	// 3.1.2.1 -- reorder and split the class 1 bits straight into u[].
+	char *u = mU.begin();
+	for (unsigned k=0; k<=90; k++) u[k] = frameBit(frame,sUFrameBit[k]);
+	for (unsigned k=94; k<=184; k++) u[k] = frameBit(frame,sUFrameBit[k]);
+	// Tail bits, GSM 05.03 3.1.2.1.
+	// Set every time, since decode() shares u[].
+	mU.fillField(185,0,4);
+
+	// 3.1.2.1 -- parity bits over class 1A
+	char *d1A = mClass1A.begin();
+	for (unsigned k=0; k<50; k++) d1A[k] = u[sClass1AUIndex[k]];
+	mParity.writeParityWord(mClass1A,mP);
+
+	// 3.1.2.2 -- encode u[] to c[] for class 1
+	BitVector class1(c.head(378));
+	mU.encode(mVCoder,class1);
+
+	// 3.1.2.2 -- class 2 bits d[] to c[]
+	char *c2 = c.begin() + 378;
+	for (unsigned k=0; k<78; k++) c2[k] = frameBit(frame,sClass2FrameBit[k]);
+}
+
+
+
+bool TCHFSCodec::decode(const SoftVector& c, unsigned char* frame)
+{
+	// GSM 05.03 3.1.2, but backwards
+	assert(c.size()==456);
+
+	// 3.1.2.2 -- decode from c[] to u[]
+	c.head(378).decode(mVCoder,mU);
+
+	// 3.1.2.1 -- check parity of class 1A and the tail bits
+	const char *u = mU.begin();
+	char *d1A = mClass1A.begin();
+	for (unsigned k=0; k<50; k++) d1A[k] = u[sClass1AUIndex[k]];
+	unsigned sentParity = (~mU.peekField(91,3)) & 0x07;
+	unsigned calcParity = mClass1A.parity(mParity) & 0x07;
+	unsigned tail = mU.peekField(185,4);
+	if ((sentParity!=calcParity) || (tail!=0)) return false;
+
+	// Undo the class split and importance ordering in one pass,
+	// packing directly into the output frame.
+	const float *c2 = c.begin() + 378;
+	memset(frame,0,gTCHFSFrameBytes);
+	frame[0] = 0xd0;
+	for (unsigned j=0; j<260; j++) {
+		unsigned src = sFrameSource[j];
+		bool bit = (src<189) ? (u[src] & 0x01) : (c2[src-189]>0.5F);
+		if (!bit) continue;
+		unsigned index = j+4;
+		frame[index>>3] |= 0x80 >> (index&0x07);
+	}
+	return true;
+}
+
+
+
+void TCHFSCodec::encode(const unsigned char* frames, unsigned count, BitVector& c)
+{
+	assert(c.size()==count*456);
+	for (unsigned i=0; i<count; i++) {
+		BitVector ci(c.segment(i*456,456));
+		encode(frames + i*gTCHFSFrameBytes, ci);
+	}
+}
+
+
+unsigned TCHFSCodec::decode(const SoftVector& c, unsigned count, unsigned char* frames, bool* good)
+{
+	assert(c.size()==count*456);
+	unsigned goodCount = 0;
+	for (unsigned i=0; i<count; i++) {
+		bool ok = decode(c.segment(i*456,456), frames + i*gTCHFSFrameBytes);
+		if (ok) goodCount++;
+		if (good) good[i] = ok;
+	}
+	return goodCount;
+}
+
+
+
+
+// vim: ts=4 sw=4
@@ -0,0 +1,141 @@
+/*
+* Copyright 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#ifndef GSMTCHCODEC_H
+#define GSMTCHCODEC_H
+
+#include "BitVector.h"
+#include "Threads.h"
+#include "LinkedLists.h"
+
+
+namespace GSM {
+
+
+/** Size of a packed GSM 06.10 (RTP payload type 3) frame, in bytes. */
+static const unsigned gTCHFSFrameBytes = 33;
+
+
+
+/**
+	A free list of packed speech frame buffers.
+	Buffers are plain new[]'d arrays, so a caller that delete[]s
+	a buffer instead of releasing it does no harm, it just defeats the reuse.
+*/
+class SpeechFramePool {
+
+	private:
+
+	PointerFIFO mFree;		///< buffers available for reuse
+	mutable Mutex mLock;
+	unsigned mAllocated;	///< total buffers ever allocated from the heap
+
+	public:
+
+	SpeechFramePool():mAllocated(0) {}
+
+	~SpeechFramePool();
+
+	/** Get a buffer of gTCHFSFrameBytes, from the pool if possible. */
+	unsigned char* get();
+
+	/** Return a buffer to the pool. */
+	void release(unsigned char* frame);
+
+	/** Number of buffers ever taken from the heap. */
+	unsigned allocated() const { return mAllocated; }
+};
+
+
+
+/**
+	Channel coder for full rate speech, GSM 05.03 3.1.
+
+	This works directly between packed GSM 06.10 frames and c[].
+	The importance ordering of GSM 05.03 Table 2, the class 1/class 2 split
+	and the interleaving of d[] into u[] of 05.03 3.1.2.1 are fused into single
+	lookup tables that are built once, so there is no intermediate d[] and
+	no BitVector pack/unpack on the 20 ms path.
+*/
+class TCHFSCodec {
+
+	private:
+
+	ViterbiR2O4 mVCoder;	///< the GSM rate 1/2 convolutional code
+	Parity mParity;			///< class 1A block coder, GSM 05.03 3.1.2.1
+	BitVector mU;			///< u[], as per GSM 05.03 2.2
+	BitVector mClass1A;		///< the class 1A part of d[], for the parity calculation
+	BitVector mP;			///< p[], an alias into u[]
+
+	public:
+
+	TCHFSCodec();
+
+	/**
+		Encode one packed frame into c[].
+		@param frame A packed 33-byte frame.
+		@param c The 456-bit c[] of GSM 05.03 3.1.2.2.
+	*/
+	void encode(const unsigned char* frame, BitVector& c);
+
+	/**
+		Decode c[] into a packed frame.
+		@param c The 456 soft bits of c[].
+		@param frame A 33-byte buffer for the result, written only if the frame is good.
+		@return true if the class 1A parity and tail bits check out.
+	*/
+	bool decode(const SoftVector& c, unsigned char* frame);
+
+	/**@name Bulk interfaces, mostly for testing and benchmarking. */
+	//@{
+	/**
+		Encode a contiguous array of packed frames.
+		@param frames count*33 bytes of packed frames.
+		@param count The number of frames.
+		@param c The target, count*456 bits.
+	*/
+	void encode(const unsigned char* frames, unsigned count, BitVector& c);
+
+	/**
+		Decode a contiguous block of c[]s.
+		@param c count*456 soft bits.
+		@param count The number of frames.
+		@param frames count*33 bytes for the packed results.
+		@param good If not NULL, count flags, one per frame.
+		@return The number of good frames.
+	*/
+	unsigned decode(const SoftVector& c, unsigned count, unsigned char* frames, bool* good=NULL);
+	//@}
+};
+
+
+
+}; 	// namespace GSM
+
+
+#endif
+
+// vim: ts=4 sw=4
@@ -0,0 +1,118 @@
+/*
+* Copyright 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#include "GSMTCHCodec.h"
+#include "GSM610Tables.h"
+#include "Timeval.h"
+#include <iostream>
+#include <cstdlib>
+#include <string.h>
+
+using namespace std;
+using namespace GSM;
+
+
+/** The original BitVector-based TCH/FS encoder, for comparison. */
+void referenceEncode(const unsigned char* frame, BitVector& c)
+{
+	static ViterbiR2O4 vCoder;
+	static Parity parity(0x0b,3,50);
+	BitVector vFrame(264);
+	vFrame.unpack(frame);
+	BitVector d(260);
+	vFrame.tail(4).map(g610BitOrder,260,d);
+	BitVector u(189);
+	u.zero();
+	BitVector p = u.segment(91,3);
+	parity.writeParityWord(d.head(50),p);
+	for (unsigned k=0; k<=90; k++) {
+		u[k] = d[2*k];
+		u[184-k] = d[2*k+1];
+	}
+	BitVector class1 = c.head(378);
+	u.encode(vCoder,class1);
+	d.segment(182,78).copyToSegment(c,378);
+}
+
+
+int main(int argc, char *argv[])
+{
+	const unsigned count = (argc>1) ? atoi(argv[1]) : 10000;
+
+	// Random frames with the RFC 3551 signature.
+	unsigned char *frames = new unsigned char[count*gTCHFSFrameBytes];
+	for (unsigned i=0; i<count*gTCHFSFrameBytes; i++) frames[i] = random();
+	for (unsigned i=0; i<count; i++) {
+		unsigned char *f = frames + i*gTCHFSFrameBytes;
+		f[0] = 0xd0 | (f[0] & 0x0f);
+	}
+
+	TCHFSCodec codec;
+
+	// Check the fused tables against the original path.
+	BitVector refC(456);
+	BitVector c(456);
+	unsigned mismatches = 0;
+	for (unsigned i=0; i<100 && i<count; i++) {
+		const unsigned char *f = frames + i*gTCHFSFrameBytes;
+		referenceEncode(f,refC);
+		codec.encode(f,c);
+		if (memcmp(refC.begin(),c.begin(),456)) mismatches++;
+	}
+	cout << "encoder mismatches against reference: " << mismatches << endl;
+
+	// Bulk encode.
+	BitVector allC(count*456);
+	Timeval start;
+	codec.encode(frames,count,allC);
+	long encodeMs = start.elapsed();
+
+	// Bulk decode of clean soft bits.
+	SoftVector allSoft(allC);
+	unsigned char *decoded = new unsigned char[count*gTCHFSFrameBytes];
+	start.now();
+	unsigned good = codec.decode(allSoft,count,decoded);
+	long decodeMs = start.elapsed();
+	bool same = memcmp(frames,decoded,count*gTCHFSFrameBytes)==0;
+	cout << "decoded " << good << "/" << count << " good, round trip " << (same ? "OK" : "FAILED") << endl;
+
+	// A little noise on class 1 should be corrected.
+	for (unsigned i=0; i<count*456; i+=47) allSoft[i] = 1.0F - allSoft[i];
+	good = codec.decode(allSoft,count,decoded);
+	cout << "with bit errors, decoded " << good << "/" << count << " good" << endl;
+
+	// Throughput on one core.
+	if (encodeMs<1) encodeMs=1;
+	if (decodeMs<1) decodeMs=1;
+	cout << "encode: " << (1000.0*count/encodeMs) << " frames/s per core" << endl;
+	cout << "decode: " << (1000.0*count/decodeMs) << " frames/s per core" << endl;
+
+	delete[] frames;
+	delete[] decoded;
+}
+
+
+// vim: ts=4 sw=4
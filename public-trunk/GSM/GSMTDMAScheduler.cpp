@@ -0,0 +1,169 @@
+/*
+* Copyright 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+
+#include "GSMTDMAScheduler.h"
+#include <Globals.h>
+#include <Logger.h>
+
+
+using namespace GSM;
+
+
+
+void *GSM::TDMASchedulerTickLoopAdapter(TDMAScheduler* scheduler)
+{
+	scheduler->tickLoop();
+	return NULL;
+}
+
+
+void *GSM::TDMASchedulerWorkerLoopAdapter(TDMAScheduler* scheduler)
+{
+	scheduler->workerLoop();
+	return NULL;
+}
+
+
+
+void TDMAScheduler::start()
+{
+	mLock.lock();
+	if (mStarted) {
+		mLock.unlock();
+		return;
+	}
+	mStarted = true;
+	mNumWorkers = 4;
+	if (gConfig.defines("GSM.Scheduler.Threads")) mNumWorkers = gConfig.getNum("GSM.Scheduler.Threads");
+	if (mNumWorkers<1) mNumWorkers = 1;
+	if (mNumWorkers>mMaxWorkers) mNumWorkers = mMaxWorkers;
+	LOG(INFO) << "starting TDMA scheduler with " << mNumWorkers << " workers";
+	mLock.unlock();
+	for (unsigned i=0; i<mNumWorkers; i++) {
+		mWorkers[i].start((void*(*)(void*))TDMASchedulerWorkerLoopAdapter,(void*)this,"tdma.worker");
+	}
+	mTickThread.start((void*(*)(void*))TDMASchedulerTickLoopAdapter,(void*)this,"tdma.tick");
+}
+
+
+
+void TDMAScheduler::insert(TDMATask* task)
+{
+	// Keep each wheel slot in timeslot order.
+	TaskList& slot = mWheel[task->mDueFN % mWheelSize];
+	TaskList::iterator pos = slot.begin();
+	while (pos!=slot.end() && (*pos)->mDueTN<=task->mDueTN) ++pos;
+	slot.insert(pos,task);
+}
+
+
+
+void TDMAScheduler::schedule(TDMATask* task, int32_t FN, unsigned TN)
+{
+	if (!mStarted) start();
+	assert(task);
+	FN = FN % gHyperframe;
+	mLock.lock();
+	// Anything late, or for the frame being ticked, runs on the next frame.
+	if (mLastFN>=0 && FNDelta(FN,mLastFN)<=0) FN = (mLastFN+1) % gHyperframe;
+	task->mDueFN = FN;
+	task->mDueTN = TN;
+	insert(task);
+	mLock.unlock();
+}
+
+
+
+void TDMAScheduler::tick()
+{
+	int32_t now = mClock.FN();
+	// Due tasks are collected and queued after the lock is released.
+	mDue.clear();
+	mLock.lock();
+	if (mLastFN<0) mLastFN = (now+gHyperframe-1) % gHyperframe;
+	int32_t behind = FNDelta(now,mLastFN);
+	if (behind<0 || behind>(int)mWheelSize) {
+		// The clock was moved, probably by the transceiver.
+		// Everything is due; the encoders resync themselves.
+		LOG(NOTICE) << "TDMA scheduler clock jump from " << mLastFN << " to " << now;
+		for (unsigned i=0; i<mWheelSize; i++) {
+			while (!mWheel[i].empty()) {
+				mDue.push_back(mWheel[i].front());
+				mWheel[i].pop_front();
+			}
+		}
+		mLastFN = now;
+		mLock.unlock();
+		if (mDue.size()) mRunQ.writeBatch(&mDue[0],mDue.size());
+		return;
+	}
+	if (behind>1) mSkips += behind-1;
+	while (mLastFN!=now) {
+		mLastFN = (mLastFN+1) % gHyperframe;
+		mTicks++;
+		TaskList& slot = mWheel[mLastFN % mWheelSize];
+		TaskList::iterator pos = slot.begin();
+		while (pos!=slot.end()) {
+			TDMATask* task = *pos;
+			// Tasks more than a wheel turn ahead stay put.
+			if (task->mDueFN!=mLastFN) {
+				++pos;
+				continue;
+			}
+			mDue.push_back(task);
+			pos = slot.erase(pos);
+		}
+	}
+	mLock.unlock();
+	if (mDue.size()) mRunQ.writeBatch(&mDue[0],mDue.size());
+}
+
+
+
+void TDMAScheduler::tickLoop()
+{
+	while (true) {
+		tick();
+		mClock.waitNextFrame();
+	}
+}
+
+
+
+void TDMAScheduler::workerLoop()
+{
+	while (true) {
+		TDMATask* task = mRunQ.read();
+		int32_t next = task->runTask(task->mDueFN);
+		mRuns++;
+		if (next>=0) schedule(task,next,task->mDueTN);
+	}
+}
+
+
+
+// vim: ts=4 sw=4
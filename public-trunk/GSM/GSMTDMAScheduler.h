@@ -0,0 +1,167 @@
+/*
+* Copyright 2010 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+
+#ifndef GSMTDMASCHEDULER_H
+#define GSMTDMASCHEDULER_H
+
+#include "GSMCommon.h"
+#include <Interthread.h>
+#include <Threads.h>
+#include <list>
+#include <vector>
+
+
+namespace GSM {
+
+
+class TDMAScheduler;
+
+
+/**
+	Work that runs at given TDMA frames, but has no thread of its own.
+	The periodic L1 encoders are tasks.
+*/
+class TDMATask {
+
+	private:
+
+	int32_t mDueFN;			///< the frame this task is scheduled for
+	unsigned mDueTN;		///< the timeslot, for ordering within a frame
+
+	friend class TDMAScheduler;
+
+	public:
+
+	TDMATask():mDueFN(0),mDueTN(0) {}
+
+	virtual ~TDMATask() {}
+
+	/**
+		Do one step of work.
+		This runs on a shared worker, so it should not block for long.
+		@param FN The frame the task was scheduled for.
+		@return The frame to run at next, or a negative value to leave the schedule.
+	*/
+	virtual int32_t runTask(int32_t FN) =0;
+};
+
+
+
+/**
+	Central TDMA frame scheduler.
+
+	A tick thread follows the BTS clock, which is disciplined by the
+	transceiver's IND CLOCK messages, waking on each frame boundary.
+	Tasks wait on a timing wheel, one slot per frame, kept in timeslot order
+	within each slot.  As each frame comes due its tasks go to a small pool
+	of worker threads.  A task that asks for a time that has already passed
+	runs on the next frame, so a task can never spin.
+*/
+class TDMAScheduler {
+
+	public:
+
+	static const unsigned mWheelSize = 256;		///< must divide the hyperframe
+	static const unsigned mMaxWorkers = 16;
+	static const unsigned mRunQSize = 1024;		///< more than the tasks on any one BTS
+
+	private:
+
+	typedef std::list<TDMATask*> TaskList;
+
+	const Clock& mClock;				///< the BTS clock
+	mutable Mutex mLock;				///< protects the wheel and mLastFN
+	TaskList mWheel[mWheelSize];		///< waiting tasks, by FN modulo mWheelSize
+	InterthreadBoundedQueue<TDMATask> mRunQ;	///< tasks ready to run
+	std::vector<TDMATask*> mDue;		///< tick thread scratch, tasks coming due
+	int32_t mLastFN;					///< the last frame ticked, or -1
+	bool mStarted;
+
+	Thread mTickThread;
+	Thread mWorkers[mMaxWorkers];
+	unsigned mNumWorkers;
+
+	/**@name Statistics */
+	//@{
+	volatile unsigned mTicks;			///< frames ticked
+	volatile unsigned mRuns;			///< tasks run
+	volatile unsigned mSkips;			///< frames the tick thread fell behind
+	//@}
+
+	public:
+
+	TDMAScheduler(const Clock& wClock)
+		:mClock(wClock),mRunQ(mRunQSize),mLastFN(-1),mStarted(false),mNumWorkers(0),
+		mTicks(0),mRuns(0),mSkips(0)
+	{}
+
+	/**
+		Start the tick thread and the workers.
+		The number of workers comes from GSM.Scheduler.Threads, default 4.
+		schedule() calls this if needed.
+	*/
+	void start();
+
+	/**
+		Schedule a task.
+		@param task The task; it must not already be scheduled.
+		@param FN The frame to run it at.
+		@param TN The timeslot, for ordering within the frame.
+	*/
+	void schedule(TDMATask* task, int32_t FN, unsigned TN=0);
+
+	unsigned workers() const { return mNumWorkers; }
+	unsigned ticks() const { return mTicks; }
+	unsigned runs() const { return mRuns; }
+	unsigned skips() const { return mSkips; }
+
+	private:
+
+	/** Insert into the wheel.  Lock must be held. */
+	void insert(TDMATask* task);
+
+	/** Release everything due up to the current clock. */
+	void tick();
+
+	void tickLoop();
+	void workerLoop();
+
+	friend void *TDMASchedulerTickLoopAdapter(TDMAScheduler*);
+	friend void *TDMASchedulerWorkerLoopAdapter(TDMAScheduler*);
+};
+
+
+void *TDMASchedulerTickLoopAdapter(TDMAScheduler*);
+void *TDMASchedulerWorkerLoopAdapter(TDMAScheduler*);
+
+
+}; 	// namespace GSM
+
+
+#endif
+
+// vim: ts=4 sw=4
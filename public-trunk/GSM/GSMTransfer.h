@@ -639,6 +639,28 @@ typedef InterthreadQueue<L3Frame> L3FrameFIFO;
 
 
 
+/**
+	A supplier of messages for the paging blocks of a CCCH.
+	GSM 05.02 6.5 ties each paging group to particular blocks, so pages are
+	chosen as each block comes up, rather than queued ahead of time.
+*/
+class PagingSource {
+
+	public:
+
+	virtual ~PagingSource() {}
+
+	/**
+		Return a new frame for a paging block, or NULL for none.
+		Called from the CCCH service thread, so it should be quick.
+		@param block The index of the CCCH among the paging blocks of a multiframe.
+		@param when The time of the first burst of the block.
+	*/
+	virtual L3Frame* pagingFrame(unsigned block, const Time& when) =0;
+};
+
+
+
 /** A vocoder frame for use in GSM/SIP contexts. */
 class VocoderFrame : public BitVector {
 
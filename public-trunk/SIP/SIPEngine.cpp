@@ -587,6 +587,16 @@ SIPState SIPEngine::MTCWaitForACK()
 
 void SIPEngine::InitRTP(const osip_message_t * msg )
 {
+	char d_ip_addr[20];
+	char d_port[10];
+	get_rtp_params(msg, d_port, d_ip_addr);
+	LOG(DEBUG) << "IP="<<d_ip_addr<<" "<<d_port<<" "<<mRTPPort;
+	mRTPRemoteIP = d_ip_addr;
+	mRTPRemotePort = atoi(d_port);
+
+	// The media relay owns the RTP port.
+	if (gMediaRelay.running()) return;
+
 	if(session == NULL)
 		session = rtp_session_new(RTP_SESSION_SENDRECV);
 
@@ -599,13 +609,8 @@ void SIPEngine::InitRTP(const osip_message_t * msg )
 	// FIXME -- Make this work for multiple vocoder types.
 	rtp_session_set_payload_type(session, 3);
 
-	char d_ip_addr[20];
-	char d_port[10];
-	get_rtp_params(msg, d_port, d_ip_addr);
-	LOG(DEBUG) << "IP="<<d_ip_addr<<" "<<d_port<<" "<<mRTPPort;
-
 	rtp_session_set_local_addr(session, "0.0.0.0", mRTPPort );
-	rtp_session_set_remote_addr(session, d_ip_addr, atoi(d_port));
+	rtp_session_set_remote_addr(session, d_ip_addr, mRTPRemotePort);
 
 }
 
@@ -644,13 +649,32 @@ int SIPEngine::RxFrame(unsigned char * rx_frame){
 		int ret=0;
 		// HACK -- Hardcoded for GSM/8000.
 		// FIXME -- Make this work for multiple vocoder types.
+		// Without blocking, the due timestamp comes from the clock, 8 samples per ms.
+		if (mRTPNonBlocking) rx_time = mRTPStart.elapsed()*8;
 		ret = rtp_session_recv_with_ts(session, rx_frame, 33, rx_time, &more);
-		rx_time += 160;
+		if (!mRTPNonBlocking) rx_time += 160;
 		return ret;
 	}	
 }
 
 
+void SIPEngine::RTPNonBlocking()
+{
+	assert(session);
+	rtp_session_set_blocking_mode(session, FALSE);
+	mRTPStart = Timeval();
+	rx_time = 0;
+	mRTPNonBlocking = true;
+}
+
+
+int SIPEngine::RTPSocket() const
+{
+	if (!session) return -1;
+	return rtp_session_get_rtp_socket(session);
+}
+
+
 
 
 SIPState SIPEngine::MOSMSSendMESSAGE(const char * wCalledUsername, 
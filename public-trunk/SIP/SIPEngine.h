@@ -36,6 +36,7 @@
 
 
 #include "Sockets.h"
+#include "Timeval.h"
 #include <Globals.h>
 
 
@@ -80,6 +81,8 @@ private:
 
 	// MOC, MTC information.
 	short mRTPPort;
+	std::string mRTPRemoteIP;		///< far end RTP address, from its SDP
+	unsigned short mRTPRemotePort;	///< far end RTP port, from its SDP
 	std::string mRemoteUsername;
 	std::string mRemoteDomain;
 	unsigned mCodec;
@@ -117,11 +120,20 @@ public:
 	unsigned int rx_time;
 	int time_outs;
 
+private:
+
+	bool mRTPNonBlocking;		///< true if RxFrame should not wait for the next frame
+	Timeval mRTPStart;			///< receive timestamp origin in non-blocking mode
+
+public:
+
 	/** Default contructor. Initialize the object. */
 	SIPEngine()
-		:mCSeq(random()%1000),
+		:mRTPRemotePort(0),
+		mCSeq(random()%1000),
 		mINVITE(NULL), mOK(NULL), mBYE(NULL),
-		session(NULL), mState(NullState),tx_time(0), rx_time(0)
+		session(NULL), mState(NullState),tx_time(0), rx_time(0),
+		mRTPNonBlocking(false)
 	{
 		mSIPPort = gConfig.getNum("SIP.Port");
 		const char* wAsteriskIP = gConfig.getStr("Asterisk.IP");
@@ -270,8 +282,27 @@ public:
 	void TxFrame( unsigned char * tx_frame );
 	int  RxFrame(unsigned char * rx_frame);
 
+	/**
+		Stop RxFrame from blocking until the next frame is due.
+		The receive timestamp then follows the wall clock from this call,
+		so RxFrame returns whatever frame is due, or nothing.
+		For callers that wait on RTPSocket() themselves.
+	*/
+	void RTPNonBlocking();
+
+	/** The RTP socket descriptor, or -1 if there is no RTP session. */
+	int RTPSocket() const;
+
+	/**@name RTP endpoints, for a media relay that does its own RTP. */
+	//@{
+	unsigned short RTPPort() const { return mRTPPort; }
+	const char* RTPRemoteIP() const { return mRTPRemoteIP.c_str(); }
+	unsigned short RTPRemotePort() const { return mRTPRemotePort; }
+	//@}
+
 	// We need the host sides RTP information contained
-	// in INVITE or 200 OK
+	// in INVITE or 200 OK.
+	// No ortp session is made if gMediaRelay carries the speech.
 	void InitRTP(const osip_message_t * msg );
 	void MOCInitRTP();
 	void MTCInitRTP();
@@ -122,6 +122,14 @@ int SIPInterface::fifoSize(const std::string& call_id )
 	return fifo->size();
 }	
 
+bool SIPInterface::listener(const std::string& call_id, QueueListener* wListener)
+{
+	OSIPMessageFIFO * fifo = mSIPMap.map().read(call_id,0);
+	if (fifo==NULL) return false;
+	fifo->listener(wListener);
+	return true;
+}
+
 
 
 SIPInterface::SIPInterface()
@@ -150,7 +158,7 @@ void SIPInterface::start(){
 	ortp_scheduler_init();
 	// FIXME -- Can we coordinate this with the global logger?
 	//ortp_set_log_level_mask(ORTP_MESSAGE|ORTP_WARNING|ORTP_ERROR);
-	mDriveThread.start((void *(*)(void*))driveLoop,this );
+	mDriveThread.start((void *(*)(void*))driveLoop,this,"sip");
 }
 
 
@@ -331,7 +339,8 @@ bool SIPInterface::checkInvite( osip_message_t * msg )
 	// Skip this for USSD.
 	if (  mSIPMap.map().readNoBlock(call_id_num) != NULL) {
 		TransactionEntry transaction;
-		if (!gTransactionTable.find(mobile_id,transaction)) {
+		if (!gTransactionTable.findByCallID(call_id_num,transaction)
+			&& !gTransactionTable.find(mobile_id,transaction)) {
 			// FIXME -- Send "call leg non-existent" response on SIP interface.
 			LOG(WARN) << "repeated INVITE/MESSAGE with no transaction record";
 			// Delete the bogus FIFO.
@@ -90,6 +90,7 @@ std::ostream& operator<<(std::ostream& os, const OSIPMessageFIFO& m);
 	A Map the keeps a SIP message FIFO for each active SIP transaction.
 	Keyed by SIP call ID string.
 	Overall map is thread-safe.  Each FIFO is also thread-safe.
+	A call blocks on its own FIFO, never on the map, so a message wakes only its call.
 */
 // FIXME -- This should probably just be a subclass of OSIPMessageFIFOMap.
 class SIPMessageMap 
@@ -206,6 +207,12 @@ public:
 
 	int fifoSize(const std::string& call_id );
 
+	/**
+		Set or clear a listener for messages written to a call's FIFO.
+		@return False if the FIFO does not exist.
+	*/
+	bool listener(const std::string& call_id, QueueListener* wListener);
+
 };
 
 void driveLoop(SIPInterface*);
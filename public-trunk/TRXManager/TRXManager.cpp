@@ -59,7 +59,7 @@ TransceiverManager::TransceiverManager(int numARFCNs,
 
 void TransceiverManager::start()
 {
-	mClockThread.start((void*(*)(void*))ClockLoopAdapter,this);
+	mClockThread.start((void*(*)(void*))ClockLoopAdapter,this,"trx.clock");
 	for (unsigned i=0; i<mARFCNs.size(); i++) {
 		mARFCNs[i]->start();
 	}
@@ -131,6 +131,12 @@ void TransceiverManager::clockHandler()
 			mDemuxTable[i][j] = NULL;
 		}
 	}
+	// Deeper kernel buffers ride out scheduling hiccups without dropping bursts.
+	if (gConfig.defines("TRX.SocketBuffer")) {
+		int bytes = gConfig.getNum("TRX.SocketBuffer");
+		LOG(INFO) << "data socket SO_RCVBUF " << mDataSocket.receiveBufferSize(bytes)
+			<< " SO_SNDBUF " << mDataSocket.sendBufferSize(bytes);
+	}
 }
 
 
@@ -138,7 +144,7 @@ void TransceiverManager::clockHandler()
 
 void ::ARFCNManager::start()
 {
-	mRxThread.start((void*(*)(void*))ReceiveLoopAdapter,this);
+	mRxThread.start((void*(*)(void*))ReceiveLoopAdapter,this,"trx.rx");
 }
 
 
@@ -203,33 +209,37 @@ void ::ARFCNManager::writeHighSide(const GSM::TxBurst& burst)
 
 void ::ARFCNManager::driveRx()
 {
-	// read the message
-	char buffer[MAX_UDP_LENGTH];
-	int msgLen = mDataSocket.read(buffer);
-	if (msgLen<=0) SOCKET_ERROR;
-	// decode
-	unsigned char *rp = (unsigned char*)buffer;
-	// timeslot number
-	unsigned TN = *rp++;
-	// frame number
-	int32_t FN = *rp++;
-	FN = (FN<<8) + (*rp++);
-	FN = (FN<<8) + (*rp++);
-	FN = (FN<<8) + (*rp++);
-	// physcial header data
-	signed char* srp = (signed char*)rp++;
-	// reported RSSI is negated dB wrt full scale
-	int RSSI = *srp;
-	srp = (signed char*)rp++;
-	// timing error comes in 1/256 symbol steps
-	// because that fits nicely in 2 bytes
-	int timingError = *srp;
-	timingError = (timingError<<8) | (*rp++);
-	// soft symbols
-	float data[gSlotLen];
-	for (unsigned i=0; i<gSlotLen; i++) data[i] = (*rp++) / 256.0F;
-	// demux
-	receiveBurst(RxBurst(data,GSM::Time(FN,TN),timingError/256.0F,-RSSI));
+	// Read whatever bursts are queued, blocking only for the first.
+	char buffers[rxBatch*MAX_UDP_LENGTH];
+	size_t lengths[rxBatch];
+	int count = mDataSocket.readBatch(buffers,lengths,rxBatch);
+	if (count<=0) SOCKET_ERROR;
+	for (int i=0; i<count; i++) {
+		if (lengths[i]==0) SOCKET_ERROR;
+		// decode
+		unsigned char *rp = (unsigned char*)(buffers + i*MAX_UDP_LENGTH);
+		// timeslot number
+		unsigned TN = *rp++;
+		// frame number
+		int32_t FN = *rp++;
+		FN = (FN<<8) + (*rp++);
+		FN = (FN<<8) + (*rp++);
+		FN = (FN<<8) + (*rp++);
+		// physcial header data
+		signed char* srp = (signed char*)rp++;
+		// reported RSSI is negated dB wrt full scale
+		int RSSI = *srp;
+		srp = (signed char*)rp++;
+		// timing error comes in 1/256 symbol steps
+		// because that fits nicely in 2 bytes
+		int timingError = *srp;
+		timingError = (timingError<<8) | (*rp++);
+		// soft symbols
+		float data[gSlotLen];
+		for (unsigned j=0; j<gSlotLen; j++) data[j] = (*rp++) / 256.0F;
+		// demux
+		receiveBurst(RxBurst(data,GSM::Time(FN,TN),timingError/256.0F,-RSSI));
+	}
 }
 
 
@@ -121,6 +121,7 @@ class ARFCNManager {
 	UDPSocket mControlSocket;		///< socket for radio control
 
 	Thread mRxThread;				///< thread to receive data from rx
+	static const unsigned rxBatch = 8;	///< maximum bursts taken from the data socket per read
 
 	/**@name The demux table. */
 	//@{
@@ -86,6 +86,23 @@ protected:
 	int mLockFileFD;
 };
 
+/** Applies the Thread.<role> policies, at startup and whenever they change. */
+class ThreadPolicyLoader : public ConfigurationSubscriber
+{
+public:
+	ThreadPolicyLoader()
+	{
+		gThreadRegistry().configure(gConfig.snapshot());
+		gConfig.subscribe(this);
+	}
+
+	void configurationChanged(const std::string& key)
+	{
+		if (key.compare(0,7,"Thread.")==0)
+			gThreadRegistry().configure(gConfig.snapshot());
+	}
+};
+
 class Restarter
 {
 public:
@@ -99,6 +116,8 @@ public:
 
 /// Load configuration from a file.
 ConfigurationTable gConfig("OpenBTS.config");
+/// Set thread policies before any threads start.
+static ThreadPolicyLoader sgThreadPolicyLoader;
 /// Initialize Logger form the config.
 static LogInitializer sgLogInitializer;
 /// Fork daemon if needed.
@@ -521,6 +540,37 @@ int main(int argc, char *argv[])
 	// Start the SIP interface.
 	gSIPInterface.start();
 
+	// Start the threads that serve connected calls.
+	unsigned reactorThreads = 4;
+	if (gConfig.defines("Control.Reactor.Threads")) reactorThreads = gConfig.getNum("Control.Reactor.Threads");
+	unsigned blockingThreads = 8;
+	if (gConfig.defines("Control.Reactor.BlockingThreads")) blockingThreads = gConfig.getNum("Control.Reactor.BlockingThreads");
+	gCallReactor.start(reactorThreads,"call",blockingThreads);
+
+	// Start the threads that relay speech, unless speech stays with ortp.
+	unsigned mediaThreads = 2;
+	if (gConfig.defines("Control.Media.Threads")) mediaThreads = gConfig.getNum("Control.Media.Threads");
+	if (mediaThreads) gMediaRelay.start(mediaThreads,"media");
+
+	// Start the threads that send REGISTERs for location updates.
+	unsigned registerWindow = 8;
+	if (gConfig.defines("Control.Registrar.Window")) registerWindow = gConfig.getNum("Control.Registrar.Window");
+	unsigned positiveTTL = 30;
+	if (gConfig.defines("Control.Registrar.PositiveTTL")) positiveTTL = gConfig.getNum("Control.Registrar.PositiveTTL");
+	unsigned negativeTTL = 10;
+	if (gConfig.defines("Control.Registrar.NegativeTTL")) negativeTTL = gConfig.getNum("Control.Registrar.NegativeTTL");
+	gRegistrar.start(registerWindow,positiveTTL,negativeTTL);
+
+	// Start the workers that serve transactions on the SDCCHs and TCHs.
+	unsigned DCCHMin = 4;
+	if (gConfig.defines("Control.DCCH.MinThreads")) DCCHMin = gConfig.getNum("Control.DCCH.MinThreads");
+	unsigned DCCHMax = 64;
+	if (gConfig.defines("Control.DCCH.MaxThreads")) DCCHMax = gConfig.getNum("Control.DCCH.MaxThreads");
+	gDCCHPool.start(DCCHMin,DCCHMax);
+
+	// Start the stage that answers RACH bursts on the AGCHs.
+	gAccessGrant.start();
+
 	// Start the transceiver interface.
 	// Sleep long enough for the USRP to bootload.
 	sleep(5);
@@ -588,11 +638,10 @@ int main(int argc, char *argv[])
 			SDCCHLogicalChannel(0,gSDCCH_4_2),
 			SDCCHLogicalChannel(0,gSDCCH_4_3),
 	};
-	Thread C0T0SDCCHControlThread[4];
 	for (int i=0; i<4; i++) {
 		C0T0SDCCH[i].downstream(radio);
-		C0T0SDCCHControlThread[i].start((void*(*)(void*))Control::DCCHDispatcher,&C0T0SDCCH[i]);
 		C0T0SDCCH[i].open();
+		gDCCHPool.add(&C0T0SDCCH[i]);
 		gBTS.addSDCCH(&C0T0SDCCH[i]);
 	}
 
@@ -639,7 +688,8 @@ int main(int argc, char *argv[])
 
 	// Set up the pager.
 	// Set up paging channels.
-	// HACK -- For now, use a single paging channel, since paging groups are broken.
+	// With BS_AG_BLKS_RES=2, the paging block of C-V is B2;
+	// the pager spreads the paging groups over its multiframes.
 	gBTS.addPCH(&CCCH2);
 
 	// Be sure we are not over-reserving.